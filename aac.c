@@ -532,7 +532,12 @@ static av_cold int aac_decode_init(AVCodecContext *avccontext)
     // 32768 - Required to scale values to the correct range for the bias method
     //         for float to int16 conversion.
 
-    if (ac->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
+    if (avccontext->request_sample_fmt == SAMPLE_FMT_FLTP) {
+        avccontext->sample_fmt = SAMPLE_FMT_FLTP;
+        ac->add_bias  = 0.0f;
+        ac->sf_scale  = 1. / (-1024. * 32768.);
+        ac->sf_offset = 0;
+    } else if (ac->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
         ac->add_bias  = 385.0f;
         ac->sf_scale  = 1. / (-1024. * 32768.);
         ac->sf_offset = 0;
@@ -1708,6 +1713,8 @@ static void imdct_and_windowing(AACContext *ac, SingleChannelElement *sce)
     const float *swindow_prev = ics->use_kb_window[1] ? ff_aac_kbd_short_128 : ff_sine_128;
     float *buf  = ac->buf_mdct;
     float *temp = ac->temp;
+    float *buf_short[8];
+    const float *in_short[8];
     int i;
 
     // imdct
@@ -1716,8 +1723,11 @@ static void imdct_and_windowing(AACContext *ac, SingleChannelElement *sce)
             av_log(ac->avccontext, AV_LOG_WARNING,
                    "Transition from an ONLY_LONG or LONG_STOP to an EIGHT_SHORT sequence detected. "
                    "If you heard an audible artifact, please submit the sample to the FFmpeg developers.\n");
-        for (i = 0; i < 1024; i += 128)
-            ff_imdct_half(&ac->mdct_small, buf + i, in + i);
+        for (i = 0; i < 8; i++) {
+            buf_short[i] = buf + 128 * i;
+            in_short[i]  = in  + 128 * i;
+        }
+        ff_imdct_half_batch(&ac->mdct_small, buf_short, in_short, 8);
     } else
         ff_imdct_half(&ac->mdct, buf, in);
 
@@ -1929,7 +1939,7 @@ static int aac_decode_frame(AVCodecContext *avccontext, void *data,
     ChannelElement *che = NULL;
     GetBitContext gb;
     enum RawDataBlockType elem_type;
-    int err, elem_id, data_size_tmp;
+    int err, elem_id, data_size_tmp, i;
 
     init_get_bits(&gb, buf, buf_size * 8);
 
@@ -2014,7 +2024,8 @@ static int aac_decode_frame(AVCodecContext *avccontext, void *data,
         return buf_size;
     }
 
-    data_size_tmp = 1024 * avccontext->channels * sizeof(int16_t);
+    data_size_tmp = 1024 * avccontext->channels *
+                    (av_get_bits_per_sample_format(avccontext->sample_fmt) >> 3);
     if (*data_size < data_size_tmp) {
         av_log(avccontext, AV_LOG_ERROR,
                "Output buffer too small (%d) or trying to output too many samples (%d) for this frame.\n",
@@ -2023,7 +2034,11 @@ static int aac_decode_frame(AVCodecContext *avccontext, void *data,
     }
     *data_size = data_size_tmp;
 
-    ac->dsp.float_to_int16_interleave(data, (const float **)ac->output_data, 1024, avccontext->channels);
+    if (avccontext->sample_fmt == SAMPLE_FMT_FLTP) {
+        for (i = 0; i < avccontext->channels; i++)
+            memcpy((float *)data + 1024 * i, ac->output_data[i], 1024 * sizeof(float));
+    } else
+        ac->dsp.float_to_int16_interleave(data, (const float **)ac->output_data, 1024, avccontext->channels);
 
     if (ac->output_configured)
         ac->output_configured = OC_LOCKED;
@@ -2057,7 +2072,7 @@ AVCodec aac_decoder = {
     aac_decode_frame,
     .long_name = NULL_IF_CONFIG_SMALL("Advanced Audio Coding"),
     .sample_fmts = (const enum SampleFormat[]) {
-        SAMPLE_FMT_S16,SAMPLE_FMT_NONE
+        SAMPLE_FMT_S16,SAMPLE_FMT_FLTP,SAMPLE_FMT_NONE
     },
     .channel_layouts = aac_channel_layout,
 };
@@ -77,10 +77,9 @@ static int aac_sync(uint64_t state, AACAC3ParseContext *hdr_info,
     int size;
     union {
         uint64_t u64;
-        uint8_t  u8[8];
-    } tmp;
+        uint8_t  u8[8 + FF_INPUT_BUFFER_PADDING_SIZE];
+    } tmp = { be2me_64(state) };
 
-    tmp.u64 = be2me_64(state);
     init_get_bits(&bits, tmp.u8+8-AAC_ADTS_HEADER_SIZE, AAC_ADTS_HEADER_SIZE * 8);
 
     if ((size = ff_aac_parse_header(&bits, &hdr)) < 0)
@@ -65,7 +65,7 @@ static av_always_inline int quant(float coef, const float Q)
     return sqrtf(a * sqrtf(a)) + 0.4054;
 }
 
-static void quantize_bands(int (*out)[2], const float *in, const float *scaled,
+void ff_aac_quantize_bands(int (*out)[2], const float *in, const float *scaled,
                            int size, float Q34, int is_signed, int maxval)
 {
     int i;
@@ -81,7 +81,7 @@ static void quantize_bands(int (*out)[2], const float *in, const float *scaled,
     }
 }
 
-static void abs_pow34_v(float *out, const float *in, const int size)
+void ff_aac_abs_pow34(float *out, const float *in, int size)
 {
 #ifndef USE_REALLY_FULL_SEARCH
     int i;
@@ -130,7 +130,7 @@ static float quantize_band_cost(struct AACEncContext *s, const float *in,
     offs[0] = 1;
     for (i = 1; i < dim; i++)
         offs[i] = offs[i-1]*range;
-    quantize_bands(s->qcoefs, in, scaled, size, Q34, !IS_CODEBOOK_UNSIGNED(cb), maxval);
+    s->dsp.aac_quantize_bands(s->qcoefs, in, scaled, size, Q34, !IS_CODEBOOK_UNSIGNED(cb), maxval);
 #endif /* USE_REALLY_FULL_SEARCH */
     for (i = 0; i < size; i += dim) {
         float mincost;
@@ -243,8 +243,8 @@ static void quantize_and_encode_band(struct AACEncContext *s, PutBitContext *pb,
     offs[0] = 1;
     for (i = 1; i < dim; i++)
         offs[i] = offs[i-1]*range;
-    abs_pow34_v(scaled, in, size);
-    quantize_bands(s->qcoefs, in, scaled, size, Q34, !IS_CODEBOOK_UNSIGNED(cb), maxval);
+    s->dsp.aac_abs_pow34(scaled, in, size);
+    s->dsp.aac_quantize_bands(s->qcoefs, in, scaled, size, Q34, !IS_CODEBOOK_UNSIGNED(cb), maxval);
 #endif /* USE_REALLY_FULL_SEARCH */
     for (i = 0; i < size; i += dim) {
         float mincost;
@@ -368,7 +368,7 @@ static void encode_window_bands_info(AACEncContext *s, SingleChannelElement *sce
     float next_minrd = INFINITY;
     int next_mincb = 0;
 
-    abs_pow34_v(s->scoefs, sce->coeffs, 1024);
+    s->dsp.aac_abs_pow34(s->scoefs, sce->coeffs, 1024);
     start = win*128;
     for (cb = 0; cb < 12; cb++) {
         path[0][cb].cost     = 0.0f;
@@ -493,7 +493,7 @@ static void search_for_quantizers_anmr(AVCodecContext *avctx, AACEncContext *s,
         }
     }
     idx = 1;
-    abs_pow34_v(s->scoefs, sce->coeffs, 1024);
+    s->dsp.aac_abs_pow34(s->scoefs, sce->coeffs, 1024);
     for (w = 0; w < sce->ics.num_windows; w += sce->ics.group_len[w]) {
         start = w*128;
         for (g = 0; g < sce->ics.num_swb; g++) {
@@ -661,7 +661,7 @@ static void search_for_quantizers_twoloop(AVCodecContext *avctx,
 
     if (!allz)
         return;
-    abs_pow34_v(s->scoefs, sce->coeffs, 1024);
+    s->dsp.aac_abs_pow34(s->scoefs, sce->coeffs, 1024);
     //perform two-loop search
     //outer loop - improve quality
     do {
@@ -839,7 +839,7 @@ static void search_for_quantizers_faac(AVCodecContext *avctx, AACEncContext *s,
         }
     }
     memset(sce->sf_idx, 0, sizeof(sce->sf_idx));
-    abs_pow34_v(s->scoefs, sce->coeffs, 1024);
+    s->dsp.aac_abs_pow34(s->scoefs, sce->coeffs, 1024);
     for (w = 0; w < sce->ics.num_windows; w += sce->ics.group_len[w]) {
         start = w*128;
         for (g = 0;  g < sce->ics.num_swb; g++) {
@@ -978,10 +978,10 @@ static void search_for_ms(AACEncContext *s, ChannelElement *cpe,
                         S[i] =  sce0->coeffs[start+w2*128+i]
                               - sce1->coeffs[start+w2*128+i];
                     }
-                    abs_pow34_v(L34, sce0->coeffs+start+w2*128, sce0->ics.swb_sizes[g]);
-                    abs_pow34_v(R34, sce1->coeffs+start+w2*128, sce0->ics.swb_sizes[g]);
-                    abs_pow34_v(M34, M,                         sce0->ics.swb_sizes[g]);
-                    abs_pow34_v(S34, S,                         sce0->ics.swb_sizes[g]);
+                    s->dsp.aac_abs_pow34(L34, sce0->coeffs+start+w2*128, sce0->ics.swb_sizes[g]);
+                    s->dsp.aac_abs_pow34(R34, sce1->coeffs+start+w2*128, sce0->ics.swb_sizes[g]);
+                    s->dsp.aac_abs_pow34(M34, M,                         sce0->ics.swb_sizes[g]);
+                    s->dsp.aac_abs_pow34(S34, S,                         sce0->ics.swb_sizes[g]);
                     dist1 += quantize_band_cost(s, sce0->coeffs + start + w2*128,
                                                 L34,
                                                 sce0->ics.swb_sizes[g],
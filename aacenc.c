@@ -196,6 +196,11 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
     s->coder = &ff_aac_coders[0];
 
     s->lambda = avctx->global_quality ? avctx->global_quality : 120;
+    if (avctx->thread_count > 1) {
+        s->thread_ctx = av_malloc(sizeof(*s->thread_ctx) * avctx->thread_count);
+        if (!s->thread_ctx)
+            return -1;
+    }
 #if !CONFIG_HARDCODED_TABLES
     for (i = 0; i < 428; i++)
         ff_aac_pow2sf_tab[i] = pow(2, (i - 200)/4.);
@@ -455,6 +460,53 @@ static int encode_individual_channel(AVCodecContext *avctx, AACEncContext *s,
     return 0;
 }
 
+/**
+ * Search the quantizers of one channel element and decide its stereo coding.
+ * Elements are independent, so they are searched in parallel, each thread
+ * with its own copy of the context for the scratch buffers.
+ */
+static int search_element_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    AACEncContext *s = avctx->priv_data;
+    AACEncContext *t = s;
+    const uint8_t *chan_map = aac_chan_configs[avctx->channels-1];
+    ChannelElement *cpe = &s->cpe[jobnr];
+    FFPsyWindowInfo *wi;
+    int i, j, chans, start_ch = 0;
+
+    if (s->thread_ctx) {
+        t  = &s->thread_ctx[threadnr];
+        *t = *s;
+    }
+    for (i = 0; i < jobnr; i++)
+        start_ch += chan_map[i+1] == TYPE_CPE ? 2 : 1;
+    chans = chan_map[jobnr+1] == TYPE_CPE ? 2 : 1;
+    wi    = (FFPsyWindowInfo*)arg + start_ch;
+
+    for (j = 0; j < chans; j++) {
+        t->cur_channel = start_ch + j;
+        s->coder->search_for_quantizers(avctx, t, &cpe->ch[j], s->lambda);
+    }
+    cpe->common_window = 0;
+    if (chans > 1
+        && wi[0].window_type[0] == wi[1].window_type[0]
+        && wi[0].window_shape   == wi[1].window_shape) {
+
+        cpe->common_window = 1;
+        for (j = 0; j < wi[0].num_windows; j++) {
+            if (wi[0].grouping[j] != wi[1].grouping[j]) {
+                cpe->common_window = 0;
+                break;
+            }
+        }
+    }
+    t->cur_channel = start_ch;
+    if (cpe->common_window && s->coder->search_for_ms)
+        s->coder->search_for_ms(t, cpe, s->lambda);
+    adjust_frame_information(t, cpe, chans);
+    return 0;
+}
+
 /**
  * Write some auxiliary information about the created AAC file.
  */
@@ -545,6 +597,7 @@ static int aac_encode_frame(AVCodecContext *avctx,
         init_put_bits(&s->pb, frame, buf_size*8);
         if ((avctx->frame_number & 0xFF)==1 && !(avctx->flags & CODEC_FLAG_BITEXACT))
             put_bitstream_info(avctx, s, LIBAVCODEC_IDENT);
+        avctx->execute2(avctx, search_element_thread, windows, NULL, chan_map[0]);
         start_ch = 0;
         memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < chan_map[0]; i++) {
@@ -552,25 +605,6 @@ static int aac_encode_frame(AVCodecContext *avctx,
             tag      = chan_map[i+1];
             chans    = tag == TYPE_CPE ? 2 : 1;
             cpe      = &s->cpe[i];
-            for (j = 0; j < chans; j++) {
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[j], s->lambda);
-            }
-            cpe->common_window = 0;
-            if (chans > 1
-                && wi[0].window_type[0] == wi[1].window_type[0]
-                && wi[0].window_shape   == wi[1].window_shape) {
-
-                cpe->common_window = 1;
-                for (j = 0; j < wi[0].num_windows; j++) {
-                    if (wi[0].grouping[j] != wi[1].grouping[j]) {
-                        cpe->common_window = 0;
-                        break;
-                    }
-                }
-            }
-            if (cpe->common_window && s->coder->search_for_ms)
-                s->coder->search_for_ms(s, cpe, s->lambda);
-            adjust_frame_information(s, cpe, chans);
             put_bits(&s->pb, 3, tag);
             put_bits(&s->pb, 4, chan_el_counter[tag]++);
             if (chans == 2) {
@@ -624,6 +658,7 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     ff_psy_preprocess_end(s->psypp);
     av_freep(&s->samples);
     av_freep(&s->cpe);
+    av_freep(&s->thread_ctx);
     return 0;
 }
 
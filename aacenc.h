@@ -66,6 +66,7 @@ typedef struct AACEncContext {
     float lambda;
     DECLARE_ALIGNED_16(int,   qcoefs)[96][2];    ///< quantized coefficients
     DECLARE_ALIGNED_16(float, scoefs)[1024];     ///< scaled coefficients
+    struct AACEncContext *thread_ctx;            ///< copies with separate scratch buffers for each thread, NULL without threads
 } AACEncContext;
 
 #endif /* AVCODEC_AACENC_H */
@@ -196,7 +196,10 @@ static av_cold int ac3_decode_init(AVCodecContext *avctx)
     av_lfg_init(&s->dith_state, 0);
 
     /* set bias values for float to int16 conversion */
-    if(s->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
+    if (avctx->request_sample_fmt == SAMPLE_FMT_FLTP) {
+        s->add_bias = 0.0f;
+        s->mul_bias = 1.0f;
+    } else if(s->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
         s->add_bias = 385.0f;
         s->mul_bias = 1.0f;
     } else {
@@ -219,7 +222,8 @@ static av_cold int ac3_decode_init(AVCodecContext *avctx)
             return AVERROR_NOMEM;
     }
 
-    avctx->sample_fmt = SAMPLE_FMT_S16;
+    avctx->sample_fmt = avctx->request_sample_fmt == SAMPLE_FMT_FLTP ?
+                        SAMPLE_FMT_FLTP : SAMPLE_FMT_S16;
     return 0;
 }
 
@@ -1218,7 +1222,8 @@ static int ac3_decode_frame(AVCodecContext * avctx, void *data, int *data_size,
     int buf_size = avpkt->size;
     AC3DecodeContext *s = avctx->priv_data;
     int16_t *out_samples = (int16_t *)data;
-    int blk, ch, err;
+    int blk, ch, err, out_size;
+    const int data_size_orig = *data_size;
     const uint8_t *channel_map;
     const float *output[AC3_MAX_CHANNELS];
 
@@ -1310,6 +1315,13 @@ static int ac3_decode_frame(AVCodecContext * avctx, void *data, int *data_size,
             s->output_mode  = s->out_channels == 1 ? AC3_CHMODE_MONO : AC3_CHMODE_STEREO;
     }
 
+    out_size = s->num_blocks * 256 * s->out_channels *
+               (av_get_bits_per_sample_format(avctx->sample_fmt) >> 3);
+    if (data_size_orig < out_size) {
+        av_log(avctx, AV_LOG_ERROR, "Output buffer too small\n");
+        return -1;
+    }
+
     /* decode the audio blocks */
     channel_map = ff_ac3_dec_channel_map[s->output_mode & ~AC3_OUTPUT_LFEON][s->lfe_on];
     for (ch = 0; ch < s->out_channels; ch++)
@@ -1319,10 +1331,16 @@ static int ac3_decode_frame(AVCodecContext * avctx, void *data, int *data_size,
             av_log(avctx, AV_LOG_ERROR, "error decoding the audio block\n");
             err = 1;
         }
-        s->dsp.float_to_int16_interleave(out_samples, output, 256, s->out_channels);
-        out_samples += 256 * s->out_channels;
+        if (avctx->sample_fmt == SAMPLE_FMT_FLTP) {
+            for (ch = 0; ch < s->out_channels; ch++)
+                memcpy((float *)data + (ch * s->num_blocks + blk) * 256, output[ch],
+                       256 * sizeof(float));
+        } else {
+            s->dsp.float_to_int16_interleave(out_samples, output, 256, s->out_channels);
+            out_samples += 256 * s->out_channels;
+        }
     }
-    *data_size = s->num_blocks * 256 * avctx->channels * sizeof (int16_t);
+    *data_size = out_size;
     return s->frame_size;
 }
 
@@ -41,6 +41,7 @@ static const SampleFmtInfo sample_fmt_info[SAMPLE_FMT_NB] = {
     [SAMPLE_FMT_S32] = { .name = "s32", .bits = 32 },
     [SAMPLE_FMT_FLT] = { .name = "flt", .bits = 32 },
     [SAMPLE_FMT_DBL] = { .name = "dbl", .bits = 64 },
+    [SAMPLE_FMT_FLTP]= { .name = "fltp",.bits = 32 },
 };
 
 const char *avcodec_get_sample_fmt_name(int sample_fmt)
@@ -175,6 +176,9 @@ AVAudioConvert *av_audio_convert_alloc(enum SampleFormat out_fmt, int out_channe
         return NULL;
     ctx->in_channels = in_channels;
     ctx->out_channels = out_channels;
+    /* the planar layout is described by the per channel pointers */
+    if (out_fmt == SAMPLE_FMT_FLTP) out_fmt = SAMPLE_FMT_FLT;
+    if (in_fmt  == SAMPLE_FMT_FLTP) in_fmt  = SAMPLE_FMT_FLT;
     ctx->fmt_pair = out_fmt + SAMPLE_FMT_NB*in_fmt;
     return ctx;
 }
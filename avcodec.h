@@ -30,7 +30,7 @@
 #include "libavutil/avutil.h"
 
 #define LIBAVCODEC_VERSION_MAJOR 52
-#define LIBAVCODEC_VERSION_MINOR 48
+#define LIBAVCODEC_VERSION_MINOR 56
 #define LIBAVCODEC_VERSION_MICRO  0
 
 #define LIBAVCODEC_VERSION_INT  AV_VERSION_INT(LIBAVCODEC_VERSION_MAJOR, \
@@ -366,6 +366,7 @@ enum SampleFormat {
     SAMPLE_FMT_S32,             ///< signed 32 bits
     SAMPLE_FMT_FLT,             ///< float
     SAMPLE_FMT_DBL,             ///< double
+    SAMPLE_FMT_FLTP,            ///< float, planar: all samples of the first channel, then the second channel, ...
     SAMPLE_FMT_NB               ///< Number of sample formats. DO NOT USE if dynamically linking to libavcodec
 };
 
@@ -447,6 +448,7 @@ enum Motion_Est_ID {
     ME_UMH,         ///< uneven multi-hexagon search
     ME_ITER,        ///< iterative search
     ME_TESA,        ///< transformed exhaustive search algorithm
+    ME_PYRAMID,     ///< EPZS seeded by a search on 2x and 4x downsampled planes
 };
 
 enum AVDiscard{
@@ -584,6 +586,7 @@ typedef struct RcOverride{
 #define CODEC_FLAG2_NON_LINEAR_QUANT 0x00010000 ///< Use MPEG-2 nonlinear quantizer.
 #define CODEC_FLAG2_BIT_RESERVOIR 0x00020000 ///< Use a bit reservoir when encoding if possible
 #define CODEC_FLAG2_MBTREE        0x00040000 ///< Use macroblock tree ratecontrol (x264 only)
+#define CODEC_FLAG2_WAVEFRONT     0x00080000 ///< H.264: run reconstruction and deblocking as a wavefront of MB rows on the slice threads
 
 /* Unsupported options :
  *              Syntax Arithmetic coding (SAC)
@@ -629,6 +632,10 @@ typedef struct RcOverride{
  * as a last resort.
  */
 #define CODEC_CAP_SUBFRAMES        0x0100
+/**
+ * Codec supports frame-level multithreading.
+ */
+#define CODEC_CAP_FRAME_THREADS    0x0200
 
 //The following defines may change, don't expect compatibility if you use them.
 #define MB_TYPE_INTRA4x4   0x0001
@@ -908,6 +915,27 @@ typedef struct AVPanScan{
      * - decoding: Set by libavcodec\
      */\
     void *hwaccel_picture_private;\
+\
+    /**\
+     * the AVCodecContext which ff_thread_get_buffer() was last called on\
+     * - encoding: Set by libavcodec.\
+     * - decoding: Set by libavcodec.\
+     */\
+    struct AVCodecContext *owner;\
+\
+    /**\
+     * used by multithreading to store frame-specific info\
+     * - encoding: Set by libavcodec.\
+     * - decoding: Set by libavcodec.\
+     */\
+    void *thread_opaque;\
+\
+    /**\
+     * reference-counted buffer holding the image, see avcodec_ref_frame()\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec.\
+     */\
+    void *buffer_ref;\
 
 
 #define FF_QSCALE_TYPE_MPEG1 0
@@ -1208,6 +1236,15 @@ typedef struct AVCodecContext {
     int rc_strategy;
 #define FF_RC_STRATEGY_XVID 1
 
+    /**
+     * strategy to choose between I/P/B-frames
+     * 0: fixed max_b_frames, 1: intra count heuristic, 2: trial encodes of
+     * downscaled frames, 3: motion search on decimated frames in a lookahead
+     * of rc_lookahead frames, which also detects scene cuts and lowers the
+     * quantizer of MBs that later frames refer to.
+     * - encoding: Set by user.
+     * - decoding: unused
+     */
     int b_frame_strategy;
 
     /**
@@ -1615,6 +1652,8 @@ typedef struct AVCodecContext {
 #define FF_MM_SSSE3    0x0080 ///< Conroe SSSE3 functions
 #define FF_MM_SSE4     0x0100 ///< Penryn SSE4.1 functions
 #define FF_MM_SSE42    0x0200 ///< Nehalem SSE4.2 functions
+#define FF_MM_AVX      0x4000 ///< Sandy Bridge AVX functions
+#define FF_MM_AVX2     0x8000 ///< Haswell AVX2 functions
 #define FF_MM_IWMMXT   0x0100 ///< XScale IWMMXT
 #define FF_MM_ALTIVEC  0x0001 ///< standard AltiVec
 
@@ -1673,6 +1712,7 @@ typedef struct AVCodecContext {
 #define FF_DEBUG_VIS_QP      0x00002000
 #define FF_DEBUG_VIS_MB_TYPE 0x00004000
 #define FF_DEBUG_BUFFERS     0x00008000
+#define FF_DEBUG_THREADS     0x00010000
 
     /**
      * debug
@@ -1849,13 +1889,13 @@ typedef struct AVCodecContext {
     int color_table_id;
 
     /**
-     * internal_buffer count
+     * number of internal buffers currently held by the codec
      * Don't touch, used by libavcodec default_get_buffer().
      */
     int internal_buffer_count;
 
     /**
-     * internal_buffers
+     * pool of internal buffers
      * Don't touch, used by libavcodec default_get_buffer().
      */
     void *internal_buffer;
@@ -2358,6 +2398,8 @@ typedef struct AVCodecContext {
 
     /**
      * Adjusts sensitivity of b_frame_strategy 1.
+     * For b_frame_strategy 3, the maximum inter to intra cost ratio in percent
+     * of a frame coded as B-frame.
      * - encoding: Set by user.
      * - decoding: unused
      */
@@ -2576,6 +2618,93 @@ typedef struct AVCodecContext {
      * - decoding: unused
      */
     int weighted_p_pred;
+
+    /**
+     * Which multithreading methods to use.
+     * Use of FF_THREAD_FRAME will increase decoding delay by one frame per thread,
+     * so clients which cannot provide future frames should not use it.
+     * The MPEG-1/2/4 and H.263 encoders code frames in parallel if only
+     * FF_THREAD_FRAME is set, which also increases the delay by one frame
+     * per thread and limits vertical motion vectors.
+     *
+     * - encoding: Set by user, otherwise the default is used.
+     * - decoding: Set by user, otherwise the default is used.
+     */
+    int thread_type;
+#define FF_THREAD_FRAME   1 //< Decode more than one frame at once
+#define FF_THREAD_SLICE   2 //< Decode more than one part of a single frame at once
+
+    /**
+     * Which multithreading methods are in use by the codec.
+     * - encoding: Set by libavcodec.
+     * - decoding: Set by libavcodec.
+     */
+    int active_thread_type;
+
+    /**
+     * Set by the client if its custom get_buffer() callback can be called
+     * from another thread, which allows faster multithreaded decoding.
+     * draw_horiz_band() will be called from other threads regardless of this setting.
+     * Ignored if the default get_buffer() is used.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    int thread_safe_callbacks;
+
+    /**
+     * Whether this is a copy of the context which had init() called on it.
+     * This is used by multithreading - shared tables and picture pointers
+     * should be freed from the original context only.
+     * - encoding: Set by libavcodec.
+     * - decoding: Set by libavcodec.
+     */
+    int is_copy;
+
+    /**
+     * Worker pool shared with other contexts, see avcodec_thread_pool_alloc().
+     * If set, slice threading runs on the workers of the pool instead of
+     * starting threads of its own. thread_count still limits how many threads
+     * work on one execute() call.
+     * - encoding: Set by user before avcodec_open().
+     * - decoding: Set by user before avcodec_open().
+     */
+    struct AVThreadPool *thread_pool;
+
+    /**
+     * Priority of the jobs of this context in a shared thread_pool.
+     * Idle workers serve contexts with a higher priority first.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    int thread_priority;
+
+    /**
+     * Maximum number of workers of a shared thread_pool working on one
+     * execute() call of this context, besides the calling thread.
+     * 0 means no limit other than thread_count. While several contexts
+     * wait for workers, each gets at most its fair share of the pool anyway.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    int thread_pool_max_workers;
+
+    /**
+     * Number of frames b_frame_strategy 3 analyzes before choosing a frame
+     * type, at least max_b_frames. Increases the encoding delay accordingly.
+     * - encoding: Set by user.
+     * - decoding: unused
+     */
+    int rc_lookahead;
+
+    /**
+     * Sample format the decoder should output if it can, SAMPLE_FMT_NONE
+     * for default. Float decoders support SAMPLE_FMT_FLTP, which avoids
+     * the conversion to 16 bit. Check sample_fmt for the format actually
+     * used.
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    enum SampleFormat request_sample_fmt;
 } AVCodecContext;
 
 /**
@@ -2617,6 +2746,26 @@ typedef struct AVCodec {
     const int *supported_samplerates;       ///< array of supported audio samplerates, or NULL if unknown, array is terminated by 0
     const enum SampleFormat *sample_fmts;   ///< array of supported sample formats, or NULL if unknown, array is terminated by -1
     const int64_t *channel_layouts;         ///< array of support channel layouts, or NULL if unknown. array is terminated by 0
+
+    /**
+     * @defgroup framethreading Frame-level threading support functions.
+     * @{
+     */
+    /**
+     * If defined, called on thread contexts when they are created.
+     * If the codec allocates writable tables in init(), re-allocate them here.
+     * priv_data will be set to a copy of the original.
+     */
+    int (*init_thread_copy)(AVCodecContext *);
+    /**
+     * Copy necessary context variables from a previous thread context to the current one.
+     * If not defined, the next thread will start automatically; otherwise, the codec
+     * must call ff_thread_finish_setup().
+     *
+     * dst and src will (rarely) point to the same context, in which case memcpy should be skipped.
+     */
+    int (*update_thread_context)(AVCodecContext *dst, const AVCodecContext *src);
+    /** @} */
 } AVCodec;
 
 /**
@@ -2838,6 +2987,23 @@ void av_shrink_packet(AVPacket *pkt, int size);
  */
 int av_dup_packet(AVPacket *pkt);
 
+/**
+ * Create a new reference to the payload of a packet without copying it.
+ * src is made reference counted first if it is not already; data allocated
+ * with av_new_packet() is taken over, other data is copied once. Both
+ * packets then share the payload, including its zeroed padding, which is
+ * freed when the last of them is passed to av_free_packet().
+ * The shared payload must be treated as read-only, so av_shrink_packet()
+ * must not be used on such packets while other references exist.
+ * The reference count is updated atomically if the compiler supports it
+ * or pthreads are available, so references can be passed between threads.
+ *
+ * @param dst packet which receives the new reference, all fields are overwritten
+ * @param src packet to reference, AVPacket.priv is used for the shared state
+ * @return 0 if OK, AVERROR_xxx otherwise
+ */
+int av_ref_packet(AVPacket *dst, AVPacket *src);
+
 /**
  * Free a packet.
  *
@@ -3203,6 +3369,33 @@ AVFrame *avcodec_alloc_frame(void);
 int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic);
 void avcodec_default_release_buffer(AVCodecContext *s, AVFrame *pic);
 int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic);
+
+/**
+ * Creates a new reference to the image of a frame returned by a decoder,
+ * so that it stays valid after the decoder released the frame and can be
+ * kept without copying it. The buffer is only reused once all references
+ * are gone, even after the codec was closed.
+ * Only frames allocated by avcodec_default_get_buffer() can be referenced;
+ * the side tables (qscale_table, motion_val, ...) are not kept and are set
+ * to NULL in dst.
+ * References may only be created and dropped from another thread than the
+ * one using the codec if a lock manager was registered with
+ * av_lockmgr_register() before the codec allocated its first frame; without
+ * one, the caller must serialize these calls with the decoding calls.
+ * The buffers keep using the lock manager they were allocated with, which
+ * must stay callable until all their references are gone.
+ *
+ * @param dst frame which receives the new reference
+ * @param src frame returned by a decoder
+ * @return 0 on success, AVERROR(ENOSYS) if the frame is not reference counted
+ */
+int avcodec_ref_frame(AVFrame *dst, const AVFrame *src);
+
+/**
+ * Drops a reference created with avcodec_ref_frame() and clears the data
+ * pointers of the frame. Does nothing if the frame holds no reference.
+ */
+void avcodec_unref_frame(AVFrame *frame);
 void avcodec_align_dimensions(AVCodecContext *s, int *width, int *height);
 
 /**
@@ -3218,6 +3411,25 @@ enum PixelFormat avcodec_default_get_format(struct AVCodecContext *s, const enum
 
 int avcodec_thread_init(AVCodecContext *s, int thread_count);
 void avcodec_thread_free(AVCodecContext *s);
+
+typedef struct AVThreadPool AVThreadPool;
+
+/**
+ * Creates a pool of worker threads which the slice threading of several
+ * codec contexts can share, see AVCodecContext.thread_pool.
+ *
+ * @param thread_count number of worker threads
+ * @return the new pool, or NULL on failure or if not supported by the
+ *         threading implementation
+ */
+AVThreadPool *avcodec_thread_pool_alloc(int thread_count);
+
+/**
+ * Stops the worker threads of a pool and frees it.
+ * All contexts using the pool must have been closed before.
+ */
+void avcodec_thread_pool_free(AVThreadPool *pool);
+
 int avcodec_thread_execute(AVCodecContext *s, int (*func)(AVCodecContext *c2, void *arg2),void *arg, int *ret, int count, int size);
 int avcodec_default_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2),void *arg, int *ret, int count, int size);
 int avcodec_default_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2, int, int),void *arg, int *ret, int count);
@@ -3519,6 +3731,14 @@ typedef struct AVCodecParserContext {
 
     int flags;
 #define PARSER_FLAG_COMPLETE_FRAMES           0x0001
+/**
+ * Each input passed to av_parser_parse2() stays valid and unchanged until the
+ * frame returned by the following call has been used. Allows parsers to
+ * return frames ending at the end of an input buffer in place instead of
+ * copying them. Such a frame is only returned by the next call, when the
+ * start of the following frame is seen, and points into the earlier input.
+ */
+#define PARSER_FLAG_STABLE_INPUT              0x0002
 
     int64_t offset;      ///< byte offset from starting packet start
     int64_t cur_frame_end[AV_PARSER_PTS_NB];
@@ -3641,7 +3861,11 @@ int av_parser_parse(AVCodecParserContext *s,
  * @param avctx         codec context.
  * @param poutbuf       set to pointer to parsed buffer or NULL if not yet finished.
  * @param poutbuf_size  set to size of parsed buffer or zero if not yet finished.
- * @param buf           input buffer.
+ * @param buf           input buffer. With PARSER_FLAG_STABLE_INPUT it must stay
+ *                      valid until the parsed buffer returned by the next
+ *                      call has been used, since that buffer may point into
+ *                      it, e.g. by keeping a reference to its packet with
+ *                      av_ref_packet() for one more call.
  * @param buf_size      input length, to signal EOF, this should be 0 (so that the last frame can be output).
  * @param pts           input presentation timestamp.
  * @param dts           input decoding timestamp.
@@ -3851,7 +4075,9 @@ enum AVLockOp {
  *           Thus, the application must be prepared to handle that.
  *           If cb is set to NULL the lockmgr will be unregistered.
  *           Also note that during unregistration the previously registered
- *           lockmgr callback may also be invoked.
+ *           lockmgr callback may also be invoked, as well as later on for
+ *           frames referenced with avcodec_ref_frame() while it was
+ *           registered.
  */
 int av_lockmgr_register(int (*cb)(void **mutex, enum AVLockOp op));
 
@@ -19,8 +19,36 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
 #include "avcodec.h"
+#if !AV_GCC_VERSION_AT_LEAST(4,1) && HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
+/**
+ * Payload shared by reference-counted packets, pointed to by AVPacket.priv.
+ */
+typedef struct PacketBuffer {
+    volatile int refcount;
+    uint8_t *data;          ///< start of the allocation, freed with the last reference
+} PacketBuffer;
+
+#if AV_GCC_VERSION_AT_LEAST(4,1)
+#define ref_add(ptr, inc) __sync_add_and_fetch(ptr, inc)
+#elif HAVE_PTHREADS
+static pthread_mutex_t ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int ref_add(volatile int *ptr, int inc)
+{
+    int ret;
+    pthread_mutex_lock(&ref_lock);
+    ret = *ptr += inc;
+    pthread_mutex_unlock(&ref_lock);
+    return ret;
+}
+#else
+#define ref_add(ptr, inc) (*(ptr) += (inc))
+#endif
 
 void av_destruct_packet_nofree(AVPacket *pkt)
 {
@@ -71,6 +99,67 @@ void av_shrink_packet(AVPacket *pkt, int size)
     memset(pkt->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
 }
 
+static void destruct_packet_ref(AVPacket *pkt)
+{
+    PacketBuffer *buf = pkt->priv;
+
+    if (!ref_add(&buf->refcount, -1)) {
+        av_free(buf->data);
+        av_free(buf);
+    }
+    pkt->priv = NULL;
+    pkt->data = NULL; pkt->size = 0;
+}
+
+/**
+ * Makes pkt reference counted. Data allocated by av_new_packet() is taken
+ * over, anything else is copied with the padding added again.
+ */
+static int make_packet_ref(AVPacket *pkt)
+{
+    PacketBuffer *buf = av_malloc(sizeof(PacketBuffer));
+
+    if (!buf)
+        return AVERROR(ENOMEM);
+    buf->refcount = 1;
+
+    if (pkt->destruct == av_destruct_packet) {
+        buf->data = pkt->data;
+    } else {
+        int size = pkt->size;
+
+        if ((unsigned)size > (unsigned)size + FF_INPUT_BUFFER_PADDING_SIZE ||
+            !(buf->data = av_malloc(size + FF_INPUT_BUFFER_PADDING_SIZE))) {
+            av_free(buf);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(buf->data, pkt->data, size);
+        memset(buf->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+        if (pkt->destruct)
+            pkt->destruct(pkt);
+        pkt->data = buf->data;
+        pkt->size = size;
+    }
+    pkt->priv     = buf;
+    pkt->destruct = destruct_packet_ref;
+    return 0;
+}
+
+int av_ref_packet(AVPacket *dst, AVPacket *src)
+{
+    if (src->destruct != destruct_packet_ref) {
+        int ret;
+
+        if (!src->data)
+            return AVERROR(EINVAL);
+        if ((ret = make_packet_ref(src)) < 0)
+            return ret;
+    }
+    ref_add(&((PacketBuffer*)src->priv)->refcount, 1);
+    *dst = *src;
+    return 0;
+}
+
 int av_dup_packet(AVPacket *pkt)
 {
     if (((pkt->destruct == av_destruct_packet_nofree) || (pkt->destruct == NULL)) && pkt->data) {
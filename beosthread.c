@@ -126,6 +126,7 @@ int avcodec_thread_init(AVCodecContext *s, int thread_count){
     if (thread_count <= 1)
         return 0;
 
+    s->active_thread_type= FF_THREAD_SLICE;
     assert(!s->thread_opaque);
     c= av_mallocz(sizeof(ThreadContext)*thread_count);
     s->thread_opaque= c;
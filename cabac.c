@@ -207,6 +207,10 @@ START_TIMER
 STOP_TIMER("put_cabac_bypass")
     }
 
+    for(i=0; i<SIZE; i++){
+        put_cabac_bypass(&c, r[i]&1);
+    }
+
     for(i=0; i<SIZE; i++){
 START_TIMER
         put_cabac(&c, state, r[i]&1);
@@ -238,6 +242,24 @@ START_TIMER
 STOP_TIMER("get_cabac_bypass")
     }
 
+#ifdef BATCHED_CABAC_BYPASS
+    for(i=0; i<SIZE; ){
+        int n= FFMIN(r[i] + 1 + (i+1 < SIZE ? r[i+1]&3 : 0)*4, SIZE - i);
+        int j, v;
+START_TIMER
+        v= get_cabac_bypass_bits(&c, n);
+STOP_TIMER("get_cabac_bypass_bits")
+        for(j=n-1; j>=0; j--, i++){
+            if( (r[i]&1) != ((v>>j)&1) )
+                av_log(NULL, AV_LOG_ERROR, "CABAC batched bypass failure at %d\n", i);
+        }
+    }
+#else
+    for(i=0; i<SIZE; i++){
+        get_cabac_bypass(&c);
+    }
+#endif
+
     for(i=0; i<SIZE; i++){
 START_TIMER
         if( (r[i]&1) != get_cabac(&c, state) )
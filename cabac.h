@@ -36,6 +36,7 @@
 #define CABAC_BITS 16
 #define CABAC_MASK ((1<<CABAC_BITS)-1)
 #define BRANCHLESS_CABAC_DECODER 1
+#define BATCHED_CABAC_BYPASS 1
 //#define ARCH_X86_DISABLED 1
 
 typedef struct CABACContext{
@@ -626,12 +627,22 @@ static int av_unused get_cabac_bypass(CABACContext *c){
         refill(c);
 
     range= c->range<<(CABAC_BITS+1);
+#ifndef BRANCHLESS_CABAC_DECODER
     if(c->low < range){
         return 0;
     }else{
         c->low -= range;
         return 1;
     }
+#else
+    {
+        int mask;
+        c->low -= range;
+        mask= c->low >> 31;
+        c->low += range & mask;
+        return mask + 1;
+    }
+#endif
 #endif
 }
 
@@ -683,6 +694,42 @@ static av_always_inline int get_cabac_bypass_sign(CABACContext *c, int val){
 #endif
 }
 
+#ifdef BATCHED_CABAC_BYPASS
+/**
+ * Decodes n consecutive bypass bins, the first one ending up in the most
+ * significant bit of the result.
+ * The bins are decoded without branches in batches that end when the
+ * buffered bits run out, so the bytestream is checked for a refill once
+ * every CABAC_BITS bins instead of after each bin.
+ */
+static av_always_inline int get_cabac_bypass_bits(CABACContext *c, int n){
+    int low  = c->low;
+    int range= c->range<<(CABAC_BITS+1);
+    int v= 0;
+
+    while(n > 0){
+        /* the lowest set bit of low marks the end of the buffered bits */
+        int k= FFMIN(n, CABAC_BITS - av_log2(low & -low));
+
+        n -= k;
+        while(k--){
+            int mask;
+            low += low - range;
+            mask = low >> 31;
+            low += range & mask;
+            v    = 2*v + 1 + mask;
+        }
+        if(!(low & CABAC_MASK)){
+            c->low= low;
+            refill(c);
+            low= c->low;
+        }
+    }
+    c->low= low;
+    return v;
+}
+#endif /* BATCHED_CABAC_BYPASS */
+
 /**
  *
  * @return the number of bytes read or 0 if no end
@@ -240,7 +240,7 @@ typedef struct {
     DECLARE_ALIGNED_16(float, samples)[1536];  /* 6 * 256 = 1536, might only need 5 */
     const float *samples_chanptr[6];
 
-    uint8_t dca_buffer[DCA_MAX_FRAME_SIZE];
+    uint8_t dca_buffer[DCA_MAX_FRAME_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];
     int dca_buffer_size;        ///< how much data is in the dca_buffer
 
     const int8_t* channel_order_tab;                             ///< channel reordering table, lfe and non lfe
@@ -1211,10 +1211,10 @@ static int dca_decode_frame(AVCodecContext * avctx,
     const uint8_t *buf = avpkt->data;
     int buf_size = avpkt->size;
 
-    int i;
+    int i, ch;
     int16_t *samples = data;
     DCAContext *s = avctx->priv_data;
-    int channels;
+    int channels, sample_size, len;
 
 
     s->dca_buffer_size = dca_convert_bitstream(buf, buf_size, s->dca_buffer, DCA_MAX_FRAME_SIZE);
@@ -1263,13 +1263,21 @@ static int dca_decode_frame(AVCodecContext * avctx,
     if (!avctx->channels)
         avctx->channels = channels;
 
-    if(*data_size < (s->sample_blocks / 8) * 256 * sizeof(int16_t) * channels)
+    sample_size = av_get_bits_per_sample_format(avctx->sample_fmt) >> 3;
+    len = (s->sample_blocks / 8) * 256;
+    if(*data_size < len * sample_size * channels)
         return -1;
-    *data_size = 256 / 8 * s->sample_blocks * sizeof(int16_t) * channels;
+    *data_size = len * sample_size * channels;
     for (i = 0; i < (s->sample_blocks / 8); i++) {
         dca_decode_block(s);
-        s->dsp.float_to_int16_interleave(samples, s->samples_chanptr, 256, channels);
-        samples += 256 * channels;
+        if (avctx->sample_fmt == SAMPLE_FMT_FLTP) {
+            for (ch = 0; ch < channels; ch++)
+                memcpy((float *)data + ch * len + i * 256, s->samples_chanptr[ch],
+                       256 * sizeof(float));
+        } else {
+            s->dsp.float_to_int16_interleave(samples, s->samples_chanptr, 256, channels);
+            samples += 256 * channels;
+        }
     }
 
     return buf_size;
@@ -1298,18 +1306,22 @@ static av_cold int dca_decode_init(AVCodecContext * avctx)
         s->samples_chanptr[i] = s->samples + i * 256;
     avctx->sample_fmt = SAMPLE_FMT_S16;
 
-    if(s->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
+    if (avctx->request_sample_fmt == SAMPLE_FMT_FLTP) {
+        avctx->sample_fmt = SAMPLE_FMT_FLTP;
+        s->add_bias = 0.0f;
+        s->scale_bias = 1.0 / 32768.0;
+    } else if(s->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
         s->add_bias = 385.0f;
         s->scale_bias = 1.0 / 32768.0;
     } else {
         s->add_bias = 0.0f;
         s->scale_bias = 1.0;
+    }
 
-        /* allow downmixing to stereo */
-        if (avctx->channels > 0 && avctx->request_channels < avctx->channels &&
-                avctx->request_channels == 2) {
-            avctx->channels = avctx->request_channels;
-        }
+    /* allow downmixing to stereo */
+    if (!s->add_bias && avctx->channels > 0 &&
+        avctx->request_channels < avctx->channels && avctx->request_channels == 2) {
+        avctx->channels = avctx->request_channels;
     }
 
 
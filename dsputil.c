@@ -49,8 +49,24 @@ void ff_ac3_downmix_c(float (*samples)[256], float (*matrix)[2], int out_ch, int
 /* lpc.c */
 void ff_lpc_compute_autocorr(const int32_t *data, int len, int lag, double *autoc);
 
+/* aaccoder.c */
+void ff_aac_quantize_bands(int (*out)[2], const float *in, const float *scaled,
+                           int size, float Q34, int is_signed, int maxval);
+void ff_aac_abs_pow34(float *out, const float *in, int size);
+
+/* flacenc.c */
+void ff_flac_encode_residual_fixed(int32_t *res, const int32_t *smp, int n, int order);
+void ff_flac_encode_residual_lpc(int32_t *res, const int32_t *smp, int n,
+                                 int order, const int32_t *coefs, int shift);
+void ff_flac_calc_sums(uint32_t *sums, const int32_t *res, int n, int pred_order, int porder);
+
 /* pngdec.c */
 void ff_add_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+void ff_add_png_avg_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+
+/* pngenc.c */
+void ff_sub_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+void ff_sub_png_avg_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
 
 /* eaidct.c */
 void ff_ea_idct_put_c(uint8_t *dest, int linesize, DCTELEM *block);
@@ -441,17 +457,11 @@ int w97_32_c(void *v, uint8_t * pix1, uint8_t * pix2, int line_size, int h){
 
 /* draw the edges of width 'w' of an image of size width, height */
 //FIXME check that this is ok for mpeg4 interlaced
-static void draw_edges_c(uint8_t *buf, int wrap, int width, int height, int w)
+static void draw_edges_c(uint8_t *buf, int wrap, int width, int height, int w, int sides)
 {
     uint8_t *ptr, *last_line;
     int i;
 
-    last_line = buf + (height - 1) * wrap;
-    for(i=0;i<w;i++) {
-        /* top and bottom */
-        memcpy(buf - (i + 1) * wrap, buf, width);
-        memcpy(last_line + (i + 1) * wrap, last_line, width);
-    }
     /* left and right */
     ptr = buf;
     for(i=0;i<height;i++) {
@@ -459,13 +469,16 @@ static void draw_edges_c(uint8_t *buf, int wrap, int width, int height, int w)
         memset(ptr + width, ptr[width-1], w);
         ptr += wrap;
     }
-    /* corners */
-    for(i=0;i<w;i++) {
-        memset(buf - (i + 1) * wrap - w, buf[0], w); /* top left */
-        memset(buf - (i + 1) * wrap + width, buf[width-1], w); /* top right */
-        memset(last_line + (i + 1) * wrap - w, last_line[0], w); /* top left */
-        memset(last_line + (i + 1) * wrap + width, last_line[width-1], w); /* top right */
-    }
+
+    /* top and bottom + corners */
+    buf -= w;
+    last_line = buf + (height - 1) * wrap;
+    if (sides & EDGE_TOP)
+        for(i = 0; i < w; i++)
+            memcpy(buf - (i + 1) * wrap, buf, width + w + w); // top
+    if (sides & EDGE_BOTTOM)
+        for (i = 0; i < w; i++)
+            memcpy(last_line + (i + 1) * wrap, last_line, width + w + w); // bottom
 }
 
 /**
@@ -4803,6 +4816,11 @@ av_cold void dsputil_init(DSPContext* c, AVCodecContext *avctx)
     c->bswap_buf= bswap_buf;
 #if CONFIG_PNG_DECODER
     c->add_png_paeth_prediction= ff_add_png_paeth_prediction;
+    c->add_png_avg_prediction= ff_add_png_avg_prediction;
+#endif
+#if CONFIG_PNG_ENCODER
+    c->sub_png_paeth_prediction= ff_sub_png_paeth_prediction;
+    c->sub_png_avg_prediction= ff_sub_png_avg_prediction;
 #endif
 
     c->h264_v_loop_filter_luma= h264_v_loop_filter_luma_c;
@@ -4847,6 +4865,15 @@ av_cold void dsputil_init(DSPContext* c, AVCodecContext *avctx)
 #endif
 #if CONFIG_LPC
     c->lpc_compute_autocorr = ff_lpc_compute_autocorr;
+#endif
+#if CONFIG_AAC_ENCODER
+    c->aac_quantize_bands = ff_aac_quantize_bands;
+    c->aac_abs_pow34 = ff_aac_abs_pow34;
+#endif
+#if CONFIG_FLAC_ENCODER
+    c->flac_encode_residual_fixed = ff_flac_encode_residual_fixed;
+    c->flac_encode_residual_lpc = ff_flac_encode_residual_lpc;
+    c->flac_calc_sums = ff_flac_calc_sums;
 #endif
     c->vector_fmul = vector_fmul_c;
     c->vector_fmul_reverse = vector_fmul_reverse_c;
@@ -164,6 +164,11 @@ static void a(uint8_t *block, const uint8_t *pixels, int line_size, int h){\
 // h is limited to {width/2, width, 2*width} but never larger than 16 and never smaller then 2
 // although currently h<4 is not used as functions with width <8 are neither used nor implemented
 typedef int (*me_cmp_func)(void /*MpegEncContext*/ *s, uint8_t *blk1/*align width (8 or 16)*/, uint8_t *blk2/*align 1*/, int line_size, int h)/* __attribute__ ((const))*/;
+/**
+ * Compares one block against 4 candidate blocks of the reference, the SADs
+ * are written to scores.
+ */
+typedef void (*me_cmp_x4_func)(int scores[4], uint8_t *blk1/*align width (8 or 16)*/, uint8_t * const blk2[4]/*align 1*/, int line_size, int h);
 
 
 // for snow slices
@@ -237,6 +242,11 @@ typedef struct DSPContext {
     me_cmp_func mb_cmp[6];
     me_cmp_func ildct_cmp[6]; //only width 16 used
     me_cmp_func frame_skip_cmp[6]; //only width 8 used
+    /**
+     * sad[0] and sad[1] of 4 candidates at once.
+     * NULL if there is nothing faster than 4 calls of sad[].
+     */
+    me_cmp_x4_func sad_x4[2];
 
     int (*ssd_int8_vs_int16)(const int8_t *pix1, const int16_t *pix2,
                              int size);
@@ -353,6 +363,11 @@ typedef struct DSPContext {
     void (*add_hfyu_left_prediction_bgr32)(uint8_t *dst, const uint8_t *src, int w, int *red, int *green, int *blue, int *alpha);
     /* this might write to dst[w] */
     void (*add_png_paeth_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+    /* unfilters a whole row, including its first pixel */
+    void (*add_png_avg_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+    /* PNG encoder filters, these read src[-bpp] and top[-bpp], w is a multiple of 16 */
+    void (*sub_png_paeth_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+    void (*sub_png_avg_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
     void (*bswap_buf)(uint32_t *dst, const uint32_t *src, int w);
 
     void (*h264_v_loop_filter_luma)(uint8_t *pix/*align 16*/, int stride, int alpha, int beta, int8_t *tc0);
@@ -387,6 +402,15 @@ typedef struct DSPContext {
     void (*ac3_downmix)(float (*samples)[256], float (*matrix)[2], int out_ch, int in_ch, int len);
     /* no alignment needed */
     void (*lpc_compute_autocorr)(const int32_t *data, int len, int lag, double *autoc);
+    /* AAC encoder quantizer, no alignment needed, size is a multiple of 4 */
+    void (*aac_quantize_bands)(int (*out)[2], const float *in, const float *scaled,
+                               int size, float Q34, int is_signed, int maxval);
+    void (*aac_abs_pow34)(float *out, const float *in, int size);
+    /* FLAC encoder residual and rice partition sums, no alignment needed */
+    void (*flac_encode_residual_fixed)(int32_t *res, const int32_t *smp, int n, int order);
+    void (*flac_encode_residual_lpc)(int32_t *res, const int32_t *smp, int n,
+                                     int order, const int32_t *coefs, int shift);
+    void (*flac_calc_sums)(uint32_t *sums, const int32_t *res, int n, int pred_order, int porder);
     /* assume len is a multiple of 8, and arrays are 16-byte aligned */
     void (*vector_fmul)(float *dst, const float *src, int len);
     void (*vector_fmul_reverse)(float *dst, const float *src0, const float *src1, int len);
@@ -499,8 +523,10 @@ typedef struct DSPContext {
 #define BASIS_SHIFT 16
 #define RECON_SHIFT 6
 
-    void (*draw_edges)(uint8_t *buf, int wrap, int width, int height, int w);
+    void (*draw_edges)(uint8_t *buf, int wrap, int width, int height, int w, int sides);
 #define EDGE_WIDTH 16
+#define EDGE_TOP    1
+#define EDGE_BOTTOM 2
 
     /* h264 functions */
     /* NOTE!!! if you implement any of h264_idct8_add, h264_idct8_add4 then you must implement all of them
@@ -721,6 +747,7 @@ typedef struct FFTContext {
     uint16_t *revtab;
     FFTComplex *exptab;
     FFTComplex *exptab1; /* only used by SSE code */
+    FFTSample *twiddle_avx; /* only used by AVX code */
     FFTComplex *tmp_buf;
     int mdct_size; /* size of MDCT (i.e. number of input data * 2) */
     int mdct_bits; /* n = 2^nbits */
@@ -731,6 +758,8 @@ typedef struct FFTContext {
     void (*fft_calc)(struct FFTContext *s, FFTComplex *z);
     void (*imdct_calc)(struct FFTContext *s, FFTSample *output, const FFTSample *input);
     void (*imdct_half)(struct FFTContext *s, FFTSample *output, const FFTSample *input);
+    void (*imdct_half_batch)(struct FFTContext *s, FFTSample **output,
+                             const FFTSample **input, int count);
     void (*mdct_calc)(struct FFTContext *s, FFTSample *output, const FFTSample *input);
     int split_radix;
     int permutation;
@@ -830,6 +859,19 @@ static inline void ff_imdct_half(FFTContext *s, FFTSample *output, const FFTSamp
     s->imdct_half(s, output, input);
 }
 
+/**
+ * Compute ff_imdct_half() of count blocks of the same size at once,
+ * e.g. all the channels of a frame. Optimized versions may process
+ * the blocks together instead of one after the other.
+ * @param output count pointers to N/2 output samples
+ * @param input  count pointers to N/2 input samples
+ */
+static inline void ff_imdct_half_batch(FFTContext *s, FFTSample **output,
+                                       const FFTSample **input, int count)
+{
+    s->imdct_half_batch(s, output, input, count);
+}
+
 static inline void ff_mdct_calc(FFTContext *s, FFTSample *output,
                                 const FFTSample *input)
 {
@@ -867,6 +909,8 @@ extern SINETABLE_CONST float * const ff_sine_windows[13];
 int ff_mdct_init(FFTContext *s, int nbits, int inverse, double scale);
 void ff_imdct_calc_c(FFTContext *s, FFTSample *output, const FFTSample *input);
 void ff_imdct_half_c(FFTContext *s, FFTSample *output, const FFTSample *input);
+void ff_imdct_half_batch_c(FFTContext *s, FFTSample **output,
+                           const FFTSample **input, int count);
 void ff_mdct_calc_c(FFTContext *s, FFTSample *output, const FFTSample *input);
 void ff_mdct_end(FFTContext *s);
 
@@ -447,8 +447,8 @@ static void dv_decode_ac(GetBitContext *gb, BlockInfo *mb, DCTELEM *block)
 
     /* if we must parse a partial vlc, we do it here */
     if (partial_bit_count > 0) {
-        re_cache = ((unsigned)re_cache >> partial_bit_count) |
-                   (mb->partial_bit_buffer << (sizeof(re_cache) * 8 - partial_bit_count));
+        re_cache = (re_cache >> partial_bit_count) |
+                   ((uint64_t)mb->partial_bit_buffer << (sizeof(re_cache) * 8 - partial_bit_count));
         re_index -= partial_bit_count;
         mb->partial_bit_count = 0;
     }
@@ -459,10 +459,10 @@ static void dv_decode_ac(GetBitContext *gb, BlockInfo *mb, DCTELEM *block)
         printf("%2d: bits=%04x index=%d\n", pos, SHOW_UBITS(re, gb, 16), re_index);
 #endif
         /* our own optimized GET_RL_VLC */
-        index   = NEG_USR32(re_cache, TEX_VLC_BITS);
+        index   = SHOW_UBITS(re, gb, TEX_VLC_BITS);
         vlc_len = dv_rl_vlc[index].len;
         if (vlc_len < 0) {
-            index = NEG_USR32((unsigned)re_cache << TEX_VLC_BITS, -vlc_len) + dv_rl_vlc[index].level;
+            index = NEG_USR32(GET_CACHE(re, gb) << TEX_VLC_BITS, -vlc_len) + dv_rl_vlc[index].level;
             vlc_len = TEX_VLC_BITS - vlc_len;
         }
         level = dv_rl_vlc[index].level;
@@ -472,7 +472,7 @@ static void dv_decode_ac(GetBitContext *gb, BlockInfo *mb, DCTELEM *block)
         if (re_index + vlc_len > last_index) {
             /* should be < 16 bits otherwise a codeword could have been parsed */
             mb->partial_bit_count = last_index - re_index;
-            mb->partial_bit_buffer = NEG_USR32(re_cache, mb->partial_bit_count);
+            mb->partial_bit_buffer = SHOW_UBITS(re, gb, mb->partial_bit_count);
             re_index = last_index;
             break;
         }
@@ -533,13 +533,13 @@ static int dv_decode_video_segment(AVCodecContext *avctx, void *arg)
     GetBitContext gb;
     BlockInfo mb_data[5 * DV_MAX_BPM], *mb, *mb1;
     DECLARE_ALIGNED_16(DCTELEM, sblock)[5*DV_MAX_BPM][64];
-    DECLARE_ALIGNED_16(uint8_t, mb_bit_buffer)[80 + 4]; /* allow some slack */
-    DECLARE_ALIGNED_16(uint8_t, vs_bit_buffer)[5 * 80 + 4]; /* allow some slack */
+    DECLARE_ALIGNED_16(uint8_t, mb_bit_buffer)[80 + FF_INPUT_BUFFER_PADDING_SIZE]; /* allow some slack */
+    DECLARE_ALIGNED_16(uint8_t, vs_bit_buffer)[5 * 80 + FF_INPUT_BUFFER_PADDING_SIZE]; /* allow some slack */
     const int log2_blocksize = 3-s->avctx->lowres;
     int is_field_mode[5];
 
-    assert((((int)mb_bit_buffer) & 7) == 0);
-    assert((((int)vs_bit_buffer) & 7) == 0);
+    assert((((intptr_t)mb_bit_buffer) & 7) == 0);
+    assert((((intptr_t)vs_bit_buffer) & 7) == 0);
 
     memset(sblock, 0, sizeof(sblock));
 
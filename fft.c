@@ -101,8 +101,10 @@ av_cold int ff_fft_init(FFTContext *s, int nbits, int inverse)
     s->fft_calc    = ff_fft_calc_c;
     s->imdct_calc  = ff_imdct_calc_c;
     s->imdct_half  = ff_imdct_half_c;
+    s->imdct_half_batch = ff_imdct_half_batch_c;
     s->mdct_calc   = ff_mdct_calc_c;
     s->exptab1     = NULL;
+    s->twiddle_avx = NULL;
     s->split_radix = 1;
 
     if (ARCH_ARM)     ff_fft_init_arm(s);
@@ -166,6 +168,7 @@ av_cold int ff_fft_init(FFTContext *s, int nbits, int inverse)
     av_freep(&s->revtab);
     av_freep(&s->exptab);
     av_freep(&s->exptab1);
+    av_freep(&s->twiddle_avx);
     av_freep(&s->tmp_buf);
     return -1;
 }
@@ -200,6 +203,7 @@ av_cold void ff_fft_end(FFTContext *s)
     av_freep(&s->revtab);
     av_freep(&s->exptab);
     av_freep(&s->exptab1);
+    av_freep(&s->twiddle_avx);
     av_freep(&s->tmp_buf);
 }
 
@@ -25,6 +25,7 @@
  * FF Video Codec 1 (an experimental lossless codec)
  */
 
+#include "libavutil/intreadwrite.h"
 #include "avcodec.h"
 #include "get_bits.h"
 #include "put_bits.h"
@@ -32,8 +33,10 @@
 #include "rangecoder.h"
 #include "golomb.h"
 #include "mathops.h"
+#include "thread.h"
 
 #define MAX_PLANES 4
+#define MAX_SLICES 256
 #define CONTEXT_SIZE 32
 
 extern const uint8_t ff_log2_run[32];
@@ -217,6 +220,14 @@ typedef struct FFV1Context{
     int16_t quant_table[5][256];
     int run_index;
     int colorspace;
+    struct FFV1Context *fsrc;            ///< context of the previous frame thread, whose states a non keyframe continues from
+
+    int num_h_slices, num_v_slices;      ///< slice grid, 1x1 unless version >= 2
+    int slice_count;
+    struct FFV1Context *slice_context[MAX_SLICES]; ///< the first one is the context itself
+    int slice_x, slice_y;                ///< position of this slice in luma samples
+    int slice_width, slice_height;
+    int slice_bytes;                     ///< coded size of this slice (encoder)
 
     DSPContext dsp;
 }FFV1Context;
@@ -486,7 +497,7 @@ static inline int encode_line(FFV1Context *s, int w, int_fast16_t *sample[2], in
     return 0;
 }
 
-static void encode_plane(FFV1Context *s, uint8_t *src, int w, int h, int stride, int plane_index){
+static int encode_plane(FFV1Context *s, uint8_t *src, int w, int h, int stride, int plane_index){
     int x,y,i;
     const int ring_size= s->avctx->context_model ? 3 : 2;
     int_fast16_t sample_buffer[ring_size][w+6], *sample[ring_size];
@@ -505,18 +516,21 @@ static void encode_plane(FFV1Context *s, uint8_t *src, int w, int h, int stride,
             for(x=0; x<w; x++){
                 sample[0][x]= src[x + stride*y];
             }
-            encode_line(s, w, sample, plane_index, 8);
+            if(encode_line(s, w, sample, plane_index, 8) < 0)
+                return -1;
         }else{
             for(x=0; x<w; x++){
                 sample[0][x]= ((uint16_t*)(src + stride*y))[x] >> (16 - s->avctx->bits_per_raw_sample);
             }
-            encode_line(s, w, sample, plane_index, s->avctx->bits_per_raw_sample);
+            if(encode_line(s, w, sample, plane_index, s->avctx->bits_per_raw_sample) < 0)
+                return -1;
         }
 //STOP_TIMER("encode line")}
     }
+    return 0;
 }
 
-static void encode_rgb_frame(FFV1Context *s, uint32_t *src, int w, int h, int stride){
+static int encode_rgb_frame(FFV1Context *s, uint32_t *src, int w, int h, int stride){
     int x, y, p, i;
     const int ring_size= s->avctx->context_model ? 3 : 2;
     int_fast16_t sample_buffer[3][ring_size][w+6], *sample[3][ring_size];
@@ -550,9 +564,11 @@ static void encode_rgb_frame(FFV1Context *s, uint32_t *src, int w, int h, int st
         for(p=0; p<3; p++){
             sample[p][0][-1]= sample[p][1][0  ];
             sample[p][1][ w]= sample[p][1][w-1];
-            encode_line(s, w, sample[p], FFMIN(p, 1), 9);
+            if(encode_line(s, w, sample[p], FFMIN(p, 1), 9) < 0)
+                return -1;
         }
     }
+    return 0;
 }
 
 static void write_quant_table(RangeCoder *c, int16_t *quant_table){
@@ -589,6 +605,11 @@ static void write_header(FFV1Context *f){
 
     for(i=0; i<5; i++)
         write_quant_table(c, f->quant_table[i]);
+
+    if(f->version>1){
+        put_symbol(c, state, f->num_h_slices-1, 0);
+        put_symbol(c, state, f->num_v_slices-1, 0);
+    }
 }
 #endif /* CONFIG_FFV1_ENCODER */
 
@@ -608,6 +629,83 @@ static av_cold int common_init(AVCodecContext *avctx){
     return 0;
 }
 
+/**
+ * Sets up the contexts of the slice grid and copies the header parameters
+ * into them. The first slice is coded with the frame context itself.
+ */
+static int init_slice_contexts(FFV1Context *f){
+    const int xmask= (1<<f->chroma_h_shift) - 1;
+    const int ymask= (1<<f->chroma_v_shift) - 1;
+    int slice_count;
+    int i, j;
+
+    f->slice_count= 0;
+    /* checked one by one first, the product of two bogus values can wrap */
+    if(   f->num_h_slices < 1 || f->num_h_slices > MAX_SLICES
+       || f->num_v_slices < 1 || f->num_v_slices > MAX_SLICES)
+        return -1;
+    slice_count= f->num_h_slices * f->num_v_slices;
+    if(slice_count > MAX_SLICES)
+        return -1;
+
+    for(i=0; i<slice_count; i++){
+        FFV1Context *fs= f->slice_context[i];
+        int sx= i % f->num_h_slices;
+        int sy= i / f->num_h_slices;
+        int sxs= (f->width  *  sx    / f->num_h_slices) & ~xmask;
+        int sys= (f->height *  sy    / f->num_v_slices) & ~ymask;
+        int sxe= sx+1 < f->num_h_slices ? (f->width  * (sx+1) / f->num_h_slices) & ~xmask : f->width;
+        int sye= sy+1 < f->num_v_slices ? (f->height * (sy+1) / f->num_v_slices) & ~ymask : f->height;
+
+        if(sxe <= sxs || sye <= sys){
+            av_log(f->avctx, AV_LOG_ERROR, "slice %d is empty\n", i);
+            return -1;
+        }
+
+        if(!fs){
+            fs= i ? av_mallocz(sizeof(*fs)) : f;
+            if(!fs)
+                return AVERROR(ENOMEM);
+            f->slice_context[i]= fs;
+        }
+        fs->slice_x     = sxs;
+        fs->slice_y     = sys;
+        fs->slice_width = sxe - sxs;
+        fs->slice_height= sye - sys;
+        if(fs == f)
+            continue;
+
+        fs->avctx         = f->avctx;
+        fs->version       = f->version;
+        fs->ac            = f->ac;
+        fs->colorspace    = f->colorspace;
+        fs->chroma_h_shift= f->chroma_h_shift;
+        fs->chroma_v_shift= f->chroma_v_shift;
+        fs->plane_count   = f->plane_count;
+        memcpy(fs->quant_table, f->quant_table, sizeof(fs->quant_table));
+
+        for(j=0; j<f->plane_count; j++){
+            PlaneContext * const p= &fs->plane[j];
+            const PlaneContext * const p0= &f->plane[j];
+
+            if(p->context_count != p0->context_count){
+                av_freep(&p->state);
+                av_freep(&p->vlc_state);
+                p->context_count= p0->context_count;
+            }
+            if(p0->state && !p->state)
+                p->state= av_malloc(CONTEXT_SIZE*p->context_count*sizeof(uint8_t));
+            if(p0->vlc_state && !p->vlc_state)
+                p->vlc_state= av_malloc(p->context_count*sizeof(VlcState));
+            if((p0->state && !p->state) || (p0->vlc_state && !p->vlc_state))
+                return AVERROR(ENOMEM);
+        }
+    }
+    f->slice_count= slice_count;
+
+    return 0;
+}
+
 #if CONFIG_FFV1_ENCODER
 static av_cold int encode_init(AVCodecContext *avctx)
 {
@@ -695,6 +793,20 @@ static av_cold int encode_init(AVCodecContext *avctx)
     }
     avcodec_get_chroma_sub_sample(avctx->pix_fmt, &s->chroma_h_shift, &s->chroma_v_shift);
 
+    s->num_h_slices=
+    s->num_v_slices= 1;
+    if(avctx->thread_count > 1){
+        if(avctx->strict_std_compliance > FF_COMPLIANCE_EXPERIMENTAL){
+            av_log(avctx, AV_LOG_WARNING, "Multiple slices are still experimental, coding a single slice.\n"
+               "Use vstrict=-2 / -strict -2 to use them anyway.\n");
+        }else{
+            s->version= 2;
+            s->num_v_slices= av_clip(avctx->thread_count, 1, FFMIN(FFMAX(s->height / 16, 1), MAX_SLICES));
+        }
+    }
+    if(init_slice_contexts(s) < 0)
+        return -1;
+
     s->picture_number=0;
 
     return 0;
@@ -703,37 +815,99 @@ static av_cold int encode_init(AVCodecContext *avctx)
 
 
 static void clear_state(FFV1Context *f){
-    int i, j;
+    int i, j, si;
 
-    for(i=0; i<f->plane_count; i++){
-        PlaneContext *p= &f->plane[i];
+    for(si=0; si<f->slice_count; si++){
+        FFV1Context *fs= f->slice_context[si];
 
-        p->interlace_bit_state[0]= 128;
-        p->interlace_bit_state[1]= 128;
+        for(i=0; i<f->plane_count; i++){
+            PlaneContext *p= &fs->plane[i];
 
-        for(j=0; j<p->context_count; j++){
-            if(f->ac){
-                memset(p->state[j], 128, sizeof(uint8_t)*CONTEXT_SIZE);
-            }else{
-                p->vlc_state[j].drift= 0;
-                p->vlc_state[j].error_sum= 4; //FFMAX((RANGE + 32)/64, 2);
-                p->vlc_state[j].bias= 0;
-                p->vlc_state[j].count= 1;
+            p->interlace_bit_state[0]= 128;
+            p->interlace_bit_state[1]= 128;
+
+            for(j=0; j<p->context_count; j++){
+                if(f->ac){
+                    memset(p->state[j], 128, sizeof(uint8_t)*CONTEXT_SIZE);
+                }else{
+                    p->vlc_state[j].drift= 0;
+                    p->vlc_state[j].error_sum= 4; //FFMAX((RANGE + 32)/64, 2);
+                    p->vlc_state[j].bias= 0;
+                    p->vlc_state[j].count= 1;
+                }
             }
         }
     }
 }
 
 #if CONFIG_FFV1_ENCODER
+/**
+ * Codes one slice of f->picture into the range coder of its slice context,
+ * which must have been set up already; sets slice_bytes.
+ * @return <0 if the slice did not fit into its part of the buffer
+ */
+static int encode_slice(AVCodecContext *avctx, void *arg, int jobnr, int threadnr){
+    FFV1Context *f = avctx->priv_data;
+    FFV1Context *fs= f->slice_context[jobnr];
+    AVFrame * const p= &f->picture;
+    const int x= fs->slice_x;
+    const int y= fs->slice_y;
+    const int width = fs->slice_width;
+    const int height= fs->slice_height;
+    const int ps= 1 + (avctx->bits_per_raw_sample > 8); //bytes per sample
+    int used_count= 0;
+    int ret;
+
+    if(f->version>1){
+        uint8_t state[CONTEXT_SIZE];
+        memset(state, 128, sizeof(state));
+        put_symbol(&fs->c, state, jobnr, 0);
+    }
+
+    if(!f->ac){
+        used_count= ff_rac_terminate(&fs->c);
+        init_put_bits(&fs->pb, fs->c.bytestream_start + used_count,
+                      fs->c.bytestream_end - fs->c.bytestream_start - used_count);
+    }
+
+    if(f->colorspace==0){
+        const int chroma_width = -((-width )>>f->chroma_h_shift);
+        const int chroma_height= -((-height)>>f->chroma_v_shift);
+        const int cx= x>>f->chroma_h_shift;
+        const int cy= y>>f->chroma_v_shift;
+
+        ret= encode_plane(fs, p->data[0] + ps*x  + y *p->linesize[0], width, height, p->linesize[0], 0);
+
+        if(ret >= 0)
+            ret= encode_plane(fs, p->data[1] + ps*cx + cy*p->linesize[1], chroma_width, chroma_height, p->linesize[1], 1);
+        if(ret >= 0)
+            ret= encode_plane(fs, p->data[2] + ps*cx + cy*p->linesize[2], chroma_width, chroma_height, p->linesize[2], 1);
+    }else{
+        ret= encode_rgb_frame(fs, (uint32_t*)(p->data[0]) + x + y*(p->linesize[0]/4), width, height, p->linesize[0]/4);
+    }
+    emms_c();
+    if(ret < 0)
+        return ret;
+
+    if(f->ac){
+        fs->slice_bytes= ff_rac_terminate(&fs->c);
+    }else{
+        flush_put_bits(&fs->pb); //nicer padding FIXME
+        fs->slice_bytes= used_count + (put_bits_count(&fs->pb)+7)/8;
+    }
+
+    return 0;
+}
+
 static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
     FFV1Context *f = avctx->priv_data;
     RangeCoder * const c= &f->c;
     AVFrame *pict = data;
-    const int width= f->width;
-    const int height= f->height;
     AVFrame * const p= &f->picture;
-    int used_count= 0;
     uint8_t keystate=128;
+    uint8_t *buf_p;
+    int i, header_size, slice_size;
+    int ret[MAX_SLICES];
 
     ff_init_range_encoder(c, buf, buf_size);
     ff_build_rac_states(c, 0.05*(1LL<<32), 256-8);
@@ -751,39 +925,54 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
         p->key_frame= 0;
     }
 
-    if(!f->ac){
-        used_count += ff_rac_terminate(c);
-//printf("pos=%d\n", used_count);
-        init_put_bits(&f->pb, buf + used_count, buf_size - used_count);
-    }
+    f->picture_number++;
 
-    if(f->colorspace==0){
-        const int chroma_width = -((-width )>>f->chroma_h_shift);
-        const int chroma_height= -((-height)>>f->chroma_v_shift);
+    if(f->version<2){
+        if(encode_slice(avctx, NULL, 0, 0) < 0)
+            return -1;
+        return f->slice_bytes;
+    }
 
-        encode_plane(f, p->data[0], width, height, p->linesize[0], 0);
+    /* Every slice is coded into its own part of the buffer, followed by its
+     * size in 3 bytes, so that the decoder can find them from the end. */
+    header_size= ff_rac_terminate(c);
+    slice_size = (buf_size - header_size) / f->slice_count;
+    /* the size field has 24 bits, larger slices could not be signalled */
+    slice_size = FFMIN(slice_size, (1<<24) - 1 + 3);
+    if(slice_size <= 3){
+        av_log(avctx, AV_LOG_ERROR, "encoded frame too large\n");
+        return -1;
+    }
+    for(i=0; i<f->slice_count; i++){
+        FFV1Context *fs= f->slice_context[i];
 
-        encode_plane(f, p->data[1], chroma_width, chroma_height, p->linesize[1], 1);
-        encode_plane(f, p->data[2], chroma_width, chroma_height, p->linesize[2], 1);
-    }else{
-        encode_rgb_frame(f, (uint32_t*)(p->data[0]), width, height, p->linesize[0]/4);
+        ff_init_range_encoder(&fs->c, buf + header_size + i*slice_size, slice_size - 3);
+        ff_build_rac_states(&fs->c, 0.05*(1LL<<32), 256-8);
     }
-    emms_c();
 
-    f->picture_number++;
+    avctx->execute2(avctx, encode_slice, NULL, ret, f->slice_count);
+    for(i=0; i<f->slice_count; i++)
+        if(ret[i] < 0)
+            return -1;
 
-    if(f->ac){
-        return ff_rac_terminate(c);
-    }else{
-        flush_put_bits(&f->pb); //nicer padding FIXME
-        return used_count + (put_bits_count(&f->pb)+7)/8;
+    buf_p= buf + header_size;
+    for(i=0; i<f->slice_count; i++){
+        FFV1Context *fs= f->slice_context[i];
+
+        if(fs->c.bytestream_start != buf_p)
+            memmove(buf_p, fs->c.bytestream_start, fs->slice_bytes);
+        buf_p += fs->slice_bytes;
+        AV_WB24(buf_p, fs->slice_bytes);
+        buf_p += 3;
     }
+
+    return buf_p - buf;
 }
 #endif /* CONFIG_FFV1_ENCODER */
 
 static av_cold int common_end(AVCodecContext *avctx){
     FFV1Context *s = avctx->priv_data;
-    int i;
+    int i, j;
 
     for(i=0; i<s->plane_count; i++){
         PlaneContext *p= &s->plane[i];
@@ -792,9 +981,30 @@ static av_cold int common_end(AVCodecContext *avctx){
         av_freep(&p->vlc_state);
     }
 
+    for(j=1; j<MAX_SLICES; j++){
+        FFV1Context *fs= s->slice_context[j];
+
+        if(!fs)
+            continue;
+        for(i=0; i<fs->plane_count; i++){
+            av_freep(&fs->plane[i].state);
+            av_freep(&fs->plane[i].vlc_state);
+        }
+        av_freep(&s->slice_context[j]);
+    }
+
     return 0;
 }
 
+static av_cold int decode_end(AVCodecContext *avctx){
+    FFV1Context *s = avctx->priv_data;
+
+    if(s->picture.data[0])
+        ff_thread_release_buffer(avctx, &s->picture);
+
+    return common_end(avctx);
+}
+
 static av_always_inline void decode_line(FFV1Context *s, int w, int_fast16_t *sample[2], int plane_index, int bits){
     PlaneContext * const p= &s->plane[plane_index];
     RangeCoder * const c= &s->c;
@@ -1022,6 +1232,14 @@ static int read_header(FFV1Context *f){
     }
     context_count= (context_count+1)/2;
 
+    if(f->version>1){
+        f->num_h_slices= get_symbol(c, state, 0) + 1;
+        f->num_v_slices= get_symbol(c, state, 0) + 1;
+    }else{
+        f->num_h_slices=
+        f->num_v_slices= 1;
+    }
+
     for(i=0; i<f->plane_count; i++){
         PlaneContext * const p= &f->plane[i];
 
@@ -1034,6 +1252,11 @@ static int read_header(FFV1Context *f){
         }
     }
 
+    if(init_slice_contexts(f) < 0){
+        av_log(f->avctx, AV_LOG_ERROR, "invalid slice layout %dx%d\n", f->num_h_slices, f->num_v_slices);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -1046,15 +1269,148 @@ static av_cold int decode_init(AVCodecContext *avctx)
     return 0;
 }
 
+static av_cold int decode_init_thread_copy(AVCodecContext *avctx)
+{
+    FFV1Context *f = avctx->priv_data;
+    int i;
+
+    f->avctx= avctx;
+    f->fsrc= NULL;
+    for(i=0; i<MAX_PLANES; i++){
+        f->plane[i].state= NULL;
+        f->plane[i].vlc_state= NULL;
+    }
+    f->slice_count= 0;
+    memset(f->slice_context, 0, sizeof(f->slice_context));
+
+    return 0;
+}
+
+static int decode_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    FFV1Context *fdst = dst->priv_data, *fsrc = src->priv_data;
+    int i;
+
+    if(dst == src) return 0;
+
+    fdst->version       = fsrc->version;
+    fdst->ac            = fsrc->ac;
+    fdst->colorspace    = fsrc->colorspace;
+    fdst->chroma_h_shift= fsrc->chroma_h_shift;
+    fdst->chroma_v_shift= fsrc->chroma_v_shift;
+    fdst->plane_count   = fsrc->plane_count;
+    memcpy(fdst->quant_table, fsrc->quant_table, sizeof(fdst->quant_table));
+
+    for(i=0; i<fdst->plane_count; i++){
+        PlaneContext * const p= &fdst->plane[i];
+        const PlaneContext * const psrc= &fsrc->plane[i];
+
+        if(p->context_count != psrc->context_count){
+            av_freep(&p->state);
+            av_freep(&p->vlc_state);
+            p->context_count= psrc->context_count;
+        }
+        if(psrc->state && !p->state)
+            p->state= av_malloc(CONTEXT_SIZE*p->context_count*sizeof(uint8_t));
+        if(psrc->vlc_state && !p->vlc_state)
+            p->vlc_state= av_malloc(p->context_count*sizeof(VlcState));
+        if((psrc->state && !p->state) || (psrc->vlc_state && !p->vlc_state))
+            return AVERROR(ENOMEM);
+    }
+
+    fdst->num_h_slices= fsrc->num_h_slices;
+    fdst->num_v_slices= fsrc->num_v_slices;
+    if(fsrc->slice_count && init_slice_contexts(fdst) < 0)
+        return -1;
+
+    fdst->fsrc= fsrc;
+
+    return 0;
+}
+
+/**
+ * Continues the context model of the previous frame in a non keyframe.
+ * The states are only final once the previous thread is done with its
+ * frame, so this waits for it to finish decoding.
+ */
+static void copy_states(FFV1Context *f, FFV1Context *fsrc){
+    int i, j;
+
+    ff_thread_await_progress(&fsrc->picture, INT_MAX, 0);
+
+    for(j=0; j<FFMIN(f->slice_count, fsrc->slice_count); j++){
+        FFV1Context * const fs= f->slice_context[j];
+        const FFV1Context * const fssrc= fsrc->slice_context[j];
+
+        for(i=0; i<f->plane_count; i++){
+            PlaneContext * const p= &fs->plane[i];
+            const PlaneContext * const psrc= &fssrc->plane[i];
+
+            memcpy(p->interlace_bit_state, psrc->interlace_bit_state, sizeof(p->interlace_bit_state));
+            if(p->state && psrc->state)
+                memcpy(p->state, psrc->state, CONTEXT_SIZE*p->context_count*sizeof(uint8_t));
+            if(p->vlc_state && psrc->vlc_state)
+                memcpy(p->vlc_state, psrc->vlc_state, p->context_count*sizeof(VlcState));
+        }
+    }
+}
+
+/**
+ * Decodes one slice into f->picture. The range coder of the slice context
+ * must already point to the slice data.
+ */
+static int decode_slice(AVCodecContext *avctx, void *arg, int jobnr, int threadnr){
+    FFV1Context *f = avctx->priv_data;
+    FFV1Context *fs= f->slice_context[jobnr];
+    AVFrame * const p= &f->picture;
+    const int x= fs->slice_x;
+    const int y= fs->slice_y;
+    const int width = fs->slice_width;
+    const int height= fs->slice_height;
+    const int ps= 1 + (avctx->bits_per_raw_sample > 8); //bytes per sample
+
+    if(f->version>1){
+        uint8_t state[CONTEXT_SIZE];
+        memset(state, 128, sizeof(state));
+        if(get_symbol(&fs->c, state, 0) != jobnr){
+            av_log(avctx, AV_LOG_ERROR, "slice %d header damaged\n", jobnr);
+            return -1;
+        }
+    }
+
+    if(!f->ac){
+        const int bytes_read= fs->c.bytestream - fs->c.bytestream_start - 1;
+        if(bytes_read ==0) av_log(avctx, AV_LOG_ERROR, "error at end of AC stream\n"); //FIXME
+        init_get_bits(&fs->gb, fs->c.bytestream_start + bytes_read,
+                      fs->c.bytestream_end - fs->c.bytestream_start - bytes_read);
+    }
+
+    if(f->colorspace==0){
+        const int chroma_width = -((-width )>>f->chroma_h_shift);
+        const int chroma_height= -((-height)>>f->chroma_v_shift);
+        const int cx= x>>f->chroma_h_shift;
+        const int cy= y>>f->chroma_v_shift;
+
+        decode_plane(fs, p->data[0] + ps*x  + y *p->linesize[0], width, height, p->linesize[0], 0);
+
+        decode_plane(fs, p->data[1] + ps*cx + cy*p->linesize[1], chroma_width, chroma_height, p->linesize[1], 1);
+        decode_plane(fs, p->data[2] + ps*cx + cy*p->linesize[2], chroma_width, chroma_height, p->linesize[2], 1);
+    }else{
+        decode_rgb_frame(fs, (uint32_t*)p->data[0] + x + y*(p->linesize[0]/4), width, height, p->linesize[0]/4);
+    }
+
+    emms_c();
+
+    return 0;
+}
+
 static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt){
     const uint8_t *buf = avpkt->data;
     int buf_size = avpkt->size;
     FFV1Context *f = avctx->priv_data;
     RangeCoder * const c= &f->c;
-    const int width= f->width;
-    const int height= f->height;
     AVFrame * const p= &f->picture;
-    int bytes_read;
+    int i, bytes_read;
     uint8_t keystate= 128;
 
     AVFrame *picture = data;
@@ -1072,53 +1428,70 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     }else{
         p->key_frame= 0;
     }
-    if(!f->plane[0].state && !f->plane[0].vlc_state)
+    if(!f->slice_count || (!f->plane[0].state && !f->plane[0].vlc_state))
         return -1;
 
+    if(f->version>1){
+        /* the slices are found from the end, each is followed by its size */
+        const uint8_t *buf_p= buf + buf_size;
+
+        for(i=f->slice_count-1; i>=0; i--){
+            FFV1Context *fs= f->slice_context[i];
+            int slice_size;
+
+            if(buf_p - buf < 3 + 2)
+                slice_size= -1;
+            else{
+                buf_p -= 3;
+                slice_size= AV_RB24(buf_p);
+            }
+            if(slice_size < 2 || slice_size > buf_p - buf){
+                av_log(avctx, AV_LOG_ERROR, "slice %d size invalid\n", i);
+                return -1;
+            }
+            buf_p -= slice_size;
+
+            ff_init_range_decoder(&fs->c, buf_p, slice_size);
+            ff_build_rac_states(&fs->c, 0.05*(1LL<<32), 256-8);
+        }
+    }
+
+    if(p->data[0])
+        ff_thread_release_buffer(avctx, p);
+
     p->reference= 0;
-    if(avctx->get_buffer(avctx, p) < 0){
+    if(ff_thread_get_buffer(avctx, p) < 0){
         av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
         return -1;
     }
 
+    if(!p->key_frame && f->fsrc)
+        copy_states(f, f->fsrc);
+    ff_thread_finish_setup(avctx);
+
     if(avctx->debug&FF_DEBUG_PICT_INFO)
         av_log(avctx, AV_LOG_ERROR, "keyframe:%d coder:%d\n", p->key_frame, f->ac);
 
-    if(!f->ac){
-        bytes_read = c->bytestream - c->bytestream_start - 1;
-        if(bytes_read ==0) av_log(avctx, AV_LOG_ERROR, "error at end of AC stream\n"); //FIXME
-//printf("pos=%d\n", bytes_read);
-        init_get_bits(&f->gb, buf + bytes_read, buf_size - bytes_read);
-    } else {
-        bytes_read = 0; /* avoid warning */
-    }
+    if(f->version>1)
+        avctx->execute2(avctx, decode_slice, NULL, NULL, f->slice_count);
+    else
+        decode_slice(avctx, NULL, 0, 0);
 
-    if(f->colorspace==0){
-        const int chroma_width = -((-width )>>f->chroma_h_shift);
-        const int chroma_height= -((-height)>>f->chroma_v_shift);
-        decode_plane(f, p->data[0], width, height, p->linesize[0], 0);
-
-        decode_plane(f, p->data[1], chroma_width, chroma_height, p->linesize[1], 1);
-        decode_plane(f, p->data[2], chroma_width, chroma_height, p->linesize[2], 1);
-    }else{
-        decode_rgb_frame(f, (uint32_t*)p->data[0], width, height, p->linesize[0]/4);
-    }
-
-    emms_c();
+    ff_thread_report_progress(p, INT_MAX, 0);
 
     f->picture_number++;
 
     *picture= *p;
 
-    avctx->release_buffer(avctx, p); //FIXME
-
     *data_size = sizeof(AVFrame);
 
-    if(f->ac){
+    if(f->version>1){
+        bytes_read= buf_size;
+    }else if(f->ac){
         bytes_read= c->bytestream - c->bytestream_start - 1;
         if(bytes_read ==0) av_log(f->avctx, AV_LOG_ERROR, "error at end of frame\n");
     }else{
-        bytes_read+= (get_bits_count(&f->gb)+7)/8;
+        bytes_read= f->gb.buffer - buf + (get_bits_count(&f->gb)+7)/8;
     }
 
     return bytes_read;
@@ -1131,11 +1504,13 @@ AVCodec ffv1_decoder = {
     sizeof(FFV1Context),
     decode_init,
     NULL,
-    common_end,
+    decode_end,
     decode_frame,
-    CODEC_CAP_DR1 /*| CODEC_CAP_DRAW_HORIZ_BAND*/,
+    CODEC_CAP_DR1 | CODEC_CAP_FRAME_THREADS /*| CODEC_CAP_DRAW_HORIZ_BAND*/,
     NULL,
     .long_name= NULL_IF_CONFIG_SMALL("FFmpeg video codec #1"),
+    .init_thread_copy      = decode_init_thread_copy,
+    .update_thread_context = decode_update_thread_context,
 };
 
 #if CONFIG_FFV1_ENCODER
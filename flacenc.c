@@ -457,25 +457,34 @@ static uint32_t calc_optimal_rice_params(RiceContext *rc, int porder,
     return all_bits;
 }
 
-static void calc_sums(int pmin, int pmax, uint32_t *data, int n, int pred_order,
-                      uint32_t sums[][MAX_PARTITIONS])
+/**
+ * Sums of the folded residual for the highest partition order.
+ */
+void ff_flac_calc_sums(uint32_t *sums, const int32_t *res, int n,
+                       int pred_order, int porder)
 {
     int i, j;
-    int parts;
-    uint32_t *res, *res_end;
+    int parts = 1 << porder;
+    int end = n >> porder;
 
-    /* sums for highest level */
-    parts = (1 << pmax);
-    res = &data[pred_order];
-    res_end = &data[n >> pmax];
-    for(i=0; i<parts; i++) {
+    for(i=0, j=pred_order; i<parts; i++) {
         uint32_t sum = 0;
-        while(res < res_end){
-            sum += *(res++);
-        }
-        sums[pmax][i] = sum;
-        res_end+= n >> pmax;
+        for(; j<end; j++)
+            sum += (2*res[j]) ^ (res[j]>>31);
+        sums[i] = sum;
+        end += n >> porder;
     }
+}
+
+static void calc_sums(DSPContext *dsp, int pmin, int pmax, int32_t *data,
+                      int n, int pred_order, uint32_t sums[][MAX_PARTITIONS])
+{
+    int i, j;
+    int parts;
+
+    /* sums for highest level */
+    dsp->flac_calc_sums(sums[pmax], data, n, pred_order, pmax);
+
     /* sums for lower levels */
     for(i=pmax-1; i>=pmin; i--) {
         parts = (1 << i);
@@ -485,26 +494,21 @@ static void calc_sums(int pmin, int pmax, uint32_t *data, int n, int pred_order,
     }
 }
 
-static uint32_t calc_rice_params(RiceContext *rc, int pmin, int pmax,
+static uint32_t calc_rice_params(DSPContext *dsp, RiceContext *rc,
+                                 int pmin, int pmax,
                                  int32_t *data, int n, int pred_order)
 {
     int i;
     uint32_t bits[MAX_PARTITION_ORDER+1];
     int opt_porder;
     RiceContext tmp_rc;
-    uint32_t *udata;
     uint32_t sums[MAX_PARTITION_ORDER+1][MAX_PARTITIONS];
 
     assert(pmin >= 0 && pmin <= MAX_PARTITION_ORDER);
     assert(pmax >= 0 && pmax <= MAX_PARTITION_ORDER);
     assert(pmin <= pmax);
 
-    udata = av_malloc(n * sizeof(uint32_t));
-    for(i=0; i<n; i++) {
-        udata[i] = (2*data[i]) ^ (data[i]>>31);
-    }
-
-    calc_sums(pmin, pmax, udata, n, pred_order, sums);
+    calc_sums(dsp, pmin, pmax, data, n, pred_order, sums);
 
     opt_porder = pmin;
     bits[pmin] = UINT32_MAX;
@@ -516,7 +520,6 @@ static uint32_t calc_rice_params(RiceContext *rc, int pmin, int pmax,
         }
     }
 
-    av_freep(&udata);
     return bits[opt_porder];
 }
 
@@ -528,7 +531,8 @@ static int get_max_p_order(int max_porder, int n, int order)
     return porder;
 }
 
-static uint32_t calc_rice_params_fixed(RiceContext *rc, int pmin, int pmax,
+static uint32_t calc_rice_params_fixed(DSPContext *dsp, RiceContext *rc,
+                                       int pmin, int pmax,
                                        int32_t *data, int n, int pred_order,
                                        int bps)
 {
@@ -536,11 +540,12 @@ static uint32_t calc_rice_params_fixed(RiceContext *rc, int pmin, int pmax,
     pmin = get_max_p_order(pmin, n, pred_order);
     pmax = get_max_p_order(pmax, n, pred_order);
     bits = pred_order*bps + 6;
-    bits += calc_rice_params(rc, pmin, pmax, data, n, pred_order);
+    bits += calc_rice_params(dsp, rc, pmin, pmax, data, n, pred_order);
     return bits;
 }
 
-static uint32_t calc_rice_params_lpc(RiceContext *rc, int pmin, int pmax,
+static uint32_t calc_rice_params_lpc(DSPContext *dsp, RiceContext *rc,
+                                     int pmin, int pmax,
                                      int32_t *data, int n, int pred_order,
                                      int bps, int precision)
 {
@@ -548,7 +553,7 @@ static uint32_t calc_rice_params_lpc(RiceContext *rc, int pmin, int pmax,
     pmin = get_max_p_order(pmin, n, pred_order);
     pmax = get_max_p_order(pmax, n, pred_order);
     bits = pred_order*bps + 4 + 5 + pred_order*precision + 6;
-    bits += calc_rice_params(rc, pmin, pmax, data, n, pred_order);
+    bits += calc_rice_params(dsp, rc, pmin, pmax, data, n, pred_order);
     return bits;
 }
 
@@ -558,8 +563,8 @@ static void encode_residual_verbatim(int32_t *res, int32_t *smp, int n)
     memcpy(res, smp, n * sizeof(int32_t));
 }
 
-static void encode_residual_fixed(int32_t *res, const int32_t *smp, int n,
-                                  int order)
+void ff_flac_encode_residual_fixed(int32_t *res, const int32_t *smp, int n,
+                                   int order)
 {
     int i;
 
@@ -676,8 +681,8 @@ static av_always_inline void encode_residual_lpc_unrolled(
     }
 }
 
-static void encode_residual_lpc(int32_t *res, const int32_t *smp, int n,
-                                int order, const int32_t *coefs, int shift)
+void ff_flac_encode_residual_lpc(int32_t *res, const int32_t *smp, int n,
+                                 int order, const int32_t *coefs, int shift)
 {
     int i;
     for(i=0; i<order; i++) {
@@ -760,9 +765,9 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
         opt_order = 0;
         bits[0] = UINT32_MAX;
         for(i=min_order; i<=max_order; i++) {
-            encode_residual_fixed(res, smp, n, i);
-            bits[i] = calc_rice_params_fixed(&sub->rc, min_porder, max_porder, res,
-                                             n, i, sub->obits);
+            ctx->dsp.flac_encode_residual_fixed(res, smp, n, i);
+            bits[i] = calc_rice_params_fixed(&ctx->dsp, &sub->rc, min_porder,
+                                             max_porder, res, n, i, sub->obits);
             if(bits[i] < bits[opt_order]) {
                 opt_order = i;
             }
@@ -771,9 +776,10 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
         sub->type = FLAC_SUBFRAME_FIXED;
         sub->type_code = sub->type | sub->order;
         if(sub->order != max_order) {
-            encode_residual_fixed(res, smp, n, sub->order);
-            return calc_rice_params_fixed(&sub->rc, min_porder, max_porder, res, n,
-                                          sub->order, sub->obits);
+            ctx->dsp.flac_encode_residual_fixed(res, smp, n, sub->order);
+            return calc_rice_params_fixed(&ctx->dsp, &sub->rc, min_porder,
+                                          max_porder, res, n, sub->order,
+                                          sub->obits);
         }
         return bits[sub->order];
     }
@@ -795,8 +801,9 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
         for(i=levels-1; i>=0; i--) {
             order = min_order + (((max_order-min_order+1) * (i+1)) / levels)-1;
             if(order < 0) order = 0;
-            encode_residual_lpc(res, smp, n, order+1, coefs[order], shift[order]);
-            bits[i] = calc_rice_params_lpc(&sub->rc, min_porder, max_porder,
+            ctx->dsp.flac_encode_residual_lpc(res, smp, n, order+1,
+                                              coefs[order], shift[order]);
+            bits[i] = calc_rice_params_lpc(&ctx->dsp, &sub->rc, min_porder, max_porder,
                                            res, n, order+1, sub->obits, precision);
             if(bits[i] < bits[opt_index]) {
                 opt_index = i;
@@ -810,8 +817,8 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
         opt_order = 0;
         bits[0] = UINT32_MAX;
         for(i=min_order-1; i<max_order; i++) {
-            encode_residual_lpc(res, smp, n, i+1, coefs[i], shift[i]);
-            bits[i] = calc_rice_params_lpc(&sub->rc, min_porder, max_porder,
+            ctx->dsp.flac_encode_residual_lpc(res, smp, n, i+1, coefs[i], shift[i]);
+            bits[i] = calc_rice_params_lpc(&ctx->dsp, &sub->rc, min_porder, max_porder,
                                            res, n, i+1, sub->obits, precision);
             if(bits[i] < bits[opt_order]) {
                 opt_order = i;
@@ -830,8 +837,8 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
             for(i=last-step; i<=last+step; i+= step){
                 if(i<min_order-1 || i>=max_order || bits[i] < UINT32_MAX)
                     continue;
-                encode_residual_lpc(res, smp, n, i+1, coefs[i], shift[i]);
-                bits[i] = calc_rice_params_lpc(&sub->rc, min_porder, max_porder,
+                ctx->dsp.flac_encode_residual_lpc(res, smp, n, i+1, coefs[i], shift[i]);
+                bits[i] = calc_rice_params_lpc(&ctx->dsp, &sub->rc, min_porder, max_porder,
                                             res, n, i+1, sub->obits, precision);
                 if(bits[i] < bits[opt_order])
                     opt_order= i;
@@ -847,9 +854,19 @@ static int encode_residual(FlacEncodeContext *ctx, int ch)
     for(i=0; i<sub->order; i++) {
         sub->coefs[i] = coefs[sub->order-1][i];
     }
-    encode_residual_lpc(res, smp, n, sub->order, sub->coefs, sub->shift);
-    return calc_rice_params_lpc(&sub->rc, min_porder, max_porder, res, n, sub->order,
-                                sub->obits, precision);
+    ctx->dsp.flac_encode_residual_lpc(res, smp, n, sub->order, sub->coefs, sub->shift);
+    return calc_rice_params_lpc(&ctx->dsp, &sub->rc, min_porder, max_porder,
+                                res, n, sub->order, sub->obits, precision);
+}
+
+/**
+ * Channels are coded independently after the decorrelation, so each one is
+ * a separate job. The result does not depend on the number of threads.
+ */
+static int encode_residual_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    encode_residual(avctx->priv_data, jobnr);
+    return 0;
 }
 
 static int encode_residual_v(FlacEncodeContext *ctx, int ch)
@@ -1202,9 +1219,7 @@ static int flac_encode_frame(AVCodecContext *avctx, uint8_t *frame,
 
     channel_decorrelation(s);
 
-    for(ch=0; ch<s->channels; ch++) {
-        encode_residual(s, ch);
-    }
+    avctx->execute2(avctx, encode_residual_thread, NULL, NULL, s->channels);
 
 write_frame:
     init_put_bits(&s->pb, frame, buf_size);
@@ -119,9 +119,11 @@ CLOSE_READER(name, gb)
 UPDATE_CACHE(name, gb)
     refills the internal cache from the bitstream
     after this call at least MIN_CACHE_BITS will be available,
+    and UPDATE_CACHE_BITS can be read with SKIP_BITS / SKIP_CACHE
+    before the next UPDATE_CACHE is needed
 
 GET_CACHE(name, gb)
-    will output the contents of the internal cache, next bit is MSB of 32 or 64 bit (FIXME 64bit)
+    will output the contents of the internal cache, next bit is MSB of 32 bit
 
 SHOW_UBITS(name, gb, num)
     will return the next num bits
@@ -151,9 +153,20 @@ for examples see get_bits, show_bits, skip_bits, get_vlc
 #ifdef ALT_BITSTREAM_READER
 #   define MIN_CACHE_BITS 25
 
+/* with a 64 bit cache several codes can be read per UPDATE_CACHE,
+ * so that the load is not on the critical path of every code */
+# if HAVE_FAST_64BIT && !defined(ALT_BITSTREAM_READER_LE)
+#   define ALT_BITSTREAM_READER_64
+#   define UPDATE_CACHE_BITS 57
+#   define ALT_CACHE_TYPE uint64_t
+# else
+#   define UPDATE_CACHE_BITS 25
+#   define ALT_CACHE_TYPE unsigned int
+# endif
+
 #   define OPEN_READER(name, gb)\
         int name##_index= (gb)->index;\
-        int name##_cache= 0;\
+        ALT_CACHE_TYPE name##_cache= 0;\
 
 #   define CLOSE_READER(name, gb)\
         (gb)->index= name##_index;\
@@ -164,6 +177,12 @@ for examples see get_bits, show_bits, skip_bits, get_vlc
 
 #   define SKIP_CACHE(name, gb, num)\
         name##_cache >>= (num);
+# elif defined ALT_BITSTREAM_READER_64
+#   define UPDATE_CACHE(name, gb)\
+        name##_cache= AV_RB64( ((const uint8_t *)(gb)->buffer)+(name##_index>>3) ) << (name##_index&0x07);\
+
+#   define SKIP_CACHE(name, gb, num)\
+        name##_cache <<= (num);
 # else
 #   define UPDATE_CACHE(name, gb)\
         name##_cache= AV_RB32( ((const uint8_t *)(gb)->buffer)+(name##_index>>3) ) << (name##_index&0x07);\
@@ -191,6 +210,12 @@ for examples see get_bits, show_bits, skip_bits, get_vlc
 
 #   define SHOW_SBITS(name, gb, num)\
         NEG_SSR32((name##_cache)<<(32-(num)), num)
+# elif defined ALT_BITSTREAM_READER_64
+#   define SHOW_UBITS(name, gb, num)\
+        ((uint32_t)(name##_cache >> (64-(num))))
+
+#   define SHOW_SBITS(name, gb, num)\
+        ((int32_t)((int64_t)name##_cache >> (64-(num))))
 # else
 #   define SHOW_UBITS(name, gb, num)\
         NEG_USR32(name##_cache, num)
@@ -199,8 +224,13 @@ for examples see get_bits, show_bits, skip_bits, get_vlc
         NEG_SSR32(name##_cache, num)
 # endif
 
+# ifdef ALT_BITSTREAM_READER_64
+#   define GET_CACHE(name, gb)\
+        ((uint32_t)(name##_cache >> 32))
+# else
 #   define GET_CACHE(name, gb)\
         ((uint32_t)name##_cache)
+# endif
 
 static inline int get_bits_count(GetBitContext *s){
     return s->index;
@@ -214,6 +244,7 @@ static inline void skip_bits_long(GetBitContext *s, int n){
 //libmpeg2 like reader
 
 #   define MIN_CACHE_BITS 17
+#   define UPDATE_CACHE_BITS 17
 
 #   define OPEN_READER(name, gb)\
         int name##_bit_count=(gb)->bit_count;\
@@ -273,6 +304,7 @@ static inline void skip_bits_long(GetBitContext *s, int n){
 #elif defined A32_BITSTREAM_READER
 
 #   define MIN_CACHE_BITS 32
+#   define UPDATE_CACHE_BITS 32
 
 #   define OPEN_READER(name, gb)\
         int name##_bit_count=(gb)->bit_count;\
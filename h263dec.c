@@ -36,6 +36,7 @@
 #include "vdpau_internal.h"
 #include "flv.h"
 #include "mpeg4video.h"
+#include "thread.h"
 
 //#define DEBUG
 //#define PRINT_FRAME_TIME
@@ -198,6 +199,12 @@ static int decode_slice(MpegEncContext *s){
             s->last_dc[2]= 128;
         }
 
+        /* direct mode and skipped MBs of B-frames use the motion vectors
+         * and skip flags of the colocated MBs in the next picture, the
+         * end of slice check also peeks at the following row */
+        if(s->codec_id==CODEC_ID_MPEG4 && s->pict_type==FF_B_TYPE)
+            ff_thread_await_progress((AVFrame*)s->next_picture_ptr, FFMIN(s->mb_y+1, s->mb_height-1), 0);
+
         ff_init_block_index(s);
         for(; s->mb_x < s->mb_width; s->mb_x++) {
             int ret;
@@ -234,6 +241,7 @@ static int decode_slice(MpegEncContext *s){
                     if(++s->mb_x >= s->mb_width){
                         s->mb_x=0;
                         ff_draw_horiz_band(s, s->mb_y*mb_size, mb_size);
+                        MPV_report_decode_progress(s);
                         s->mb_y++;
                     }
                     return 0;
@@ -254,6 +262,7 @@ static int decode_slice(MpegEncContext *s){
         }
 
         ff_draw_horiz_band(s, s->mb_y*mb_size, mb_size);
+        MPV_report_decode_progress(s);
 
         s->mb_x= 0;
     }
@@ -629,6 +638,11 @@ retry:
 
     ff_er_frame_start(s);
 
+    /* packed B-frames are only split off at the end of the frame, so the
+     * next thread has to wait for the whole frame in that case */
+    if(!s->divx_packed)
+        ff_thread_finish_setup(avctx);
+
     //the second part of the wmv2 header contains the MB skip bits which are stored in current_picture->mb_type
     //which is not available before MPV_frame_start()
     if (CONFIG_WMV2_DECODER && s->msmpeg4_version==5){
@@ -37,6 +37,7 @@
 #include "mathops.h"
 #include "rectangle.h"
 #include "vdpau_internal.h"
+#include "thread.h"
 
 #include "cabac.h"
 
@@ -563,6 +564,135 @@ static inline void prefetch_motion(H264Context *h, int list){
     }
 }
 
+static inline int get_lowest_part_list_y(H264Context *h, Picture *pic, int n, int height,
+                                         int y_offset, int list){
+    int raw_my= h->mv_cache[list][ scan8[n] ][1];
+    int filter_height= (raw_my&3) ? 2 : 0;
+    int full_my= (raw_my>>2) + y_offset;
+    int top = full_my - filter_height, bottom = full_my + height + filter_height;
+
+    return FFMAX(abs(top), bottom);
+}
+
+static inline void get_lowest_part_y(H264Context *h, int refs[2][48], int n, int height,
+                                     int y_offset, int list0, int list1, int *nrefs){
+    MpegEncContext * const s = &h->s;
+    int list, my;
+
+    y_offset += 16*(s->mb_y >> MB_FIELD);
+
+    for(list=0; list<2; list++){
+        int ref_n;
+        Picture *ref;
+
+        if(!(list ? list1 : list0))
+            continue;
+
+        ref_n = h->ref_cache[list][ scan8[n] ];
+        ref= &h->ref_list[list][ref_n];
+
+        // Error resilience puts the current picture in the ref list.
+        // Don't try to wait on these as it will cause a deadlock.
+        // Fields can wait on each other, though.
+        if(ref->thread_opaque != s->current_picture.thread_opaque ||
+           (ref->reference&3) != s->picture_structure) {
+            my = get_lowest_part_list_y(h, ref, n, height, y_offset, list);
+            if (refs[list][ref_n] < 0) nrefs[list] += 1;
+            refs[list][ref_n] = FFMAX(refs[list][ref_n], my);
+        }
+    }
+}
+
+/**
+ * Waits until all reference frames are available for MC operations.
+ *
+ * @param h the H264 context
+ */
+static void await_references(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    const int mb_xy= h->mb_xy;
+    const int mb_type= s->current_picture.mb_type[mb_xy];
+    int refs[2][48];
+    int nrefs[2] = {0};
+    int ref, list;
+
+    memset(refs, -1, sizeof(refs));
+
+    if(IS_16X16(mb_type)){
+        get_lowest_part_y(h, refs, 0, 16, 0,
+                  IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), nrefs);
+    }else if(IS_16X8(mb_type)){
+        get_lowest_part_y(h, refs, 0, 8, 0,
+                  IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), nrefs);
+        get_lowest_part_y(h, refs, 8, 8, 8,
+                  IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1), nrefs);
+    }else if(IS_8X16(mb_type)){
+        get_lowest_part_y(h, refs, 0, 16, 0,
+                  IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), nrefs);
+        get_lowest_part_y(h, refs, 4, 16, 0,
+                  IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1), nrefs);
+    }else{
+        int i;
+
+        assert(IS_8X8(mb_type));
+
+        for(i=0; i<4; i++){
+            const int sub_mb_type= h->sub_mb_type[i];
+            const int n= 4*i;
+            int y_offset= (i&2)<<2;
+
+            if(IS_SUB_8X8(sub_mb_type)){
+                get_lowest_part_y(h, refs, n  , 8, y_offset,
+                          IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+            }else if(IS_SUB_8X4(sub_mb_type)){
+                get_lowest_part_y(h, refs, n  , 4, y_offset,
+                          IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+                get_lowest_part_y(h, refs, n+2, 4, y_offset+4,
+                          IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+            }else if(IS_SUB_4X8(sub_mb_type)){
+                get_lowest_part_y(h, refs, n  , 8, y_offset,
+                          IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+                get_lowest_part_y(h, refs, n+1, 8, y_offset,
+                          IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+            }else{
+                int j;
+                assert(IS_SUB_4X4(sub_mb_type));
+                for(j=0; j<4; j++){
+                    int sub_y_offset= y_offset + 2*(j&2);
+                    get_lowest_part_y(h, refs, n+j, 4, sub_y_offset,
+                              IS_DIR(sub_mb_type, 0, 0), IS_DIR(sub_mb_type, 0, 1), nrefs);
+                }
+            }
+        }
+    }
+
+    for(list=h->list_count-1; list>=0; list--){
+        for(ref=0; ref<48 && nrefs[list]; ref++){
+            int row = refs[list][ref];
+            if(row >= 0){
+                Picture *ref_pic = &h->ref_list[list][ref];
+                int ref_field = ref_pic->reference - 1;
+                int ref_field_picture = ref_pic->field_picture;
+                int pic_height = 16*s->mb_height >> ref_field_picture;
+
+                row <<= MB_MBAFF;
+                nrefs[list]--;
+
+                if(!FIELD_PICTURE && ref_field_picture){ // frame referencing two fields
+                    ff_thread_await_progress((AVFrame*)ref_pic, FFMIN((row >> 1) - !(row&1), pic_height-1), 1);
+                    ff_thread_await_progress((AVFrame*)ref_pic, FFMIN((row >> 1)           , pic_height-1), 0);
+                }else if(FIELD_PICTURE && !ref_field_picture){ // field referencing one field of a frame
+                    ff_thread_await_progress((AVFrame*)ref_pic, FFMIN(row*2 + ref_field    , pic_height-1), 0);
+                }else if(FIELD_PICTURE){
+                    ff_thread_await_progress((AVFrame*)ref_pic, FFMIN(row, pic_height-1), ref_field);
+                }else{
+                    ff_thread_await_progress((AVFrame*)ref_pic, FFMIN(row, pic_height-1), 0);
+                }
+            }
+        }
+    }
+}
+
 static void hl_motion(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
                       qpel_mc_func (*qpix_put)[16], h264_chroma_mc_func (*chroma_put),
                       qpel_mc_func (*qpix_avg)[16], h264_chroma_mc_func (*chroma_avg),
@@ -573,6 +703,8 @@ static void hl_motion(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t
 
     assert(IS_INTER(mb_type));
 
+    if(s->avctx->active_thread_type&FF_THREAD_FRAME)
+        await_references(h);
     prefetch_motion(h, 0);
 
     if(IS_16X16(mb_type)){
@@ -667,6 +799,7 @@ static void free_tables(H264Context *h){
 
     av_freep(&h->mb2b_xy);
     av_freep(&h->mb2b8_xy);
+    av_freep(&h->mb_records);
 
     for(i = 0; i < MAX_THREADS; i++) {
         hx = h->thread_context[i];
@@ -874,7 +1007,7 @@ av_cold int ff_h264_decode_init(AVCodecContext *avctx){
     }
 
     h->thread_context[0] = h;
-    h->outputed_poc = INT_MIN;
+    h->outputed_poc = h->next_outputed_poc = INT_MIN;
     h->prev_poc_msb= 1<<16;
     ff_h264_reset_sei(h);
     if(avctx->codec_id == CODEC_ID_H264){
@@ -886,6 +1019,139 @@ av_cold int ff_h264_decode_init(AVCodecContext *avctx){
     return 0;
 }
 
+#define IN_RANGE(a, b, size) (((void*)(a) >= (void*)(b)) && ((void*)(a) < (void*)((b)+(size))))
+static void copy_picture_range(Picture **to, Picture **from, int count, MpegEncContext *new_base, MpegEncContext *old_base)
+{
+    int i;
+
+    for (i=0; i<count; i++){
+        assert((IN_RANGE(from[i], old_base, sizeof(*old_base)) ||
+                IN_RANGE(from[i], old_base->picture, sizeof(Picture) * old_base->picture_count) ||
+                !from[i]));
+        to[i] = REBASE_PICTURE(from[i], new_base, old_base);
+    }
+}
+
+static void copy_parameter_set(void **to, void **from, int count, int size)
+{
+    int i;
+
+    for (i=0; i<count; i++){
+        if (to[i] && !from[i]) av_freep(&to[i]);
+        else if (from[i] && !to[i]) to[i] = av_malloc(size);
+
+        if (from[i]) memcpy(to[i], from[i], size);
+    }
+}
+
+static int decode_init_thread_copy(AVCodecContext *avctx){
+    H264Context *h= avctx->priv_data;
+
+    if (!avctx->is_copy) return 0;
+    memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
+    memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+
+    return 0;
+}
+
+#define copy_fields(to, from, start_field, end_field) memcpy(&to->start_field, &from->start_field, (char*)&to->end_field - (char*)&to->start_field)
+static int decode_update_thread_context(AVCodecContext *dst, const AVCodecContext *src){
+    H264Context *h= dst->priv_data, *h1= src->priv_data;
+    MpegEncContext * const s = &h->s, * const s1 = &h1->s;
+    int inited = s->context_initialized, err;
+    int i;
+
+    if(dst == src || !s1->context_initialized) return 0;
+
+    err = ff_mpeg_update_thread_context(dst, src);
+    if(err) return err;
+
+    //FIXME handle width/height changing
+    if(!inited){
+        for(i = 0; i < MAX_SPS_COUNT; i++)
+            av_freep(h->sps_buffers + i);
+
+        for(i = 0; i < MAX_PPS_COUNT; i++)
+            av_freep(h->pps_buffers + i);
+
+        memcpy(&h->s + 1, &h1->s + 1, sizeof(H264Context) - sizeof(MpegEncContext)); //copy all fields after MpegEnc
+        memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
+        memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+        memset(h->thread_context, 0, sizeof(h->thread_context));
+        h->thread_context[0] = h;
+        h->mb_records = NULL;
+
+        if (ff_h264_alloc_tables(h) < 0 || context_init(h) < 0)
+            return -1;
+
+        for(i=0; i<2; i++){
+            h->rbsp_buffer[i] = NULL;
+            h->rbsp_buffer_size[i] = 0;
+        }
+
+        // frame_start may not be called for the next thread (if it's decoding a bottom field)
+        // so this has to be allocated here
+        h->s.obmc_scratchpad = av_malloc(16*2*s->linesize + 8*2*s->uvlinesize);
+
+        s->dsp.clear_blocks(h->mb);
+    }
+
+    //extradata/NAL handling
+    h->is_avc          = h1->is_avc;
+    h->got_avcC        = h1->got_avcC;
+    h->nal_length_size = h1->nal_length_size;
+
+    //SPS/PPS
+    copy_parameter_set((void**)h->sps_buffers, (void**)h1->sps_buffers, MAX_SPS_COUNT, sizeof(SPS));
+    h->sps             = h1->sps;
+    copy_parameter_set((void**)h->pps_buffers, (void**)h1->pps_buffers, MAX_PPS_COUNT, sizeof(PPS));
+    h->pps             = h1->pps;
+
+    //Dequantization matrices
+    //FIXME these are big - can they be only copied when PPS changes?
+    copy_fields(h, h1, dequant4_buffer, dequant4_coeff);
+
+    for(i=0; i<6; i++)
+        h->dequant4_coeff[i] = h->dequant4_buffer[0] + (h1->dequant4_coeff[i] - h1->dequant4_buffer[0]);
+
+    for(i=0; i<2; i++)
+        h->dequant8_coeff[i] = h->dequant8_buffer[0] + (h1->dequant8_coeff[i] - h1->dequant8_buffer[0]);
+
+    h->dequant_coeff_pps = h1->dequant_coeff_pps;
+
+    //POC timing
+    copy_fields(h, h1, poc_lsb, redundant_pic_count);
+
+    //reference lists
+    copy_fields(h, h1, ref_count, list_count);
+    copy_fields(h, h1, ref_list,  intra_gb);
+    copy_fields(h, h1, short_ref, cabac_init_idc);
+
+    copy_picture_range(h->short_ref,   h1->short_ref,   32, s, s1);
+    copy_picture_range(h->long_ref,    h1->long_ref,    32, s, s1);
+    copy_picture_range(h->delayed_pic, h1->delayed_pic, MAX_DELAYED_PIC_COUNT+2, s, s1);
+    h->next_output_pic = NULL;
+
+    h->last_slice_type = h1->last_slice_type;
+    h->x264_build      = h1->x264_build;
+    h->prev_interlaced_frame = h1->prev_interlaced_frame;
+
+    if(!s->current_picture_ptr) return 0;
+
+    // the previous thread skipped the reference marking of its last field
+    // (see field_end()), so it is done here on its behalf
+    if(!s->dropable) {
+        ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
+        h->prev_poc_msb     = h->poc_msb;
+        h->prev_poc_lsb     = h->poc_lsb;
+    }
+    h->prev_frame_num_offset= h->frame_num_offset;
+    h->prev_frame_num       = h->frame_num;
+    h->outputed_poc         = h->next_outputed_poc;
+
+    return 0;
+}
+
 int ff_h264_frame_start(H264Context *h){
     MpegEncContext * const s = &h->s;
     int i;
@@ -917,8 +1183,8 @@ int ff_h264_frame_start(H264Context *h){
 
     /* can't be in alloc_tables because linesize isn't known there.
      * FIXME: redo bipred weight to not require extra buffer? */
-    for(i = 0; i < s->avctx->thread_count; i++)
-        if(!h->thread_context[i]->s.obmc_scratchpad)
+    for(i = 0; i < MAX_THREADS; i++)
+        if(h->thread_context[i] && !h->thread_context[i]->s.obmc_scratchpad)
             h->thread_context[i]->s.obmc_scratchpad = av_malloc(16*2*s->linesize + 8*2*s->uvlinesize);
 
     /* some macroblocks will be accessed before they're available */
@@ -940,6 +1206,8 @@ int ff_h264_frame_start(H264Context *h){
     s->current_picture_ptr->field_poc[1]= INT_MAX;
     assert(s->current_picture_ptr->long_ref==0);
 
+    h->next_output_pic = NULL;
+
     return 0;
 }
 
@@ -1442,7 +1710,7 @@ static void flush_dpb(AVCodecContext *avctx){
             h->delayed_pic[i]->reference= 0;
         h->delayed_pic[i]= NULL;
     }
-    h->outputed_poc= INT_MIN;
+    h->outputed_poc= h->next_outputed_poc= INT_MIN;
     h->prev_interlaced_frame = 1;
     idr(h);
     if(h->s.current_picture_ptr)
@@ -1579,7 +1847,13 @@ static void init_scan_tables(H264Context *h){
     }
 }
 
-static void field_end(H264Context *h){
+/**
+ * Finishes decoding of the current field or frame.
+ *
+ * @param in_setup 1 if called during the setup of the next field,
+ *                 before ff_thread_finish_setup()
+ */
+static void field_end(H264Context *h, int in_setup){
     MpegEncContext * const s = &h->s;
     AVCodecContext * const avctx= s->avctx;
     s->mb_y= 0;
@@ -1590,13 +1864,18 @@ static void field_end(H264Context *h){
     if (CONFIG_H264_VDPAU_DECODER && s->avctx->codec->capabilities&CODEC_CAP_HWACCEL_VDPAU)
         ff_vdpau_h264_set_reference_frames(s);
 
-    if(!s->dropable) {
-        ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
-        h->prev_poc_msb= h->poc_msb;
-        h->prev_poc_lsb= h->poc_lsb;
+    /* with frame threading the next thread may already be using these
+     * variables; it does the marking itself in decode_update_thread_context() */
+    if (in_setup || !(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        if(!s->dropable) {
+            ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
+            h->prev_poc_msb= h->poc_msb;
+            h->prev_poc_lsb= h->poc_lsb;
+        }
+        h->prev_frame_num_offset= h->frame_num_offset;
+        h->prev_frame_num= h->frame_num;
+        h->outputed_poc = h->next_outputed_poc;
     }
-    h->prev_frame_num_offset= h->frame_num_offset;
-    h->prev_frame_num= h->frame_num;
 
     if (avctx->hwaccel) {
         if (avctx->hwaccel->end_frame(avctx) < 0)
@@ -1623,6 +1902,10 @@ static void field_end(H264Context *h){
 
     MPV_frame_end(s);
 
+    if (!s->dropable)
+        ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX,
+                                  s->picture_structure==PICT_BOTTOM_FIELD);
+
     h->current_slice=0;
 }
 
@@ -1686,7 +1969,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
 
     if(first_mb_in_slice == 0){ //FIXME better field boundary detection
         if(h0->current_slice && FIELD_PICTURE){
-            field_end(h);
+            field_end(h, 1);
         }
 
         h0->current_slice = 0;
@@ -1756,8 +2039,10 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
 
     if (s->context_initialized
         && (   s->width != s->avctx->width || s->height != s->avctx->height)) {
-        if(h != h0)
+        if(h != h0 || (s->avctx->active_thread_type & FF_THREAD_FRAME)) {
+            av_log(h->s.avctx, AV_LOG_ERROR, "Width/height changing with threads is not implemented.\n");
             return -1;   // width / height changed during parallelized decoding
+        }
         free_tables(h);
         flush_dpb(s->avctx);
         MPV_common_end(s);
@@ -1798,7 +2083,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
         init_scan_tables(h);
         ff_h264_alloc_tables(h);
 
-        for(i = 1; i < s->avctx->thread_count; i++) {
+        for(i = 1; i < s->slice_context_count; i++) {
             H264Context *c;
             c = h->thread_context[i] = av_malloc(sizeof(H264Context));
             memcpy(c, h->s.thread_context[i], sizeof(MpegEncContext));
@@ -1809,7 +2094,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
             clone_tables(c, h);
         }
 
-        for(i = 0; i < s->avctx->thread_count; i++)
+        for(i = 0; i < s->slice_context_count; i++)
             if(context_init(h->thread_context[i]) < 0)
                 return -1;
     }
@@ -1840,6 +2125,8 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
             h->prev_frame_num++;
             h->prev_frame_num %= 1<<h->sps.log2_max_frame_num;
             s->current_picture_ptr->frame_num= h->prev_frame_num;
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 0);
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 1);
             ff_h264_execute_ref_pic_marking(h, NULL, 0);
         }
 
@@ -1855,6 +2142,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                  * Previous field is unmatched. Don't display it, but let it
                  * remain for reference if marked as such.
                  */
+                if (last_pic_structure != PICT_FRAME)
+                    ff_thread_report_progress((AVFrame*)s0->current_picture_ptr, INT_MAX,
+                                              last_pic_structure == PICT_TOP_FIELD);
                 s0->current_picture_ptr = NULL;
                 s0->first_field = FIELD_PICTURE;
 
@@ -1868,6 +2158,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                      * pair. Throw away previous field except for reference
                      * purposes.
                      */
+                    if (last_pic_structure != PICT_FRAME)
+                        ff_thread_report_progress((AVFrame*)s0->current_picture_ptr, INT_MAX,
+                                                  last_pic_structure == PICT_TOP_FIELD);
                     s0->first_field = 1;
                     s0->current_picture_ptr = NULL;
 
@@ -2159,7 +2452,7 @@ int ff_h264_get_slice_type(H264Context *h)
     }
 }
 
-static void loop_filter(H264Context *h){
+static void loop_filter(H264Context *h, int start_x, int end_x){
     MpegEncContext * const s = &h->s;
     uint8_t  *dest_y, *dest_cb, *dest_cr;
     int linesize, uvlinesize, mb_x, mb_y;
@@ -2167,7 +2460,7 @@ static void loop_filter(H264Context *h){
     const int old_slice_type= h->slice_type;
 
     if(h->deblocking_filter) {
-        for(mb_x= 0; mb_x<s->mb_width; mb_x++){
+        for(mb_x= start_x; mb_x<end_x; mb_x++){
             for(mb_y=end_mb_y - FRAME_MBAFF; mb_y<= end_mb_y; mb_y++){
                 int list, mb_xy, mb_type, is_complex;
                 mb_xy = h->mb_xy = mb_x + mb_y*s->mb_stride;
@@ -2224,6 +2517,121 @@ static void loop_filter(H264Context *h){
     s->mb_y= end_mb_y - FRAME_MBAFF;
 }
 
+/**
+ * Draws edges and reports progress for the last MB row decoded.
+ * The rows still subject to deblocking by the next MB row are held back.
+ */
+static void decode_finish_row(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    int top = 16*(s->mb_y >> FIELD_PICTURE);
+    int height = 16 << FRAME_MBAFF;
+    int deblock_border = (16 + 4) << FRAME_MBAFF;
+    int pic_height = 16*s->mb_height >> FIELD_PICTURE;
+
+    if (h->deblocking_filter) {
+        if((top + height) >= pic_height)
+            height += deblock_border;
+
+        top -= deblock_border;
+    }
+
+    if (top >= pic_height || (top + height) < h->emu_edge_height)
+        return;
+
+    height = FFMIN(height, pic_height - top);
+    if (top < h->emu_edge_height) {
+        height = top+height;
+        top = 0;
+    }
+
+    ff_draw_horiz_band(s, top, height);
+
+    if (s->dropable) return;
+
+    ff_thread_report_progress((AVFrame*)s->current_picture_ptr, top + height - 1,
+                              s->picture_structure==PICT_BOTTOM_FIELD);
+}
+
+/**
+ * Saves what reconstructing the current macroblock needs, so that it can be
+ * done later by another thread, see decode_row_wavefront().
+ */
+static void save_mb_record(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    const int mb_index = s->mb_x + s->mb_y*s->mb_width;
+    H264MBRecord * const rec = &h->mb_records[mb_index];
+
+    memcpy(rec->mv_cache,                 h->mv_cache,                 sizeof(rec->mv_cache));
+    memcpy(rec->ref_cache,                h->ref_cache,                sizeof(rec->ref_cache));
+    memcpy(rec->non_zero_count_cache,     h->non_zero_count_cache,     sizeof(rec->non_zero_count_cache));
+    memcpy(rec->intra4x4_pred_mode_cache, h->intra4x4_pred_mode_cache, sizeof(rec->intra4x4_pred_mode_cache));
+    memcpy(rec->sub_mb_type,              h->sub_mb_type,              sizeof(rec->sub_mb_type));
+    rec->topleft_samples_available  = h->topleft_samples_available;
+    rec->topright_samples_available = h->topright_samples_available;
+    rec->top_mb_xy            = h->top_mb_xy;
+    rec->chroma_pred_mode     = h->chroma_pred_mode;
+    rec->intra16x16_pred_mode = h->intra16x16_pred_mode;
+    rec->cbp                  = h->cbp;
+    rec->qscale               = s->qscale;
+
+    /* entropy decoding expects the coefficients to be cleared like
+     * ff_h264_hl_decode_mb() does */
+    if(h->cbp || IS_INTRA(s->current_picture.mb_type[h->mb_xy])){
+        memcpy(rec->mb, h->mb, sizeof(rec->mb));
+        s->dsp.clear_blocks(h->mb);
+    }
+
+    h->wavefront_end = mb_index + 1;
+}
+
+/**
+ * Restores a macroblock saved by save_mb_record() into the context
+ * reconstructing it.
+ */
+static void load_mb_record(H264Context *h, const H264MBRecord *rec, int mb_x, int mb_y){
+    MpegEncContext * const s = &h->s;
+
+    s->mb_x  = mb_x;
+    s->mb_y  = mb_y;
+    h->mb_xy = mb_x + mb_y*s->mb_stride;
+
+    memcpy(h->mv_cache,                 rec->mv_cache,                 sizeof(h->mv_cache));
+    memcpy(h->ref_cache,                rec->ref_cache,                sizeof(h->ref_cache));
+    memcpy(h->non_zero_count_cache,     rec->non_zero_count_cache,     sizeof(h->non_zero_count_cache));
+    memcpy(h->intra4x4_pred_mode_cache, rec->intra4x4_pred_mode_cache, sizeof(h->intra4x4_pred_mode_cache));
+    memcpy(h->sub_mb_type,              rec->sub_mb_type,              sizeof(h->sub_mb_type));
+    h->topleft_samples_available  = rec->topleft_samples_available;
+    h->topright_samples_available = rec->topright_samples_available;
+    h->top_mb_xy            = rec->top_mb_xy;
+    h->chroma_pred_mode     = rec->chroma_pred_mode;
+    h->intra16x16_pred_mode = rec->intra16x16_pred_mode;
+    h->cbp                  = rec->cbp;
+    s->qscale               = rec->qscale;
+    h->chroma_qp[0] = get_chroma_qp(h, 0, s->qscale);
+    h->chroma_qp[1] = get_chroma_qp(h, 1, s->qscale);
+
+    if(h->cbp || IS_INTRA(s->current_picture.mb_type[h->mb_xy]))
+        memcpy(h->mb, rec->mb, sizeof(h->mb));
+}
+
+static av_always_inline void hl_decode_mb_or_save(H264Context *h){
+    if(h->wavefront)
+        save_mb_record(h);
+    else
+        ff_h264_hl_decode_mb(h);
+}
+
+static void decode_end_row(H264Context *h){
+    MpegEncContext * const s = &h->s;
+
+    if(h->wavefront){
+        ff_thread_report_row_progress(s->avctx, 0, s->mb_y + 1 - h->wavefront_start_row);
+    }else{
+        loop_filter(h, 0, s->mb_width);
+        decode_finish_row(h);
+    }
+}
+
 static int decode_slice(struct AVCodecContext *avctx, void *arg){
     H264Context *h = *(void**)arg;
     MpegEncContext * const s = &h->s;
@@ -2252,14 +2660,14 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
             int eos;
 //STOP_TIMER("decode_mb_cabac")
 
-            if(ret>=0) ff_h264_hl_decode_mb(h);
+            if(ret>=0) hl_decode_mb_or_save(h);
 
             if( ret >= 0 && FRAME_MBAFF ) { //FIXME optimal? or let mb_decode decode 16x32 ?
                 s->mb_y++;
 
                 ret = ff_h264_decode_mb_cabac(h);
 
-                if(ret>=0) ff_h264_hl_decode_mb(h);
+                if(ret>=0) hl_decode_mb_or_save(h);
                 s->mb_y--;
             }
             eos = get_cabac_terminate( &h->cabac );
@@ -2272,8 +2680,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
 
             if( ++s->mb_x >= s->mb_width ) {
                 s->mb_x = 0;
-                loop_filter(h);
-                ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                decode_end_row(h);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -2291,13 +2698,13 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
         for(;;){
             int ret = ff_h264_decode_mb_cavlc(h);
 
-            if(ret>=0) ff_h264_hl_decode_mb(h);
+            if(ret>=0) hl_decode_mb_or_save(h);
 
             if(ret>=0 && FRAME_MBAFF){ //FIXME optimal? or let mb_decode decode 16x32 ?
                 s->mb_y++;
                 ret = ff_h264_decode_mb_cavlc(h);
 
-                if(ret>=0) ff_h264_hl_decode_mb(h);
+                if(ret>=0) hl_decode_mb_or_save(h);
                 s->mb_y--;
             }
 
@@ -2310,8 +2717,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
 
             if(++s->mb_x >= s->mb_width){
                 s->mb_x=0;
-                loop_filter(h);
-                ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                decode_end_row(h);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -2394,6 +2800,175 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
     return -1; //not reached
 }
 
+/**
+ * Prepares a slice thread context for reconstructing rows of the slice
+ * being entropy decoded in src.
+ */
+static void wavefront_clone(H264Context *dst, H264Context *src){
+    MpegEncContext * const s = &src->s;
+    int mb_xy, last_slice = -1;
+
+    clone_slice(dst, src);
+    dst->s.picture_structure = s->picture_structure;
+    dst->s.pict_type         = s->pict_type;
+    dst->s.low_delay         = s->low_delay;
+    dst->s.dropable          = s->dropable;
+    dst->s.last_picture_ptr  = s->last_picture_ptr;
+
+    dst->sps            = src->sps;
+    dst->pps            = src->pps;
+    dst->slice_type     = src->slice_type;
+    dst->slice_type_nos = src->slice_type_nos;
+    dst->list_count     = src->list_count;
+    dst->ref_count[0]   = src->ref_count[0];
+    dst->ref_count[1]   = src->ref_count[1];
+    copy_fields(dst, src, use_weight, implicit_weight);
+    if(src->use_weight == 2)
+        memcpy(dst->implicit_weight, src->implicit_weight, sizeof(dst->implicit_weight));
+    copy_fields(dst, src, deblocking_filter, redundant_pic_count);
+    dst->qp_thresh       = src->qp_thresh;
+    dst->emu_edge_width  = src->emu_edge_width;
+    dst->emu_edge_height = src->emu_edge_height;
+    dst->is_complex      = src->is_complex;
+
+    /* The first row may have been started by earlier slices and is deblocked
+     * against the row above, so their reference mappings are needed too. */
+    memcpy(dst->ref2frm[src->slice_num&(MAX_SLICES-1)], src->ref2frm[src->slice_num&(MAX_SLICES-1)], sizeof(dst->ref2frm[0]));
+    for(mb_xy = FFMAX(src->wavefront_start_row - 1, 0)*s->mb_stride; mb_xy < src->wavefront_start_row*s->mb_stride + src->wavefront_start_x; mb_xy++){
+        int slice = src->slice_table[mb_xy]&(MAX_SLICES-1);
+        if(slice != last_slice){
+            memcpy(dst->ref2frm[slice], src->ref2frm[slice], sizeof(dst->ref2frm[0]));
+            last_slice = slice;
+        }
+    }
+}
+
+/**
+ * Reconstructs and deblocks one MB row of the slice entropy decoded by h.
+ * Each macroblock waits until the row above is deblocked up to the
+ * macroblock above right, and deblocking trails reconstruction by one
+ * macroblock, as intra prediction needs the unfiltered left neighbour.
+ * Rows the slice does not complete are reconstructed but not deblocked,
+ * as in the non-wavefront case.
+ *
+ * @param h context doing the entropy decoding
+ * @param c context to reconstruct in, h itself once entropy decoding is done
+ */
+static void decode_row_wavefront(H264Context *c, H264Context *h, int mb_y){
+    MpegEncContext * const s = &c->s;
+    AVCodecContext * const avctx = s->avctx;
+    const int mb_width = s->mb_width;
+    const int row = mb_y - h->wavefront_start_row + 1; // progress counter 0 is the entropy decoding
+    uint8_t (*top_borders)[16+2*8] = c->top_borders[1];
+    int start_x = row == 1 ? h->wavefront_start_x : 0;
+    int end_x, mb_x, filter_x = 0;
+
+    ff_thread_await_row_progress(avctx, 0, row);
+    end_x = av_clip(h->wavefront_end - mb_y*mb_width, 0, mb_width);
+
+    for(mb_x = start_x; mb_x < end_x; mb_x++){
+        if(row > 1)
+            ff_thread_await_row_progress(avctx, row - 1, FFMIN(mb_x + 2, mb_width));
+
+        load_mb_record(c, &h->mb_records[mb_x + mb_y*mb_width], mb_x, mb_y);
+        c->top_borders[1] = h->wavefront_borders[(mb_y - 1)&1];
+        ff_h264_hl_decode_mb(c);
+
+        if(end_x == mb_width && mb_x > filter_x){
+            c->top_borders[1] = h->wavefront_borders[mb_y&1];
+            loop_filter(c, filter_x, mb_x);
+            filter_x = mb_x;
+            ff_thread_report_row_progress(avctx, row, filter_x);
+        }
+    }
+
+    if(end_x == mb_width){
+        c->top_borders[1] = h->wavefront_borders[mb_y&1];
+        s->mb_y = mb_y;
+        loop_filter(c, filter_x, mb_width);
+        ff_thread_report_row_progress(avctx, row, mb_width);
+
+        /* bands must be drawn in order */
+        if(row > 1)
+            ff_thread_await_row_progress(avctx, row - 1, mb_width + 1);
+        s->mb_y = mb_y;
+        decode_finish_row(c);
+    }
+    ff_thread_report_row_progress(avctx, row, mb_width + 1);
+
+    c->top_borders[1] = top_borders;
+}
+
+static int decode_slice_wavefront(AVCodecContext *avctx, void *arg, int jobnr, int threadnr){
+    H264Context *h = arg;
+    H264Context *c = jobnr ? h->thread_context[jobnr] : h;
+    MpegEncContext * const s = &h->s;
+    const int nb_rows = s->mb_height - h->wavefront_start_row;
+    int row, end_mb_x, end_mb_y;
+
+    if(jobnr){
+        while((row = ff_thread_next_row(avctx)) < nb_rows)
+            decode_row_wavefront(c, h, h->wavefront_start_row + row);
+        return 0;
+    }
+
+    decode_slice(avctx, &h);
+    ff_thread_report_row_progress(avctx, 0, INT_MAX);
+
+    /* reconstruction moves the position the slice ended at */
+    end_mb_x = s->mb_x;
+    end_mb_y = s->mb_y;
+    h->wavefront = 0;
+    while((row = ff_thread_next_row(avctx)) < nb_rows)
+        decode_row_wavefront(h, h, h->wavefront_start_row + row);
+    s->mb_x = end_mb_x;
+    s->mb_y = end_mb_y;
+
+    return 0;
+}
+
+/**
+ * Decodes a slice with reconstruction and deblocking running as a wavefront
+ * of MB rows on the slice threads, while entropy decoding runs ahead in h.
+ * Falls back to decode_slice() if the needed memory cannot be allocated.
+ */
+static void execute_decode_slice_wavefront(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    AVCodecContext * const avctx = s->avctx;
+    const int borders_size = s->mb_width * (16+8+8);
+    int i, last_row;
+
+    if(!h->mb_records)
+        h->mb_records = av_malloc(s->mb_width * s->mb_height * sizeof(*h->mb_records));
+    if(!h->mb_records || ff_thread_init_row_progress(avctx, s->mb_height - s->mb_y + 1) < 0){
+        decode_slice(avctx, &h);
+        return;
+    }
+
+    h->is_complex = CONFIG_GRAY && (s->flags&CODEC_FLAG_GRAY);
+    h->wavefront_start_row = s->mb_y;
+    h->wavefront_start_x   = s->mb_x;
+    h->wavefront_end       = s->mb_x + s->mb_y*s->mb_width;
+
+    /* Rows back up their bottom edge into the top_borders of their parity,
+     * outside the wavefront everything goes into top_borders[1]. */
+    h->wavefront_borders[0] = h->top_borders[0];
+    h->wavefront_borders[1] = h->top_borders[1];
+    if(s->mb_y > 0 && !((s->mb_y - 1)&1))
+        memcpy(h->top_borders[0], h->top_borders[1], borders_size);
+
+    for(i = 1; i < s->slice_context_count; i++)
+        wavefront_clone(h->thread_context[i], h);
+
+    h->wavefront = 1;
+    avctx->execute2(avctx, decode_slice_wavefront, h, NULL, s->slice_context_count);
+    h->wavefront = 0;
+
+    last_row = h->wavefront_end / s->mb_width - 1;
+    if(last_row >= h->wavefront_start_row && !(last_row&1))
+        memcpy(h->top_borders[1], h->top_borders[0], borders_size);
+}
+
 /**
  * Call decode_slice() for each context.
  *
@@ -2411,7 +2986,12 @@ static void execute_decode_slices(H264Context *h, int context_count){
     if(s->avctx->codec->capabilities&CODEC_CAP_HWACCEL_VDPAU)
         return;
     if(context_count == 1) {
-        decode_slice(avctx, &h);
+        if(HAVE_PTHREADS && (avctx->flags2 & CODEC_FLAG2_WAVEFRONT)
+           && (avctx->active_thread_type&FF_THREAD_SLICE) && s->slice_context_count > 1
+           && s->codec_id == CODEC_ID_H264 && s->picture_structure == PICT_FRAME && !FRAME_MBAFF)
+            execute_decode_slice_wavefront(h);
+        else
+            decode_slice(avctx, &h);
     } else {
         for(i = 1; i < context_count; i++) {
             hx = h->thread_context[i];
@@ -2434,6 +3014,224 @@ static void execute_decode_slices(H264Context *h, int context_count){
 }
 
 
+/**
+ * Runs setup operations that must be done after slice header decoding.
+ * This includes finding the next displayed frame.
+ *
+ * @param h h264 master context
+ * @param setup_finished enough NALs have been read that
+ * the next thread can start decoding
+ */
+static void decode_postinit(H264Context *h, int setup_finished){
+    MpegEncContext * const s = &h->s;
+    Picture *out = s->current_picture_ptr;
+    Picture *cur = s->current_picture_ptr;
+    int i, pics, out_of_order, out_idx;
+
+    s->current_picture_ptr->qscale_type= FF_QSCALE_TYPE_H264;
+    s->current_picture_ptr->pict_type= s->pict_type;
+
+    if (h->next_output_pic) return;
+
+    if (cur->field_poc[0]==INT_MAX || cur->field_poc[1]==INT_MAX) {
+        //FIXME: if we have two PAFF fields in one packet, we can't start the next thread here.
+        //If we have one field per packet, we can. The check in decode_nal_units() is not good enough
+        //to find this yet, so we assume the worst for now.
+        //if (setup_finished)
+        //    ff_thread_finish_setup(s->avctx);
+        return;
+    }
+
+    /* The reference marking of this picture has not been run yet, but the
+     * reordering below must not mix pictures from before and after a reset. */
+    if (!s->dropable)
+        for (i = 0; i < h->mmco_index; i++)
+            if (h->mmco[i].opcode == MMCO_RESET)
+                cur->mmco_reset = 1;
+
+    cur->interlaced_frame = 0;
+    cur->repeat_pict = 0;
+
+    /* Signal interlacing information externally. */
+    /* Prioritize picture timing SEI information over used decoding process if it exists. */
+
+    if(h->sps.pic_struct_present_flag){
+        switch (h->sei_pic_struct)
+        {
+        case SEI_PIC_STRUCT_FRAME:
+            break;
+        case SEI_PIC_STRUCT_TOP_FIELD:
+        case SEI_PIC_STRUCT_BOTTOM_FIELD:
+            cur->interlaced_frame = 1;
+            break;
+        case SEI_PIC_STRUCT_TOP_BOTTOM:
+        case SEI_PIC_STRUCT_BOTTOM_TOP:
+            if (FIELD_OR_MBAFF_PICTURE)
+                cur->interlaced_frame = 1;
+            else
+                // try to flag soft telecine progressive
+                cur->interlaced_frame = h->prev_interlaced_frame;
+            break;
+        case SEI_PIC_STRUCT_TOP_BOTTOM_TOP:
+        case SEI_PIC_STRUCT_BOTTOM_TOP_BOTTOM:
+            // Signal the possibility of telecined film externally (pic_struct 5,6)
+            // From these hints, let the applications decide if they apply deinterlacing.
+            cur->repeat_pict = 1;
+            break;
+        case SEI_PIC_STRUCT_FRAME_DOUBLING:
+            // Force progressive here, as doubling interlaced frame is a bad idea.
+            cur->repeat_pict = 2;
+            break;
+        case SEI_PIC_STRUCT_FRAME_TRIPLING:
+            cur->repeat_pict = 4;
+            break;
+        }
+
+        if ((h->sei_ct_type & 3) && h->sei_pic_struct <= SEI_PIC_STRUCT_BOTTOM_TOP)
+            cur->interlaced_frame = (h->sei_ct_type & (1<<1)) != 0;
+    }else{
+        /* Derive interlacing flag from used decoding process. */
+        cur->interlaced_frame = FIELD_OR_MBAFF_PICTURE;
+    }
+    h->prev_interlaced_frame = cur->interlaced_frame;
+
+    if (cur->field_poc[0] != cur->field_poc[1]){
+        /* Derive top_field_first from field pocs. */
+        cur->top_field_first = cur->field_poc[0] < cur->field_poc[1];
+    }else{
+        if(cur->interlaced_frame || h->sps.pic_struct_present_flag){
+            /* Use picture timing SEI information. Even if it is a information of a past frame, better than nothing. */
+            if(h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM
+              || h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM_TOP)
+                cur->top_field_first = 1;
+            else
+                cur->top_field_first = 0;
+        }else{
+            /* Most likely progressive */
+            cur->top_field_first = 0;
+        }
+    }
+
+//FIXME do something with unavailable reference frames
+
+    /* Sort B-frames into display order */
+
+    if(h->sps.bitstream_restriction_flag
+       && s->avctx->has_b_frames < h->sps.num_reorder_frames){
+        s->avctx->has_b_frames = h->sps.num_reorder_frames;
+        s->low_delay = 0;
+    }
+
+    if(   s->avctx->strict_std_compliance >= FF_COMPLIANCE_STRICT
+       && !h->sps.bitstream_restriction_flag){
+        s->avctx->has_b_frames= MAX_DELAYED_PIC_COUNT;
+        s->low_delay= 0;
+    }
+
+    pics = 0;
+    while(h->delayed_pic[pics]) pics++;
+
+    assert(pics <= MAX_DELAYED_PIC_COUNT);
+
+    h->delayed_pic[pics++] = cur;
+    if(cur->reference == 0)
+        cur->reference = DELAYED_PIC_REF;
+
+    out = h->delayed_pic[0];
+    out_idx = 0;
+    for(i=1; h->delayed_pic[i] && !h->delayed_pic[i]->key_frame && !h->delayed_pic[i]->mmco_reset; i++)
+        if(h->delayed_pic[i]->poc < out->poc){
+            out = h->delayed_pic[i];
+            out_idx = i;
+        }
+    if(s->avctx->has_b_frames == 0 && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset))
+        h->next_outputed_poc= INT_MIN;
+    out_of_order = out->poc < h->next_outputed_poc;
+
+    if(h->sps.bitstream_restriction_flag && s->avctx->has_b_frames >= h->sps.num_reorder_frames)
+        { }
+    else if((out_of_order && pics-1 == s->avctx->has_b_frames && s->avctx->has_b_frames < MAX_DELAYED_PIC_COUNT)
+       || (s->low_delay &&
+        ((h->next_outputed_poc != INT_MIN && out->poc > h->next_outputed_poc + 2)
+         || cur->pict_type == FF_B_TYPE)))
+    {
+        s->low_delay = 0;
+        s->avctx->has_b_frames++;
+    }
+
+    if(out_of_order || pics > s->avctx->has_b_frames){
+        out->reference &= ~DELAYED_PIC_REF;
+        out->owner2 = s; // for frame threading, the owner must be the second field's thread
+                         // or else the first thread can release the picture and reuse it unsafely
+        for(i=out_idx; h->delayed_pic[i]; i++)
+            h->delayed_pic[i] = h->delayed_pic[i+1];
+    }
+    if(!out_of_order && pics > s->avctx->has_b_frames){
+        h->next_output_pic = out;
+        if(out_idx==0 && h->delayed_pic[0] && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset)) {
+            h->next_outputed_poc = INT_MIN;
+        } else
+            h->next_outputed_poc = out->poc;
+    }else{
+        av_log(s->avctx, AV_LOG_DEBUG, "no picture\n");
+    }
+
+    if (setup_finished)
+        ff_thread_finish_setup(s->avctx);
+}
+
+/**
+ * Finds the last NAL unit that starts a new field or frame.
+ * The next frame thread can only be started after it has been parsed.
+ *
+ * @return the offset of that NAL unit in buf, or buf_size if there is none
+ */
+static int find_last_first_slice(H264Context *h, const uint8_t *buf, int buf_size){
+    int buf_index = 0, last = buf_size;
+    int next_avc = h->is_avc ? 0 : buf_size;
+
+    for(;;){
+        int i, nalsize, type;
+
+        if(buf_index >= next_avc) {
+            if(buf_index >= buf_size) break;
+            nalsize = 0;
+            for(i = 0; i < h->nal_length_size; i++)
+                nalsize = (nalsize << 8) | buf[buf_index++];
+            if(nalsize <= 1 || nalsize > buf_size - buf_index){
+                if(nalsize == 1){
+                    buf_index++;
+                    continue;
+                }
+                break;
+            }
+            next_avc= buf_index + nalsize;
+        } else {
+            for(; buf_index + 3 < next_avc; buf_index++){
+                if(buf[buf_index] == 0 && buf[buf_index+1] == 0 && buf[buf_index+2] == 1)
+                    break;
+            }
+
+            if(buf_index+3 >= buf_size) break;
+
+            buf_index+=3;
+            if(buf_index >= next_avc) continue;
+        }
+
+        /* first_mb_in_slice is the first exp-golomb code after the NAL header,
+         * it is 0 exactly when its first bit is set; an escape sequence cannot
+         * occur that early */
+        type = buf[buf_index] & 0x1F;
+        if((type == NAL_SLICE || type == NAL_IDR_SLICE || type == NAL_DPA) &&
+           buf_index + 1 < next_avc && (buf[buf_index+1] & 0x80))
+            last = buf_index;
+
+        buf_index++;
+    }
+
+    return last;
+}
+
 static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
     MpegEncContext * const s = &h->s;
     AVCodecContext * const avctx= s->avctx;
@@ -2441,8 +3239,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
     H264Context *hx; ///< thread context
     int context_count = 0;
     int next_avc= h->is_avc ? 0 : buf_size;
+    int last_first_slice = buf_size;
 
-    h->max_contexts = avctx->thread_count;
+    h->max_contexts = (avctx->active_thread_type&FF_THREAD_SLICE) ? avctx->thread_count : 1;
 #if 0
     int i;
     for(i=0; i<50; i++){
@@ -2456,6 +3255,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
         ff_h264_reset_sei(h);
     }
 
+    if(avctx->active_thread_type&FF_THREAD_FRAME)
+        last_first_slice = find_last_first_slice(h, buf, buf_size);
+
     for(;;){
         int consumed;
         int dst_length;
@@ -2463,6 +3265,7 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
         const uint8_t *ptr;
         int i, nalsize = 0;
         int err;
+        int nal_start;
 
         if(buf_index >= next_avc) {
             if(buf_index >= buf_size) break;
@@ -2494,6 +3297,7 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
         }
 
         hx = h->thread_context[context_count];
+        nal_start = buf_index;
 
         ptr= ff_h264_decode_nal(hx, buf + buf_index, &dst_length, &consumed, next_avc - buf_index);
         if (ptr==NULL || dst_length < 0){
@@ -2543,6 +3347,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
             s->current_picture_ptr->key_frame |=
                     (hx->nal_unit_type == NAL_IDR_SLICE) ||
                     (h->sei_recovery_frame_cnt >= 0);
+
+            if (h->current_slice == 1 && !(s->flags2 & CODEC_FLAG2_CHUNKS))
+                decode_postinit(h, nal_start >= last_first_slice);
             if(hx->redundant_pic_count==0 && hx->s.hurry_up < 5
                && (avctx->skip_frame < AVDISCARD_NONREF || hx->nal_ref_idc)
                && (avctx->skip_frame < AVDISCARD_BIDIR  || hx->slice_type_nos!=FF_B_TYPE)
@@ -2568,6 +3375,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
             if ((err = decode_slice_header(hx, h)) < 0)
                 break;
 
+            if (h->current_slice == 1 && !(s->flags2 & CODEC_FLAG2_CHUNKS))
+                decode_postinit(h, nal_start >= last_first_slice);
+
             hx->s.data_partitioning = 1;
 
             break;
@@ -2749,143 +3559,17 @@ static int decode_frame(AVCodecContext *avctx,
     }
 
     if(!(s->flags2 & CODEC_FLAG2_CHUNKS) || (s->mb_y >= s->mb_height && s->mb_height)){
-        Picture *out = s->current_picture_ptr;
-        Picture *cur = s->current_picture_ptr;
-        int i, pics, out_of_order, out_idx;
+        if(s->flags2 & CODEC_FLAG2_CHUNKS) decode_postinit(h, 1);
 
-        field_end(h);
+        field_end(h, 0);
 
-        if (cur->field_poc[0]==INT_MAX || cur->field_poc[1]==INT_MAX) {
+        if (!h->next_output_pic) {
             /* Wait for second field. */
             *data_size = 0;
 
         } else {
-            cur->interlaced_frame = 0;
-            cur->repeat_pict = 0;
-
-            /* Signal interlacing information externally. */
-            /* Prioritize picture timing SEI information over used decoding process if it exists. */
-
-            if(h->sps.pic_struct_present_flag){
-                switch (h->sei_pic_struct)
-                {
-                case SEI_PIC_STRUCT_FRAME:
-                    break;
-                case SEI_PIC_STRUCT_TOP_FIELD:
-                case SEI_PIC_STRUCT_BOTTOM_FIELD:
-                    cur->interlaced_frame = 1;
-                    break;
-                case SEI_PIC_STRUCT_TOP_BOTTOM:
-                case SEI_PIC_STRUCT_BOTTOM_TOP:
-                    if (FIELD_OR_MBAFF_PICTURE)
-                        cur->interlaced_frame = 1;
-                    else
-                        // try to flag soft telecine progressive
-                        cur->interlaced_frame = h->prev_interlaced_frame;
-                    break;
-                case SEI_PIC_STRUCT_TOP_BOTTOM_TOP:
-                case SEI_PIC_STRUCT_BOTTOM_TOP_BOTTOM:
-                    // Signal the possibility of telecined film externally (pic_struct 5,6)
-                    // From these hints, let the applications decide if they apply deinterlacing.
-                    cur->repeat_pict = 1;
-                    break;
-                case SEI_PIC_STRUCT_FRAME_DOUBLING:
-                    // Force progressive here, as doubling interlaced frame is a bad idea.
-                    cur->repeat_pict = 2;
-                    break;
-                case SEI_PIC_STRUCT_FRAME_TRIPLING:
-                    cur->repeat_pict = 4;
-                    break;
-                }
-
-                if ((h->sei_ct_type & 3) && h->sei_pic_struct <= SEI_PIC_STRUCT_BOTTOM_TOP)
-                    cur->interlaced_frame = (h->sei_ct_type & (1<<1)) != 0;
-            }else{
-                /* Derive interlacing flag from used decoding process. */
-                cur->interlaced_frame = FIELD_OR_MBAFF_PICTURE;
-            }
-            h->prev_interlaced_frame = cur->interlaced_frame;
-
-            if (cur->field_poc[0] != cur->field_poc[1]){
-                /* Derive top_field_first from field pocs. */
-                cur->top_field_first = cur->field_poc[0] < cur->field_poc[1];
-            }else{
-                if(cur->interlaced_frame || h->sps.pic_struct_present_flag){
-                    /* Use picture timing SEI information. Even if it is a information of a past frame, better than nothing. */
-                    if(h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM
-                      || h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM_TOP)
-                        cur->top_field_first = 1;
-                    else
-                        cur->top_field_first = 0;
-                }else{
-                    /* Most likely progressive */
-                    cur->top_field_first = 0;
-                }
-            }
-
-        //FIXME do something with unavailable reference frames
-
-            /* Sort B-frames into display order */
-
-            if(h->sps.bitstream_restriction_flag
-               && s->avctx->has_b_frames < h->sps.num_reorder_frames){
-                s->avctx->has_b_frames = h->sps.num_reorder_frames;
-                s->low_delay = 0;
-            }
-
-            if(   s->avctx->strict_std_compliance >= FF_COMPLIANCE_STRICT
-               && !h->sps.bitstream_restriction_flag){
-                s->avctx->has_b_frames= MAX_DELAYED_PIC_COUNT;
-                s->low_delay= 0;
-            }
-
-            pics = 0;
-            while(h->delayed_pic[pics]) pics++;
-
-            assert(pics <= MAX_DELAYED_PIC_COUNT);
-
-            h->delayed_pic[pics++] = cur;
-            if(cur->reference == 0)
-                cur->reference = DELAYED_PIC_REF;
-
-            out = h->delayed_pic[0];
-            out_idx = 0;
-            for(i=1; h->delayed_pic[i] && !h->delayed_pic[i]->key_frame && !h->delayed_pic[i]->mmco_reset; i++)
-                if(h->delayed_pic[i]->poc < out->poc){
-                    out = h->delayed_pic[i];
-                    out_idx = i;
-                }
-            if(s->avctx->has_b_frames == 0 && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset))
-                h->outputed_poc= INT_MIN;
-            out_of_order = out->poc < h->outputed_poc;
-
-            if(h->sps.bitstream_restriction_flag && s->avctx->has_b_frames >= h->sps.num_reorder_frames)
-                { }
-            else if((out_of_order && pics-1 == s->avctx->has_b_frames && s->avctx->has_b_frames < MAX_DELAYED_PIC_COUNT)
-               || (s->low_delay &&
-                ((h->outputed_poc != INT_MIN && out->poc > h->outputed_poc + 2)
-                 || cur->pict_type == FF_B_TYPE)))
-            {
-                s->low_delay = 0;
-                s->avctx->has_b_frames++;
-            }
-
-            if(out_of_order || pics > s->avctx->has_b_frames){
-                out->reference &= ~DELAYED_PIC_REF;
-                for(i=out_idx; h->delayed_pic[i]; i++)
-                    h->delayed_pic[i] = h->delayed_pic[i+1];
-            }
-            if(!out_of_order && pics > s->avctx->has_b_frames){
-                *data_size = sizeof(AVFrame);
-
-                if(out_idx==0 && h->delayed_pic[0] && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset)) {
-                    h->outputed_poc = INT_MIN;
-                } else
-                    h->outputed_poc = out->poc;
-                *pict= *(AVFrame*)out;
-            }else{
-                av_log(avctx, AV_LOG_DEBUG, "no picture\n");
-            }
+            *data_size = sizeof(AVFrame);
+            *pict = *(AVFrame*)h->next_output_pic;
         }
     }
 
@@ -3128,10 +3812,12 @@ AVCodec h264_decoder = {
     NULL,
     ff_h264_decode_end,
     decode_frame,
-    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
     .flush= flush_dpb,
     .long_name = NULL_IF_CONFIG_SMALL("H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10"),
     .pix_fmts= ff_hwaccel_pixfmt_list_420,
+    .init_thread_copy      = decode_init_thread_copy,
+    .update_thread_context = decode_update_thread_context,
 };
 
 #if CONFIG_H264_VDPAU_DECODER
@@ -254,6 +254,26 @@ typedef struct MMCO{
     int long_arg;       ///< index, pic_num, or num long refs depending on opcode
 } MMCO;
 
+/**
+ * What reconstructing a macroblock needs from its entropy decoding,
+ * saved per macroblock in wavefront mode, see CODEC_FLAG2_WAVEFRONT.
+ */
+typedef struct H264MBRecord{
+    DECLARE_ALIGNED_16(DCTELEM, mb)[16*24];     ///< only valid if cbp is set or the MB is intra
+    DECLARE_ALIGNED_8(int16_t, mv_cache)[2][5*8][2];
+    DECLARE_ALIGNED_8(int8_t, ref_cache)[2][5*8];
+    DECLARE_ALIGNED_8(uint8_t, non_zero_count_cache)[6*8];
+    int8_t intra4x4_pred_mode_cache[5*8];
+    uint16_t sub_mb_type[4];
+    unsigned int topleft_samples_available;
+    unsigned int topright_samples_available;
+    int top_mb_xy;
+    int chroma_pred_mode;
+    int intra16x16_pred_mode;
+    int cbp;
+    int qscale;
+}H264MBRecord;
+
 /**
  * H264Context
  */
@@ -439,7 +459,9 @@ typedef struct H264Context{
                                           according to picture reordering in slice header */
     int ref2frm[MAX_SLICES][2][64];  ///< reference to frame number lists, used in the loop filter, the first 2 are for -2,-1
     Picture *delayed_pic[MAX_DELAYED_PIC_COUNT+2]; //FIXME size?
+    Picture *next_output_pic;
     int outputed_poc;
+    int next_outputed_poc;
 
     /**
      * memory management control operations buffer.
@@ -520,6 +542,17 @@ typedef struct H264Context{
     int single_decode_warning;
 
     int last_slice_type;
+
+    /**
+     * Wavefront mode: entropy decoding of the slice saves each macroblock to
+     * mb_records, and the slice threads reconstruct and deblock them row by row.
+     */
+    int wavefront;
+    H264MBRecord *mb_records;   ///< one per macroblock of the picture
+    int wavefront_start_row;    ///< first MB row of the slice
+    int wavefront_start_x;
+    volatile int wavefront_end; ///< raster index of the first MB which entropy decoding did not save
+    uint8_t (*wavefront_borders[2])[16+2*8]; ///< top_borders written by even and odd rows
     /** @} */
 
     int mb_xy;
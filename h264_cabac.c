@@ -1194,6 +1194,7 @@ static av_always_inline void decode_cabac_residual_internal( H264Context *h, DCT
             }
         } else {
             int coeff_abs = 2;
+            int level;
             ctx = coeff_abs_levelgt1_ctx[node_ctx] + abs_level_m1_ctx_base;
             node_ctx = coeff_abs_level_transition[1][node_ctx];
 
@@ -1207,17 +1208,27 @@ static av_always_inline void decode_cabac_residual_internal( H264Context *h, DCT
                     j++;
                 }
 
+#ifdef BATCHED_CABAC_BYPASS
+                /* the Exp-Golomb suffix and the sign are consecutive bypass
+                 * bins, decode them in one go */
+                level = get_cabac_bypass_bits( CC, j + 1 );
+                coeff_abs = (level >> 1) + (1 << j) + 14;
+                level = (coeff_abs ^ -(level & 1)) + (level & 1);
+#else
                 coeff_abs=1;
                 while( j-- ) {
                     coeff_abs += coeff_abs + get_cabac_bypass( CC );
                 }
                 coeff_abs+= 14;
-            }
+                level = get_cabac_bypass_sign( CC, -coeff_abs );
+#endif
+            } else
+                level = get_cabac_bypass_sign( CC, -coeff_abs );
 
             if( is_dc ) {
-                block[j] = get_cabac_bypass_sign( CC, -coeff_abs );
+                block[j] = level;
             }else{
-                block[j] = (get_cabac_bypass_sign( CC, -coeff_abs ) * qmul[j] + 32) >> 6;
+                block[j] = (level * qmul[j] + 32) >> 6;
             }
         }
     } while( coeff_count );
@@ -32,6 +32,7 @@
 #include "h264.h"
 #include "h264_mvpred.h"
 #include "rectangle.h"
+#include "thread.h"
 
 //#undef NDEBUG
 #include <assert.h>
@@ -130,6 +131,31 @@ void ff_h264_direct_ref_list_init(H264Context * const h){
     }
 }
 
+/**
+ * Waits until the co-located macroblock rows of the first list 1 reference
+ * have been decoded by the thread responsible for them.
+ */
+static void await_reference_mb_row(H264Context * const h, Picture *ref, int mb_y)
+{
+    int ref_field = ref->reference - 1;
+    int ref_field_picture = ref->field_picture;
+    int ref_height = 16*h->s.mb_height >> ref_field_picture;
+
+    if(!(h->s.avctx->active_thread_type&FF_THREAD_FRAME))
+        return;
+
+    // error resilience may have put the picture being decoded in the list
+    if(ref->thread_opaque == h->s.current_picture.thread_opaque &&
+       (ref->reference&3) == h->s.picture_structure)
+        return;
+
+    //FIXME it can be safe to access mb stuff
+    //even if pixels aren't deblocked yet
+
+    ff_thread_await_progress((AVFrame*)ref, FFMIN(16*mb_y >> ref_field_picture, ref_height-1),
+                             ref_field_picture && ref_field);
+}
+
 void ff_h264_pred_direct_motion(H264Context * const h, int *mb_type){
     MpegEncContext * const s = &h->s;
     int b8_stride = h->b8_stride;
@@ -144,6 +170,9 @@ void ff_h264_pred_direct_motion(H264Context * const h, int *mb_type){
 
     assert(h->ref_list[1][0].reference&3);
 
+    // the co-located macroblock is at most one row below the current one
+    await_reference_mb_row(h, &h->ref_list[1][0], s->mb_y + 1);
+
 #define MB_TYPE_16x16_OR_INTRA (MB_TYPE_16x16|MB_TYPE_INTRA4x4|MB_TYPE_INTRA16x16|MB_TYPE_INTRA_PCM)
 
     if(IS_INTERLACED(h->ref_list[1][0].mb_type[mb_xy])){ // AFL/AFR/FR/FL -> AFL/FL
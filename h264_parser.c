@@ -246,6 +246,7 @@ static int h264_parse(AVCodecParserContext *s,
         next= buf_size;
     }else{
         next= ff_h264_find_frame_end(h, buf, buf_size);
+        pc->stable_input= s->flags & PARSER_FLAG_STABLE_INPUT;
 
         if (ff_combine_frame(pc, next, &buf, &buf_size) < 0) {
             *poutbuf = NULL;
@@ -28,12 +28,15 @@
  * huffyuv codec for libavcodec.
  */
 
+#include "libavutil/intreadwrite.h"
 #include "avcodec.h"
 #include "get_bits.h"
 #include "put_bits.h"
 #include "dsputil.h"
+#include "thread.h"
 
 #define VLC_BITS 11
+#define MAX_BANDS 255
 
 #if HAVE_BIGENDIAN
 #define B 3
@@ -79,15 +82,22 @@ typedef struct HYuvContext{
     uint8_t *bitstream_buffer;
     unsigned int bitstream_buffer_size;
     DSPContext dsp;
+    int nb_bands;                           //number of bands with stored offsets, ffvhuff only
+    int band_pos[MAX_BANDS+1];              //bit position of the first row of each band
+    uint8_t *residual;                      //residuals of the whole frame if the bands are decoded in parallel
+    unsigned int residual_size;
+    uint8_t *res[3];                        //next row in residual for each plane, NULL for serial decoding
 }HYuvContext;
 
-static const unsigned char classic_shift_luma[] = {
+#define classic_shift_luma_table_size 43
+static const unsigned char classic_shift_luma[classic_shift_luma_table_size + FF_INPUT_BUFFER_PADDING_SIZE] = {
   34,36,35,69,135,232,9,16,10,24,11,23,12,16,13,10,14,8,15,8,
   16,8,17,20,16,10,207,206,205,236,11,8,10,21,9,23,8,8,199,70,
   69,68, 0
 };
 
-static const unsigned char classic_shift_chroma[] = {
+#define classic_shift_chroma_table_size 60
+static const unsigned char classic_shift_chroma[classic_shift_chroma_table_size + FF_INPUT_BUFFER_PADDING_SIZE] = {
   66,36,37,38,39,40,41,75,76,77,110,239,144,81,82,83,84,85,118,183,
   56,57,88,89,56,89,154,57,58,57,26,141,57,56,58,57,58,57,184,119,
   214,245,116,83,82,49,80,79,78,77,44,75,41,40,39,38,37,36,34, 0
@@ -369,10 +379,10 @@ static int read_old_huffman_tables(HYuvContext *s){
     GetBitContext gb;
     int i;
 
-    init_get_bits(&gb, classic_shift_luma, sizeof(classic_shift_luma)*8);
+    init_get_bits(&gb, classic_shift_luma, classic_shift_luma_table_size*8);
     if(read_len_table(s->len[0], &gb)<0)
         return -1;
-    init_get_bits(&gb, classic_shift_chroma, sizeof(classic_shift_chroma)*8);
+    init_get_bits(&gb, classic_shift_chroma, classic_shift_chroma_table_size*8);
     if(read_len_table(s->len[1], &gb)<0)
         return -1;
 
@@ -408,7 +418,10 @@ static av_cold void alloc_temp(HYuvContext *s){
             s->temp[i]= av_malloc(s->width + 16);
         }
     }else{
-        s->temp[0]= av_mallocz(4*s->width + 16);
+        /* temp[1] holds the vertical difference for the plane predictor */
+        for(i=0; i<2; i++){
+            s->temp[i]= av_mallocz(4*s->width + 16);
+        }
     }
 }
 
@@ -461,6 +474,8 @@ s->bgr32=1;
         interlace= (((uint8_t*)avctx->extradata)[2] & 0x30) >> 4;
         s->interlaced= (interlace==1) ? 1 : (interlace==2) ? 0 : s->interlaced;
         s->context= ((uint8_t*)avctx->extradata)[2] & 0x40 ? 1 : 0;
+        if(avctx->codec_id == CODEC_ID_FFVHUFF)
+            s->nb_bands= ((uint8_t*)avctx->extradata)[3];
 
         if(read_huffman_tables(s, ((uint8_t*)avctx->extradata)+4, avctx->extradata_size) < 0)
             return -1;
@@ -517,12 +532,44 @@ s->bgr32=1;
         assert(0);
     }
 
+    if(s->nb_bands > 1 && (s->bitstream_bpp==12 || (s->width&1) || s->nb_bands > s->height)){
+        av_log(avctx, AV_LOG_WARNING, "ignoring band offsets\n");
+        s->nb_bands= 0;
+    }
+
     alloc_temp(s);
 
 //    av_log(NULL, AV_LOG_DEBUG, "pred:%d bpp:%d hbpp:%d il:%d\n", s->predictor, s->bitstream_bpp, avctx->bits_per_coded_sample, s->interlaced);
 
     return 0;
 }
+
+static av_cold int decode_init_thread_copy(AVCodecContext *avctx)
+{
+    HYuvContext *s = avctx->priv_data;
+    int i;
+
+    s->avctx= avctx;
+    avctx->coded_frame= &s->picture;
+    s->bitstream_buffer= NULL;
+    s->bitstream_buffer_size= 0;
+    s->residual= NULL;
+    s->residual_size= 0;
+    alloc_temp(s);
+
+    for(i=0; i<6; i++)
+        s->vlc[i].table= NULL;
+
+    if(s->version==2){
+        if(read_huffman_tables(s, ((uint8_t*)avctx->extradata)+4, avctx->extradata_size) < 0)
+            return -1;
+    }else{
+        if(read_old_huffman_tables(s) < 0)
+            return -1;
+    }
+
+    return 0;
+}
 #endif /* CONFIG_HUFFYUV_DECODER || CONFIG_FFVHUFF_DECODER */
 
 #if CONFIG_HUFFYUV_ENCODER || CONFIG_FFVHUFF_ENCODER
@@ -606,12 +653,19 @@ static av_cold int encode_init(AVCodecContext *avctx)
         return -1;
     }
 
+    /* Store where each band starts so that decoders can run the huffman
+     * decoding of the bands in parallel. The bitstream is unchanged, the
+     * offsets are appended to each frame and ignored by older decoders. */
+    s->nb_bands= 0;
+    if(avctx->codec->id==CODEC_ID_FFVHUFF && avctx->thread_count > 1 && s->bitstream_bpp != 12)
+        s->nb_bands= av_clip(avctx->thread_count, 1, FFMIN(FFMAX(s->height / 16, 1), MAX_BANDS));
+
     ((uint8_t*)avctx->extradata)[0]= s->predictor | (s->decorrelate << 6);
     ((uint8_t*)avctx->extradata)[1]= s->bitstream_bpp;
     ((uint8_t*)avctx->extradata)[2]= s->interlaced ? 0x10 : 0x20;
     if(s->context)
         ((uint8_t*)avctx->extradata)[2]|= 0x40;
-    ((uint8_t*)avctx->extradata)[3]= 0;
+    ((uint8_t*)avctx->extradata)[3]= s->nb_bands > 1 ? s->nb_bands : 0;
     s->avctx->extradata_size= 4;
 
     if(avctx->stats_in){
@@ -679,33 +733,71 @@ static av_cold int encode_init(AVCodecContext *avctx)
 
 /* TODO instead of restarting the read when the code isn't in the first level
  * of the joint table, jump into the 2nd level of the individual table. */
-#define READ_2PIX(dst0, dst1, plane1){\
-    uint16_t code = get_vlc2(&s->gb, s->vlc[3+plane1].table, VLC_BITS, 1);\
+#define READ_2PIX(gb, dst0, dst1, plane1){\
+    uint16_t code = get_vlc2(gb, s->vlc[3+plane1].table, VLC_BITS, 1);\
     if(code != 0xffff){\
         dst0 = code>>8;\
         dst1 = code;\
     }else{\
-        dst0 = get_vlc2(&s->gb, s->vlc[0].table, VLC_BITS, 3);\
-        dst1 = get_vlc2(&s->gb, s->vlc[plane1].table, VLC_BITS, 3);\
+        dst0 = get_vlc2(gb, s->vlc[0].table, VLC_BITS, 3);\
+        dst1 = get_vlc2(gb, s->vlc[plane1].table, VLC_BITS, 3);\
     }\
 }
 
-static void decode_422_bitstream(HYuvContext *s, int count){
+/* Same as READ_2PIX() but on the open reader re, the caller refills the
+ * cache. Every code ends within VLC_BITS bits of the last refill, even the
+ * ones GET_VLC() refills for, so this uses at most 2*VLC_BITS. */
+#define READ_2PIX_CACHED(gb, dst0, dst1, plane1){\
+    uint16_t code;\
+    GET_VLC(code, re, gb, s->vlc[3+plane1].table, VLC_BITS, 1)\
+    if(code != 0xffff){\
+        dst0 = code>>8;\
+        dst1 = code;\
+    }else{\
+        int code0, code1;\
+        GET_VLC(code0, re, gb, s->vlc[0].table, VLC_BITS, 3)\
+        GET_VLC(code1, re, gb, s->vlc[plane1].table, VLC_BITS, 3)\
+        dst0 = code0;\
+        dst1 = code1;\
+    }\
+}
+
+static void read_422_bitstream(HYuvContext *s, GetBitContext *gb, uint8_t *y, uint8_t *u, uint8_t *v, int count){
     int i;
 
     count/=2;
 
-    if(count >= (get_bits_left(&s->gb))/(31*4)){
-        for(i=0; i<count && get_bits_count(&s->gb) < s->gb.size_in_bits; i++){
-            READ_2PIX(s->temp[0][2*i  ], s->temp[1][i], 1);
-            READ_2PIX(s->temp[0][2*i+1], s->temp[2][i], 2);
+    if(count >= (get_bits_left(gb))/(31*4)){
+        for(i=0; i<count && get_bits_count(gb) < gb->size_in_bits; i++){
+            READ_2PIX(gb, y[2*i  ], u[i], 1);
+            READ_2PIX(gb, y[2*i+1], v[i], 2);
         }
     }else{
+        OPEN_READER(re, gb);
         for(i=0; i<count; i++){
-            READ_2PIX(s->temp[0][2*i  ], s->temp[1][i], 1);
-            READ_2PIX(s->temp[0][2*i+1], s->temp[2][i], 2);
+            UPDATE_CACHE(re, gb);
+            READ_2PIX_CACHED(gb, y[2*i  ], u[i], 1);
+#if UPDATE_CACHE_BITS < 4*VLC_BITS
+            UPDATE_CACHE(re, gb);
+#endif
+            READ_2PIX_CACHED(gb, y[2*i+1], v[i], 2);
         }
+        CLOSE_READER(re, gb);
+    }
+}
+
+static void decode_422_bitstream(HYuvContext *s, int count){
+    if(s->res[0]){
+        /* already decoded by decode_band(), just point temp at it */
+        s->temp[0]= s->res[0];
+        s->temp[1]= s->res[1];
+        s->temp[2]= s->res[2];
+        s->res[0]+= count;
+        s->res[1]+= count/2;
+        s->res[2]+= count/2;
+        return;
     }
+    read_422_bitstream(s, &s->gb, s->temp[0], s->temp[1], s->temp[2], count);
 }
 
 static void decode_gray_bitstream(HYuvContext *s, int count){
@@ -715,12 +807,19 @@ static void decode_gray_bitstream(HYuvContext *s, int count){
 
     if(count >= (get_bits_left(&s->gb))/(31*2)){
         for(i=0; i<count && get_bits_count(&s->gb) < s->gb.size_in_bits; i++){
-            READ_2PIX(s->temp[0][2*i  ], s->temp[0][2*i+1], 0);
+            READ_2PIX(&s->gb, s->temp[0][2*i  ], s->temp[0][2*i+1], 0);
         }
     }else{
+        OPEN_READER(re, &s->gb);
         for(i=0; i<count; i++){
-            READ_2PIX(s->temp[0][2*i  ], s->temp[0][2*i+1], 0);
+            UPDATE_CACHE(re, &s->gb);
+            READ_2PIX_CACHED(&s->gb, s->temp[0][2*i  ], s->temp[0][2*i+1], 0);
+#if UPDATE_CACHE_BITS >= 4*VLC_BITS
+            if(++i < count)
+                READ_2PIX_CACHED(&s->gb, s->temp[0][2*i  ], s->temp[0][2*i+1], 0);
+#endif
         }
+        CLOSE_READER(re, &s->gb);
     }
 }
 
@@ -822,40 +921,69 @@ static int encode_gray_bitstream(HYuvContext *s, int count){
 }
 #endif /* CONFIG_HUFFYUV_ENCODER || CONFIG_FFVHUFF_ENCODER */
 
-static av_always_inline void decode_bgr_1(HYuvContext *s, int count, int decorrelate, int alpha){
-    int i;
+static av_always_inline void decode_bgr_1(HYuvContext *s, GetBitContext *gb, uint8_t *dst, int count, int decorrelate, int alpha){
+    int i, code, b, g, r;
+    OPEN_READER(re, gb);
     for(i=0; i<count; i++){
-        int code = get_vlc2(&s->gb, s->vlc[3].table, VLC_BITS, 1);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlc[3].table, VLC_BITS, 1)
         if(code != -1){
-            *(uint32_t*)&s->temp[0][4*i] = s->pix_bgr_map[code];
+            *(uint32_t*)&dst[4*i] = s->pix_bgr_map[code];
         }else if(decorrelate){
-            s->temp[0][4*i+G] = get_vlc2(&s->gb, s->vlc[1].table, VLC_BITS, 3);
-            s->temp[0][4*i+B] = get_vlc2(&s->gb, s->vlc[0].table, VLC_BITS, 3) + s->temp[0][4*i+G];
-            s->temp[0][4*i+R] = get_vlc2(&s->gb, s->vlc[2].table, VLC_BITS, 3) + s->temp[0][4*i+G];
+            GET_VLC(g, re, gb, s->vlc[1].table, VLC_BITS, 3)
+            GET_VLC(b, re, gb, s->vlc[0].table, VLC_BITS, 3)
+#if UPDATE_CACHE_BITS < 3*VLC_BITS
+            UPDATE_CACHE(re, gb);
+#endif
+            GET_VLC(r, re, gb, s->vlc[2].table, VLC_BITS, 3)
+            dst[4*i+G] = g;
+            dst[4*i+B] = b + g;
+            dst[4*i+R] = r + g;
         }else{
-            s->temp[0][4*i+B] = get_vlc2(&s->gb, s->vlc[0].table, VLC_BITS, 3);
-            s->temp[0][4*i+G] = get_vlc2(&s->gb, s->vlc[1].table, VLC_BITS, 3);
-            s->temp[0][4*i+R] = get_vlc2(&s->gb, s->vlc[2].table, VLC_BITS, 3);
+            GET_VLC(b, re, gb, s->vlc[0].table, VLC_BITS, 3)
+            GET_VLC(g, re, gb, s->vlc[1].table, VLC_BITS, 3)
+#if UPDATE_CACHE_BITS < 3*VLC_BITS
+            UPDATE_CACHE(re, gb);
+#endif
+            GET_VLC(r, re, gb, s->vlc[2].table, VLC_BITS, 3)
+            dst[4*i+B] = b;
+            dst[4*i+G] = g;
+            dst[4*i+R] = r;
+        }
+        if(alpha){
+#if UPDATE_CACHE_BITS < 4*VLC_BITS
+            UPDATE_CACHE(re, gb);
+#endif
+            GET_VLC(code, re, gb, s->vlc[2].table, VLC_BITS, 3)
+            dst[4*i+A] = code;
         }
-        if(alpha)
-            s->temp[0][4*i+A] = get_vlc2(&s->gb, s->vlc[2].table, VLC_BITS, 3);
     }
+    CLOSE_READER(re, gb);
 }
 
-static void decode_bgr_bitstream(HYuvContext *s, int count){
+static void read_bgr_bitstream(HYuvContext *s, GetBitContext *gb, uint8_t *dst, int count){
     if(s->decorrelate){
         if(s->bitstream_bpp==24)
-            decode_bgr_1(s, count, 1, 0);
+            decode_bgr_1(s, gb, dst, count, 1, 0);
         else
-            decode_bgr_1(s, count, 1, 1);
+            decode_bgr_1(s, gb, dst, count, 1, 1);
     }else{
         if(s->bitstream_bpp==24)
-            decode_bgr_1(s, count, 0, 0);
+            decode_bgr_1(s, gb, dst, count, 0, 0);
         else
-            decode_bgr_1(s, count, 0, 1);
+            decode_bgr_1(s, gb, dst, count, 0, 1);
     }
 }
 
+static void decode_bgr_bitstream(HYuvContext *s, int count){
+    if(s->res[0]){
+        s->temp[0]= s->res[0];
+        s->res[0]+= 4*count;
+        return;
+    }
+    read_bgr_bitstream(s, &s->gb, s->temp[0], count);
+}
+
 static int encode_bgr_bitstream(HYuvContext *s, int count){
     int i;
 
@@ -925,6 +1053,58 @@ static void draw_slice(HYuvContext *s, int y){
     s->last_slice_end= y + h;
 }
 
+/**
+ * Read the band offsets stored after the bitstream.
+ * @return 0 on success, -1 if they are not usable; the frame can then
+ *         still be decoded serially as the bitstream itself is unchanged
+ */
+static int read_band_offsets(HYuvContext *s, const uint8_t *buf, int buf_size, int table_size){
+    const int trailer= 4*(s->nb_bands-1);
+    const uint8_t *p= buf + buf_size - trailer;
+    int i;
+
+    if(buf_size - table_size < trailer + 4)
+        return -1;
+
+    s->band_pos[0]= 32; // the first pixels are stored uncompressed
+    s->band_pos[s->nb_bands]= (buf_size - table_size - trailer)*8;
+    for(i=1; i<s->nb_bands; i++){
+        s->band_pos[i]= AV_RB32(p + 4*(i-1));
+        if(s->band_pos[i] <= s->band_pos[i-1] || s->band_pos[i] >= s->band_pos[s->nb_bands])
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Huffman decode the rows of one band into s->residual.
+ * The prediction is undone serially afterwards in decode_frame().
+ */
+static int decode_band(AVCodecContext *avctx, void *arg, int jobnr, int threadnr){
+    HYuvContext *s = avctx->priv_data;
+    const int width= s->width;
+    const int first= jobnr*s->height/s->nb_bands;
+    const int last= (jobnr+1)*s->height/s->nb_bands;
+    GetBitContext gb;
+    int y;
+
+    init_get_bits(&gb, s->gb.buffer, s->band_pos[jobnr+1]);
+    skip_bits_long(&gb, s->band_pos[jobnr]);
+
+    for(y=first; y<last; y++){
+        if(s->bitstream_bpp<24){
+            const int offset= y ? y*width-2 : 0;
+            uint8_t *u= s->residual + width*s->height;
+
+            read_422_bitstream(s, &gb, s->residual + offset, u + offset/2, u + width*s->height/2 + offset/2,
+                               y ? width : width-2);
+        }else{
+            read_bgr_bitstream(s, &gb, s->residual + 4*(y ? y*width-1 : 0), y ? width : width-1);
+        }
+    }
+    return 0;
+}
+
 static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt){
     const uint8_t *buf = avpkt->data;
     int buf_size = avpkt->size;
@@ -935,6 +1115,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     int fake_ystride, fake_ustride, fake_vstride;
     AVFrame * const p= &s->picture;
     int table_size= 0;
+    uint8_t *temp[3];
 
     AVFrame *picture = data;
 
@@ -946,10 +1127,10 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     s->dsp.bswap_buf((uint32_t*)s->bitstream_buffer, (const uint32_t*)buf, buf_size/4);
 
     if(p->data[0])
-        avctx->release_buffer(avctx, p);
+        ff_thread_release_buffer(avctx, p);
 
     p->reference= 0;
-    if(avctx->get_buffer(avctx, p) < 0){
+    if(ff_thread_get_buffer(avctx, p) < 0){
         av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
         return -1;
     }
@@ -965,6 +1146,24 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
 
     init_get_bits(&s->gb, s->bitstream_buffer+table_size, (buf_size-table_size)*8);
 
+    if(s->nb_bands > 1 && (avctx->active_thread_type&FF_THREAD_SLICE)){
+        if(read_band_offsets(s, buf, buf_size, table_size) < 0){
+            av_log(avctx, AV_LOG_WARNING, "invalid band offsets, decoding serially\n");
+        }else{
+            const int plane_size= s->width*s->height;
+
+            av_fast_malloc(&s->residual, &s->residual_size, 4*plane_size + 32);
+            if(!s->residual)
+                return AVERROR(ENOMEM);
+            avctx->execute2(avctx, decode_band, NULL, NULL, s->nb_bands);
+
+            memcpy(temp, s->temp, sizeof(temp));
+            s->res[0]= s->residual;
+            s->res[1]= s->residual + plane_size;
+            s->res[2]= s->residual + plane_size*3/2;
+        }
+    }
+
     fake_ystride= s->interlaced ? p->linesize[0]*2  : p->linesize[0];
     fake_ustride= s->interlaced ? p->linesize[1]*2  : p->linesize[1];
     fake_vstride= s->interlaced ? p->linesize[2]*2  : p->linesize[2];
@@ -1169,6 +1368,12 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     *picture= *p;
     *data_size = sizeof(AVFrame);
 
+    if(s->res[0]){
+        memcpy(s->temp, temp, sizeof(temp));
+        s->res[0]= NULL;
+        return buf_size;
+    }
+
     return (get_bits_count(&s->gb)+31)/32*4 + table_size;
 }
 #endif /* CONFIG_HUFFYUV_DECODER || CONFIG_FFVHUFF_DECODER */
@@ -1189,10 +1394,11 @@ static av_cold int decode_end(AVCodecContext *avctx)
     int i;
 
     if (s->picture.data[0])
-        avctx->release_buffer(avctx, &s->picture);
+        ff_thread_release_buffer(avctx, &s->picture);
 
     common_end(s);
     av_freep(&s->bitstream_buffer);
+    av_freep(&s->residual);
 
     for(i=0; i<6; i++){
         free_vlc(&s->vlc[i]);
@@ -1203,6 +1409,19 @@ static av_cold int decode_end(AVCodecContext *avctx)
 #endif /* CONFIG_HUFFYUV_DECODER || CONFIG_FFVHUFF_DECODER */
 
 #if CONFIG_HUFFYUV_ENCODER || CONFIG_FFVHUFF_ENCODER
+/**
+ * Store the bit position of row y if it is the first row of a band.
+ */
+static void mark_band_start(HYuvContext *s, int y){
+    int band;
+
+    if(s->nb_bands < 2)
+        return;
+    band= (y*s->nb_bands + s->height - 1) / s->height;
+    if(band < s->nb_bands && band*s->height/s->nb_bands == y)
+        s->band_pos[band]= put_bits_count(&s->pb);
+}
+
 static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
     HYuvContext *s = avctx->priv_data;
     AVFrame *pict = data;
@@ -1256,6 +1475,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                 leftu= sub_left_prediction(s, s->temp[1], p->data[1]+p->linesize[1], width2, leftu);
                 leftv= sub_left_prediction(s, s->temp[2], p->data[2]+p->linesize[2], width2, leftv);
 
+                mark_band_start(s, y);
                 encode_422_bitstream(s, 0, width);
                 y++; cy++;
             }
@@ -1264,6 +1484,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             leftu= sub_left_prediction(s, s->temp[1], p->data[1]+fake_ustride, 2, leftu);
             leftv= sub_left_prediction(s, s->temp[2], p->data[2]+fake_vstride, 2, leftv);
 
+            mark_band_start(s, y);
             encode_422_bitstream(s, 0, 4);
 
             lefttopy= p->data[0][3];
@@ -1295,6 +1516,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                 s->dsp.sub_hfyu_median_prediction(s->temp[1], udst - fake_ustride, udst, width2, &leftu, &lefttopu);
                 s->dsp.sub_hfyu_median_prediction(s->temp[2], vdst - fake_vstride, vdst, width2, &leftv, &lefttopv);
 
+                mark_band_start(s, y);
                 encode_422_bitstream(s, 0, width);
             }
         }else{
@@ -1335,6 +1557,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                     leftv= sub_left_prediction(s, s->temp[2], vdst, width2, leftv);
                 }
 
+                mark_band_start(s, y);
                 encode_422_bitstream(s, 0, width);
             }
         }
@@ -1361,6 +1584,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             }else{
                 sub_left_prediction_bgr32(s, s->temp[0], dst, width, &leftr, &leftg, &leftb);
             }
+            mark_band_start(s, y);
             encode_bgr_bitstream(s, width);
         }
     }else{
@@ -1391,6 +1615,16 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     if(!(s->avctx->flags2 & CODEC_FLAG2_NO_OUTPUT)){
         flush_put_bits(&s->pb);
         s->dsp.bswap_buf((uint32_t*)buf, (uint32_t*)buf, size);
+
+        if(s->nb_bands > 1){
+            if(buf_size < 4*(size + s->nb_bands-1)){
+                av_log(avctx, AV_LOG_ERROR, "encoded frame too large\n");
+                return -1;
+            }
+            for(i=1; i<s->nb_bands; i++)
+                AV_WB32(buf + 4*size + 4*(i-1), s->band_pos[i]);
+            size+= s->nb_bands-1;
+        }
     }
 
     s->picture_number++;
@@ -1421,9 +1655,10 @@ AVCodec huffyuv_decoder = {
     NULL,
     decode_end,
     decode_frame,
-    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND,
+    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_FRAME_THREADS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("Huffyuv / HuffYUV"),
+    .init_thread_copy = decode_init_thread_copy,
 };
 #endif
 
@@ -1437,9 +1672,10 @@ AVCodec ffvhuff_decoder = {
     NULL,
     decode_end,
     decode_frame,
-    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND,
+    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_FRAME_THREADS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("Huffyuv FFmpeg variant"),
+    .init_thread_copy = decode_init_thread_copy,
 };
 #endif
 
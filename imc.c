@@ -651,7 +651,7 @@ static int imc_decode_frame(AVCodecContext * avctx,
     int flag;
     int bits, summer;
     int counter, bitscount;
-    uint16_t buf16[IMC_BLOCK_SIZE / 2];
+    uint16_t buf16[(IMC_BLOCK_SIZE + FF_INPUT_BUFFER_PADDING_SIZE) / 2];
 
     if (buf_size < IMC_BLOCK_SIZE) {
         av_log(avctx, AV_LOG_ERROR, "imc frame too small!\n");
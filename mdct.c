@@ -153,6 +153,20 @@ void ff_imdct_half_c(FFTContext *s, FFTSample *output, const FFTSample *input)
     }
 }
 
+/**
+ * Compute the middle half of count inverse MDCTs of size N = 2^nbits
+ * @param output count pointers to N/2 samples
+ * @param input count pointers to N/2 samples
+ */
+void ff_imdct_half_batch_c(FFTContext *s, FFTSample **output,
+                           const FFTSample **input, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        s->imdct_half(s, output[i], input[i]);
+}
+
 /**
  * Compute inverse MDCT of size N = 2^nbits
  * @param output N samples
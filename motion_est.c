@@ -232,6 +232,18 @@ static int zero_cmp(void *s, uint8_t *a, uint8_t *b, int stride, int h){
 static void zero_hpel(uint8_t *a, const uint8_t *b, int stride, int h){
 }
 
+/**
+ * Builds the luma planes of pic downsampled by 2 and by 4 from the input
+ * picture, they are searched when pic is coded and when it is a reference.
+ */
+static void build_pyramid(MpegEncContext *s, Picture *pic){
+    const int w= 8*s->mb_width;
+    const int h= 8*s->mb_height;
+
+    s->dsp.shrink[1](pic->me_pyramid[0], w   , s->new_picture.data[0], s->linesize, w   , h   );
+    s->dsp.shrink[1](pic->me_pyramid[1], w>>1, pic->me_pyramid[0]    , w          , w>>1, h>>1);
+}
+
 int ff_init_me(MpegEncContext *s){
     MotionEstContext * const c= &s->me;
     int cache_size= FFMIN(ME_MAP_SIZE>>ME_MAP_SHIFT, 1<<ME_MAP_SHIFT);
@@ -242,8 +254,8 @@ int ff_init_me(MpegEncContext *s){
         return -1;
     }
     //special case of snow is needed because snow uses its own iterative ME code
-    if(s->me_method!=ME_ZERO && s->me_method!=ME_EPZS && s->me_method!=ME_X1 && s->avctx->codec_id != CODEC_ID_SNOW){
-        av_log(s->avctx, AV_LOG_ERROR, "me_method is only allowed to be set to zero and epzs; for hex,umh,full and others see dia_size\n");
+    if(s->me_method!=ME_ZERO && s->me_method!=ME_EPZS && s->me_method!=ME_X1 && s->me_method!=ME_PYRAMID && s->avctx->codec_id != CODEC_ID_SNOW){
+        av_log(s->avctx, AV_LOG_ERROR, "me_method is only allowed to be set to zero, epzs and pyramid; for hex,umh,full and others see dia_size\n");
         return -1;
     }
 
@@ -279,6 +291,7 @@ int ff_init_me(MpegEncContext *s){
             c->sub_motion_search= hpel_motion_search;
     }
     c->hpel_avg= s->dsp.avg_pixels_tab;
+    c->sad_x4= c->avctx->me_cmp == FF_CMP_SAD && s->dsp.sad_x4[0] ? s->dsp.sad_x4 : NULL;
     if(s->no_rounding) c->hpel_put= s->dsp.put_no_rnd_pixels_tab;
     else               c->hpel_put= s->dsp.put_pixels_tab;
 
@@ -308,6 +321,11 @@ int ff_init_me(MpegEncContext *s){
         c->sub_motion_search= no_sub_motion_search;
     }
 
+    c->pyramid_valid= 0;
+    if(s->me_method == ME_PYRAMID && s->codec_id != CODEC_ID_SNOW
+       && s->current_picture_ptr && s->current_picture_ptr->me_pyramid[0])
+        build_pyramid(s, s->current_picture_ptr);
+
     return 0;
 }
 
@@ -517,6 +535,94 @@ static inline void get_limits(MpegEncContext *s, int x, int y)
         c->ymin = FFMAX(c->ymin,-range);
         c->ymax = FFMIN(c->ymax, range);
     }
+    if(c->vrange){
+        c->ymin = FFMAX(c->ymin,-c->vrange);
+        c->ymax = FFMIN(c->ymax, c->vrange);
+    }
+}
+
+#define PYRAMID_RANGE      8 ///< search range on the plane downsampled by 4
+#define PYRAMID_MV_PENALTY 2 ///< cost of one downsampled pixel of vector length
+
+static av_always_inline int pyramid_cmp(MpegEncContext *s, uint8_t *cur, uint8_t *ref, int stride,
+                                        int mx, int my, int best[2], int dmin){
+    const int d= s->dsp.sad[1](NULL, cur, ref + mx + my*stride, stride, 8)
+                 + PYRAMID_MV_PENALTY*(FFABS(mx) + FFABS(my));
+
+    if(d < dmin){
+        best[0]= mx;
+        best[1]= my;
+        return d;
+    }
+    return dmin;
+}
+
+/**
+ * Searches the motion of the current MB on the planes downsampled by 4 and
+ * by 2 and stores it as an additional candidate of the following EPZS search.
+ * A coarse grid on the smallest plane finds motion which is too large for the
+ * predictors and the diamond without needing a large me_range.
+ * get_limits() must have been called for the MB.
+ * @param ref the reference picture
+ * @param pred_x fullpel predicted motion vector
+ */
+static void pyramid_search(MpegEncContext *s, Picture *ref, int mb_x, int mb_y,
+                           int pred_x, int pred_y){
+    static const int8_t dia[4][2]={{-1,0},{1,0},{0,-1},{0,1}};
+    MotionEstContext * const c= &s->me;
+    int best[2]={0, 0};
+    int level, dmin, i, x, y;
+
+    c->pyramid_valid= 0;
+    if(!s->current_picture.me_pyramid[1] || !ref->me_pyramid[1] || s->mb_width < 2 || s->mb_height < 2)
+        return;
+
+    for(level=1; level>=0; level--){
+        const int stride= 8*s->mb_width  >> level;
+        const int h     = 8*s->mb_height >> level;
+        const int shift = level + 1;
+        /* 8x8 blocks, the 4x4 MB is centered in it on the smallest plane */
+        const int bx= av_clip((8*mb_x >> level) - 2*level, 0, stride - 8);
+        const int by= av_clip((8*mb_y >> level) - 2*level, 0, h      - 8);
+        const int xmin= FFMAX(-bx, c->xmin >> shift), xmax= FFMIN(stride - 8 - bx, c->xmax >> shift);
+        const int ymin= FFMAX(-by, c->ymin >> shift), ymax= FFMIN(h      - 8 - by, c->ymax >> shift);
+        uint8_t *cur   = s->current_picture.me_pyramid[level] + bx + by*stride;
+        uint8_t *ref_y = ref->me_pyramid[level]               + bx + by*stride;
+
+        if(level){
+            dmin= INT_MAX;
+            for(y=-PYRAMID_RANGE; y<=PYRAMID_RANGE; y+=2){
+                if(y < ymin || y > ymax) continue;
+                for(x=-PYRAMID_RANGE; x<=PYRAMID_RANGE; x+=2){
+                    if(x < xmin || x > xmax) continue;
+                    dmin= pyramid_cmp(s, cur, ref_y, stride, x, y, best, dmin);
+                }
+            }
+        }else{
+            best[0]= av_clip(2*best[0], xmin, xmax);
+            best[1]= av_clip(2*best[1], ymin, ymax);
+            dmin= pyramid_cmp(s, cur, ref_y, stride, best[0], best[1], best, INT_MAX);
+        }
+        dmin= pyramid_cmp(s, cur, ref_y, stride, av_clip(pred_x >> shift, xmin, xmax),
+                                                 av_clip(pred_y >> shift, ymin, ymax), best, dmin);
+
+        for(;;){
+            const int cx= best[0], cy= best[1];
+
+            for(i=0; i<4; i++){
+                x= cx + dia[i][0];
+                y= cy + dia[i][1];
+                if(x >= xmin && x <= xmax && y >= ymin && y <= ymax)
+                    dmin= pyramid_cmp(s, cur, ref_y, stride, x, y, best, dmin);
+            }
+            if(best[0] == cx && best[1] == cy)
+                break;
+        }
+    }
+
+    c->pyramid_mv[0]= 2*best[0];
+    c->pyramid_mv[1]= 2*best[1];
+    c->pyramid_valid= 1;
 }
 
 static inline void init_mv4_ref(MotionEstContext *c){
@@ -1008,6 +1114,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
         break;
     case ME_X1:
     case ME_EPZS:
+    case ME_PYRAMID:
        {
             const int mot_stride = s->b8_stride;
             const int mot_xy = s->block_index[0];
@@ -1042,7 +1149,12 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
             }
 
         }
+        if(s->me_method == ME_PYRAMID){
+            int *pred= s->first_slice_line ? P_LEFT : P_MEDIAN;
+            pyramid_search(s, &s->last_picture, mb_x, mb_y, pred[0]>>shift, pred[1]>>shift);
+        }
         dmin = ff_epzs_motion_search(s, &mx, &my, P, 0, 0, s->p_mv_table, (1<<16)>>shift, 0, 16);
+        c->pyramid_valid= 0;
 
         break;
     }
@@ -1279,6 +1391,7 @@ static int ff_estimate_motion_b(MpegEncContext * s,
         break;
     case ME_X1:
     case ME_EPZS:
+    case ME_PYRAMID:
        {
             P_LEFT[0]        = mv_table[mot_xy - 1][0];
             P_LEFT[1]        = mv_table[mot_xy - 1][1];
@@ -1308,7 +1421,13 @@ static int ff_estimate_motion_b(MpegEncContext * s,
             mv_scale= ((s->pb_time - s->pp_time)<<16) / (s->pp_time<<shift);
         }
 
+        if(s->me_method == ME_PYRAMID){
+            int *pred= s->first_slice_line ? P_LEFT : P_MEDIAN;
+            pyramid_search(s, ref_index ? &s->next_picture : &s->last_picture,
+                           mb_x, mb_y, pred[0]>>shift, pred[1]>>shift);
+        }
         dmin = ff_epzs_motion_search(s, &mx, &my, P, 0, ref_index, s->p_mv_table, mv_scale, 0, 16);
+        c->pyramid_valid= 0;
 
         break;
     }
@@ -523,26 +523,6 @@ static int qpel_motion_search(MpegEncContext * s,
     CHECK_MV(Lx2, Ly2)\
 }
 
-#define CHECK_MV_DIR(x,y,new_dir)\
-{\
-    const int key= ((y)<<ME_MAP_MV_BITS) + (x) + map_generation;\
-    const int index= (((y)<<ME_MAP_SHIFT) + (x))&(ME_MAP_SIZE-1);\
-/*printf("check_mv_dir %d %d %d\n", x, y, new_dir);*/\
-    if(map[index]!=key){\
-        d= cmp(s, x, y, 0, 0, size, h, ref_index, src_index, cmpf, chroma_cmpf, flags);\
-        map[index]= key;\
-        score_map[index]= d;\
-        d += (mv_penalty[((x)<<shift)-pred_x] + mv_penalty[((y)<<shift)-pred_y])*penalty_factor;\
-/*printf("score:%d\n", d);*/\
-        if(d<dmin){\
-            best[0]=x;\
-            best[1]=y;\
-            dmin=d;\
-            next_dir= new_dir;\
-        }\
-    }\
-}
-
 #define check(x,y,S,v)\
 if( (x)<(xmin<<(S)) ) printf("%d %d %d %d %d xmin" #v, xmin, (x), (y), s->mb_x, s->mb_y);\
 if( (x)>(xmax<<(S)) ) printf("%d %d %d %d %d xmax" #v, xmax, (x), (y), s->mb_x, s->mb_y);\
@@ -554,6 +534,88 @@ if( (y)>(ymax<<(S)) ) printf("%d %d %d %d %d ymax" #v, ymax, (x), (y), s->mb_x,
     const int qpel= flags&FLAG_QPEL;\
     const int shift= 1+qpel;\
 
+/**
+ * Checks the fullpel candidates cand[0..n-1] in order like CHECK_MV(), the
+ * ones not in the map yet are scored 4 at a time with one batched SAD if
+ * me_cmp allows it.
+ * @return index of the candidate which became the new best one, -1 if none
+ */
+static av_always_inline int check_candidates(MpegEncContext * s, int *best, int *dmin_ptr,
+                                       int (*cand)[2], int n,
+                                       int src_index, int ref_index, int const penalty_factor,
+                                       int size, int h, int flags)
+{
+    MotionEstContext * const c= &s->me;
+    me_cmp_func cmpf, chroma_cmpf;
+    LOAD_COMMON
+    LOAD_COMMON2
+    const int map_generation= c->map_generation;
+    const int stride= c->stride;
+    const int batch= !(flags&(FLAG_CHROMA|FLAG_DIRECT)) && size<2 && c->sad_x4 && c->sad_x4[size];
+    int dmin= *dmin_ptr;
+    int ret= -1;
+    int i, j;
+
+    cmpf= s->dsp.me_cmp[size];
+    chroma_cmpf= s->dsp.me_cmp[size+1];
+
+    for(i=0; i<n; ){
+        uint8_t *ref[4];
+        int idx[4], index[4], d[4];
+        int m= 0;
+
+        for(; i<n && m<4; i++){
+            const int x= cand[i][0];
+            const int y= cand[i][1];
+            const int key= (y<<ME_MAP_MV_BITS) + x + map_generation;
+            assert(x >= xmin && x <= xmax && y >= ymin && y <= ymax);
+
+            index[m]= ((y<<ME_MAP_SHIFT) + x)&(ME_MAP_SIZE-1);
+            if(map[index[m]]!=key){
+                map[index[m]]= key;
+                ref[m]= c->ref[ref_index][0] + x + y*stride;
+                idx[m++]= i;
+            }
+        }
+        if(batch && m>1){
+            for(j=m; j<4; j++)
+                ref[j]= ref[0];
+            c->sad_x4[size](d, c->src[src_index][0], ref, stride, h);
+        }else{
+            for(j=0; j<m; j++)
+                d[j]= cmp(s, cand[idx[j]][0], cand[idx[j]][1], 0, 0, size, h, ref_index, src_index, cmpf, chroma_cmpf, flags);
+        }
+        for(j=0; j<m; j++){
+            const int x= cand[idx[j]][0];
+            const int y= cand[idx[j]][1];
+            score_map[index[j]]= d[j];
+            d[j] += (mv_penalty[(x<<shift)-pred_x] + mv_penalty[(y<<shift)-pred_y])*penalty_factor;
+            if(d[j] < dmin){
+                dmin= d[j];
+                best[0]= x;
+                best[1]= y;
+                ret= idx[j];
+            }
+        }
+    }
+    *dmin_ptr= dmin;
+    return ret;
+}
+
+#define ADD_CANDIDATE(x,y)\
+{\
+    cand[n][0]= x;\
+    cand[n][1]= y;\
+    n++;\
+}
+
+#define ADD_CLIPPED_CANDIDATE(ax,ay)\
+{\
+    const int Lx= ax;\
+    const int Ly= ay;\
+    ADD_CANDIDATE(FFMAX(xmin, FFMIN(Lx, xmax)), FFMAX(ymin, FFMIN(Ly, ymax)))\
+}
+
 static av_always_inline int small_diamond_search(MpegEncContext * s, int *best, int dmin,
                                        int src_index, int ref_index, int const penalty_factor,
                                        int size, int h, int flags)
@@ -578,21 +640,23 @@ static av_always_inline int small_diamond_search(MpegEncContext * s, int *best,
     }
 
     for(;;){
-        int d;
+        int cand[4][2], cand_dir[4];
+        int n= 0, i;
         const int dir= next_dir;
         const int x= best[0];
         const int y= best[1];
-        next_dir=-1;
 
 //printf("%d", dir);
-        if(dir!=2 && x>xmin) CHECK_MV_DIR(x-1, y  , 0)
-        if(dir!=3 && y>ymin) CHECK_MV_DIR(x  , y-1, 1)
-        if(dir!=0 && x<xmax) CHECK_MV_DIR(x+1, y  , 2)
-        if(dir!=1 && y<ymax) CHECK_MV_DIR(x  , y+1, 3)
+        if(dir!=2 && x>xmin){ cand_dir[n]= 0; ADD_CANDIDATE(x-1, y  ) }
+        if(dir!=3 && y>ymin){ cand_dir[n]= 1; ADD_CANDIDATE(x  , y-1) }
+        if(dir!=0 && x<xmax){ cand_dir[n]= 2; ADD_CANDIDATE(x+1, y  ) }
+        if(dir!=1 && y<ymax){ cand_dir[n]= 3; ADD_CANDIDATE(x  , y+1) }
 
-        if(next_dir==-1){
+        i= check_candidates(s, best, &dmin, cand, n, src_index, ref_index, penalty_factor, size, h, flags);
+        if(i<0){
             return dmin;
         }
+        next_dir= cand_dir[i];
     }
 }
 
@@ -662,29 +726,29 @@ static int hex_search(MpegEncContext * s, int *best, int dmin,
                                        int size, int h, int flags, int dia_size)
 {
     MotionEstContext * const c= &s->me;
-    me_cmp_func cmpf, chroma_cmpf;
-    LOAD_COMMON
-    LOAD_COMMON2
-    int map_generation= c->map_generation;
-    int x,y,d;
+    const int xmin= c->xmin;
+    const int ymin= c->ymin;
+    const int xmax= c->xmax;
+    const int ymax= c->ymax;
+    int x,y;
     const int dec= dia_size & (dia_size-1);
 
-    cmpf= s->dsp.me_cmp[size];
-    chroma_cmpf= s->dsp.me_cmp[size+1];
-
     for(;dia_size; dia_size= dec ? dia_size-1 : dia_size>>1){
         do{
+            int cand[6][2];
+            int n= 0;
             x= best[0];
             y= best[1];
 
-            CHECK_CLIPPED_MV(x  -dia_size    , y);
-            CHECK_CLIPPED_MV(x+  dia_size    , y);
-            CHECK_CLIPPED_MV(x+( dia_size>>1), y+dia_size);
-            CHECK_CLIPPED_MV(x+( dia_size>>1), y-dia_size);
+            ADD_CLIPPED_CANDIDATE(x  -dia_size    , y);
+            ADD_CLIPPED_CANDIDATE(x+  dia_size    , y);
+            ADD_CLIPPED_CANDIDATE(x+( dia_size>>1), y+dia_size);
+            ADD_CLIPPED_CANDIDATE(x+( dia_size>>1), y-dia_size);
             if(dia_size>1){
-                CHECK_CLIPPED_MV(x+(-dia_size>>1), y+dia_size);
-                CHECK_CLIPPED_MV(x+(-dia_size>>1), y-dia_size);
+                ADD_CLIPPED_CANDIDATE(x+(-dia_size>>1), y+dia_size);
+                ADD_CLIPPED_CANDIDATE(x+(-dia_size>>1), y-dia_size);
             }
+            check_candidates(s, best, &dmin, cand, n, src_index, ref_index, penalty_factor, size, h, flags);
         }while(best[0] != x || best[1] != y);
     }
 
@@ -933,55 +997,55 @@ static int var_diamond_search(MpegEncContext * s, int *best, int dmin,
                                        int size, int h, int flags)
 {
     MotionEstContext * const c= &s->me;
-    me_cmp_func cmpf, chroma_cmpf;
     int dia_size;
-    LOAD_COMMON
-    LOAD_COMMON2
-    int map_generation= c->map_generation;
+    const int xmin= c->xmin;
+    const int ymin= c->ymin;
+    const int xmax= c->xmax;
+    const int ymax= c->ymax;
 
-    cmpf= s->dsp.me_cmp[size];
-    chroma_cmpf= s->dsp.me_cmp[size+1];
+#define ADD_DIAMOND_CANDIDATE(ax,ay)\
+{\
+    ADD_CANDIDATE(ax, ay)\
+    if(n==4){\
+        check_candidates(s, best, &dmin, cand, n, src_index, ref_index, penalty_factor, size, h, flags);\
+        n= 0;\
+    }\
+}
 
     for(dia_size=1; dia_size<=c->dia_size; dia_size++){
-        int dir, start, end;
+        int cand[4][2];
+        int n= 0, dir, start, end;
         const int x= best[0];
         const int y= best[1];
 
         start= FFMAX(0, y + dia_size - ymax);
         end  = FFMIN(dia_size, xmax - x + 1);
         for(dir= start; dir<end; dir++){
-            int d;
-
 //check(x + dir,y + dia_size - dir,0, a0)
-            CHECK_MV(x + dir           , y + dia_size - dir);
+            ADD_DIAMOND_CANDIDATE(x + dir           , y + dia_size - dir);
         }
 
         start= FFMAX(0, x + dia_size - xmax);
         end  = FFMIN(dia_size, y - ymin + 1);
         for(dir= start; dir<end; dir++){
-            int d;
-
 //check(x + dia_size - dir, y - dir,0, a1)
-            CHECK_MV(x + dia_size - dir, y - dir           );
+            ADD_DIAMOND_CANDIDATE(x + dia_size - dir, y - dir           );
         }
 
         start= FFMAX(0, -y + dia_size + ymin );
         end  = FFMIN(dia_size, x - xmin + 1);
         for(dir= start; dir<end; dir++){
-            int d;
-
 //check(x - dir,y - dia_size + dir,0, a2)
-            CHECK_MV(x - dir           , y - dia_size + dir);
+            ADD_DIAMOND_CANDIDATE(x - dir           , y - dia_size + dir);
         }
 
         start= FFMAX(0, -x + dia_size + xmin );
         end  = FFMIN(dia_size, ymax - y + 1);
         for(dir= start; dir<end; dir++){
-            int d;
-
 //check(x - dia_size + dir, y + dir,0, a3)
-            CHECK_MV(x - dia_size + dir, y + dir           );
+            ADD_DIAMOND_CANDIDATE(x - dia_size + dir, y + dir           );
         }
+        check_candidates(s, best, &dmin, cand, n, src_index, ref_index, penalty_factor, size, h, flags);
 
         if(x!=best[0] || y!=best[1])
             dia_size=0;
@@ -1101,6 +1165,8 @@ static av_always_inline int epzs_motion_search_internal(MpegEncContext * s, int
         CHECK_MV(P_TOP[0]     >>shift, P_TOP[1]     >>shift)
         CHECK_MV(P_TOPRIGHT[0]>>shift, P_TOPRIGHT[1]>>shift)
     }
+    if(c->pyramid_valid)
+        CHECK_CLIPPED_MV(c->pyramid_mv[0], c->pyramid_mv[1])
     if(dmin>h*h*4){
         if(c->pre_pass){
             CHECK_CLIPPED_MV((last_mv[ref_mv_xy-1][0]*ref_mv_scale + (1<<15))>>16,
@@ -123,6 +123,7 @@ typedef struct Picture{
     int ref_poc[2][2][16];      ///< h264 POCs of the frames used as reference (FIXME need per slice)
     int ref_count[2][2];        ///< number of entries in ref_poc              (FIXME need per slice)
     int mbaff;                  ///< h264 1 -> MBAFF frame 0-> not MBAFF
+    int field_picture;          ///< whether or not the picture was encoded in separate fields
 
     int mb_var_sum;             ///< sum of MB variance for current frame
     int mc_mb_var_sum;          ///< motion compensated MB variance for current frame
@@ -131,6 +132,14 @@ typedef struct Picture{
     uint8_t *mb_mean;           ///< Table for MB luminance
     int32_t *mb_cmp_score;      ///< Table for MB cmp scores, for mb decision FIXME remove
     int b_frame_score;          /* */
+    uint16_t *lookahead_intra;  ///< intra cost estimate per MB from the lookahead, see b_frame_strategy 3
+    uint16_t *lookahead_inter;  ///< inter cost estimate per MB against the previous input picture, at most the intra cost
+    int32_t *lookahead_propagate; ///< part of the cost of later pictures which is inherited from each MB
+    int16_t (*lookahead_mv)[2]; ///< motion vector per MB found by the lookahead, in decimated pixels
+    int lookahead_intra_sum;
+    int lookahead_inter_sum;
+    uint8_t *me_pyramid[2];     ///< luma downsampled by 2 and by 4, see ME_PYRAMID
+    struct MpegEncContext *owner2; ///< pointer to the MpegEncContext that allocated this picture
 } Picture;
 
 struct MpegEncContext;
@@ -168,6 +177,9 @@ typedef struct MotionEstContext{
     int xmax;
     int ymin;
     int ymax;
+    int vrange;                        ///< vertical fullpel search range limit, 0 if only limited by me_range
+    int pyramid_mv[2];                 ///< fullpel vector found on the downsampled planes
+    int pyramid_valid;                 ///< pyramid_mv is a candidate of the next 16x16 EPZS search
     int pred_x;
     int pred_y;
     uint8_t *src[4][4];
@@ -183,6 +195,7 @@ typedef struct MotionEstContext{
     op_pixels_func (*hpel_avg)[4];
     qpel_mc_func (*qpel_put)[16];
     qpel_mc_func (*qpel_avg)[16];
+    me_cmp_x4_func *sad_x4;            ///< batched fullpel me_cmp, NULL unless me_cmp is plain SAD
     uint8_t (*mv_penalty)[MAX_MV*2+1];  ///< amount of bits needed to encode a MV
     uint8_t *current_mv_penalty;
     int (*sub_motion_search)(struct MpegEncContext * s,
@@ -244,13 +257,32 @@ typedef struct MpegEncContext {
     int linesize;              ///< line size, in bytes, may be different from width
     int uvlinesize;            ///< line size, for chroma in bytes, may be different from width
     Picture *picture;          ///< main picture buffer
+    int picture_count;         ///< number of allocated pictures (MAX_PICTURE_COUNT * avctx->thread_count)
+    int picture_range_start, picture_range_end; ///< the part of picture that this context can allocate in
+    int slice_context_count;   ///< number of used thread_contexts
     Picture **input_picture;   ///< next pictures on display order for encoding
     Picture **reordered_input_picture; ///< pointer to the next pictures in codedorder for encoding
+    int encoding_delay;        ///< number of input pictures buffered before the frame type decision
+    uint8_t *lookahead_lowres[2]; ///< decimated luma of the current and previous input picture
+    int16_t (*lookahead_mv[2])[2]; ///< lookahead motion vectors of the current and previous input picture
+    int lookahead_linesize;
 
     int start_mb_y;            ///< start mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     int end_mb_y;              ///< end   mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     struct MpegEncContext *thread_context[MAX_THREADS];
 
+    /* frame parallel encoding */
+    int frame_threads;         ///< number of frames coded in parallel, 0 if frames are split into slices instead
+    struct MpegEncContext *frame_context[MAX_THREADS]; ///< contexts of the frames coded in parallel
+    int frame_queued;          ///< number of frames set up for the next batch
+    int frame_coded;           ///< number of coded frames not yet returned
+    int frame_output;          ///< index in frame_context of the next coded frame to return
+    int frame_job;             ///< row progress counter of the frame coded by this context
+    int frame_ref_job[2];      ///< row progress counters of last/next_picture, -1 if they are complete
+    Picture *frame_release;    ///< reference dropped when this frame was set up, released once it is returned
+    uint8_t *frame_buf;        ///< bitstream of the frame coded by this context
+    unsigned int frame_buf_size;
+
     /**
      * copy of the previous picture structure.
      * note, linesize & data, might not match the previous picture (for field pictures)
@@ -700,6 +732,9 @@ void ff_write_quant_matrix(PutBitContext *pb, uint16_t *matrix);
 int ff_find_unused_picture(MpegEncContext *s, int shared);
 void ff_denoise_dct(MpegEncContext *s, DCTELEM *block);
 void ff_update_duplicate_context(MpegEncContext *dst, MpegEncContext *src);
+int ff_mpv_frame_context_init(MpegEncContext *dst, MpegEncContext *src);
+void ff_mpv_update_frame_context(MpegEncContext *dst, MpegEncContext *src);
+void ff_mpv_frame_context_end(MpegEncContext *s);
 const uint8_t *ff_find_start_code(const uint8_t *p, const uint8_t *end, uint32_t *state);
 
 void ff_er_frame_start(MpegEncContext *s);
@@ -713,6 +748,33 @@ void ff_convert_matrix(DSPContext *dsp, int (*qmat)[64], uint16_t (*qmat16)[2][6
 void ff_init_block_index(MpegEncContext *s);
 void ff_copy_picture(Picture *dst, Picture *src);
 
+/**
+ * Updates a frame-threading copy of the context from the thread that
+ * decoded the previous frame.
+ */
+int ff_mpeg_update_thread_context(AVCodecContext *dst, const AVCodecContext *src);
+
+/**
+ * Finds the lowest macroblock row of the reference picture in direction dir
+ * which the motion vectors of the current macroblock reach.
+ */
+int MPV_lowest_referenced_row(MpegEncContext *s, int dir);
+
+/**
+ * Tells later frame threads that the current macroblock row is finished.
+ * Only frame pictures which are used as reference report rows; everything
+ * else reports once at MPV_frame_end().
+ */
+void MPV_report_decode_progress(MpegEncContext *s);
+
+/**
+ * Translates a Picture pointer of old_ctx into the matching one of new_ctx.
+ * Pointers into the picture array keep their index, pointers to the Pictures
+ * embedded in the context keep their offset.
+ */
+#define REBASE_PICTURE(pic, new_ctx, old_ctx) (pic && pic >= old_ctx->picture && pic < old_ctx->picture+old_ctx->picture_count ?\
+                                &new_ctx->picture[pic - old_ctx->picture] : (Picture*)((uint8_t*)pic - (uint8_t*)old_ctx + (uint8_t*)new_ctx))
+
 /**
  * allocates a Picture
  * The pixels are allocated/set by calling get_buffer() if shared=0
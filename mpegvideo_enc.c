@@ -39,12 +39,14 @@
 #include "flv.h"
 #include "mpeg4video.h"
 #include "internal.h"
+#include "thread.h"
 #include <limits.h>
 
 //#undef NDEBUG
 //#include <assert.h>
 
 static int encode_picture(MpegEncContext *s, int picture_number);
+static int encode_frame_parallel(MpegEncContext *s, uint8_t *buf, int buf_size, AVFrame *pic_arg);
 static int dct_quantize_refine(MpegEncContext *s, DCTELEM *block, int16_t *weight, DCTELEM *orig, int n, int qscale);
 static int sse_mb(MpegEncContext *s);
 
@@ -53,6 +55,14 @@ static int sse_mb(MpegEncContext *s);
 
 //#define DEBUG
 
+#define LOOKAHEAD_PAD 16            ///< border of the decimated lookahead planes, also the range of its motion search
+#define LOOKAHEAD_MV_PENALTY 4      ///< cost per decimated pixel of motion vector length
+#define LOOKAHEAD_SCENECUT_PERCENT 75 ///< inter to intra cost ratio above which a picture starts a new scene
+
+#define FRAME_THREAD_MV_RANGE 32    ///< vertical fullpel motion vector limit with frame threads
+/** macroblock rows below the current one which must be final in the references, covers the subpel taps */
+#define FRAME_THREAD_REF_ROWS ((FRAME_THREAD_MV_RANGE + 4 + 15)/16 + 1)
+
 static uint8_t default_mv_penalty[MAX_FCODE+1][MAX_MV*2+1];
 static uint8_t default_fcode_tab[MAX_MV*2+1];
 
@@ -459,7 +469,14 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         }
     }
 
-    if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_MPEG4
+    if(   s->avctx->thread_count > 1 && !(s->avctx->thread_type & FF_THREAD_SLICE)
+       && (s->avctx->active_thread_type & FF_THREAD_SLICE)
+       && (   s->codec_id == CODEC_ID_MPEG1VIDEO || s->codec_id == CODEC_ID_MPEG2VIDEO
+           || s->codec_id == CODEC_ID_MPEG4 || s->codec_id == CODEC_ID_H263 || s->codec_id == CODEC_ID_H263P)
+       && !s->avctx->rtp_callback && !s->avctx->frame_skip_threshold && !s->avctx->frame_skip_factor)
+        s->frame_threads= FFMIN(s->avctx->thread_count, MAX_THREADS);
+
+    if(s->avctx->thread_count > 1 && !s->frame_threads && s->codec_id != CODEC_ID_MPEG4
        && s->codec_id != CODEC_ID_MPEG1VIDEO && s->codec_id != CODEC_ID_MPEG2VIDEO
        && (s->codec_id != CODEC_ID_H263P || !(s->flags & CODEC_FLAG_H263P_SLICE_STRUCT))){
         av_log(avctx, AV_LOG_ERROR, "multi threaded encoding not supported by codec\n");
@@ -471,7 +488,7 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
-    if(s->avctx->thread_count > 1)
+    if(s->avctx->thread_count > 1 && !s->frame_threads)
         s->rtp_mode= 1;
 
     if(!avctx->time_base.den || !avctx->time_base.num){
@@ -494,6 +511,15 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         avctx->b_frame_strategy = 0;
     }
 
+    if(avctx->b_frame_strategy == 3){
+        if(avctx->rc_lookahead > FF_MAX_B_FRAMES){
+            av_log(avctx, AV_LOG_ERROR, "rc_lookahead too large, max is %d\n", FF_MAX_B_FRAMES);
+            return -1;
+        }
+        if(!s->fixed_qscale)
+            s->adaptive_quant= 1;
+    }
+
     i= av_gcd(avctx->time_base.den, avctx->time_base.num);
     if(i > 1){
         av_log(avctx, AV_LOG_INFO, "removing common factors from framerate\n");
@@ -681,6 +707,14 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
+    s->encoding_delay= s->max_b_frames;
+    if(avctx->b_frame_strategy == 3){
+        s->encoding_delay= FFMAX(s->max_b_frames, avctx->rc_lookahead);
+        avctx->delay+= s->encoding_delay - s->max_b_frames;
+    }
+    if(s->frame_threads)
+        avctx->delay+= s->frame_threads - 1;
+
     avctx->has_b_frames= !s->low_delay;
 
     s->encoding = 1;
@@ -747,18 +781,55 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
                        s->inter_matrix, s->inter_quant_bias, avctx->qmin, 31, 0);
     }
 
+    if(avctx->b_frame_strategy == 3){
+        s->lookahead_linesize= 8*s->mb_width + 2*LOOKAHEAD_PAD;
+        for(i=0; i<2; i++){
+            s->lookahead_lowres[i]= av_malloc(s->lookahead_linesize*(8*s->mb_height + 2*LOOKAHEAD_PAD));
+            s->lookahead_mv[i]= av_mallocz(s->mb_stride*s->mb_height*sizeof(*s->lookahead_mv[i]));
+            if(!s->lookahead_lowres[i] || !s->lookahead_mv[i])
+                return AVERROR(ENOMEM);
+        }
+    }
+
     if(ff_rate_control_init(s) < 0)
         return -1;
 
+    if(s->frame_threads){
+        /* the references are coded concurrently, so only the rows
+         * within the vertical search range are waited for */
+        s->me.vrange= FRAME_THREAD_MV_RANGE;
+        s->picture_range_end= s->picture_count;
+        s->rc_context.delayed_update= 1;
+        for(i=0; i<s->frame_threads; i++){
+            s->frame_context[i]= av_mallocz(sizeof(MpegEncContext));
+            if(!s->frame_context[i] || ff_mpv_frame_context_init(s->frame_context[i], s) < 0){
+                av_freep(&s->frame_context[i]);
+                return AVERROR(ENOMEM);
+            }
+        }
+    }
+
     return 0;
 }
 
 av_cold int MPV_encode_end(AVCodecContext *avctx)
 {
     MpegEncContext *s = avctx->priv_data;
+    int i;
 
     ff_rate_control_uninit(s);
 
+    for(i=0; i<s->frame_threads; i++){
+        if(s->frame_context[i])
+            ff_mpv_frame_context_end(s->frame_context[i]);
+        av_freep(&s->frame_context[i]);
+    }
+
+    av_freep(&s->lookahead_lowres[0]);
+    av_freep(&s->lookahead_lowres[1]);
+    av_freep(&s->lookahead_mv[0]);
+    av_freep(&s->lookahead_mv[1]);
+
     MPV_common_end(s);
     if ((CONFIG_MJPEG_ENCODER || CONFIG_LJPEG_ENCODER) && s->out_format == FMT_MJPEG)
         ff_mjpeg_encode_close(s);
@@ -802,11 +873,247 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src, uint8_t *ref, int st
 }
 
 
+static inline uint8_t *lookahead_plane(MpegEncContext *s, int i){
+    return s->lookahead_lowres[i] + LOOKAHEAD_PAD*(s->lookahead_linesize + 1);
+}
+
+static int lookahead_shrink_thread(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= c->priv_data;
+    Picture *pic= arg;
+    const int stride= s->lookahead_linesize;
+    const int w= s->width>>1;
+    const int h= FFMIN(8, (s->height>>1) - 8*jobnr);
+    const int off= pic->type == FF_BUFFER_TYPE_SHARED || s->avctx->rc_buffer_size ? 0 : INPLACE_OFFSET;
+    uint8_t *dst= lookahead_plane(s, 0) + 8*jobnr*stride;
+    int y;
+
+    if(h <= 0)
+        return 0;
+
+    s->dsp.shrink[1](dst, stride, pic->data[0] + off + 16*jobnr*pic->linesize[0], pic->linesize[0], w, h);
+    for(y=0; y<h; y++, dst+= stride){
+        memset(dst - LOOKAHEAD_PAD, dst[0], LOOKAHEAD_PAD);
+        memset(dst + w, dst[w-1], stride - LOOKAHEAD_PAD - w);
+    }
+    return 0;
+}
+
+static int lookahead_cost(MpegEncContext *s, uint8_t *cur, uint8_t *ref, int mx, int my){
+    return s->dsp.sad[1](NULL, cur, ref + mx + my*s->lookahead_linesize, s->lookahead_linesize, 8)
+           + LOOKAHEAD_MV_PENALTY*(FFABS(mx) + FFABS(my));
+}
+
+/**
+ * Estimates the intra and inter cost of one MB row of the current decimated
+ * picture. The inter cost comes from a diamond search around the left and the
+ * co-located vectors of the previous picture, so that rows are independent.
+ */
+static int lookahead_analyse_thread(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= c->priv_data;
+    Picture *pic= arg;
+    const int stride= s->lookahead_linesize;
+    const int have_ref= pic->display_picture_number > 0;
+    const int mb_y= jobnr;
+    int16_t (*mv)[2]= s->lookahead_mv[0];
+    int16_t (*last_mv)[2]= s->lookahead_mv[1];
+    int mb_x, x, y;
+
+    for(mb_x=0; mb_x<s->mb_width; mb_x++){
+        const int xy= mb_x + mb_y*s->mb_stride;
+        uint8_t *cur= lookahead_plane(s, 0) + 8*(mb_x + mb_y*stride);
+        uint8_t *ref= lookahead_plane(s, 1) + 8*(mb_x + mb_y*stride);
+        const int xmin= -8*mb_x - LOOKAHEAD_PAD, xmax= 8*(s->mb_width  - 1 - mb_x) + LOOKAHEAD_PAD;
+        const int ymin= -8*mb_y - LOOKAHEAD_PAD, ymax= 8*(s->mb_height - 1 - mb_y) + LOOKAHEAD_PAD;
+        int sum=0, intra=0, inter, best_mx=0, best_my=0;
+
+        for(y=0; y<8; y++)
+            for(x=0; x<8; x++)
+                sum+= cur[x + y*stride];
+        sum= (sum + 32)>>6;
+        for(y=0; y<8; y++)
+            for(x=0; x<8; x++)
+                intra+= FFABS(cur[x + y*stride] - sum);
+        intra+= 32; //cost of the DC and the MB header
+
+        if(have_ref){
+            int16_t pred[3][2];
+            int i, npred= 0, improved;
+
+            inter= lookahead_cost(s, cur, ref, 0, 0);
+            pred[npred][0]= last_mv[xy][0]; pred[npred++][1]= last_mv[xy][1];
+            if(mb_x){
+                pred[npred][0]= mv[xy-1][0]; pred[npred++][1]= mv[xy-1][1];
+            }
+            if(mb_y+1 < s->mb_height){
+                pred[npred][0]= last_mv[xy+s->mb_stride][0]; pred[npred++][1]= last_mv[xy+s->mb_stride][1];
+            }
+            for(i=0; i<npred; i++){
+                const int mx= av_clip(pred[i][0], xmin, xmax);
+                const int my= av_clip(pred[i][1], ymin, ymax);
+                int cost;
+
+                if(!mx && !my)
+                    continue;
+                cost= lookahead_cost(s, cur, ref, mx, my);
+                if(cost < inter){
+                    inter= cost;
+                    best_mx= mx;
+                    best_my= my;
+                }
+            }
+
+            do{
+                static const int8_t dia[4][2]={{-1,0},{1,0},{0,-1},{0,1}};
+                const int cx= best_mx, cy= best_my;
+
+                improved= 0;
+                for(i=0; i<4; i++){
+                    const int mx= cx + dia[i][0];
+                    const int my= cy + dia[i][1];
+                    int cost;
+
+                    if(mx < xmin || mx > xmax || my < ymin || my > ymax)
+                        continue;
+                    cost= lookahead_cost(s, cur, ref, mx, my);
+                    if(cost < inter){
+                        inter= cost;
+                        best_mx= mx;
+                        best_my= my;
+                        improved= 1;
+                    }
+                }
+            }while(improved);
+            inter= FFMIN(inter, intra);
+        }else
+            inter= intra;
+
+        mv[xy][0]= best_mx;
+        mv[xy][1]= best_my;
+        pic->lookahead_intra[xy]= intra;
+        pic->lookahead_inter[xy]= inter;
+    }
+    return 0;
+}
+
+/**
+ * Decimates a new input picture and estimates its cost relative to the
+ * previous input picture, for b_frame_strategy 3.
+ */
+static void lookahead_analyse(MpegEncContext *s, Picture *pic){
+    const int stride= s->lookahead_linesize;
+    const int h= s->height>>1;
+    uint8_t *plane= lookahead_plane(s, 0);
+    int16_t (*last_mv)[2];
+    int mb_x, mb_y, y;
+
+    s->avctx->execute2(s->avctx, lookahead_shrink_thread, pic, NULL, s->mb_height);
+    for(y=-LOOKAHEAD_PAD; y<0; y++)
+        memcpy(plane + y*stride - LOOKAHEAD_PAD, plane - LOOKAHEAD_PAD, stride);
+    for(y=h; y<8*s->mb_height + LOOKAHEAD_PAD; y++)
+        memcpy(plane + y*stride - LOOKAHEAD_PAD, plane + (h-1)*stride - LOOKAHEAD_PAD, stride);
+
+    s->avctx->execute2(s->avctx, lookahead_analyse_thread, pic, NULL, s->mb_height);
+
+    pic->lookahead_intra_sum=
+    pic->lookahead_inter_sum= 0;
+    for(mb_y=0; mb_y<s->mb_height; mb_y++){
+        for(mb_x=0; mb_x<s->mb_width; mb_x++){
+            const int xy= mb_x + mb_y*s->mb_stride;
+            pic->lookahead_intra_sum+= pic->lookahead_intra[xy];
+            pic->lookahead_inter_sum+= pic->lookahead_inter[xy];
+        }
+    }
+    memcpy(pic->lookahead_mv, s->lookahead_mv[0], s->mb_stride*s->mb_height*sizeof(*pic->lookahead_mv));
+
+    FFSWAP(uint8_t *, s->lookahead_lowres[0], s->lookahead_lowres[1]);
+    last_mv= s->lookahead_mv[1];
+    s->lookahead_mv[1]= s->lookahead_mv[0];
+    s->lookahead_mv[0]= last_mv;
+}
+
+static int lookahead_is_scenecut(MpegEncContext *s, Picture *p){
+    return s->avctx->scenechange_threshold < 1000000000
+        && p->lookahead_inter_sum*100LL > p->lookahead_intra_sum*(int64_t)LOOKAHEAD_SCENECUT_PERCENT;
+}
+
+/**
+ * Chooses the number of B-frames before the next reference picture from the
+ * lookahead costs. A picture which is predicted badly from its predecessor
+ * ends the run of B-frames, a scene cut is additionally forced to be an
+ * I-frame.
+ */
+static int lookahead_b_count(MpegEncContext *s){
+    int i;
+
+    for(i=0; i<s->max_b_frames+1; i++){
+        Picture *p= s->input_picture[i];
+
+        if(!p)
+            break;
+        if(lookahead_is_scenecut(s, p)){
+            if(!p->pict_type)
+                p->pict_type= FF_I_TYPE;
+            break;
+        }
+        if(i && p->lookahead_inter_sum*100LL > p->lookahead_intra_sum*(int64_t)s->avctx->b_sensitivity)
+            break;
+    }
+    return FFMAX(0, i-1);
+}
+
+/**
+ * Computes for each MB of the buffered input pictures which part of the cost
+ * of the following pictures depends on it. Every picture is treated as the
+ * reference of the next one, which overestimates what B-frames inherit; their
+ * values are not used though.
+ */
+static void lookahead_propagate(MpegEncContext *s){
+    const int mb_array_size= s->mb_stride*s->mb_height;
+    int i, last, mb_x, mb_y;
+
+    for(last=0; last<=s->encoding_delay && s->input_picture[last]; last++)
+        memset(s->input_picture[last]->lookahead_propagate, 0, mb_array_size*sizeof(int32_t));
+
+    for(i=last-1; i>0; i--){
+        Picture *p= s->input_picture[i];
+        Picture *ref= s->input_picture[i-1];
+
+        for(mb_y=0; mb_y<s->mb_height; mb_y++){
+            for(mb_x=0; mb_x<s->mb_width; mb_x++){
+                const int xy= mb_x + mb_y*s->mb_stride;
+                const int intra= p->lookahead_intra[xy];
+                const int inter= p->lookahead_inter[xy];
+                const int x= 8*mb_x + p->lookahead_mv[xy][0];
+                const int y= 8*mb_y + p->lookahead_mv[xy][1];
+                const int fx= x&7, fy= y&7;
+                const int rx= x>>3, ry= y>>3;
+                int64_t amount;
+                int j;
+
+                if(inter >= intra)
+                    continue;
+                amount= (intra + (int64_t)p->lookahead_propagate[xy]) * (intra - inter) / intra;
+
+                /* split between the up to 4 MBs the reference block overlaps */
+                for(j=0; j<4; j++){
+                    const int bx= rx + (j&1);
+                    const int by= ry + (j>>1);
+                    const int weight= ((j&1) ? fx : 8 - fx) * ((j>>1) ? fy : 8 - fy);
+
+                    if(bx < 0 || bx >= s->mb_width || by < 0 || by >= s->mb_height || !weight)
+                        continue;
+                    ref->lookahead_propagate[bx + by*s->mb_stride]+= (amount*weight + 32)>>6;
+                }
+            }
+        }
+    }
+}
+
 static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
     AVFrame *pic=NULL;
     int64_t pts;
     int i;
-    const int encoding_delay= s->max_b_frames;
+    const int encoding_delay= s->encoding_delay;
     int direct=1;
 
     if(pic_arg){
@@ -897,6 +1204,9 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
     }
     copy_picture_attributes(s, pic, pic_arg);
     pic->pts= pts; //we set this here to avoid modifiying pic_arg
+
+    if(s->avctx->b_frame_strategy == 3)
+        lookahead_analyse(s, (Picture*)pic);
   }
 
     /* shift buffer entries */
@@ -1059,6 +1369,9 @@ static void select_input_picture(MpegEncContext *s){
 
     /* set next picture type & ordering */
     if(s->reordered_input_picture[0]==NULL && s->input_picture[0]){
+        if(s->avctx->b_frame_strategy == 3 && !s->intra_only)
+            lookahead_propagate(s);
+
         if(/*s->picture_in_gop_number >= s->gop_size ||*/ s->next_picture_ptr==NULL || s->intra_only){
             s->reordered_input_picture[0]= s->input_picture[0];
             s->reordered_input_picture[0]->pict_type= FF_I_TYPE;
@@ -1128,6 +1441,8 @@ static void select_input_picture(MpegEncContext *s){
                 }
             }else if(s->avctx->b_frame_strategy==2){
                 b_frames= estimate_best_b_count(s);
+            }else if(s->avctx->b_frame_strategy==3){
+                b_frames= lookahead_b_count(s);
             }else{
                 av_log(s->avctx, AV_LOG_ERROR, "illegal b frame strategy\n");
                 b_frames=0;
@@ -1196,6 +1511,11 @@ no_output_pic:
             s->reordered_input_picture[0]->type= 0;
 
             copy_picture_attributes(s, (AVFrame*)pic, (AVFrame*)s->reordered_input_picture[0]);
+            if(pic->lookahead_propagate){
+                const int mb_array_size= s->mb_stride*s->mb_height;
+                memcpy(pic->lookahead_intra    , s->reordered_input_picture[0]->lookahead_intra    , mb_array_size*sizeof(uint16_t));
+                memcpy(pic->lookahead_propagate, s->reordered_input_picture[0]->lookahead_propagate, mb_array_size*sizeof(int32_t));
+            }
 
             s->current_picture_ptr= pic;
         }else{
@@ -1218,12 +1538,108 @@ no_output_pic:
     }
 }
 
+/**
+ * Accounts the frame coded by f in the statistics and the rate control
+ * state of s, and completes it with stuffing and its vbv_delay.
+ * f is s itself unless frame threads are used.
+ */
+static int finish_frame(MpegEncContext *s, MpegEncContext *f){
+    AVCodecContext *avctx= s->avctx;
+    int i, stuffing_count;
+
+    avctx->header_bits = f->header_bits;
+    avctx->mv_bits     = f->mv_bits;
+    avctx->misc_bits   = f->misc_bits;
+    avctx->i_tex_bits  = f->i_tex_bits;
+    avctx->p_tex_bits  = f->p_tex_bits;
+    avctx->i_count     = f->i_count;
+    avctx->p_count     = f->mb_num - f->i_count - f->skip_count; //FIXME f/b_count in avctx
+    avctx->skip_count  = f->skip_count;
+
+    if(s->flags&CODEC_FLAG_PASS1)
+        ff_write_pass1_stats(f);
+
+    for(i=0; i<4; i++){
+        f->current_picture_ptr->error[i]= f->current_picture.error[i];
+        avctx->error[i] += f->current_picture_ptr->error[i];
+    }
+
+    if(s->flags&CODEC_FLAG_PASS1)
+        assert(avctx->header_bits + avctx->mv_bits + avctx->misc_bits + avctx->i_tex_bits + avctx->p_tex_bits == put_bits_count(&f->pb));
+    flush_put_bits(&f->pb);
+    f->frame_bits  = put_bits_count(&f->pb);
+
+    stuffing_count= ff_vbv_update(s, f->frame_bits);
+    if(stuffing_count){
+        if(f->pb.buf_end - f->pb.buf - (put_bits_count(&f->pb)>>3) < stuffing_count + 50){
+            av_log(s->avctx, AV_LOG_ERROR, "stuffing too large\n");
+            return -1;
+        }
+
+        switch(s->codec_id){
+        case CODEC_ID_MPEG1VIDEO:
+        case CODEC_ID_MPEG2VIDEO:
+            while(stuffing_count--){
+                put_bits(&f->pb, 8, 0);
+            }
+        break;
+        case CODEC_ID_MPEG4:
+            put_bits(&f->pb, 16, 0);
+            put_bits(&f->pb, 16, 0x1C3);
+            stuffing_count -= 4;
+            while(stuffing_count--){
+                put_bits(&f->pb, 8, 0xFF);
+            }
+        break;
+        default:
+            av_log(s->avctx, AV_LOG_ERROR, "vbv buffer overflow\n");
+        }
+        flush_put_bits(&f->pb);
+        f->frame_bits  = put_bits_count(&f->pb);
+    }
+
+    /* update mpeg1/2 vbv_delay for CBR */
+    if(s->avctx->rc_max_rate && s->avctx->rc_min_rate == s->avctx->rc_max_rate && s->out_format == FMT_MPEG1
+       && 90000LL * (avctx->rc_buffer_size-1) <= s->avctx->rc_max_rate*0xFFFFLL){
+        int vbv_delay, min_delay;
+        double inbits = s->avctx->rc_max_rate*av_q2d(s->avctx->time_base);
+        int    minbits= f->frame_bits - 8*(f->vbv_delay_ptr - f->pb.buf - 1);
+        double bits   = s->rc_context.buffer_index + minbits - inbits;
+
+        if(bits<0)
+            av_log(s->avctx, AV_LOG_ERROR, "Internal error, negative bits\n");
+
+        assert(f->repeat_first_field==0);
+
+        vbv_delay=     bits * 90000                               / s->avctx->rc_max_rate;
+        min_delay= (minbits * 90000LL + s->avctx->rc_max_rate - 1)/ s->avctx->rc_max_rate;
+
+        vbv_delay= FFMAX(vbv_delay, min_delay);
+
+        assert(vbv_delay < 0xFFFF);
+
+        f->vbv_delay_ptr[0] &= 0xF8;
+        f->vbv_delay_ptr[0] |= vbv_delay>>13;
+        f->vbv_delay_ptr[1]  = vbv_delay>>5;
+        f->vbv_delay_ptr[2] &= 0x07;
+        f->vbv_delay_ptr[2] |= vbv_delay<<3;
+    }
+    s->frame_bits      = f->frame_bits;
+    s->total_bits     += f->frame_bits;
+    avctx->frame_bits  = f->frame_bits;
+
+    return 0;
+}
+
 int MPV_encode_picture(AVCodecContext *avctx,
                        unsigned char *buf, int buf_size, void *data)
 {
     MpegEncContext *s = avctx->priv_data;
     AVFrame *pic_arg = data;
-    int i, stuffing_count;
+    int i;
+
+    if(s->frame_threads)
+        return encode_frame_parallel(s, buf, buf_size, pic_arg);
 
     for(i=0; i<avctx->thread_count; i++){
         int start_y= s->thread_context[i]->start_mb_y;
@@ -1252,15 +1668,6 @@ vbv_retry:
         if (encode_picture(s, s->picture_number) < 0)
             return -1;
 
-        avctx->header_bits = s->header_bits;
-        avctx->mv_bits     = s->mv_bits;
-        avctx->misc_bits   = s->misc_bits;
-        avctx->i_tex_bits  = s->i_tex_bits;
-        avctx->p_tex_bits  = s->p_tex_bits;
-        avctx->i_count     = s->i_count;
-        avctx->p_count     = s->mb_num - s->i_count - s->skip_count; //FIXME f/b_count in avctx
-        avctx->skip_count  = s->skip_count;
-
         MPV_frame_end(s);
 
         if (CONFIG_MJPEG_ENCODER && s->out_format == FMT_MJPEG)
@@ -1297,76 +1704,8 @@ vbv_retry:
             assert(s->avctx->rc_max_rate);
         }
 
-        if(s->flags&CODEC_FLAG_PASS1)
-            ff_write_pass1_stats(s);
-
-        for(i=0; i<4; i++){
-            s->current_picture_ptr->error[i]= s->current_picture.error[i];
-            avctx->error[i] += s->current_picture_ptr->error[i];
-        }
-
-        if(s->flags&CODEC_FLAG_PASS1)
-            assert(avctx->header_bits + avctx->mv_bits + avctx->misc_bits + avctx->i_tex_bits + avctx->p_tex_bits == put_bits_count(&s->pb));
-        flush_put_bits(&s->pb);
-        s->frame_bits  = put_bits_count(&s->pb);
-
-        stuffing_count= ff_vbv_update(s, s->frame_bits);
-        if(stuffing_count){
-            if(s->pb.buf_end - s->pb.buf - (put_bits_count(&s->pb)>>3) < stuffing_count + 50){
-                av_log(s->avctx, AV_LOG_ERROR, "stuffing too large\n");
-                return -1;
-            }
-
-            switch(s->codec_id){
-            case CODEC_ID_MPEG1VIDEO:
-            case CODEC_ID_MPEG2VIDEO:
-                while(stuffing_count--){
-                    put_bits(&s->pb, 8, 0);
-                }
-            break;
-            case CODEC_ID_MPEG4:
-                put_bits(&s->pb, 16, 0);
-                put_bits(&s->pb, 16, 0x1C3);
-                stuffing_count -= 4;
-                while(stuffing_count--){
-                    put_bits(&s->pb, 8, 0xFF);
-                }
-            break;
-            default:
-                av_log(s->avctx, AV_LOG_ERROR, "vbv buffer overflow\n");
-            }
-            flush_put_bits(&s->pb);
-            s->frame_bits  = put_bits_count(&s->pb);
-        }
-
-        /* update mpeg1/2 vbv_delay for CBR */
-        if(s->avctx->rc_max_rate && s->avctx->rc_min_rate == s->avctx->rc_max_rate && s->out_format == FMT_MPEG1
-           && 90000LL * (avctx->rc_buffer_size-1) <= s->avctx->rc_max_rate*0xFFFFLL){
-            int vbv_delay, min_delay;
-            double inbits = s->avctx->rc_max_rate*av_q2d(s->avctx->time_base);
-            int    minbits= s->frame_bits - 8*(s->vbv_delay_ptr - s->pb.buf - 1);
-            double bits   = s->rc_context.buffer_index + minbits - inbits;
-
-            if(bits<0)
-                av_log(s->avctx, AV_LOG_ERROR, "Internal error, negative bits\n");
-
-            assert(s->repeat_first_field==0);
-
-            vbv_delay=     bits * 90000                               / s->avctx->rc_max_rate;
-            min_delay= (minbits * 90000LL + s->avctx->rc_max_rate - 1)/ s->avctx->rc_max_rate;
-
-            vbv_delay= FFMAX(vbv_delay, min_delay);
-
-            assert(vbv_delay < 0xFFFF);
-
-            s->vbv_delay_ptr[0] &= 0xF8;
-            s->vbv_delay_ptr[0] |= vbv_delay>>13;
-            s->vbv_delay_ptr[1]  = vbv_delay>>5;
-            s->vbv_delay_ptr[2] &= 0x07;
-            s->vbv_delay_ptr[2] |= vbv_delay<<3;
-        }
-        s->total_bits += s->frame_bits;
-        avctx->frame_bits  = s->frame_bits;
+        if(finish_frame(s, s) < 0)
+            return -1;
     }else{
         assert((put_bits_ptr(&s->pb) == s->pb.buf));
         s->frame_bits=0;
@@ -1940,6 +2279,48 @@ static int sse_mb(MpegEncContext *s){
                +sse(s, s->new_picture.data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,s->dest[2], w>>1, h>>1, s->uvlinesize);
 }
 
+/**
+ * Waits until the reference pictures are coded far enough to be used by
+ * macroblock row mb_y, when they are coded by other frame threads.
+ */
+static void await_reference_rows(MpegEncContext *s, int mb_y){
+    int i;
+
+    if(!s->frame_threads)
+        return;
+
+    for(i=0; i<2; i++){
+        if(s->frame_ref_job[i] >= 0)
+            ff_thread_await_row_progress(s->avctx, s->frame_ref_job[i],
+                                         FFMIN(mb_y + 1 + FRAME_THREAD_REF_ROWS, s->mb_height));
+    }
+}
+
+/**
+ * Extends the edges of the final macroblock rows [start, end) of a picture
+ * coded by a frame thread and makes them available to the other frame threads.
+ */
+static void report_frame_rows(MpegEncContext *s, int start, int end){
+    if(   s->unrestricted_mv
+       && s->current_picture.reference
+       && !s->intra_only
+       && !(s->flags&CODEC_FLAG_EMU_EDGE)) {
+        int sides= 0;
+        int y= start*16;
+        int h= FFMIN(end*16, s->v_edge_pos) - y;
+
+        if(start == 0)              sides |= EDGE_TOP;
+        if(end*16 >= s->v_edge_pos) sides |= EDGE_BOTTOM;
+
+        s->dsp.draw_edges(s->current_picture.data[0] +  y    *s->linesize  , s->linesize  , s->h_edge_pos   , h   , EDGE_WIDTH  , sides);
+        s->dsp.draw_edges(s->current_picture.data[1] + (y>>1)*s->uvlinesize, s->uvlinesize, s->h_edge_pos>>1, h>>1, EDGE_WIDTH/2, sides);
+        s->dsp.draw_edges(s->current_picture.data[2] + (y>>1)*s->uvlinesize, s->uvlinesize, s->h_edge_pos>>1, h>>1, EDGE_WIDTH/2, sides);
+    }
+    emms_c();
+
+    ff_thread_report_row_progress(s->avctx, s->frame_job, end);
+}
+
 static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= *(void**)arg;
 
@@ -1967,6 +2348,8 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
     s->me.dia_size= s->avctx->dia_size;
     s->first_slice_line=1;
     for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
+        await_reference_rows(s, s->mb_y);
+
         s->mb_x=0; //for block init below
         ff_init_block_index(s);
         for(s->mb_x=0; s->mb_x < s->mb_width; s->mb_x++) {
@@ -2089,6 +2472,10 @@ static int encode_thread(AVCodecContext *c, void *arg){
     s->ptr_lastgob = s->pb.buf;
     for(mb_y= s->start_mb_y; mb_y < s->end_mb_y; mb_y++) {
 //    printf("row %d at %X\n", s->mb_y, (int)s);
+        /* the loop filter of this row still modifies the previous one */
+        if(s->frame_threads && mb_y >= 2)
+            report_frame_rows(s, mb_y-2, mb_y-1);
+
         s->mb_x=0;
         s->mb_y= mb_y;
 
@@ -2640,6 +3027,9 @@ static int encode_thread(AVCodecContext *c, void *arg){
         }
     }
 
+    if(s->frame_threads)
+        report_frame_rows(s, FFMAX(s->end_mb_y-2, 0), s->end_mb_y);
+
     //not beautiful here but we must write it before flushing so it has to be here
     if (CONFIG_MSMPEG4_ENCODER && s->msmpeg4_version && s->msmpeg4_version<4 && s->pict_type == FF_I_TYPE)
         msmpeg4_encode_ext_header(s);
@@ -2749,11 +3139,12 @@ static void set_frame_distances(MpegEncContext * s){
     }
 }
 
-static int encode_picture(MpegEncContext *s, int picture_number)
+/**
+ * Sets up the frame level state and the motion estimation lambda for
+ * coding the current picture.
+ */
+static int setup_picture(MpegEncContext *s, int picture_number)
 {
-    int i;
-    int bits;
-
     s->picture_number = picture_number;
 
     /* Reset the average MB variance */
@@ -2792,37 +3183,17 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     }
 
     s->mb_intra=0; //for the rate distortion & bit compare functions
-    for(i=1; i<s->avctx->thread_count; i++){
-        ff_update_duplicate_context(s->thread_context[i], s);
-    }
-
-    if(ff_init_me(s)<0)
-        return -1;
-
-    /* Estimate motion for every MB */
-    if(s->pict_type != FF_I_TYPE){
-        s->lambda = (s->lambda * s->avctx->me_penalty_compensation + 128)>>8;
-        s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
-        if(s->pict_type != FF_B_TYPE && s->avctx->me_threshold==0){
-            if((s->avctx->pre_me && s->last_non_b_pict_type==FF_I_TYPE) || s->avctx->pre_me==2){
-                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
-            }
-        }
+    return 0;
+}
 
-        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
-    }else /* if(s->pict_type == FF_I_TYPE) */{
-        /* I-Frame */
-        for(i=0; i<s->mb_stride*s->mb_height; i++)
-            s->mb_type[i]= CANDIDATE_MB_TYPE_INTRA;
+/**
+ * Stores the variance sums, handles scene changes and chooses and enforces
+ * the f/b_code, once motion estimation of the whole picture is done.
+ */
+static void end_motion_estimation(MpegEncContext *s)
+{
+    int i;
 
-        if(!s->fixed_qscale){
-            /* finding spatial complexity for I-frame rate control */
-            s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
-        }
-    }
-    for(i=1; i<s->avctx->thread_count; i++){
-        merge_context_after_me(s, s->thread_context[i]);
-    }
     s->current_picture.mc_mb_var_sum= s->current_picture_ptr->mc_mb_var_sum= s->me.mc_mb_var_sum_temp;
     s->current_picture.   mb_var_sum= s->current_picture_ptr->   mb_var_sum= s->me.   mb_var_sum_temp;
     emms_c();
@@ -2887,6 +3258,15 @@ static int encode_picture(MpegEncContext *s, int picture_number)
             }
         }
     }
+}
+
+/**
+ * Chooses the picture quantizer and writes the picture header.
+ */
+static int write_picture_header(MpegEncContext *s)
+{
+    int picture_number= s->picture_number;
+    int i;
 
     if (estimate_qp(s, 0) < 0)
         return -1;
@@ -2951,8 +3331,52 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     default:
         assert(0);
     }
-    bits= put_bits_count(&s->pb);
-    s->header_bits= bits - s->last_bits;
+    s->header_bits= put_bits_count(&s->pb) - s->last_bits;
+    return 0;
+}
+
+static int encode_picture(MpegEncContext *s, int picture_number)
+{
+    int i;
+
+    if(setup_picture(s, picture_number) < 0)
+        return -1;
+
+    for(i=1; i<s->avctx->thread_count; i++){
+        ff_update_duplicate_context(s->thread_context[i], s);
+    }
+
+    if(ff_init_me(s)<0)
+        return -1;
+
+    /* Estimate motion for every MB */
+    if(s->pict_type != FF_I_TYPE){
+        s->lambda = (s->lambda * s->avctx->me_penalty_compensation + 128)>>8;
+        s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
+        if(s->pict_type != FF_B_TYPE && s->avctx->me_threshold==0){
+            if((s->avctx->pre_me && s->last_non_b_pict_type==FF_I_TYPE) || s->avctx->pre_me==2){
+                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+            }
+        }
+
+        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+    }else /* if(s->pict_type == FF_I_TYPE) */{
+        /* I-Frame */
+        for(i=0; i<s->mb_stride*s->mb_height; i++)
+            s->mb_type[i]= CANDIDATE_MB_TYPE_INTRA;
+
+        if(!s->fixed_qscale){
+            /* finding spatial complexity for I-frame rate control */
+            s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+        }
+    }
+    for(i=1; i<s->avctx->thread_count; i++){
+        merge_context_after_me(s, s->thread_context[i]);
+    }
+    end_motion_estimation(s);
+
+    if(write_picture_header(s) < 0)
+        return -1;
 
     for(i=1; i<s->avctx->thread_count; i++){
         update_duplicate_context_after_me(s->thread_context[i], s);
@@ -2965,6 +3389,234 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     return 0;
 }
 
+/**
+ * Codes one of the frames queued with queue_frame(), in parallel with the
+ * others. The macroblock rows of a reference picture are waited for before
+ * they are used, and the rate control state is passed from frame to frame
+ * in coding order while the picture headers are written.
+ */
+static int encode_frame_thread(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= c->priv_data;
+    const int n  = s->frame_queued;
+    const int job= ff_thread_next_row(c);
+    MpegEncContext *f= s->frame_context[job];
+    int i, ret;
+
+    ret= ff_init_me(f);
+    if(ret >= 0){
+        if(f->pict_type != FF_I_TYPE){
+            f->lambda = (f->lambda * c->me_penalty_compensation + 128)>>8;
+            f->lambda2= (f->lambda2* (int64_t)c->me_penalty_compensation + 128)>>8;
+            if(f->pict_type != FF_B_TYPE && c->me_threshold==0){
+                if((c->pre_me && f->last_non_b_pict_type==FF_I_TYPE) || c->pre_me==2){
+                    if(f->frame_ref_job[0] >= 0)
+                        ff_thread_await_row_progress(c, f->frame_ref_job[0], f->mb_height);
+                    pre_estimate_motion_thread(c, &s->frame_context[job]);
+                }
+            }
+            estimate_motion_thread(c, &s->frame_context[job]);
+        }else{
+            for(i=0; i<f->mb_stride*f->mb_height; i++)
+                f->mb_type[i]= CANDIDATE_MB_TYPE_INTRA;
+
+            if(!f->fixed_qscale)
+                mb_var_thread(c, &s->frame_context[job]);
+        }
+        end_motion_estimation(f);
+    }
+
+    if(job)
+        ff_thread_await_row_progress(c, n + job - 1, 1);
+    if(ret >= 0){
+        f->rc_context        = s->rc_context;
+        f->total_bits        = s->total_bits;
+        f->gop_picture_number= s->gop_picture_number;
+        if(f->pict_type == FF_B_TYPE)
+            f->last_time_base= s->last_time_base;
+        /* scene change, the GOP restarts with this frame */
+        if(f->pict_type == FF_I_TYPE && f->new_picture.pict_type != FF_I_TYPE)
+            s->picture_in_gop_number-= f->picture_in_gop_number;
+
+        ret= write_picture_header(f);
+
+        s->rc_context        = f->rc_context;
+        s->gop_picture_number= f->gop_picture_number;
+        s->last_time_base    = f->last_time_base;
+        s->last_lambda_for[f->pict_type]= f->current_picture_ptr->quality;
+    }
+    ff_thread_report_row_progress(c, n + job, 1);
+
+    if(ret >= 0)
+        ret= encode_thread(c, &s->frame_context[job]);
+    emms_c();
+    ff_thread_report_row_progress(c, job, f->mb_height);
+
+    return ret;
+}
+
+/**
+ * Prepares the next frame context to code s->new_picture. The frame level
+ * state of s is advanced in coding order as if the picture was coded.
+ */
+static int queue_frame(MpegEncContext *s, int buf_size){
+    const int index= s->frame_queued;
+    MpegEncContext *f= s->frame_context[index];
+    const int last_time_base= s->last_time_base;
+    Picture *old_ref= NULL;
+    int i;
+
+    assert(!s->frame_coded || index < s->frame_output);
+
+    s->pict_type= s->new_picture.pict_type;
+
+    /* frames which are coded in parallel may still use the reference
+     * MPV_frame_start() would release, it is released with this frame */
+    if(   s->pict_type != FF_B_TYPE && s->last_picture_ptr
+       && s->last_picture_ptr != s->next_picture_ptr && s->last_picture_ptr->data[0]){
+        old_ref= s->last_picture_ptr;
+        s->last_picture_ptr= s->next_picture_ptr;
+    }
+
+    MPV_frame_start(s, s->avctx);
+    if(setup_picture(s, s->picture_number) < 0)
+        return -1;
+
+    ff_mpv_update_frame_context(f, s);
+    f->frame_release= old_ref;
+    f->frame_job= index;
+    f->frame_ref_job[0]=
+    f->frame_ref_job[1]= -1;
+    for(i=0; i<index; i++){
+        Picture *pic= s->frame_context[i]->current_picture_ptr;
+
+        if(s->pict_type != FF_I_TYPE && pic == s->last_picture_ptr)
+            f->frame_ref_job[0]= i;
+        if(s->pict_type == FF_B_TYPE && pic == s->next_picture_ptr)
+            f->frame_ref_job[1]= i;
+    }
+
+    av_fast_malloc(&f->frame_buf, &f->frame_buf_size, buf_size);
+    if(!f->frame_buf)
+        return AVERROR(ENOMEM);
+    init_put_bits(&f->pb, f->frame_buf, buf_size);
+
+    /* the time base is passed between the frame threads instead */
+    s->last_time_base= last_time_base;
+    s->last_pict_type= s->pict_type;
+    if(s->pict_type != FF_B_TYPE)
+        s->last_non_b_pict_type= s->pict_type;
+    if(s->pict_type == FF_I_TYPE)
+        s->picture_in_gop_number=0;
+
+    s->frame_queued++;
+    return 0;
+}
+
+/**
+ * Releases the pictures the frame context f was the last user of.
+ */
+static void release_frame_pictures(MpegEncContext *s, MpegEncContext *f){
+    AVCodecContext *avctx= s->avctx;
+
+    if(!f->current_picture_ptr->reference && f->current_picture_ptr->data[0])
+        avctx->release_buffer(avctx, (AVFrame*)f->current_picture_ptr);
+    if(f->frame_release && f->frame_release->data[0])
+        avctx->release_buffer(avctx, (AVFrame*)f->frame_release);
+    f->frame_release= NULL;
+}
+
+static int encode_frames(MpegEncContext *s){
+    int ret[MAX_THREADS];
+    int i, n= s->frame_queued, err= 0;
+
+    if(ff_thread_init_row_progress(s->avctx, 2*n) < 0){
+        err= -1;
+    }else{
+        s->avctx->execute2(s->avctx, encode_frame_thread, NULL, ret, n);
+        for(i=0; i<n; i++)
+            if(ret[i] < 0)
+                err= -1;
+    }
+
+    s->frame_queued= 0;
+    s->frame_output= 0;
+    s->frame_coded = 0;
+
+    /* none of the queued frames is output, drop their pictures */
+    if(err < 0){
+        for(i=0; i<n; i++)
+            release_frame_pictures(s, s->frame_context[i]);
+        return err;
+    }
+
+    s->frame_coded= n;
+    return 0;
+}
+
+static int encode_frame_parallel(MpegEncContext *s, uint8_t *buf, int buf_size, AVFrame *pic_arg){
+    AVCodecContext *avctx= s->avctx;
+    MpegEncContext *f;
+    int i, size;
+
+    s->picture_in_gop_number++;
+
+    if(load_input_picture(s, pic_arg) < 0)
+        return -1;
+
+    select_input_picture(s);
+
+    if(s->new_picture.data[0] && queue_frame(s, buf_size) < 0)
+        return -1;
+
+    if(!s->frame_coded && s->frame_queued && (s->frame_queued == s->frame_threads || !pic_arg)){
+        if(encode_frames(s) < 0)
+            return -1;
+    }
+
+    if(!s->frame_coded)
+        return 0;
+
+    f= s->frame_context[s->frame_output++];
+    s->frame_coded--;
+
+    if(finish_frame(s, f) < 0)
+        return -1;
+
+    if(!s->fixed_qscale && f->picture_number > 1){
+        RateControlContext *rcc= &f->rc_context;
+
+        ff_rate_update_predictor(s, f->pict_type, rcc->last_qscale,
+                                 f->pict_type == FF_I_TYPE ? rcc->last_mb_var_sum : rcc->last_mc_mb_var_sum,
+                                 f->frame_bits);
+    }
+
+    if(s->dct_error_sum){
+        for(i=0; i<64; i++){
+            s->dct_error_sum[0][i]+= f->dct_error_sum[0][i];
+            s->dct_error_sum[1][i]+= f->dct_error_sum[1][i];
+        }
+        s->dct_count[0]+= f->dct_count[0];
+        s->dct_count[1]+= f->dct_count[1];
+        memset(f->dct_error_sum, 0, 2 * 64 * sizeof(int));
+        f->dct_count[0]=
+        f->dct_count[1]= 0;
+    }
+
+    avctx->coded_frame= (AVFrame*)f->current_picture_ptr;
+
+    release_frame_pictures(s, f);
+
+    assert((f->frame_bits&7)==0);
+    size= f->frame_bits/8;
+    if(size > buf_size){
+        av_log(avctx, AV_LOG_ERROR, "encoded frame too large\n");
+        return -1;
+    }
+    memcpy(buf, f->frame_buf, size);
+
+    return size;
+}
+
 void  denoise_dct_c(MpegEncContext *s, DCTELEM *block){
     const int intra= s->mb_intra;
     int i;
@@ -3768,6 +4420,7 @@ AVCodec h263_encoder = {
     MPV_encode_init,
     MPV_encode_picture,
     MPV_encode_end,
+    .capabilities= CODEC_CAP_DELAY,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_NONE},
     .long_name= NULL_IF_CONFIG_SMALL("H.263 / H.263-1996"),
 };
@@ -3780,6 +4433,7 @@ AVCodec h263p_encoder = {
     MPV_encode_init,
     MPV_encode_picture,
     MPV_encode_end,
+    .capabilities= CODEC_CAP_DELAY,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_NONE},
     .long_name= NULL_IF_CONFIG_SMALL("H.263+ / H.263-1998 / H.263 version 2"),
 };
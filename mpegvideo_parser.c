@@ -140,6 +140,7 @@ static int mpegvideo_parse(AVCodecParserContext *s,
         next= buf_size;
     }else{
         next= ff_mpeg1_find_frame_end(pc, buf, buf_size, s);
+        pc->stable_input= s->flags & PARSER_FLAG_STABLE_INPUT;
 
         if (ff_combine_frame(pc, next, &buf, &buf_size) < 0) {
             *poutbuf = NULL;
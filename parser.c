@@ -265,11 +265,54 @@ int ff_combine_frame(ParseContext *pc, int next, const uint8_t **buf, int *buf_s
         next= 0;
     }
 
+    if(pc->pending){
+        /* the frame ended with the previous input, return it in place */
+        if(next != END_NOT_FOUND && next <= 0){
+            if(next < 0){
+                void* new_buffer = av_fast_realloc(pc->buffer, &pc->buffer_size, -next + FF_INPUT_BUFFER_PADDING_SIZE);
+
+                if(!new_buffer)
+                    return AVERROR(ENOMEM);
+                pc->buffer = new_buffer;
+                memcpy(pc->buffer, pc->pending + pc->pending_size + next, -next);
+            }
+            *buf     = pc->pending;
+            *buf_size= pc->pending_size + next;
+            pc->pending= NULL;
+            pc->last_index= -next;
+            pc->overread_index= 0;
+
+            for(;next < 0; next++){
+                pc->state = (pc->state<<8) | pc->buffer[pc->last_index + next];
+                pc->state64 = (pc->state64<<8) | pc->buffer[pc->last_index + next];
+                pc->overread++;
+            }
+            return 0;
+        }else{
+            void* new_buffer = av_fast_realloc(pc->buffer, &pc->buffer_size, pc->pending_size + FF_INPUT_BUFFER_PADDING_SIZE);
+
+            if(!new_buffer)
+                return AVERROR(ENOMEM);
+            pc->buffer = new_buffer;
+            memcpy(pc->buffer, pc->pending, pc->pending_size);
+            pc->index = pc->pending_size;
+            pc->pending= NULL;
+        }
+    }
+
     pc->last_index= pc->index;
 
     /* copy into buffer end return */
     if(next == END_NOT_FOUND){
-        void* new_buffer = av_fast_realloc(pc->buffer, &pc->buffer_size, (*buf_size) + pc->index + FF_INPUT_BUFFER_PADDING_SIZE);
+        void* new_buffer;
+
+        /* nothing buffered, defer the copy until we know the frame continues */
+        if(pc->stable_input && !pc->index){
+            pc->pending     = *buf;
+            pc->pending_size= *buf_size;
+            return -1;
+        }
+        new_buffer = av_fast_realloc(pc->buffer, &pc->buffer_size, (*buf_size) + pc->index + FF_INPUT_BUFFER_PADDING_SIZE);
 
         if(!new_buffer)
             return AVERROR(ENOMEM);
@@ -35,6 +35,9 @@ typedef struct ParseContext{
     int overread;               ///< the number of bytes which where irreversibly read from the next frame
     int overread_index;         ///< the index into ParseContext.buffer of the overread bytes
     uint64_t state64;           ///< contains the last 8 bytes in MSB order
+    int stable_input;           ///< input stays valid until the frame returned by the next call is used, set from PARSER_FLAG_STABLE_INPUT
+    const uint8_t *pending;     ///< unterminated input which was not copied into buffer yet
+    int pending_size;
 } ParseContext;
 
 struct MpegEncContext;
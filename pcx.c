@@ -188,7 +188,7 @@ static int pcx_decode_frame(AVCodecContext *avctx, void *data, int *data_size,
         }
 
     } else if (nplanes == 1) {   /* all packed formats, max. 16 colors */
-        uint8_t scanline[bytes_per_scanline];
+        uint8_t scanline[bytes_per_scanline + FF_INPUT_BUFFER_PADDING_SIZE];
         GetBitContext s;
 
         for (y=0; y<h; y++) {
@@ -189,6 +189,20 @@ void ff_add_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w
         }\
     }
 
+#define OP_SUB(x,s,l) x+s
+#define OP_AVG(x,s,l) (((x + l) >> 1) + s) & 0xff
+
+void ff_add_png_avg_prediction(uint8_t *dst, uint8_t *src, uint8_t *last, int size, int bpp)
+{
+    int i, p, r, g, b, a;
+
+    for(i = 0; i < bpp; i++) {
+        p = (last[i] >> 1);
+        dst[i] = p + src[i];
+    }
+    UNROLL_FILTER(OP_AVG);
+}
+
 /* NOTE: 'dst' can be equal to 'last' */
 static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
                            uint8_t *src, uint8_t *last, int size, int bpp)
@@ -211,7 +225,6 @@ static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
                 *(int*)(dst+i) = p;
             }
         } else {
-#define OP_SUB(x,s,l) x+s
             UNROLL_FILTER(OP_SUB);
         }
         break;
@@ -219,12 +232,7 @@ static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
         dsp->add_bytes_l2(dst, src, last, size);
         break;
     case PNG_FILTER_VALUE_AVG:
-        for(i = 0; i < bpp; i++) {
-            p = (last[i] >> 1);
-            dst[i] = p + src[i];
-        }
-#define OP_AVG(x,s,l) (((x + l) >> 1) + s) & 0xff
-        UNROLL_FILTER(OP_AVG);
+        dsp->add_png_avg_prediction(dst, src, last, size, bpp);
         break;
     case PNG_FILTER_VALUE_PAETH:
         for(i = 0; i < bpp; i++) {
@@ -32,6 +32,19 @@
 //#define DEBUG
 
 #define IOBUF_SIZE 4096
+#define MIN_BAND_HEIGHT 16
+
+/**
+ * A horizontal band of the image, compressed by one thread into a raw
+ * deflate stream which ends on a byte boundary.
+ */
+typedef struct PNGEncBand {
+    int y_start, y_end;
+    uint8_t *buf;               ///< 2 bytes for the zlib header, the deflate data and 4 bytes for the checksum
+    int size;                   ///< size of the deflate data
+    unsigned long adler;        ///< adler32 of the filtered rows of the band
+    int ret;
+} PNGEncBand;
 
 typedef struct PNGEncContext {
     DSPContext dsp;
@@ -45,6 +58,14 @@ typedef struct PNGEncContext {
 
     z_stream zstream;
     uint8_t buf[IOBUF_SIZE];
+
+    /* parameters of the current frame, used by the band threads */
+    int color_type;
+    int bits_per_pixel;
+    int row_size;
+    int compression_level;
+    PNGEncBand *bands;
+    int nb_bands;
 } PNGEncContext;
 
 static void png_get_interlaced_row(uint8_t *dst, int row_size,
@@ -85,7 +106,7 @@ static void png_get_interlaced_row(uint8_t *dst, int row_size,
     }
 }
 
-static void sub_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
+void ff_sub_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
 {
     int i;
     for(i = 0; i < w; i++) {
@@ -112,10 +133,17 @@ static void sub_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, i
     }
 }
 
+void ff_sub_png_avg_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
+{
+    int i;
+    for(i = 0; i < w; i++)
+        dst[i] = src[i] - ((src[i - bpp] + top[i]) >> 1);
+}
+
 static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
                            uint8_t *src, uint8_t *top, int size, int bpp)
 {
-    int i;
+    int i, w;
 
     switch(filter_type) {
     case PNG_FILTER_VALUE_NONE:
@@ -131,13 +159,22 @@ static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
     case PNG_FILTER_VALUE_AVG:
         for(i = 0; i < bpp; i++)
             dst[i] = src[i] - (top[i] >> 1);
-        for(; i < size; i++)
-            dst[i] = src[i] - ((src[i-bpp] + top[i]) >> 1);
+        w = (size - i) & ~15;
+        if(w) {
+            dsp->sub_png_avg_prediction(dst+i, src+i, top+i, w, bpp);
+            i += w;
+        }
+        ff_sub_png_avg_prediction(dst+i, src+i, top+i, size-i, bpp);
         break;
     case PNG_FILTER_VALUE_PAETH:
         for(i = 0; i < bpp; i++)
             dst[i] = src[i] - top[i];
-        sub_png_paeth_prediction(dst+i, src+i, top+i, size-i, bpp);
+        w = (size - i) & ~15;
+        if(w) {
+            dsp->sub_png_paeth_prediction(dst+i, src+i, top+i, w, bpp);
+            i += w;
+        }
+        ff_sub_png_paeth_prediction(dst+i, src+i, top+i, size-i, bpp);
         break;
     }
 }
@@ -229,13 +266,167 @@ static int png_write_row(PNGEncContext *s, const uint8_t *data, int size)
     return 0;
 }
 
+/**
+ * Filters and compresses the rows of one band into a raw deflate stream.
+ * The stream is primed with the filtered rows at the end of the previous
+ * band, so that the bands can be joined into one zlib stream without
+ * losing the matches across band boundaries.
+ */
+static int png_encode_band(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s = avctx->priv_data;
+    PNGEncBand *band = &s->bands[jobnr];
+    AVFrame * const p = &s->picture;
+    const int row_size = s->row_size;
+    const int bpp = s->bits_per_pixel >> 3;
+    const int dict_rows = FFMIN((32768 + row_size) / (row_size + 1), band->y_start);
+    const int flush = jobnr == s->nb_bands - 1 ? Z_FINISH : Z_SYNC_FLUSH;
+    z_stream zstream;
+    uint8_t *crow_base, *crow_buf, *crow, *ptr, *top = NULL;
+    uint8_t *rgba_buf = NULL, *top_buf = NULL, *dict = NULL;
+    int y, ret, buf_size, dict_size = 0;
+
+    band->ret = -1;
+
+    zstream.zalloc = ff_png_zalloc;
+    zstream.zfree = ff_png_zfree;
+    zstream.opaque = NULL;
+    ret = deflateInit2(&zstream, s->compression_level,
+                       Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+        return -1;
+    buf_size = deflateBound(&zstream, (band->y_end - band->y_start) * (row_size + 1)) + 16;
+
+    crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    band->buf = av_malloc(buf_size + 6);
+    if (!crow_base || !band->buf)
+        goto the_end;
+    crow_buf = crow_base + 15;
+    if (dict_rows) {
+        dict = av_malloc(dict_rows * (row_size + 1));
+        if (!dict)
+            goto the_end;
+    }
+    if (s->color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+        rgba_buf = av_malloc(row_size + 1);
+        top_buf = av_malloc(row_size + 1);
+        if (!rgba_buf || !top_buf)
+            goto the_end;
+    }
+
+    zstream.avail_out = buf_size;
+    zstream.next_out = band->buf + 2;
+    band->adler = adler32(0, Z_NULL, 0);
+
+    /* the row above the first dictionary row is only needed as top */
+    for(y = FFMAX(band->y_start - dict_rows - 1, 0); y < band->y_end; y++) {
+        ptr = p->data[0] + y * p->linesize[0];
+        if (s->color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+            FFSWAP(uint8_t*, rgba_buf, top_buf);
+            convert_from_rgb32(rgba_buf, ptr, avctx->width);
+            ptr = rgba_buf;
+        }
+        if (y >= band->y_start - dict_rows) {
+            crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bpp);
+            if (y < band->y_start) {
+                memcpy(dict + dict_size, crow, row_size + 1);
+                dict_size += row_size + 1;
+            } else {
+                if (y == band->y_start && dict_size)
+                    deflateSetDictionary(&zstream, dict + FFMAX(dict_size - 32768, 0),
+                                         FFMIN(dict_size, 32768));
+                band->adler = adler32(band->adler, crow, row_size + 1);
+                zstream.avail_in = row_size + 1;
+                zstream.next_in = crow;
+                if (deflate(&zstream, Z_NO_FLUSH) != Z_OK)
+                    goto the_end;
+            }
+        }
+        top = ptr;
+    }
+
+    /* the sync flush ends the stream of all but the last band on a byte boundary */
+    ret = deflate(&zstream, flush);
+    if (ret != (flush == Z_FINISH ? Z_STREAM_END : Z_OK) || !zstream.avail_out)
+        goto the_end;
+    band->size = zstream.next_out - band->buf - 2;
+    band->ret = 0;
+
+ the_end:
+    av_free(crow_base);
+    av_free(rgba_buf);
+    av_free(top_buf);
+    av_free(dict);
+    deflateEnd(&zstream);
+    return band->ret;
+}
+
+/**
+ * Compresses the image in horizontal bands in parallel and writes them as
+ * one IDAT chunk per band.
+ */
+static int png_write_bands(AVCodecContext *avctx, int nb_bands)
+{
+    PNGEncContext *s = avctx->priv_data;
+    uLong adler = adler32(0, Z_NULL, 0);
+    int i, level, flevel, ret = -1;
+
+    s->bands = av_mallocz(nb_bands * sizeof(*s->bands));
+    if (!s->bands)
+        return -1;
+    s->nb_bands = nb_bands;
+    for(i = 0; i < nb_bands; i++) {
+        s->bands[i].y_start = avctx->height *  i      / nb_bands;
+        s->bands[i].y_end   = avctx->height * (i + 1) / nb_bands;
+    }
+
+    avctx->execute2(avctx, png_encode_band, NULL, NULL, nb_bands);
+
+    for(i = 0; i < nb_bands; i++) {
+        PNGEncBand *band = &s->bands[i];
+        uint8_t *start = band->buf + 2;
+        int len = band->size;
+
+        if (band->ret < 0)
+            goto the_end;
+        adler = adler32_combine(adler, band->adler,
+                                (band->y_end - band->y_start) * (s->row_size + 1));
+        if (i == 0) {
+            /* zlib header with the same level hint deflate() writes */
+            level = s->compression_level == Z_DEFAULT_COMPRESSION ? 6 : s->compression_level;
+            flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+            start -= 2;
+            len += 2;
+            start[0] = 0x78;
+            start[1] = flevel << 6;
+            start[1] += 31 - (start[0] * 256 + start[1]) % 31;
+        }
+        if (i == nb_bands - 1) {
+            AV_WB32(start + len, adler);
+            len += 4;
+        }
+        if (s->bytestream_end - s->bytestream < len + 24) {
+            av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+            goto the_end;
+        }
+        png_write_chunk(&s->bytestream, MKTAG('I', 'D', 'A', 'T'), start, len);
+    }
+    ret = 0;
+
+ the_end:
+    for(i = 0; i < nb_bands; i++)
+        av_free(s->bands[i].buf);
+    av_freep(&s->bands);
+    return ret;
+}
+
 static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
     PNGEncContext *s = avctx->priv_data;
     AVFrame *pict = data;
     AVFrame * const p= &s->picture;
     int bit_depth, color_type, y, len, row_size, ret, is_progressive;
     int bits_per_pixel, pass_row_size;
-    int compression_level;
+    int compression_level, nb_bands;
     uint8_t *ptr, *top;
     uint8_t *crow_base = NULL, *crow_buf, *crow;
     uint8_t *progressive_buf = NULL;
@@ -277,6 +468,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     }
     bits_per_pixel = ff_png_get_nb_channels(color_type) * bit_depth;
     row_size = (avctx->width * bits_per_pixel + 7) >> 3;
+    nb_bands = is_progressive ? 1 : av_clip(avctx->height / MIN_BAND_HEIGHT, 1, avctx->thread_count);
 
     s->zstream.zalloc = ff_png_zalloc;
     s->zstream.zfree = ff_png_zfree;
@@ -284,6 +476,10 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT ?
                             Z_DEFAULT_COMPRESSION :
                             av_clip(avctx->compression_level, 0, 9);
+    s->color_type = color_type;
+    s->bits_per_pixel = bits_per_pixel;
+    s->row_size = row_size;
+    s->compression_level = compression_level;
     ret = deflateInit2(&s->zstream, compression_level,
                        Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY);
     if (ret != Z_OK)
@@ -350,7 +546,10 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     /* now put each row */
     s->zstream.avail_out = IOBUF_SIZE;
     s->zstream.next_out = s->buf;
-    if (is_progressive) {
+    if (nb_bands > 1) {
+        if (png_write_bands(avctx, nb_bands) < 0)
+            goto fail;
+    } else if (is_progressive) {
         int pass;
 
         for(pass = 0; pass < NB_PASSES; pass++) {
@@ -392,7 +591,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
         }
     }
     /* compress last bytes */
-    for(;;) {
+    while (nb_bands == 1) {
         ret = deflate(&s->zstream, Z_FINISH);
         if (ret == Z_OK || ret == Z_STREAM_END) {
             len = IOBUF_SIZE - s->zstream.avail_out;
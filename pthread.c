@@ -24,128 +24,476 @@
 #include <pthread.h>
 
 #include "avcodec.h"
+#include "thread.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
-typedef struct ThreadContext {
-    pthread_t *workers;
+/// Number of polls an idle thread makes before it goes to sleep.
+#define SPIN_COUNT 4096
+
+/// The job ranges of a batch are packed into 16 bits each.
+#define MAX_BATCH_JOBS 0xFFFF
+#define MAKE_RANGE(begin, end) ((uint32_t)(begin) << 16 | (end))
+#define RANGE_BEGIN(r) ((r) >> 16)
+#define RANGE_END(r)   ((r) & 0xFFFF)
+
+#if AV_GCC_VERSION_AT_LEAST(4,1)
+#define atomic_cas(ptr, oldval, newval) __sync_val_compare_and_swap(ptr, oldval, newval)
+#define atomic_add(ptr, inc)            __sync_add_and_fetch(ptr, inc)
+#define memory_barrier()                __sync_synchronize()
+#else
+static pthread_mutex_t atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t atomic_cas(volatile uint32_t *ptr, uint32_t oldval, uint32_t newval)
+{
+    uint32_t ret;
+    pthread_mutex_lock(&atomic_lock);
+    ret = *ptr;
+    if (ret == oldval)
+        *ptr = newval;
+    pthread_mutex_unlock(&atomic_lock);
+    return ret;
+}
+
+static int atomic_add(volatile int *ptr, int inc)
+{
+    int ret;
+    pthread_mutex_lock(&atomic_lock);
+    ret = *ptr += inc;
+    pthread_mutex_unlock(&atomic_lock);
+    return ret;
+}
+
+#define memory_barrier() do { pthread_mutex_lock(&atomic_lock); pthread_mutex_unlock(&atomic_lock); } while (0)
+#endif
+
+#if ARCH_X86
+#define cpu_relax() __asm__ volatile("rep; nop" ::: "memory")
+#else
+#define cpu_relax() do {} while (0)
+#endif
+
+/**
+ * The jobs of one execute() call.
+ * They are split into one range per participating thread. Each thread takes
+ * jobs from the front of its own range and, once that is empty, steals the
+ * back half of another one.
+ */
+typedef struct ThreadBatch {
+    AVCodecContext *avctx;
     action_func *func;
     action_func2 *func2;
     void *args;
     int *rets;
     int rets_count;
-    int job_count;
     int job_size;
+    int job_offset;                 ///< Number of the first job, a batch has at most MAX_BATCH_JOBS.
+    int priority;                   ///< Batches with a higher priority are served first.
 
-    pthread_cond_t last_job_cond;
-    pthread_cond_t current_job_cond;
-    pthread_mutex_t current_job_lock;
-    int current_job;
-    int done;
+    volatile uint32_t *range;       ///< Remaining jobs per participant, see MAKE_RANGE().
+    int nb_slots;                   ///< Maximum number of participants, the job function's threadnr is below it.
+    int nb_joined;                  ///< Participants so far, the calling thread being the first.
+    volatile int jobs_left;         ///< Jobs which have not finished yet.
+    volatile int refs;              ///< Workers currently inside the batch.
+
+    struct ThreadBatch *next;
+} ThreadBatch;
+
+/**
+ * A set of worker threads and the batches they work on.
+ * It is either private to one context or shared between several,
+ * see avcodec_thread_pool_alloc().
+ */
+typedef struct AVThreadPool {
+    pthread_t *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;           ///< Protects the batch list, nb_joined, refs and the sleeping workers.
+    pthread_cond_t work_cond;       ///< Used by idle workers to wait for new batches.
+    pthread_cond_t done_cond;       ///< Used by execute() to wait for its batch to finish.
+
+    ThreadBatch *batches;           ///< Sorted by decreasing priority.
+    int nb_batches;
+    volatile unsigned generation;   ///< Incremented whenever a batch is added.
+    int nb_sleeping;
+    volatile int done;
+} ThreadPool;
+
+/**
+ * Context stored in the client AVCodecContext thread_opaque when slice threading.
+ */
+typedef struct ThreadContext {
+    ThreadPool *pool;
+    volatile uint32_t *range;       ///< Job ranges of this context's batches, thread_count entries.
+    int own_pool;                   ///< The pool was created for this context, not set by the user.
+
+    volatile int *row_progress;     ///< See ff_thread_init_row_progress().
+    int nb_row_progress;
+    volatile int next_row;
+    volatile int nb_row_waiting;    ///< Jobs waiting on row_cond.
+    pthread_mutex_t row_mutex;
+    pthread_cond_t row_cond;
 } ThreadContext;
 
-static void* attribute_align_arg worker(void *v)
+/// Max number of frame buffers that can be allocated when using frame threads.
+#define MAX_BUFFERS (32+1)
+
+/**
+ * Context used by codec threads and stored in their AVCodecContext thread_opaque.
+ */
+typedef struct PerThreadContext {
+    struct FrameThreadContext *parent;
+
+    pthread_t      thread;
+    int            thread_init;
+    pthread_cond_t input_cond;      ///< Used to wait for a new packet from the main thread.
+    pthread_cond_t progress_cond;   ///< Used by child threads to wait for progress to change.
+    pthread_cond_t output_cond;     ///< Used by the main thread to wait for frames to finish.
+
+    pthread_mutex_t mutex;          ///< Mutex used to protect the contents of the PerThreadContext.
+    pthread_mutex_t progress_mutex; ///< Mutex used to protect frame progress values and progress_cond.
+
+    AVCodecContext *avctx;          ///< Context used to decode packets passed to this thread.
+
+    AVPacket       avpkt;           ///< Input packet (for decoding) or output (for encoding).
+    unsigned int   allocated_buf_size; ///< Size allocated for avpkt.data
+
+    AVFrame frame;                  ///< Output frame (for decoding) or input (for encoding).
+    int     got_frame;              ///< The output of got_picture_ptr from the last avcodec_decode_video() call.
+    int     result;                 ///< The result of the last codec decode/encode() call.
+
+    enum {
+        STATE_INPUT_READY,          ///< Set when the thread is awaiting a packet.
+        STATE_SETTING_UP,           ///< Set before the codec has called ff_thread_finish_setup().
+        STATE_GET_BUFFER,           /**<
+                                     * Set when the codec calls get_buffer().
+                                     * State is returned to STATE_SETTING_UP afterwards.
+                                     */
+        STATE_SETUP_FINISHED        ///< Set after the codec has called ff_thread_finish_setup().
+    } state;
+
+    /**
+     * Array of frames passed to ff_thread_release_buffer().
+     * Frames are released after all threads referencing them are finished.
+     */
+    AVFrame released_buffers[MAX_BUFFERS];
+    int     num_released_buffers;
+
+    /**
+     * Array of progress values used by ff_thread_get_buffer().
+     */
+    int     progress[MAX_BUFFERS][2];
+    uint8_t progress_used[MAX_BUFFERS];
+
+    AVFrame *requested_frame;       ///< AVFrame the codec passed to get_buffer()
+} PerThreadContext;
+
+/**
+ * Context stored in the client AVCodecContext thread_opaque.
+ */
+typedef struct FrameThreadContext {
+    PerThreadContext *threads;     ///< The contexts for each thread.
+    PerThreadContext *prev_thread; ///< The last thread submit_packet() was called on.
+
+    pthread_mutex_t buffer_mutex;  ///< Mutex used to protect get/release_buffer().
+
+    int next_decoding;             ///< The next context to submit a packet to.
+    int next_finished;             ///< The next context to return output from.
+
+    int delaying;                  /**<
+                                    * Set for the first N packets, where N is the number of threads.
+                                    * While it is set, ff_thread_decode_frame() won't return any results.
+                                    */
+
+    int die;                       ///< Set when threads should exit.
+} FrameThreadContext;
+
+/**
+ * Takes the next job of a batch, stealing from other participants once
+ * the own range is used up.
+ *
+ * @return the job number relative to job_offset, or -1 if none is left
+ */
+static int take_job(ThreadBatch *b, int slot)
 {
-    AVCodecContext *avctx = v;
-    ThreadContext *c = avctx->thread_opaque;
-    int our_job = c->job_count;
-    int thread_count = avctx->thread_count;
-    int self_id;
+    volatile uint32_t *own = &b->range[slot];
+    uint32_t r;
+    int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    self_id = c->current_job++;
-    for (;;){
-        while (our_job >= c->job_count) {
-            if (c->current_job == thread_count + c->job_count)
-                pthread_cond_signal(&c->last_job_cond);
+    for (r = *own; RANGE_BEGIN(r) < RANGE_END(r); r = *own)
+        if (atomic_cas(own, r, r + (1 << 16)) == r)
+            return RANGE_BEGIN(r);
 
-            pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
-            our_job = self_id;
+    for (i = 1; i < b->nb_slots; i++) {
+        volatile uint32_t *victim = &b->range[(slot + i) % b->nb_slots];
 
-            if (c->done) {
-                pthread_mutex_unlock(&c->current_job_lock);
-                return NULL;
+        for (r = *victim; RANGE_BEGIN(r) < RANGE_END(r); r = *victim) {
+            int begin = RANGE_BEGIN(r), end = RANGE_END(r);
+            int split = end - ((end - begin + 1) >> 1);
+
+            if (atomic_cas(victim, r, MAKE_RANGE(begin, split)) == r) {
+                /* nobody else writes an empty range, so a plain store is enough */
+                *own = MAKE_RANGE(split + 1, end);
+                memory_barrier();
+                return split;
             }
         }
-        pthread_mutex_unlock(&c->current_job_lock);
+    }
+
+    return -1;
+}
+
+static int batch_has_work(ThreadBatch *b)
+{
+    int i;
+
+    for (i = 0; i < b->nb_slots; i++)
+        if (RANGE_BEGIN(b->range[i]) < RANGE_END(b->range[i]))
+            return 1;
+
+    return 0;
+}
+
+static void run_batch(ThreadBatch *b, int slot)
+{
+    int job;
+
+    while ((job = take_job(b, slot)) >= 0) {
+        job += b->job_offset;
+        b->rets[job%b->rets_count] = b->func ? b->func(b->avctx, (char*)b->args + job*b->job_size):
+                                               b->func2(b->avctx, b->args, job, slot);
+        atomic_add(&b->jobs_left, -1);
+    }
+}
+
+/**
+ * Chooses the batch an idle worker should join.
+ * Batches with fewer workers than their fair share of the pool are served
+ * first, in order of priority. Only when all of them have their share do
+ * remaining workers go to the highest priority batch with work left.
+ */
+static ThreadBatch *pick_batch(ThreadPool *pool)
+{
+    ThreadBatch *b, *fallback = NULL;
+    int share;
+
+    if (!pool->nb_batches)
+        return NULL;
+
+    share = (pool->nb_workers + pool->nb_batches - 1) / pool->nb_batches;
+
+    for (b = pool->batches; b; b = b->next) {
+        if (b->nb_joined >= b->nb_slots || !batch_has_work(b))
+            continue;
+        if (b->refs < share)
+            return b;
+        if (!fallback)
+            fallback = b;
+    }
+
+    return fallback;
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    ThreadPool *pool = v;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->done) {
+        ThreadBatch *b = pick_batch(pool);
+        unsigned generation;
+        int i;
+
+        if (b) {
+            int slot = b->nb_joined++;
+
+            b->refs++;
+            pthread_mutex_unlock(&pool->lock);
+
+            run_batch(b, slot);
+
+            pthread_mutex_lock(&pool->lock);
+            b->refs--;
+            if (!b->jobs_left)
+                pthread_cond_broadcast(&pool->done_cond);
+            continue;
+        }
 
-        c->rets[our_job%c->rets_count] = c->func ? c->func(avctx, (char*)c->args + our_job*c->job_size):
-                                                   c->func2(avctx, c->args, our_job, self_id);
+        /* Spin for a while before sleeping, as codecs tend to call
+         * execute() several times in a row. */
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 0; i < SPIN_COUNT && pool->generation == generation && !pool->done; i++)
+            cpu_relax();
 
-        pthread_mutex_lock(&c->current_job_lock);
-        our_job = c->current_job++;
+        pthread_mutex_lock(&pool->lock);
+        pool->nb_sleeping++;
+        while (pool->generation == generation && !pool->done)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        pool->nb_sleeping--;
     }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
 }
 
-static av_always_inline void avcodec_thread_park_workers(ThreadContext *c, int thread_count)
+static void pool_destroy(ThreadPool *pool)
 {
-    pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
-    pthread_mutex_unlock(&c->current_job_lock);
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->done = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    av_free(pool->workers);
+    av_free(pool);
 }
 
-void avcodec_thread_free(AVCodecContext *avctx)
+static ThreadPool *pool_create(int nb_workers)
 {
-    ThreadContext *c = avctx->thread_opaque;
+    ThreadPool *pool = av_mallocz(sizeof(ThreadPool));
     int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    c->done = 1;
-    pthread_cond_broadcast(&c->current_job_cond);
-    pthread_mutex_unlock(&c->current_job_lock);
+    if (!pool)
+        return NULL;
+
+    pool->workers = av_mallocz(sizeof(pthread_t)*nb_workers);
+    if (!pool->workers) {
+        av_free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (i = 0; i < nb_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, worker, pool)) {
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->nb_workers++;
+    }
+
+    return pool;
+}
+
+/**
+ * Runs a batch on the pool. The calling thread takes part as the first
+ * participant and returns once all jobs are finished.
+ */
+static void pool_execute(ThreadPool *pool, ThreadBatch *b)
+{
+    ThreadBatch **p;
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    for (p = &pool->batches; *p && (*p)->priority >= b->priority; p = &(*p)->next);
+    b->next = *p;
+    *p = b;
+    pool->nb_batches++;
+    pool->generation++;
+    if (pool->nb_sleeping)
+        pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_batch(b, 0);
+
+    for (i = 0; i < SPIN_COUNT && (b->jobs_left || b->refs); i++)
+        cpu_relax();
+
+    pthread_mutex_lock(&pool->lock);
+    while (b->jobs_left || b->refs)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    for (p = &pool->batches; *p != b; p = &(*p)->next);
+    *p = b->next;
+    pool->nb_batches--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void thread_free(AVCodecContext *avctx)
+{
+    ThreadContext *c = avctx->thread_opaque;
 
-    for (i=0; i<avctx->thread_count; i++)
-         pthread_join(c->workers[i], NULL);
+    if (!c)
+        return;
 
-    pthread_mutex_destroy(&c->current_job_lock);
-    pthread_cond_destroy(&c->current_job_cond);
-    pthread_cond_destroy(&c->last_job_cond);
-    av_free(c->workers);
+    if (c->own_pool)
+        pool_destroy(c->pool);
+    pthread_mutex_destroy(&c->row_mutex);
+    pthread_cond_destroy(&c->row_cond);
+    av_free((void*)c->row_progress);
+    av_free((void*)c->range);
     av_freep(&avctx->thread_opaque);
 }
 
-int avcodec_thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
+static int thread_execute(AVCodecContext *avctx, action_func* func, action_func2* func2, void *arg, int *ret, int job_count, int job_size)
 {
     ThreadContext *c= avctx->thread_opaque;
-    int dummy_ret;
+    ThreadBatch b;
+    int dummy_ret, i;
 
     if (job_count <= 0)
         return 0;
 
-    pthread_mutex_lock(&c->current_job_lock);
-
-    c->current_job = avctx->thread_count;
-    c->job_count = job_count;
-    c->job_size = job_size;
-    c->args = arg;
-    c->func = func;
+    b.avctx    = avctx;
+    b.func     = func;
+    b.func2    = func2;
+    b.args     = arg;
+    b.job_size = job_size;
+    b.priority = avctx->thread_priority;
+    b.range    = c->range;
+    b.nb_slots = avctx->thread_count;
+    if (!c->own_pool && avctx->thread_pool_max_workers > 0)
+        b.nb_slots = FFMIN(b.nb_slots, avctx->thread_pool_max_workers + 1);
     if (ret) {
-        c->rets = ret;
-        c->rets_count = job_count;
+        b.rets = ret;
+        b.rets_count = job_count;
     } else {
-        c->rets = &dummy_ret;
-        c->rets_count = 1;
+        b.rets = &dummy_ret;
+        b.rets_count = 1;
     }
-    pthread_cond_broadcast(&c->current_job_cond);
 
-    avcodec_thread_park_workers(c, avctx->thread_count);
+    for (b.job_offset = 0; b.job_offset < job_count; b.job_offset += MAX_BATCH_JOBS) {
+        int n = FFMIN(job_count - b.job_offset, MAX_BATCH_JOBS);
+
+        for (i = 0; i < b.nb_slots; i++)
+            b.range[i] = MAKE_RANGE(i*n / b.nb_slots, (i+1)*n / b.nb_slots);
+        b.nb_joined = 1;
+        b.jobs_left = n;
+        b.refs      = 0;
+
+        pool_execute(c->pool, &b);
+    }
 
     return 0;
 }
 
+int avcodec_thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
+{
+    return thread_execute(avctx, func, NULL, arg, ret, job_count, job_size);
+}
+
 int avcodec_thread_execute2(AVCodecContext *avctx, action_func2* func2, void *arg, int *ret, int job_count)
 {
-    ThreadContext *c= avctx->thread_opaque;
-    c->func2 = func2;
-    return avcodec_thread_execute(avctx, NULL, arg, ret, job_count, 0);
+    return thread_execute(avctx, NULL, func2, arg, ret, job_count, 0);
 }
 
-int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
+static int thread_init(AVCodecContext *avctx)
 {
-    int i;
     ThreadContext *c;
-
-    avctx->thread_count = thread_count;
+    int thread_count = avctx->thread_count;
 
     if (thread_count <= 1)
         return 0;
@@ -154,33 +502,821 @@ int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
     if (!c)
         return -1;
 
-    c->workers = av_mallocz(sizeof(pthread_t)*thread_count);
-    if (!c->workers) {
+    /* the thread calling execute() does its share of the work */
+    c->range = av_malloc(sizeof(*c->range)*thread_count);
+    if (avctx->thread_pool) {
+        c->pool = avctx->thread_pool;
+    } else {
+        c->pool = pool_create(thread_count - 1);
+        c->own_pool = 1;
+    }
+    if (!c->range || !c->pool) {
+        if (c->own_pool)
+            pool_destroy(c->pool);
+        av_free((void*)c->range);
         av_free(c);
         return -1;
     }
 
+    pthread_mutex_init(&c->row_mutex, NULL);
+    pthread_cond_init(&c->row_cond, NULL);
+
     avctx->thread_opaque = c;
-    c->current_job = 0;
-    c->job_count = 0;
-    c->job_size = 0;
-    c->done = 0;
-    pthread_cond_init(&c->current_job_cond, NULL);
-    pthread_cond_init(&c->last_job_cond, NULL);
-    pthread_mutex_init(&c->current_job_lock, NULL);
-    pthread_mutex_lock(&c->current_job_lock);
-    for (i=0; i<thread_count; i++) {
-        if(pthread_create(&c->workers[i], NULL, worker, avctx)) {
-           avctx->thread_count = i;
-           pthread_mutex_unlock(&c->current_job_lock);
-           avcodec_thread_free(avctx);
-           return -1;
+    avctx->execute = avcodec_thread_execute;
+    avctx->execute2 = avcodec_thread_execute2;
+    return 0;
+}
+
+int ff_thread_init_row_progress(AVCodecContext *avctx, int nb_rows)
+{
+    ThreadContext *c = avctx->thread_opaque;
+    int i;
+
+    if (!(avctx->active_thread_type&FF_THREAD_SLICE) || !c)
+        return -1;
+
+    if (nb_rows > c->nb_row_progress) {
+        av_free((void*)c->row_progress);
+        c->row_progress = av_malloc(sizeof(*c->row_progress)*nb_rows);
+        if (!c->row_progress) {
+            c->nb_row_progress = 0;
+            return AVERROR(ENOMEM);
         }
+        c->nb_row_progress = nb_rows;
     }
 
-    avcodec_thread_park_workers(c, thread_count);
+    for (i = 0; i < nb_rows; i++)
+        c->row_progress[i] = 0;
+    c->next_row = 0;
+
+    return 0;
+}
+
+int ff_thread_next_row(AVCodecContext *avctx)
+{
+    ThreadContext *c = avctx->thread_opaque;
+
+    return atomic_add(&c->next_row, 1) - 1;
+}
+
+void ff_thread_report_row_progress(AVCodecContext *avctx, int row, int progress)
+{
+    ThreadContext *c = avctx->thread_opaque;
+
+    if (c->row_progress[row] >= progress)
+        return;
+
+    /* Publish whatever was written for the row before its progress, and the
+     * progress before checking for waiters; ff_thread_await_row_progress()
+     * does the opposite, so one of them always sees the other. */
+    memory_barrier();
+    c->row_progress[row] = progress;
+    memory_barrier();
+
+    if (c->nb_row_waiting) {
+        pthread_mutex_lock(&c->row_mutex);
+        pthread_cond_broadcast(&c->row_cond);
+        pthread_mutex_unlock(&c->row_mutex);
+    }
+}
+
+void ff_thread_await_row_progress(AVCodecContext *avctx, int row, int progress)
+{
+    ThreadContext *c = avctx->thread_opaque;
+
+    if (c->row_progress[row] < progress) {
+        pthread_mutex_lock(&c->row_mutex);
+        c->nb_row_waiting++;
+        memory_barrier();
+        while (c->row_progress[row] < progress)
+            pthread_cond_wait(&c->row_cond, &c->row_mutex);
+        c->nb_row_waiting--;
+        pthread_mutex_unlock(&c->row_mutex);
+    }
+
+    memory_barrier();
+}
+
+AVThreadPool *avcodec_thread_pool_alloc(int thread_count)
+{
+    if (thread_count < 1)
+        return NULL;
+
+    return pool_create(thread_count);
+}
+
+void avcodec_thread_pool_free(AVThreadPool *pool)
+{
+    pool_destroy(pool);
+}
+
+/**
+ * Codec worker thread.
+ *
+ * Automatically calls ff_thread_finish_setup() if the codec does
+ * not provide an update_thread_context method, or if the codec returns
+ * before calling it.
+ */
+static attribute_align_arg void *frame_worker_thread(void *arg)
+{
+    PerThreadContext *p = arg;
+    FrameThreadContext *fctx = p->parent;
+    AVCodecContext *avctx = p->avctx;
+    AVCodec *codec = avctx->codec;
+
+    while (1) {
+        if (p->state == STATE_INPUT_READY && !fctx->die) {
+            pthread_mutex_lock(&p->mutex);
+            while (p->state == STATE_INPUT_READY && !fctx->die)
+                pthread_cond_wait(&p->input_cond, &p->mutex);
+            pthread_mutex_unlock(&p->mutex);
+        }
+
+        if (fctx->die) break;
+
+        if (!codec->update_thread_context && (avctx->thread_safe_callbacks ||
+            avctx->get_buffer == avcodec_default_get_buffer))
+            ff_thread_finish_setup(avctx);
+
+        pthread_mutex_lock(&p->mutex);
+        avcodec_get_frame_defaults(&p->frame);
+        p->got_frame = 0;
+        p->result = codec->decode(avctx, &p->frame, &p->got_frame, &p->avpkt);
+
+        if (p->state == STATE_SETTING_UP) ff_thread_finish_setup(avctx);
+
+        p->state = STATE_INPUT_READY;
+
+        pthread_mutex_lock(&p->progress_mutex);
+        pthread_cond_signal(&p->output_cond);
+        pthread_mutex_unlock(&p->progress_mutex);
+
+        pthread_mutex_unlock(&p->mutex);
+    }
+
+    return NULL;
+}
+
+/**
+ * Updates the next thread's AVCodecContext with values from the reference thread's context.
+ *
+ * @param dst The destination context.
+ * @param src The source context.
+ * @param for_user 0 if the destination is a codec thread, 1 if the destination is the user's thread.
+ */
+static int update_context_from_thread(AVCodecContext *dst, AVCodecContext *src, int for_user)
+{
+    int err = 0;
+
+    if (dst != src) {
+        dst->sub_id    = src->sub_id;
+        dst->time_base = src->time_base;
+        dst->width     = src->width;
+        dst->height    = src->height;
+        dst->pix_fmt   = src->pix_fmt;
+
+        dst->coded_width  = src->coded_width;
+        dst->coded_height = src->coded_height;
+
+        dst->has_b_frames = src->has_b_frames;
+        dst->idct_algo    = src->idct_algo;
+        dst->slice_count  = src->slice_count;
+
+        dst->bits_per_coded_sample = src->bits_per_coded_sample;
+        dst->sample_aspect_ratio   = src->sample_aspect_ratio;
+        dst->dtg_active_format     = src->dtg_active_format;
+
+        dst->profile = src->profile;
+        dst->level   = src->level;
+
+        dst->bits_per_raw_sample = src->bits_per_raw_sample;
+        dst->ticks_per_frame     = src->ticks_per_frame;
+        dst->color_primaries     = src->color_primaries;
+
+        dst->color_trc   = src->color_trc;
+        dst->colorspace  = src->colorspace;
+        dst->color_range = src->color_range;
+        dst->chroma_sample_location = src->chroma_sample_location;
+    }
+
+    if (for_user) {
+        dst->coded_frame = src->coded_frame;
+    } else {
+        if (dst->codec->update_thread_context)
+            err = dst->codec->update_thread_context(dst, src);
+    }
+
+    return err;
+}
+
+/**
+ * Updates the next thread's AVCodecContext with values set by the user.
+ *
+ * @param dst The destination context.
+ * @param src The source context.
+ */
+static void update_context_from_user(AVCodecContext *dst, AVCodecContext *src)
+{
+    dst->flags          = src->flags;
+
+    dst->draw_horiz_band= src->draw_horiz_band;
+    dst->get_buffer     = src->get_buffer;
+    dst->release_buffer = src->release_buffer;
+
+    dst->opaque   = src->opaque;
+    dst->dsp_mask = src->dsp_mask;
+    dst->debug    = src->debug;
+    dst->debug_mv = src->debug_mv;
+
+    dst->slice_flags = src->slice_flags;
+    dst->flags2      = src->flags2;
+
+    dst->skip_loop_filter = src->skip_loop_filter;
+    dst->skip_idct        = src->skip_idct;
+    dst->skip_frame       = src->skip_frame;
+
+    dst->frame_number     = src->frame_number;
+    dst->reordered_opaque = src->reordered_opaque;
+    dst->thread_safe_callbacks = src->thread_safe_callbacks;
+}
+
+static void free_progress(AVFrame *f)
+{
+    PerThreadContext *p = f->owner->thread_opaque;
+    int *progress = f->thread_opaque;
+
+    p->progress_used[(progress - p->progress[0]) / 2] = 0;
+}
+
+/// Releases the buffers that this decoding thread was the last user of.
+static void release_delayed_buffers(PerThreadContext *p)
+{
+    FrameThreadContext *fctx = p->parent;
+
+    while (p->num_released_buffers > 0) {
+        AVFrame *f;
+
+        pthread_mutex_lock(&fctx->buffer_mutex);
+        f = &p->released_buffers[--p->num_released_buffers];
+        free_progress(f);
+        f->thread_opaque = NULL;
+
+        f->owner->release_buffer(f->owner, f);
+        pthread_mutex_unlock(&fctx->buffer_mutex);
+    }
+}
+
+static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
+{
+    FrameThreadContext *fctx = p->parent;
+    PerThreadContext *prev_thread = fctx->prev_thread;
+    AVCodec *codec = p->avctx->codec;
+    uint8_t *buf = p->avpkt.data;
+
+    if (!avpkt->size && !(codec->capabilities & CODEC_CAP_DELAY)) return 0;
+
+    pthread_mutex_lock(&p->mutex);
+
+    release_delayed_buffers(p);
+
+    if (prev_thread) {
+        int err;
+        if (prev_thread->state == STATE_SETTING_UP) {
+            pthread_mutex_lock(&prev_thread->progress_mutex);
+            while (prev_thread->state == STATE_SETTING_UP)
+                pthread_cond_wait(&prev_thread->progress_cond, &prev_thread->progress_mutex);
+            pthread_mutex_unlock(&prev_thread->progress_mutex);
+        }
+
+        err = update_context_from_thread(p->avctx, prev_thread->avctx, 0);
+        if (err) {
+            pthread_mutex_unlock(&p->mutex);
+            return err;
+        }
+    }
+
+    av_fast_malloc(&buf, &p->allocated_buf_size, avpkt->size + FF_INPUT_BUFFER_PADDING_SIZE);
+    p->avpkt = *avpkt;
+    p->avpkt.data = buf;
+    if (!buf) {
+        p->avpkt.size = 0;
+        pthread_mutex_unlock(&p->mutex);
+        return AVERROR(ENOMEM);
+    }
+    memcpy(buf, avpkt->data, avpkt->size);
+    memset(buf + avpkt->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+    p->state = STATE_SETTING_UP;
+    pthread_cond_signal(&p->input_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    /*
+     * If the client doesn't have a thread-safe get_buffer(),
+     * then decoding threads call back to the main thread,
+     * and it calls back to the client here.
+     */
+
+    if (!p->avctx->thread_safe_callbacks &&
+         p->avctx->get_buffer != avcodec_default_get_buffer) {
+        while (p->state != STATE_SETUP_FINISHED && p->state != STATE_INPUT_READY) {
+            pthread_mutex_lock(&p->progress_mutex);
+            while (p->state == STATE_SETTING_UP)
+                pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+
+            if (p->state == STATE_GET_BUFFER) {
+                p->result = p->avctx->get_buffer(p->avctx, p->requested_frame);
+                p->state  = STATE_SETTING_UP;
+                pthread_cond_signal(&p->progress_cond);
+            }
+            pthread_mutex_unlock(&p->progress_mutex);
+        }
+    }
+
+    fctx->prev_thread = p;
+    fctx->next_decoding++;
+
+    return 0;
+}
+
+int ff_thread_decode_frame(AVCodecContext *avctx,
+                           AVFrame *picture, int *got_picture_ptr,
+                           AVPacket *avpkt)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    int finished = fctx->next_finished;
+    PerThreadContext *p;
+    int err;
+
+    /*
+     * Submit a packet to the next decoding thread.
+     */
+
+    p = &fctx->threads[fctx->next_decoding];
+    update_context_from_user(p->avctx, avctx);
+    err = submit_packet(p, avpkt);
+    if (err) return err;
+
+    /*
+     * If we're still receiving the initial packets, don't return a frame.
+     */
+
+    if (fctx->delaying && avpkt->size) {
+        if (fctx->next_decoding >= (avctx->thread_count-1)) fctx->delaying = 0;
+
+        *got_picture_ptr=0;
+        return avpkt->size;
+    }
+
+    /*
+     * Return the next available frame from the oldest thread.
+     * If we're at the end of the stream, then we have to skip threads that
+     * didn't output a frame, because we don't want to accidentally signal
+     * EOF (avpkt->size == 0 && *got_picture_ptr == 0).
+     */
+
+    do {
+        p = &fctx->threads[finished++];
+
+        if (p->state != STATE_INPUT_READY) {
+            pthread_mutex_lock(&p->progress_mutex);
+            while (p->state != STATE_INPUT_READY)
+                pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+            pthread_mutex_unlock(&p->progress_mutex);
+        }
+
+        *picture = p->frame;
+        *got_picture_ptr = p->got_frame;
+
+        /*
+         * A later call with avkpt->size == 0 may loop over all threads,
+         * including this one, searching for a frame to return before being
+         * stopped by the "finished != fctx->next_finished" condition.
+         * Make sure we don't mistakenly return the same frame again.
+         */
+        p->got_frame = 0;
+
+        if (finished >= avctx->thread_count) finished = 0;
+    } while (!avpkt->size && !*got_picture_ptr && finished != fctx->next_finished);
+
+    update_context_from_thread(avctx, p->avctx, 1);
+
+    if (fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+
+    fctx->next_finished = finished;
+
+    /* return the size of the consumed packet if no error occurred */
+    return (p->result >= 0) ? avpkt->size : p->result;
+}
+
+void ff_thread_report_progress(AVFrame *f, int n, int field)
+{
+    PerThreadContext *p;
+    int *progress = f->thread_opaque;
+
+    if (!progress || progress[field] >= n) return;
+
+    p = f->owner->thread_opaque;
+
+    if (f->owner->debug&FF_DEBUG_THREADS)
+        av_log(f->owner, AV_LOG_DEBUG, "%p finished %d field %d\n", progress, n, field);
+
+    pthread_mutex_lock(&p->progress_mutex);
+    progress[field] = n;
+    pthread_cond_broadcast(&p->progress_cond);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+void ff_thread_await_progress(AVFrame *f, int n, int field)
+{
+    PerThreadContext *p;
+    int *progress = f->thread_opaque;
+
+    if (!progress || progress[field] >= n) return;
+
+    p = f->owner->thread_opaque;
+
+    if (f->owner->debug&FF_DEBUG_THREADS)
+        av_log(f->owner, AV_LOG_DEBUG, "thread awaiting %d field %d from %p\n", n, field, progress);
+
+    pthread_mutex_lock(&p->progress_mutex);
+    while (progress[field] < n)
+        pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+void ff_thread_finish_setup(AVCodecContext *avctx) {
+    PerThreadContext *p = avctx->thread_opaque;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) return;
+
+    pthread_mutex_lock(&p->progress_mutex);
+    p->state = STATE_SETUP_FINISHED;
+    pthread_cond_broadcast(&p->progress_cond);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+/// Waits for all threads to finish.
+static void park_frame_worker_threads(FrameThreadContext *fctx, int thread_count)
+{
+    int i;
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        if (p->state != STATE_INPUT_READY) {
+            pthread_mutex_lock(&p->progress_mutex);
+            while (p->state != STATE_INPUT_READY)
+                pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+            pthread_mutex_unlock(&p->progress_mutex);
+        }
+    }
+}
+
+static void frame_thread_free(AVCodecContext *avctx, int thread_count)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    AVCodec *codec = avctx->codec;
+    int i;
+
+    park_frame_worker_threads(fctx, thread_count);
+
+    if (fctx->prev_thread && fctx->prev_thread != fctx->threads)
+        update_context_from_thread(fctx->threads->avctx, fctx->prev_thread->avctx, 0);
+
+    fctx->die = 1;
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        pthread_mutex_lock(&p->mutex);
+        pthread_cond_signal(&p->input_cond);
+        pthread_mutex_unlock(&p->mutex);
+
+        if (p->thread_init)
+            pthread_join(p->thread, NULL);
+
+        if (codec->close && p->avctx)
+            codec->close(p->avctx);
+
+        avctx->codec = NULL;
+
+        release_delayed_buffers(p);
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        if (p->avctx)
+            avcodec_default_free_buffers(p->avctx);
+
+        pthread_mutex_destroy(&p->mutex);
+        pthread_mutex_destroy(&p->progress_mutex);
+        pthread_cond_destroy(&p->input_cond);
+        pthread_cond_destroy(&p->progress_cond);
+        pthread_cond_destroy(&p->output_cond);
+        av_freep(&p->avpkt.data);
+
+        if (i && p->avctx)
+            av_freep(&p->avctx->priv_data);
+
+        av_freep(&p->avctx);
+    }
+
+    av_freep(&fctx->threads);
+    pthread_mutex_destroy(&fctx->buffer_mutex);
+    av_freep(&avctx->thread_opaque);
+}
+
+static int frame_thread_init(AVCodecContext *avctx)
+{
+    int thread_count = avctx->thread_count;
+    AVCodec *codec = avctx->codec;
+    AVCodecContext *src = avctx;
+    FrameThreadContext *fctx;
+    int i, err = 0;
+
+    avctx->thread_opaque = fctx = av_mallocz(sizeof(FrameThreadContext));
+    if (!fctx)
+        return AVERROR(ENOMEM);
+
+    fctx->threads = av_mallocz(sizeof(PerThreadContext) * thread_count);
+    if (!fctx->threads) {
+        av_freep(&avctx->thread_opaque);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&fctx->buffer_mutex, NULL);
+    fctx->delaying = 1;
+
+    for (i = 0; i < thread_count; i++) {
+        AVCodecContext *copy = av_malloc(sizeof(AVCodecContext));
+        PerThreadContext *p  = &fctx->threads[i];
+
+        pthread_mutex_init(&p->mutex, NULL);
+        pthread_mutex_init(&p->progress_mutex, NULL);
+        pthread_cond_init(&p->input_cond, NULL);
+        pthread_cond_init(&p->progress_cond, NULL);
+        pthread_cond_init(&p->output_cond, NULL);
+
+        p->parent = fctx;
+        p->avctx  = copy;
+
+        if (!copy) {
+            err = AVERROR(ENOMEM);
+            goto error;
+        }
+
+        *copy = *src;
+        copy->thread_opaque = p;
+        copy->internal_buffer = NULL;
+        copy->internal_buffer_count = 0;
+
+        if (!i) {
+            src = copy;
+
+            if (codec->init)
+                err = codec->init(copy);
+
+            update_context_from_thread(avctx, copy, 1);
+        } else {
+            copy->is_copy   = 1;
+            copy->priv_data = av_malloc(codec->priv_data_size);
+            if (!copy->priv_data) {
+                err = AVERROR(ENOMEM);
+                goto error;
+            }
+            memcpy(copy->priv_data, src->priv_data, codec->priv_data_size);
+
+            if (codec->init_thread_copy)
+                err = codec->init_thread_copy(copy);
+        }
+
+        if (err) goto error;
+
+        if (!pthread_create(&p->thread, NULL, frame_worker_thread, p))
+            p->thread_init = 1;
+    }
+
+    return 0;
+
+error:
+    /* The copy which failed was never fully set up, so it must not be closed. */
+    if (fctx->threads[i].avctx) {
+        if (i)
+            av_freep(&fctx->threads[i].avctx->priv_data);
+        av_freep(&fctx->threads[i].avctx);
+    }
+    frame_thread_free(avctx, i+1);
+
+    return err;
+}
+
+void ff_thread_flush(AVCodecContext *avctx)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    int i;
+
+    if (!avctx->thread_opaque) return;
+
+    park_frame_worker_threads(fctx, avctx->thread_count);
+    if (fctx->prev_thread) {
+        if (fctx->prev_thread != &fctx->threads[0])
+            update_context_from_thread(fctx->threads[0].avctx, fctx->prev_thread->avctx, 0);
+        if (avctx->codec->flush)
+            avctx->codec->flush(fctx->threads[0].avctx);
+    }
+
+    fctx->next_decoding = fctx->next_finished = 0;
+    fctx->delaying = 1;
+    fctx->prev_thread = NULL;
+    /* Make sure decode flush calls with size=0 won't return old frames. */
+    for (i = 0; i < avctx->thread_count; i++)
+        fctx->threads[i].got_frame = 0;
+}
+
+static int *allocate_progress(PerThreadContext *p)
+{
+    int i;
+
+    for (i = 0; i < MAX_BUFFERS; i++)
+        if (!p->progress_used[i]) break;
+
+    if (i == MAX_BUFFERS) {
+        av_log(p->avctx, AV_LOG_ERROR, "allocate_progress() overflow\n");
+        return NULL;
+    }
+
+    p->progress_used[i] = 1;
+
+    return p->progress[i];
+}
+
+int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    PerThreadContext *p = avctx->thread_opaque;
+    int *progress, err;
+
+    f->owner = avctx;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        f->thread_opaque = NULL;
+        return avctx->get_buffer(avctx, f);
+    }
+
+    if (p->state != STATE_SETTING_UP &&
+        (avctx->codec->update_thread_context || (!avctx->thread_safe_callbacks &&
+                avctx->get_buffer != avcodec_default_get_buffer))) {
+        av_log(avctx, AV_LOG_ERROR, "get_buffer() cannot be called after ff_thread_finish_setup()\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&p->parent->buffer_mutex);
+    f->thread_opaque = progress = allocate_progress(p);
+
+    if (!progress) {
+        pthread_mutex_unlock(&p->parent->buffer_mutex);
+        return -1;
+    }
+
+    progress[0] =
+    progress[1] = -1;
+
+    if (avctx->thread_safe_callbacks ||
+        avctx->get_buffer == avcodec_default_get_buffer) {
+        err = avctx->get_buffer(avctx, f);
+    } else {
+        p->requested_frame = f;
+        p->state = STATE_GET_BUFFER;
+        pthread_mutex_lock(&p->progress_mutex);
+        pthread_cond_signal(&p->progress_cond);
+
+        while (p->state != STATE_SETTING_UP)
+            pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+
+        err = p->result;
+
+        pthread_mutex_unlock(&p->progress_mutex);
+
+        if (!avctx->codec->update_thread_context)
+            ff_thread_finish_setup(avctx);
+    }
+
+    if (err) {
+        free_progress(f);
+        f->thread_opaque = NULL;
+    }
+
+    pthread_mutex_unlock(&p->parent->buffer_mutex);
+
+    /*
+     * Buffer age is difficult to keep track of between
+     * multiple threads, and the optimizations it allows
+     * are not worth the effort. It is disabled for now.
+     */
+    f->age = INT_MAX;
+
+    return err;
+}
+
+void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    PerThreadContext *p = avctx->thread_opaque;
+    FrameThreadContext *fctx;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        avctx->release_buffer(avctx, f);
+        return;
+    }
+
+    if (p->num_released_buffers >= MAX_BUFFERS) {
+        av_log(p->avctx, AV_LOG_ERROR, "too many thread_release_buffer calls!\n");
+        return;
+    }
+
+    if(avctx->debug & FF_DEBUG_BUFFERS)
+        av_log(avctx, AV_LOG_DEBUG, "thread_release_buffer called on pic %p, %d buffers used\n",
+                                    f, f->owner->internal_buffer_count);
+
+    fctx = p->parent;
+    pthread_mutex_lock(&fctx->buffer_mutex);
+    p->released_buffers[p->num_released_buffers++] = *f;
+    pthread_mutex_unlock(&fctx->buffer_mutex);
+    memset(f->data, 0, sizeof(f->data));
+}
+
+/**
+ * Sets the threading algorithms used.
+ *
+ * Threading requires more than one thread.
+ * Frame threading requires entire frames to be passed to the codec,
+ * and introduces extra decoding delay, so is incompatible with low_delay.
+ *
+ * @param avctx The context.
+ */
+static void validate_thread_parameters(AVCodecContext *avctx)
+{
+    int frame_threading_supported = (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
+                                && !(avctx->flags & CODEC_FLAG_TRUNCATED)
+                                && !(avctx->flags & CODEC_FLAG_LOW_DELAY)
+                                && !(avctx->flags2 & CODEC_FLAG2_CHUNKS);
+    if (avctx->thread_count <= 1) {
+        avctx->active_thread_type = 0;
+    } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
+        avctx->active_thread_type = FF_THREAD_FRAME;
+    } else {
+        avctx->active_thread_type = FF_THREAD_SLICE;
+    }
+}
+
+int ff_thread_init(AVCodecContext *avctx)
+{
+    if (avctx->thread_opaque) {
+        av_log(avctx, AV_LOG_ERROR, "avcodec_thread_init is ignored after avcodec_open\n");
+        return -1;
+    }
+
+    if (avctx->codec) {
+        validate_thread_parameters(avctx);
+
+        if (avctx->active_thread_type&FF_THREAD_SLICE)
+            return thread_init(avctx);
+        else if (avctx->active_thread_type&FF_THREAD_FRAME)
+            return frame_thread_init(avctx);
+    }
+
+    return 0;
+}
+
+void ff_thread_free(AVCodecContext *avctx)
+{
+    if (avctx->active_thread_type&FF_THREAD_FRAME)
+        frame_thread_free(avctx, avctx->thread_count);
+    else
+        thread_free(avctx);
+
+    avctx->active_thread_type = 0;
+}
+
+void avcodec_thread_free(AVCodecContext *avctx)
+{
+    ff_thread_free(avctx);
+}
+
+int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
+{
+    if (avctx->thread_opaque) {
+        av_log(avctx, AV_LOG_ERROR, "avcodec_thread_init is ignored after avcodec_open\n");
+        return -1;
+    }
+
+    avctx->thread_count = thread_count;
+
+    /* The codec is already open and its state cannot be duplicated any
+     * more, so only slice threading can be enabled at this point.
+     * Otherwise threads are started by avcodec_open(). */
+    if (avctx->codec) {
+        avctx->active_thread_type = thread_count > 1 ? FF_THREAD_SLICE : 0;
+        return thread_init(avctx);
+    }
 
-    avctx->execute = avcodec_thread_execute;
-    avctx->execute2 = avcodec_thread_execute2;
     return 0;
 }
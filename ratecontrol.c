@@ -527,6 +527,19 @@ static void update_predictor(Predictor *p, double q, double var, double size)
     p->coeff+= new_coeff;
 }
 
+/**
+ * Updates the bits predictor of a picture type with the size of a coded frame.
+ * Used when frames are coded in parallel, so that the size of the previous
+ * frame may not be known yet when the quantizer of the next one is chosen.
+ * @param qscale the quantizer ff_rate_estimate_qscale() returned for the frame
+ * @param var the (motion compensated) variance sum of the frame
+ */
+void ff_rate_update_predictor(MpegEncContext *s, int pict_type, double qscale, int var, int frame_size){
+    RateControlContext *rcc= &s->rc_context;
+
+    update_predictor(&rcc->pred[pict_type], qscale, sqrt(var), frame_size);
+}
+
 static void adaptive_quantization(MpegEncContext *s, double q){
     int i;
     const float lumi_masking= s->avctx->lumi_masking / (128.0*128.0);
@@ -535,6 +548,7 @@ static void adaptive_quantization(MpegEncContext *s, double q){
     const float spatial_cplx_masking = s->avctx->spatial_cplx_masking;
     const float p_masking = s->avctx->p_masking;
     const float border_masking = s->avctx->border_masking;
+    const float lookahead_strength= (1.0 - s->avctx->qcompress) * 5.0 / 6.0;
     float bits_sum= 0.0;
     float cplx_sum= 0.0;
     float cplx_tab[s->mb_num];
@@ -593,6 +607,10 @@ static void adaptive_quantization(MpegEncContext *s, double q){
 
         factor*= 1.0 - border_masking*mb_factor;
 
+        /* MBs which later pictures refer to get a lower quantizer, see b_frame_strategy 3 */
+        if(pic->lookahead_propagate && s->pict_type != FF_B_TYPE && pic->lookahead_intra[mb_xy])
+            factor*= pow(1.0 + (float)pic->lookahead_propagate[mb_xy] / pic->lookahead_intra[mb_xy], lookahead_strength);
+
         if(factor<0.00001) factor= 0.00001;
 
         bits= cplx*factor;
@@ -683,7 +701,7 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
     fps= 1/av_q2d(s->avctx->time_base);
 //printf("input_pic_num:%d pic_num:%d frame_rate:%d\n", s->input_picture_number, s->picture_number, s->frame_rate);
         /* update predictors */
-    if(picture_number>2 && !dry_run){
+    if(picture_number>2 && !dry_run && !rcc->delayed_update){
         const int last_var= s->last_pict_type == FF_I_TYPE ? rcc->last_mb_var_sum : rcc->last_mc_mb_var_sum;
         update_predictor(&rcc->pred[s->last_pict_type], rcc->last_qscale, sqrt(last_var), s->frame_bits);
     }
@@ -80,6 +80,7 @@ typedef struct RateControlContext{
     uint64_t qscale_sum[5];
     int frame_count[5];
     int last_non_b_pict_type;
+    int delayed_update;           ///< predictors are updated with ff_rate_update_predictor() instead of with the previous frame
 
     void *non_lavc_opaque;        ///< context for non lavc rc code (for example xvid)
     float dry_run_qscale;         ///< for xvid rc
@@ -95,6 +96,7 @@ float ff_rate_estimate_qscale(struct MpegEncContext *s, int dry_run);
 void ff_write_pass1_stats(struct MpegEncContext *s);
 void ff_rate_control_uninit(struct MpegEncContext *s);
 int ff_vbv_update(struct MpegEncContext *s, int frame_size);
+void ff_rate_update_predictor(struct MpegEncContext *s, int pict_type, double qscale, int var, int frame_size);
 void ff_get_2pass_fcode(struct MpegEncContext *s);
 
 int ff_xvid_rate_control_init(struct MpegEncContext *s);
@@ -0,0 +1,168 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file libavcodec/thread.h
+ * Multithreading support functions
+ */
+
+#ifndef AVCODEC_THREAD_H
+#define AVCODEC_THREAD_H
+
+#include "config.h"
+#include "avcodec.h"
+
+/**
+ * Waits for decoding threads to finish and resets internal
+ * state. Called by avcodec_flush_buffers().
+ *
+ * @param avctx The context.
+ */
+void ff_thread_flush(AVCodecContext *avctx);
+
+/**
+ * Submits a new frame to a decoding thread.
+ * Returns the next available frame in picture. *got_picture_ptr
+ * will be 0 if none is available.
+ *
+ * Parameters are the same as avcodec_decode_video2().
+ */
+int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
+                           int *got_picture_ptr, AVPacket *avpkt);
+
+/**
+ * If the codec defines update_thread_context(), call this
+ * when they are ready for the next thread to start decoding
+ * the next frame. After calling it, do not change any variables
+ * read by the update_thread_context() method, or call ff_thread_get_buffer().
+ *
+ * @param avctx The context.
+ */
+void ff_thread_finish_setup(AVCodecContext *avctx);
+
+/**
+ * Notifies later decoding threads when part of their reference picture
+ * is ready.
+ * Call this when some part of the picture is finished decoding.
+ * Later calls with lower values of progress have no effect.
+ *
+ * @param f The picture being decoded.
+ * @param progress Value, in arbitrary units, of how much of the picture has decoded.
+ * @param field The field being decoded, for field-picture codecs.
+ * 0 for top field or frame pictures, 1 for bottom field.
+ */
+void ff_thread_report_progress(AVFrame *f, int progress, int field);
+
+/**
+ * Waits for earlier decoding threads to finish reference pictures.
+ * Call this before accessing some part of a picture, with a given
+ * value for progress, and it will return after the responsible decoding
+ * thread calls ff_thread_report_progress() with the same or
+ * higher value for progress.
+ *
+ * @param f The picture being referenced.
+ * @param progress Value, in arbitrary units, to wait for.
+ * @param field The field being referenced, for field-picture codecs.
+ * 0 for top field or frame pictures, 1 for bottom field.
+ */
+void ff_thread_await_progress(AVFrame *f, int progress, int field);
+
+/**
+ * Wrapper around get_buffer() for frame-multithreaded codecs.
+ * Call this function instead of avctx->get_buffer(f).
+ * Cannot be called after the codec has called ff_thread_finish_setup().
+ *
+ * @param avctx The current context.
+ * @param f The frame to write into.
+ */
+int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f);
+
+/**
+ * Wrapper around release_buffer() for frame-multithreaded codecs.
+ * Call this function instead of avctx->release_buffer(f).
+ * The AVFrame will be copied and the actual release_buffer() call
+ * will be performed later. The contents of data pointed to by the
+ * AVFrame should not be changed until ff_thread_get_buffer() is called
+ * on it.
+ *
+ * @param avctx The current context.
+ * @param f The picture being released.
+ */
+void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f);
+
+/**
+ * Allocates and resets the row progress counters of a slice threaded
+ * context. Jobs of an execute() call can use them to work on rows which
+ * depend on each other, e.g. a wavefront where each row trails the one
+ * above. Rows should be claimed with ff_thread_next_row(), so that no job
+ * waits on a row which is not being worked on.
+ * Must not be called while an execute() call is using the counters.
+ *
+ * @param avctx The context.
+ * @param nb_rows The number of counters, all of which start at 0.
+ * @return 0 on success, a negative value if slice threading is not active
+ * or on allocation failure
+ */
+int ff_thread_init_row_progress(AVCodecContext *avctx, int nb_rows);
+
+/**
+ * Claims the next row for the calling job.
+ * Rows are handed out in increasing order starting from 0, with no upper
+ * bound; callers stop once the returned number is past their last row.
+ *
+ * @param avctx The context.
+ */
+int ff_thread_next_row(AVCodecContext *avctx);
+
+/**
+ * Notifies jobs waiting on a row of how far it got.
+ * Later calls with lower values of progress have no effect.
+ *
+ * @param avctx The context.
+ * @param row The row counter, below the count given to ff_thread_init_row_progress().
+ * @param progress Value, in arbitrary units, of how much of the row is done.
+ */
+void ff_thread_report_row_progress(AVCodecContext *avctx, int row, int progress);
+
+/**
+ * Waits until ff_thread_report_row_progress() was called for a row with
+ * the same or a higher value for progress.
+ *
+ * @param avctx The context.
+ * @param row The row counter.
+ * @param progress Value, in arbitrary units, to wait for.
+ */
+void ff_thread_await_row_progress(AVCodecContext *avctx, int row, int progress);
+
+/**
+ * Sets up the threading backend selected by avctx->thread_type and
+ * avctx->thread_count. Called by avcodec_open().
+ *
+ * @param avctx The context.
+ * @return 0 on success, a negative value otherwise
+ */
+int ff_thread_init(AVCodecContext *avctx);
+
+/**
+ * Tears down whichever threading backend ff_thread_init() set up.
+ *
+ * @param avctx The context.
+ */
+void ff_thread_free(AVCodecContext *avctx);
+
+#endif /* AVCODEC_THREAD_H */
@@ -37,6 +37,7 @@
 #include "imgconvert.h"
 #include "audioconvert.h"
 #include "internal.h"
+#include "thread.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <limits.h>
@@ -106,16 +107,45 @@ void avcodec_set_dimensions(AVCodecContext *s, int width, int height){
     s->height= -((-height)>>s->lowres);
 }
 
+typedef struct BufferPool BufferPool;
+
 typedef struct InternalBuffer{
     int last_pic_num;
     uint8_t *base[4];
     uint8_t *data[4];
     int linesize[4];
-    int width, height;
-    enum PixelFormat pix_fmt;
+    int refcount;
+    int generation;                 ///< size class of the pool the buffer was allocated for
+    BufferPool *pool;
+    struct InternalBuffer *next;    ///< next unused buffer on the free list
 }InternalBuffer;
 
-#define INTERNAL_BUFFER_SIZE 32
+/**
+ * Per-context pool of reference-counted picture buffers.
+ * Buffers of the current size class, i.e. dimensions and pixel format, which
+ * are no longer referenced are kept on a free list for reuse until the size
+ * class changes; buffers of an older size class are freed with their last
+ * reference.
+ * The pool outlives its context as long as frames referencing it exist.
+ */
+struct BufferPool{
+    int width, height;
+    enum PixelFormat pix_fmt;
+    int linesize[4];
+    int size[4];                    ///< plane allocation sizes, 0 for unused planes
+    int offset[4];                  ///< offset of the first visible pixel in each plane
+    InternalBuffer *free_list;
+    int nb_buffers;                 ///< number of allocated buffers, free or not
+    int last_pic_num;
+    int generation;                 ///< incremented on every size class change
+    int closed;                     ///< set once the owning context freed its buffers
+    void *mutex;                    ///< lock manager mutex, NULL if none is registered
+    /**
+     * lock manager the mutex was created with, kept so that frames can
+     * still be released after av_lockmgr_register() changed it
+     */
+    int (*lockmgr_cb)(void **mutex, enum AVLockOp op);
+};
 
 void avcodec_align_dimensions(AVCodecContext *s, int *width, int *height){
     int w_align= 1;
@@ -190,126 +220,232 @@ int avcodec_check_dimensions(void *av_log_ctx, unsigned int w, unsigned int h){
     return -1;
 }
 
-int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic){
+static void pool_lock(BufferPool *pool){
+    if(pool->mutex)
+        pool->lockmgr_cb(&pool->mutex, AV_LOCK_OBTAIN);
+}
+
+static void pool_unlock(BufferPool *pool){
+    if(pool->mutex)
+        pool->lockmgr_cb(&pool->mutex, AV_LOCK_RELEASE);
+}
+
+/**
+ * Frees a buffer of a pool.
+ * Must be called with the pool locked.
+ */
+static void pool_free_buffer(BufferPool *pool, InternalBuffer *buf){
     int i;
-    int w= s->width;
-    int h= s->height;
-    InternalBuffer *buf;
-    int *picture_number;
 
-    if(pic->data[0]!=NULL) {
-        av_log(s, AV_LOG_ERROR, "pic->data[0]!=NULL in avcodec_default_get_buffer\n");
-        return -1;
-    }
-    if(s->internal_buffer_count >= INTERNAL_BUFFER_SIZE) {
-        av_log(s, AV_LOG_ERROR, "internal_buffer_count overflow (missing release_buffer?)\n");
-        return -1;
-    }
+    for(i=0; i<4; i++)
+        av_freep(&buf->base[i]);
+    av_free(buf);
+    pool->nb_buffers--;
+}
 
-    if(avcodec_check_dimensions(s,w,h))
-        return -1;
+/**
+ * Frees the unused buffers of a pool.
+ * Must be called with the pool locked.
+ */
+static void pool_flush(BufferPool *pool){
+    while(pool->free_list){
+        InternalBuffer *buf= pool->free_list;
 
-    if(s->internal_buffer==NULL){
-        s->internal_buffer= av_mallocz((INTERNAL_BUFFER_SIZE+1)*sizeof(InternalBuffer));
+        pool->free_list= buf->next;
+        pool_free_buffer(pool, buf);
     }
-#if 0
-    s->internal_buffer= av_fast_realloc(
-        s->internal_buffer,
-        &s->internal_buffer_size,
-        sizeof(InternalBuffer)*FFMAX(99,  s->internal_buffer_count+1)/*FIXME*/
-        );
-#endif
+}
 
-    buf= &((InternalBuffer*)s->internal_buffer)[s->internal_buffer_count];
-    picture_number= &(((InternalBuffer*)s->internal_buffer)[INTERNAL_BUFFER_SIZE]).last_pic_num; //FIXME ugly hack
-    (*picture_number)++;
+static void pool_destroy(BufferPool *pool){
+    if(pool->mutex)
+        pool->lockmgr_cb(&pool->mutex, AV_LOCK_DESTROY);
+    av_free(pool);
+}
 
-    if(buf->base[0] && (buf->width != w || buf->height != h || buf->pix_fmt != s->pix_fmt)){
-        for(i=0; i<4; i++){
-            av_freep(&buf->base[i]);
-            buf->data[i]= NULL;
+static void unref_buffer(InternalBuffer *buf){
+    BufferPool *pool= buf->pool;
+    int last= 0;
+
+    pool_lock(pool);
+    if(!--buf->refcount){
+        /* buffers of an older size class are too small for reuse */
+        if(pool->closed || buf->generation != pool->generation){
+            pool_free_buffer(pool, buf);
+        }else{
+            buf->next= pool->free_list;
+            pool->free_list= buf;
         }
+        last= pool->closed && !pool->nb_buffers;
     }
+    pool_unlock(pool);
+    if(last)
+        pool_destroy(pool);
+}
 
-    if(buf->base[0]){
-        pic->age= *picture_number - buf->last_pic_num;
-        buf->last_pic_num= *picture_number;
-    }else{
-        int h_chroma_shift, v_chroma_shift;
-        int size[4] = {0};
-        int tmpsize;
-        int unaligned;
-        AVPicture picture;
-        int stride_align[4];
+/**
+ * Computes the plane layout for the current dimensions and pixel format of
+ * the context and drops the unused buffers of the previous size class.
+ * Must be called with the pool locked.
+ */
+static int pool_set_size_class(AVCodecContext *s, BufferPool *pool){
+    int i;
+    int w= s->width;
+    int h= s->height;
+    int h_chroma_shift, v_chroma_shift;
+    int tmpsize;
+    int unaligned;
+    AVPicture picture;
+    int stride_align[4];
 
-        avcodec_get_chroma_sub_sample(s->pix_fmt, &h_chroma_shift, &v_chroma_shift);
+    pool_flush(pool);
+    pool->width= pool->height= 0;
+    pool->generation++;
 
-        avcodec_align_dimensions(s, &w, &h);
+    avcodec_get_chroma_sub_sample(s->pix_fmt, &h_chroma_shift, &v_chroma_shift);
 
-        if(!(s->flags&CODEC_FLAG_EMU_EDGE)){
-            w+= EDGE_WIDTH*2;
-            h+= EDGE_WIDTH*2;
-        }
+    avcodec_align_dimensions(s, &w, &h);
+
+    if(!(s->flags&CODEC_FLAG_EMU_EDGE)){
+        w+= EDGE_WIDTH*2;
+        h+= EDGE_WIDTH*2;
+    }
 
-        do {
-            // NOTE: do not align linesizes individually, this breaks e.g. assumptions
-            // that linesize[0] == 2*linesize[1] in the MPEG-encoder for 4:2:2
-            ff_fill_linesize(&picture, s->pix_fmt, w);
-            // increase alignment of w for next try (rhs gives the lowest bit set in w)
-            w += w & ~(w-1);
+    do {
+        // NOTE: do not align linesizes individually, this breaks e.g. assumptions
+        // that linesize[0] == 2*linesize[1] in the MPEG-encoder for 4:2:2
+        ff_fill_linesize(&picture, s->pix_fmt, w);
+        // increase alignment of w for next try (rhs gives the lowest bit set in w)
+        w += w & ~(w-1);
 
-            unaligned = 0;
-            for (i=0; i<4; i++){
+        unaligned = 0;
+        for (i=0; i<4; i++){
 //STRIDE_ALIGN is 8 for SSE* but this does not work for SVQ1 chroma planes
 //we could change STRIDE_ALIGN to 16 for x86/sse but it would increase the
 //picture size unneccessarily in some cases. The solution here is not
 //pretty and better ideas are welcome!
 #if HAVE_MMX
-                if(s->codec_id == CODEC_ID_SVQ1)
-                    stride_align[i]= 16;
-                else
+            if(s->codec_id == CODEC_ID_SVQ1)
+                stride_align[i]= 16;
+            else
 #endif
-                stride_align[i] = STRIDE_ALIGN;
-                unaligned |= picture.linesize[i] % stride_align[i];
-            }
-        } while (unaligned);
+            stride_align[i] = STRIDE_ALIGN;
+            unaligned |= picture.linesize[i] % stride_align[i];
+        }
+    } while (unaligned);
 
-        tmpsize = ff_fill_pointer(&picture, NULL, s->pix_fmt, h);
-        if (tmpsize < 0)
-            return -1;
+    tmpsize = ff_fill_pointer(&picture, NULL, s->pix_fmt, h);
+    if (tmpsize < 0)
+        return -1;
 
-        for (i=0; i<3 && picture.data[i+1]; i++)
-            size[i] = picture.data[i+1] - picture.data[i];
-        size[i] = tmpsize - (picture.data[i] - picture.data[0]);
+    memset(pool->size, 0, sizeof(pool->size));
+    for (i=0; i<3 && picture.data[i+1]; i++)
+        pool->size[i] = picture.data[i+1] - picture.data[i];
+    pool->size[i] = tmpsize - (picture.data[i] - picture.data[0]);
 
-        buf->last_pic_num= -256*256*256*64;
-        memset(buf->base, 0, sizeof(buf->base));
-        memset(buf->data, 0, sizeof(buf->data));
+    for(i=0; i<4; i++){
+        const int h_shift= i==0 ? 0 : h_chroma_shift;
+        const int v_shift= i==0 ? 0 : v_chroma_shift;
+
+        pool->linesize[i]= picture.linesize[i];
+        // no edge if EDEG EMU or not planar YUV
+        if((s->flags&CODEC_FLAG_EMU_EDGE) || !pool->size[2])
+            pool->offset[i]= 0;
+        else
+            pool->offset[i]= FFALIGN((pool->linesize[i]*EDGE_WIDTH>>v_shift) + (EDGE_WIDTH>>h_shift), stride_align[i]);
+    }
+
+    pool->width  = s->width;
+    pool->height = s->height;
+    pool->pix_fmt= s->pix_fmt;
+    return 0;
+}
 
-        for(i=0; i<4 && size[i]; i++){
-            const int h_shift= i==0 ? 0 : h_chroma_shift;
-            const int v_shift= i==0 ? 0 : v_chroma_shift;
+static InternalBuffer *pool_alloc_buffer(AVCodecContext *s, BufferPool *pool){
+    InternalBuffer *buf= av_mallocz(sizeof(InternalBuffer));
+    int i;
 
-            buf->linesize[i]= picture.linesize[i];
+    if(!buf)
+        return NULL;
 
-            buf->base[i]= av_malloc(size[i]+16); //FIXME 16
-            if(buf->base[i]==NULL) return -1;
-            memset(buf->base[i], 128, size[i]);
+    for(i=0; i<4 && pool->size[i]; i++){
+        buf->linesize[i]= pool->linesize[i];
 
-            // no edge if EDEG EMU or not planar YUV
-            if((s->flags&CODEC_FLAG_EMU_EDGE) || !size[2])
-                buf->data[i] = buf->base[i];
-            else
-                buf->data[i] = buf->base[i] + FFALIGN((buf->linesize[i]*EDGE_WIDTH>>v_shift) + (EDGE_WIDTH>>h_shift), stride_align[i]);
+        buf->base[i]= av_malloc(pool->size[i]+16); //FIXME 16
+        if(buf->base[i]==NULL){
+            while(i--)
+                av_freep(&buf->base[i]);
+            av_free(buf);
+            return NULL;
+        }
+        memset(buf->base[i], 128, pool->size[i]);
+
+        buf->data[i] = buf->base[i] + pool->offset[i];
+    }
+    if(pool->size[1] && !pool->size[2])
+        ff_set_systematic_pal((uint32_t*)buf->data[1], s->pix_fmt);
+    buf->last_pic_num= -256*256*256*64;
+    buf->generation= pool->generation;
+    buf->pool= pool;
+    pool->nb_buffers++;
+    return buf;
+}
+
+int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic){
+    int i;
+    BufferPool *pool;
+    InternalBuffer *buf;
+
+    if(pic->data[0]!=NULL) {
+        av_log(s, AV_LOG_ERROR, "pic->data[0]!=NULL in avcodec_default_get_buffer\n");
+        return -1;
+    }
+
+    if(avcodec_check_dimensions(s,s->width,s->height))
+        return -1;
+
+    if(s->internal_buffer==NULL){
+        pool= av_mallocz(sizeof(BufferPool));
+        if(!pool)
+            return AVERROR(ENOMEM);
+        if(ff_lockmgr_cb){
+            if(ff_lockmgr_cb(&pool->mutex, AV_LOCK_CREATE)){
+                av_free(pool);
+                return -1;
+            }
+            pool->lockmgr_cb= ff_lockmgr_cb;
+        }
+        s->internal_buffer= pool;
+    }
+    pool= s->internal_buffer;
+
+    pool_lock(pool);
+    if(pool->width != s->width || pool->height != s->height || pool->pix_fmt != s->pix_fmt){
+        if(pool_set_size_class(s, pool) < 0){
+            pool_unlock(pool);
+            return -1;
+        }
+    }
+
+    pool->last_pic_num++;
+    buf= pool->free_list;
+    if(buf){
+        pool->free_list= buf->next;
+        pic->age= pool->last_pic_num - buf->last_pic_num;
+    }else{
+        buf= pool_alloc_buffer(s, pool);
+        if(!buf){
+            pool_unlock(pool);
+            return AVERROR(ENOMEM);
         }
-        if(size[1] && !size[2])
-            ff_set_systematic_pal((uint32_t*)buf->data[1], s->pix_fmt);
-        buf->width  = s->width;
-        buf->height = s->height;
-        buf->pix_fmt= s->pix_fmt;
         pic->age= 256*256*256*64;
     }
+    buf->last_pic_num= pool->last_pic_num;
+    buf->refcount= 1;
+    buf->next= NULL;
+    pool_unlock(pool);
+
     pic->type= FF_BUFFER_TYPE_INTERNAL;
+    pic->buffer_ref= buf;
 
     for(i=0; i<4; i++){
         pic->base[i]= buf->base[i];
@@ -328,33 +464,60 @@ int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic){
 
 void avcodec_default_release_buffer(AVCodecContext *s, AVFrame *pic){
     int i;
-    InternalBuffer *buf, *last;
+    InternalBuffer *buf= pic->buffer_ref;
 
     assert(pic->type==FF_BUFFER_TYPE_INTERNAL);
     assert(s->internal_buffer_count);
+    assert(buf && buf->data[0] == pic->data[0]);
 
-    buf = NULL; /* avoids warning */
-    for(i=0; i<s->internal_buffer_count; i++){ //just 3-5 checks so is not worth to optimize
-        buf= &((InternalBuffer*)s->internal_buffer)[i];
-        if(buf->data[0] == pic->data[0])
-            break;
-    }
-    assert(i < s->internal_buffer_count);
     s->internal_buffer_count--;
-    last = &((InternalBuffer*)s->internal_buffer)[s->internal_buffer_count];
-
-    FFSWAP(InternalBuffer, *buf, *last);
+    unref_buffer(buf);
 
     for(i=0; i<4; i++){
         pic->data[i]=NULL;
 //        pic->base[i]=NULL;
     }
+    pic->buffer_ref= NULL;
 //printf("R%X\n", pic->opaque);
 
     if(s->debug&FF_DEBUG_BUFFERS)
         av_log(s, AV_LOG_DEBUG, "default_release_buffer called on pic %p, %d buffers used\n", pic, s->internal_buffer_count);
 }
 
+int avcodec_ref_frame(AVFrame *dst, const AVFrame *src){
+    InternalBuffer *buf= src->buffer_ref;
+
+    if(src->type != FF_BUFFER_TYPE_INTERNAL || !buf || !src->data[0])
+        return AVERROR(ENOSYS);
+
+    pool_lock(buf->pool);
+    buf->refcount++;
+    pool_unlock(buf->pool);
+
+    *dst= *src;
+    /* only the image is reference counted, the side tables belong to the decoder */
+    dst->qscale_table= NULL;
+    dst->mbskip_table= NULL;
+    dst->motion_val[0]= dst->motion_val[1]= NULL;
+    dst->mb_type= NULL;
+    dst->dct_coeff= NULL;
+    dst->ref_index[0]= dst->ref_index[1]= NULL;
+    dst->pan_scan= NULL;
+    dst->hwaccel_picture_private= NULL;
+    dst->owner= NULL;
+    dst->thread_opaque= NULL;
+    return 0;
+}
+
+void avcodec_unref_frame(AVFrame *frame){
+    if(!frame->buffer_ref)
+        return;
+    unref_buffer(frame->buffer_ref);
+    memset(frame->data, 0, sizeof(frame->data));
+    memset(frame->base, 0, sizeof(frame->base));
+    frame->buffer_ref= NULL;
+}
+
 int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic){
     AVFrame temp_pic;
     int i;
@@ -366,14 +529,24 @@ int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic){
         return s->get_buffer(s, pic);
     }
 
-    /* If internal buffer type return the same buffer */
+    /* If internal buffer type and not referenced elsewhere return the same buffer */
     if(pic->type == FF_BUFFER_TYPE_INTERNAL) {
-        pic->reordered_opaque= s->reordered_opaque;
-        return 0;
+        InternalBuffer *buf= pic->buffer_ref;
+        int shared;
+
+        pool_lock(buf->pool);
+        shared= buf->refcount > 1;
+        pool_unlock(buf->pool);
+        if(!shared){
+            pic->reordered_opaque= s->reordered_opaque;
+            return 0;
+        }
     }
 
     /*
-     * Not internal type and reget_buffer not overridden, emulate cr buffer
+     * Not internal type and reget_buffer not overridden, or an internal
+     * buffer also held through avcodec_ref_frame(): emulate cr buffer,
+     * so that the other references keep the old image
      */
     temp_pic = *pic;
     for(i = 0; i < 4; i++)
@@ -485,7 +658,14 @@ int attribute_align_arg avcodec_open(AVCodecContext *avctx, AVCodec *codec)
         goto free_and_end;
     }
     avctx->frame_number = 0;
-    if(avctx->codec->init){
+
+    if (HAVE_PTHREADS && !avctx->thread_opaque) {
+        ret = ff_thread_init(avctx);
+        if (ret < 0)
+            goto free_and_end;
+    }
+
+    if(avctx->codec->init && !(avctx->active_thread_type&FF_THREAD_FRAME)){
         ret = avctx->codec->init(avctx);
         if (ret < 0) {
             goto free_and_end;
@@ -501,6 +681,8 @@ end:
     }
     return ret;
 free_and_end:
+    if (HAVE_PTHREADS && avctx->thread_opaque)
+        ff_thread_free(avctx);
     av_freep(&avctx->priv_data);
     avctx->codec= NULL;
     goto end;
@@ -580,9 +762,13 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
     *got_picture_ptr= 0;
     if((avctx->coded_width||avctx->coded_height) && avcodec_check_dimensions(avctx,avctx->coded_width,avctx->coded_height))
         return -1;
-    if((avctx->codec->capabilities & CODEC_CAP_DELAY) || avpkt->size){
-        ret = avctx->codec->decode(avctx, picture, got_picture_ptr,
-                                avpkt);
+    if((avctx->codec->capabilities & CODEC_CAP_DELAY) || avpkt->size || (avctx->active_thread_type&FF_THREAD_FRAME)){
+        if (HAVE_PTHREADS && avctx->active_thread_type&FF_THREAD_FRAME)
+            ret = ff_thread_decode_frame(avctx, picture, got_picture_ptr,
+                                         avpkt);
+        else
+            ret = avctx->codec->decode(avctx, picture, got_picture_ptr,
+                                       avpkt);
 
         emms_c(); //needed to avoid an emms_c() call before every return;
 
@@ -919,25 +1105,30 @@ void avcodec_init(void)
 
 void avcodec_flush_buffers(AVCodecContext *avctx)
 {
-    if(avctx->codec->flush)
+    if(HAVE_PTHREADS && avctx->active_thread_type&FF_THREAD_FRAME)
+        ff_thread_flush(avctx);
+    else if(avctx->codec->flush)
         avctx->codec->flush(avctx);
 }
 
 void avcodec_default_free_buffers(AVCodecContext *s){
-    int i, j;
+    BufferPool *pool= s->internal_buffer;
+    int last;
 
-    if(s->internal_buffer==NULL) return;
+    if(pool==NULL) return;
 
     if (s->internal_buffer_count)
         av_log(s, AV_LOG_WARNING, "Found %i unreleased buffers!\n", s->internal_buffer_count);
-    for(i=0; i<INTERNAL_BUFFER_SIZE; i++){
-        InternalBuffer *buf= &((InternalBuffer*)s->internal_buffer)[i];
-        for(j=0; j<4; j++){
-            av_freep(&buf->base[j]);
-            buf->data[j]= NULL;
-        }
-    }
-    av_freep(&s->internal_buffer);
+
+    pool_lock(pool);
+    pool->closed= 1;
+    pool_flush(pool);
+    last= !pool->nb_buffers;
+    pool_unlock(pool);
+    /* otherwise the pool is freed along with the last buffer still referenced by a frame */
+    if(last)
+        pool_destroy(pool);
+    s->internal_buffer= NULL;
 
     s->internal_buffer_count=0;
 }
@@ -1008,6 +1199,7 @@ int av_get_bits_per_sample_format(enum SampleFormat sample_fmt) {
         return 16;
     case SAMPLE_FMT_S32:
     case SAMPLE_FMT_FLT:
+    case SAMPLE_FMT_FLTP:
         return 32;
     case SAMPLE_FMT_DBL:
         return 64;
@@ -1023,6 +1215,80 @@ int avcodec_thread_init(AVCodecContext *s, int thread_count){
 }
 #endif
 
+#if !HAVE_PTHREADS
+
+int ff_thread_init(AVCodecContext *s){
+    return 0;
+}
+
+void ff_thread_free(AVCodecContext *s){
+}
+
+AVThreadPool *avcodec_thread_pool_alloc(int thread_count)
+{
+    return NULL;
+}
+
+void avcodec_thread_pool_free(AVThreadPool *pool)
+{
+}
+
+int ff_thread_init_row_progress(AVCodecContext *avctx, int nb_rows)
+{
+    return -1;
+}
+
+int ff_thread_next_row(AVCodecContext *avctx)
+{
+    return 0;
+}
+
+void ff_thread_report_row_progress(AVCodecContext *avctx, int row, int progress)
+{
+}
+
+void ff_thread_await_row_progress(AVCodecContext *avctx, int row, int progress)
+{
+}
+
+int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
+                           int *got_picture_ptr, AVPacket *avpkt)
+{
+    return avctx->codec->decode(avctx, picture, got_picture_ptr, avpkt);
+}
+
+void ff_thread_flush(AVCodecContext *avctx)
+{
+    if (avctx->codec->flush)
+        avctx->codec->flush(avctx);
+}
+
+void ff_thread_finish_setup(AVCodecContext *avctx)
+{
+}
+
+void ff_thread_report_progress(AVFrame *f, int progress, int field)
+{
+}
+
+void ff_thread_await_progress(AVFrame *f, int progress, int field)
+{
+}
+
+int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    f->owner = avctx;
+    f->thread_opaque = NULL;
+    return avctx->get_buffer(avctx, f);
+}
+
+void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    avctx->release_buffer(avctx, f);
+}
+
+#endif
+
 unsigned int av_xiphlacing(unsigned char *s, unsigned int v)
 {
     unsigned int n = 0;
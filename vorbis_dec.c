@@ -891,8 +891,8 @@ static int vorbis_parse_id_hdr(vorbis_context *vc)
         av_log(vc->avccontext, AV_LOG_ERROR, " Vorbis id header packet corrupt (illegal blocksize). \n");
         return -3;
     }
-    // output format int16
-    if (vc->blocksize[1] / 2 * vc->audio_channels * 2 > AVCODEC_MAX_AUDIO_FRAME_SIZE) {
+    if (vc->blocksize[1] / 2 * vc->audio_channels *
+        (av_get_bits_per_sample_format(vc->avccontext->sample_fmt) >> 3) > AVCODEC_MAX_AUDIO_FRAME_SIZE) {
         av_log(vc->avccontext, AV_LOG_ERROR, "Vorbis channel count makes "
                "output packets too large.\n");
         return -4;
@@ -941,7 +941,13 @@ static av_cold int vorbis_decode_init(AVCodecContext *avccontext)
     vc->avccontext = avccontext;
     dsputil_init(&vc->dsp, avccontext);
 
-    if (vc->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
+    avccontext->sample_fmt = avccontext->request_sample_fmt == SAMPLE_FMT_FLTP ?
+                             SAMPLE_FMT_FLTP : SAMPLE_FMT_S16;
+
+    if (avccontext->sample_fmt == SAMPLE_FMT_FLTP) {
+        vc->add_bias = 0;
+        vc->exp_bias = 0;
+    } else if (vc->dsp.float_to_int16_interleave == ff_float_to_int16_interleave_c) {
         vc->add_bias = 385;
         vc->exp_bias = 0;
     } else {
@@ -992,7 +998,6 @@ static av_cold int vorbis_decode_init(AVCodecContext *avccontext)
     avccontext->channels    = vc->audio_channels;
     avccontext->sample_rate = vc->audio_samplerate;
     avccontext->frame_size  = FFMIN(vc->blocksize[0], vc->blocksize[1]) >> 2;
-    avccontext->sample_fmt  = SAMPLE_FMT_S16;
 
     return 0 ;
 }
@@ -1458,6 +1463,8 @@ static int vorbis_parse_audio_packet(vorbis_context *vc)
     float *ch_res_ptr   = vc->channel_residues;
     float *ch_floor_ptr = vc->channel_floors;
     uint_fast8_t res_chan[vc->audio_channels];
+    float *imdct_out[vc->audio_channels];
+    const float *imdct_in[vc->audio_channels];
     uint_fast8_t res_num = 0;
     int_fast16_t retlen  = 0;
     float fadd_bias = vc->add_bias;
@@ -1548,8 +1555,10 @@ static int vorbis_parse_audio_packet(vorbis_context *vc)
         ch_floor_ptr = vc->channel_floors   + j           * blocksize / 2;
         ch_res_ptr   = vc->channel_residues + res_chan[j] * blocksize / 2;
         vc->dsp.vector_fmul(ch_floor_ptr, ch_res_ptr, blocksize / 2);
-        ff_imdct_half(&vc->mdct[blockflag], ch_res_ptr, ch_floor_ptr);
+        imdct_out[j] = ch_res_ptr;
+        imdct_in[j]  = ch_floor_ptr;
     }
+    ff_imdct_half_batch(&vc->mdct[blockflag], imdct_out, imdct_in, vc->audio_channels);
 
 // Overlap/add, save data for next overlapping  FPMATH
 
@@ -1590,7 +1599,7 @@ static int vorbis_decode_frame(AVCodecContext *avccontext,
     vorbis_context *vc = avccontext->priv_data ;
     GetBitContext *gb = &(vc->gb);
     const float *channel_ptrs[vc->audio_channels];
-    int i;
+    int i, sample_size;
 
     int_fast16_t len;
 
@@ -1616,6 +1625,12 @@ static int vorbis_decode_frame(AVCodecContext *avccontext,
 
     AV_DEBUG("parsed %d bytes %d bits, returned %d samples (*ch*bits) \n", get_bits_count(gb)/8, get_bits_count(gb)%8, len);
 
+    sample_size = av_get_bits_per_sample_format(avccontext->sample_fmt) >> 3;
+    if (*data_size < len * vc->audio_channels * sample_size) {
+        av_log(avccontext, AV_LOG_ERROR, "Output buffer too small\n");
+        return -1;
+    }
+
     if (vc->audio_channels > 6) {
         for (i = 0; i < vc->audio_channels; i++)
             channel_ptrs[i] = vc->channel_floors + i * len;
@@ -1625,8 +1640,12 @@ static int vorbis_decode_frame(AVCodecContext *avccontext,
                               len * ff_vorbis_channel_layout_offsets[vc->audio_channels - 1][i];
     }
 
-    vc->dsp.float_to_int16_interleave(data, channel_ptrs, len, vc->audio_channels);
-    *data_size = len * 2 * vc->audio_channels;
+    if (avccontext->sample_fmt == SAMPLE_FMT_FLTP) {
+        for (i = 0; i < vc->audio_channels; i++)
+            memcpy((float *)data + i * len, channel_ptrs[i], len * sizeof(float));
+    } else
+        vc->dsp.float_to_int16_interleave(data, channel_ptrs, len, vc->audio_channels);
+    *data_size = len * vc->audio_channels * sample_size;
 
     return buf_size ;
 }
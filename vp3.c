@@ -36,6 +36,7 @@
 #include "avcodec.h"
 #include "dsputil.h"
 #include "get_bits.h"
+#include "thread.h"
 
 #include "vp3data.h"
 #include "xiph.h"
@@ -43,6 +44,7 @@
 #define FRAGMENT_PIXELS 8
 
 static av_cold int vp3_decode_end(AVCodecContext *avctx);
+static void update_frames(AVCodecContext *avctx);
 
 typedef struct Coeff {
     struct Coeff *next;
@@ -1407,6 +1409,16 @@ static void render_slice(Vp3DecodeContext *s, int slice)
     if (slice >= s->macroblock_height)
         return;
 
+    /* motion vectors reach at most one macroblock row down, plus the
+     * extra row needed for halfpel interpolation */
+    if (!s->keyframe) {
+        int ref_row = FFMIN(slice + 2, s->macroblock_height - 1);
+
+        ff_thread_await_progress(&s->last_frame, ref_row, 0);
+        if (s->golden_frame.data[0] != s->last_frame.data[0])
+            ff_thread_await_progress(&s->golden_frame, ref_row, 0);
+    }
+
     for (plane = 0; plane < 3; plane++) {
         uint8_t *output_plane = s->current_frame.data    [plane];
         uint8_t *  last_plane = s->   last_frame.data    [plane];
@@ -1595,7 +1607,12 @@ static void render_slice(Vp3DecodeContext *s, int slice)
     emms_c();
 }
 
-static void apply_loop_filter(Vp3DecodeContext *s)
+/*
+ * Loop filters the fragment rows of one macroblock row. Filtering a row
+ * touches the top line of the row below it, so this must not be called
+ * before the next row has been rendered.
+ */
+static void apply_loop_filter(Vp3DecodeContext *s, int slice)
 {
     int plane;
     int x, y;
@@ -1625,12 +1642,14 @@ static void apply_loop_filter(Vp3DecodeContext *s)
     for (plane = 0; plane < 3; plane++) {
         int width           = s->fragment_width  >> !!plane;
         int height          = s->fragment_height >> !!plane;
-        int fragment        = s->fragment_start        [plane];
+        int ystart          = slice << !plane;
+        int yend            = FFMIN(ystart + (1 << !plane), height);
+        int fragment        = s->fragment_start        [plane] + ystart * width;
         int stride          = s->current_frame.linesize[plane];
         uint8_t *plane_data = s->current_frame.data    [plane];
         if (!s->flipped_image) stride = -stride;
 
-        for (y = 0; y < height; y++) {
+        for (y = ystart; y < yend; y++) {
 
             for (x = 0; x < width; x++) {
                 /* This code basically just deblocks on the edges of coded blocks.
@@ -1728,6 +1747,32 @@ static void vp3_calculate_pixel_addresses(Vp3DecodeContext *s)
     }
 }
 
+/*
+ * This function allocates the tables which are rewritten for every frame,
+ * and which each frame thread therefore needs its own copy of.
+ */
+static av_cold int allocate_tables(AVCodecContext *avctx)
+{
+    Vp3DecodeContext *s = avctx->priv_data;
+
+    s->superblock_coding = av_malloc(s->superblock_count);
+    s->all_fragments = av_malloc(s->fragment_count * sizeof(Vp3Fragment));
+    s->coeff_counts = av_malloc(s->fragment_count * sizeof(*s->coeff_counts));
+    s->coeffs = av_malloc(s->fragment_count * sizeof(Coeff) * 65);
+    s->coded_fragment_list = av_malloc(s->fragment_count * sizeof(int));
+    s->fast_fragment_list = av_malloc(s->fragment_count * sizeof(int));
+    s->macroblock_coding = av_malloc(s->macroblock_count + 1);
+    s->pixel_addresses_initialized = 0;
+    if (!s->superblock_coding || !s->all_fragments || !s->coeff_counts ||
+        !s->coeffs || !s->coded_fragment_list || !s->fast_fragment_list ||
+        !s->macroblock_coding) {
+        vp3_decode_end(avctx);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * This is the ffmpeg/libavcodec API init function.
  */
@@ -1775,7 +1820,6 @@ static av_cold int vp3_decode_init(AVCodecContext *avctx)
     s->superblock_count = y_superblock_count + (c_superblock_count * 2);
     s->u_superblock_start = y_superblock_count;
     s->v_superblock_start = s->u_superblock_start + c_superblock_count;
-    s->superblock_coding = av_malloc(s->superblock_count);
 
     s->macroblock_width = (s->width + 15) / 16;
     s->macroblock_height = (s->height + 15) / 16;
@@ -1789,17 +1833,8 @@ static av_cold int vp3_decode_init(AVCodecContext *avctx)
     s->fragment_start[1] = s->fragment_width * s->fragment_height;
     s->fragment_start[2] = s->fragment_width * s->fragment_height * 5 / 4;
 
-    s->all_fragments = av_malloc(s->fragment_count * sizeof(Vp3Fragment));
-    s->coeff_counts = av_malloc(s->fragment_count * sizeof(*s->coeff_counts));
-    s->coeffs = av_malloc(s->fragment_count * sizeof(Coeff) * 65);
-    s->coded_fragment_list = av_malloc(s->fragment_count * sizeof(int));
-    s->fast_fragment_list = av_malloc(s->fragment_count * sizeof(int));
-    s->pixel_addresses_initialized = 0;
-    if (!s->superblock_coding || !s->all_fragments || !s->coeff_counts ||
-        !s->coeffs || !s->coded_fragment_list || !s->fast_fragment_list) {
-        vp3_decode_end(avctx);
+    if (allocate_tables(avctx) < 0)
         return -1;
-    }
 
     if (!s->theora_tables)
     {
@@ -1904,9 +1939,8 @@ static av_cold int vp3_decode_init(AVCodecContext *avctx)
     s->superblock_fragments = av_malloc(s->superblock_count * 16 * sizeof(int));
     s->superblock_macroblocks = av_malloc(s->superblock_count * 4 * sizeof(int));
     s->macroblock_fragments = av_malloc(s->macroblock_count * 6 * sizeof(int));
-    s->macroblock_coding = av_malloc(s->macroblock_count + 1);
     if (!s->superblock_fragments || !s->superblock_macroblocks ||
-        !s->macroblock_fragments || !s->macroblock_coding) {
+        !s->macroblock_fragments) {
         vp3_decode_end(avctx);
         return -1;
     }
@@ -1995,91 +2029,112 @@ static int vp3_decode_frame(AVCodecContext *avctx,
                     av_log(s->avctx, AV_LOG_ERROR, "Warning, unsupported keyframe coding type?!\n");
             skip_bits(&gb, 2); /* reserved? */
         }
+    } else if (!s->golden_frame.data[0]) {
+        av_log(s->avctx, AV_LOG_ERROR, "vp3: first frame not a keyframe\n");
+        return -1;
+    }
 
-        if (s->last_frame.data[0] == s->golden_frame.data[0]) {
-            if (s->golden_frame.data[0])
-                avctx->release_buffer(avctx, &s->golden_frame);
-            s->last_frame= s->golden_frame; /* ensure that we catch any access to this released frame */
-        } else {
-            if (s->golden_frame.data[0])
-                avctx->release_buffer(avctx, &s->golden_frame);
-            if (s->last_frame.data[0])
-                avctx->release_buffer(avctx, &s->last_frame);
-        }
-
-        s->golden_frame.reference = 3;
-        if(avctx->get_buffer(avctx, &s->golden_frame) < 0) {
-            av_log(s->avctx, AV_LOG_ERROR, "vp3: get_buffer() failed\n");
-            return -1;
-        }
-
-        /* golden frame is also the current frame */
-        s->current_frame= s->golden_frame;
+    /* allocate a new current frame; the reference frames are shuffled once
+     * it is decoded, see update_frames() */
+    s->current_frame.reference = 3;
+    if(ff_thread_get_buffer(avctx, &s->current_frame) < 0) {
+        av_log(s->avctx, AV_LOG_ERROR, "vp3: get_buffer() failed\n");
+        return -1;
+    }
 
-        /* time to figure out pixel addresses? */
-        if (!s->pixel_addresses_initialized)
-        {
-            vp3_calculate_pixel_addresses(s);
-            s->pixel_addresses_initialized = 1;
-        }
-    } else {
-        /* allocate a new current frame */
-        s->current_frame.reference = 3;
-        if (!s->pixel_addresses_initialized) {
-            av_log(s->avctx, AV_LOG_ERROR, "vp3: first frame not a keyframe\n");
-            return -1;
-        }
-        if(avctx->get_buffer(avctx, &s->current_frame) < 0) {
-            av_log(s->avctx, AV_LOG_ERROR, "vp3: get_buffer() failed\n");
-            return -1;
-        }
+    /* time to figure out pixel addresses? */
+    if (!s->pixel_addresses_initialized)
+    {
+        vp3_calculate_pixel_addresses(s);
+        s->pixel_addresses_initialized = 1;
     }
 
     s->current_frame.qscale_table= s->qscale_table; //FIXME allocate individual tables per AVFrame
     s->current_frame.qstride= 0;
 
+    ff_thread_finish_setup(avctx);
+
     init_frame(s, &gb);
 
     if (unpack_superblocks(s, &gb)){
         av_log(s->avctx, AV_LOG_ERROR, "error in unpack_superblocks\n");
-        return -1;
+        goto error;
     }
     if (unpack_modes(s, &gb)){
         av_log(s->avctx, AV_LOG_ERROR, "error in unpack_modes\n");
-        return -1;
+        goto error;
     }
     if (unpack_vectors(s, &gb)){
         av_log(s->avctx, AV_LOG_ERROR, "error in unpack_vectors\n");
-        return -1;
+        goto error;
     }
     if (unpack_block_qpis(s, &gb)){
         av_log(s->avctx, AV_LOG_ERROR, "error in unpack_block_qpis\n");
-        return -1;
+        goto error;
     }
     if (unpack_dct_coeffs(s, &gb)){
         av_log(s->avctx, AV_LOG_ERROR, "error in unpack_dct_coeffs\n");
-        return -1;
+        goto error;
     }
 
-    for (i = 0; i < s->macroblock_height; i++)
+    /* loop filtering lags one row behind rendering, and a row is only
+     * final once the row below it has been filtered */
+    for (i = 0; i < s->macroblock_height; i++) {
         render_slice(s, i);
-
-    apply_loop_filter(s);
+        if (i > 0) {
+            apply_loop_filter(s, i - 1);
+            ff_thread_report_progress(&s->current_frame, i - 2, 0);
+        }
+    }
+    apply_loop_filter(s, s->macroblock_height - 1);
+    ff_thread_report_progress(&s->current_frame, INT_MAX, 0);
 
     *data_size=sizeof(AVFrame);
     *(AVFrame*)data= s->current_frame;
 
+    /* with frame threading the next thread shuffles the frames when it
+     * picks up this context */
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME))
+        update_frames(avctx);
+
+    return buf_size;
+
+error:
+    ff_thread_report_progress(&s->current_frame, INT_MAX, 0);
+
+    /* setup is already finished, so with frame threading the next thread
+     * has picked up the damaged frame as its reference; keep it as the
+     * reference without frame threading too, so that both decode the
+     * following frames the same way */
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME))
+        update_frames(avctx);
+
+    return -1;
+}
+
+/*
+ * This function makes the just decoded frame the last frame, and also the
+ * golden frame if it is a keyframe, releasing whatever they replace.
+ */
+static void update_frames(AVCodecContext *avctx)
+{
+    Vp3DecodeContext *s = avctx->priv_data;
+
     /* release the last frame, if it is allocated and if it is not the
      * golden frame */
     if ((s->last_frame.data[0]) &&
         (s->last_frame.data[0] != s->golden_frame.data[0]))
-        avctx->release_buffer(avctx, &s->last_frame);
+        ff_thread_release_buffer(avctx, &s->last_frame);
+
+    if (s->keyframe) {
+        if (s->golden_frame.data[0])
+            ff_thread_release_buffer(avctx, &s->golden_frame);
+        s->golden_frame= s->current_frame;
+    }
 
     /* shuffle frames (last = current) */
     s->last_frame= s->current_frame;
     s->current_frame.data[0]= NULL; /* ensure that we catch any access to this released frame */
-
-    return buf_size;
 }
 
 /*
@@ -2096,10 +2151,16 @@ static av_cold int vp3_decode_end(AVCodecContext *avctx)
     av_free(s->coeffs);
     av_free(s->coded_fragment_list);
     av_free(s->fast_fragment_list);
+    av_free(s->macroblock_coding);
+
+    /* the mapping and VLC tables and the reference frames belong to the
+     * first context */
+    if (avctx->is_copy)
+        return 0;
+
     av_free(s->superblock_fragments);
     av_free(s->superblock_macroblocks);
     av_free(s->macroblock_fragments);
-    av_free(s->macroblock_coding);
 
     for (i = 0; i < 16; i++) {
         free_vlc(&s->dc_vlc[i]);
@@ -2116,14 +2177,54 @@ static av_cold int vp3_decode_end(AVCodecContext *avctx)
 
     /* release all frames */
     if (s->golden_frame.data[0] && s->golden_frame.data[0] != s->last_frame.data[0])
-        avctx->release_buffer(avctx, &s->golden_frame);
+        ff_thread_release_buffer(avctx, &s->golden_frame);
     if (s->last_frame.data[0])
-        avctx->release_buffer(avctx, &s->last_frame);
-    /* no need to release the current_frame since it will always be pointing
-     * to the same frame as either the golden or last frame */
+        ff_thread_release_buffer(avctx, &s->last_frame);
+    /* current_frame is never set here: update_frames() moves it to the
+     * last frame after every decoded frame, failed ones included, and with
+     * frame threading the last thread's frames are handed to this context
+     * through update_thread_context() before it is closed */
+
+    return 0;
+}
+
+static av_cold int vp3_init_thread_copy(AVCodecContext *avctx)
+{
+    Vp3DecodeContext *s = avctx->priv_data;
+
+    s->avctx = avctx;
+
+    return allocate_tables(avctx);
+}
+
+#define copy_fields(to, from, start_field, end_field) memcpy(&to->start_field, &from->start_field, (char*)&to->end_field - (char*)&to->start_field)
+static int vp3_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    Vp3DecodeContext *s = dst->priv_data, *s1 = src->priv_data;
+
+    if (dst == src)
+        return 0;
+
+    /* the previous frame was skipped or not decoded, so there is
+     * nothing to shuffle */
+    if (!s1->current_frame.data[0]) {
+        copy_fields(s, s1, golden_frame, current_frame);
+        s->current_frame.data[0] = NULL;
+        return 0;
+    }
+
+    s->version = s1->version;
+    copy_fields(s, s1, golden_frame, dsp);
+    copy_fields(s, s1, qps, superblock_count);
+    memcpy(s->qmat, s1->qmat, sizeof(s->qmat));
+    memcpy(s->qscale_table, s1->qscale_table, sizeof(s->qscale_table));
+    memcpy(s->bounding_values_array, s1->bounding_values_array, sizeof(s->bounding_values_array));
+
+    update_frames(dst);
 
     return 0;
 }
+#undef copy_fields
 
 static int read_huffman_tree(AVCodecContext *avctx, GetBitContext *gb)
 {
@@ -2418,9 +2519,11 @@ AVCodec theora_decoder = {
     NULL,
     vp3_decode_end,
     vp3_decode_frame,
-    CODEC_CAP_DR1,
+    CODEC_CAP_DR1 | CODEC_CAP_FRAME_THREADS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("Theora"),
+    .init_thread_copy      = vp3_init_thread_copy,
+    .update_thread_context = vp3_update_thread_context,
 };
 #endif
 
@@ -2433,7 +2536,9 @@ AVCodec vp3_decoder = {
     NULL,
     vp3_decode_end,
     vp3_decode_frame,
-    CODEC_CAP_DR1,
+    CODEC_CAP_DR1 | CODEC_CAP_FRAME_THREADS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("On2 VP3"),
+    .init_thread_copy      = vp3_init_thread_copy,
+    .update_thread_context = vp3_update_thread_context,
 };
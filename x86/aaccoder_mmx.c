@@ -0,0 +1,141 @@
+/*
+ * SIMD optimized AAC encoder quantizer functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/dsputil.h"
+#include "dsputil_mmx.h"
+
+/* Like in the C version, qc is rounded to float before the rounding offset
+ * is added in double precision, so that the output is identical. The sign is
+ * taken from the sign bit of in, which only differs from in < 0 for -0.0,
+ * whose quantized value is 0 anyway. */
+static const double aac_round = 0.4054;
+
+void ff_aac_quantize_bands_sse2(int (*out)[2], const float *in, const float *scaled,
+                                int size, float Q34, int is_signed, int maxval)
+{
+    const double maxv = maxval;
+    const int    sign = -is_signed;
+    x86_reg i = -4*size;
+
+    __asm__ volatile(
+        "movsd     %4, %%xmm5           \n\t"
+        "movss     %5, %%xmm6           \n\t"
+        "movsd     %6, %%xmm7           \n\t"
+        "movd      %7, %%xmm4           \n\t"
+        "unpcklpd  %%xmm5, %%xmm5       \n\t"
+        "shufps $0, %%xmm6, %%xmm6      \n\t"
+        "unpcklpd  %%xmm7, %%xmm7       \n\t"
+        "pshufd $0, %%xmm4, %%xmm4      \n\t"
+        "1:                             \n\t"
+        "movq      (%2,%0), %%xmm0      \n\t"
+        "movq      (%1,%0), %%xmm2      \n\t"
+        "mulps     %%xmm6, %%xmm0       \n\t"
+        "cvtps2pd  %%xmm0, %%xmm0       \n\t" // qc
+        "movapd    %%xmm0, %%xmm1       \n\t"
+        "addpd     %%xmm5, %%xmm1       \n\t" // qc + 0.4054
+        "minpd     %%xmm7, %%xmm0       \n\t"
+        "minpd     %%xmm7, %%xmm1       \n\t"
+        "cvttpd2dq %%xmm0, %%xmm0       \n\t"
+        "cvttpd2dq %%xmm1, %%xmm1       \n\t"
+        "psrad     $31, %%xmm2          \n\t" // sign of in
+        "punpckldq %%xmm1, %%xmm0       \n\t"
+        "pand      %%xmm4, %%xmm2       \n\t"
+        "punpckldq %%xmm2, %%xmm2       \n\t"
+        "pxor      %%xmm2, %%xmm0       \n\t"
+        "psubd     %%xmm2, %%xmm0       \n\t"
+        "movdqu    %%xmm0, (%3,%0,2)    \n\t"
+        "add       $8, %0               \n\t"
+        " jl 1b                         \n\t"
+        :"+r"(i)
+        :"r"(in + size), "r"(scaled + size), "r"(out + size),
+         "m"(aac_round), "m"(Q34), "m"(maxv), "m"(sign)
+        :"memory"
+    );
+}
+
+void ff_aac_abs_pow34_sse2(float *out, const float *in, int size)
+{
+    x86_reg i = -4*size;
+
+    __asm__ volatile(
+        "pcmpeqd   %%xmm7, %%xmm7       \n\t"
+        "psrld     $1, %%xmm7           \n\t"
+        "1:                             \n\t"
+        "movups    (%1,%0), %%xmm0      \n\t"
+        "andps     %%xmm7, %%xmm0       \n\t"
+        "sqrtps    %%xmm0, %%xmm1       \n\t"
+        "mulps     %%xmm0, %%xmm1       \n\t"
+        "sqrtps    %%xmm1, %%xmm1       \n\t"
+        "movups    %%xmm1, (%2,%0)      \n\t"
+        "add       $16, %0              \n\t"
+        " jl 1b                         \n\t"
+        :"+r"(i)
+        :"r"(in + size), "r"(out + size)
+        :"memory"
+    );
+}
+
+#if HAVE_AVX
+/* 4 coefficients per iteration, the integer part stays in xmm registers. */
+void ff_aac_quantize_bands_avx(int (*out)[2], const float *in, const float *scaled,
+                               int size, float Q34, int is_signed, int maxval)
+{
+    const double maxv = maxval;
+    const int    sign = -is_signed;
+    x86_reg i = -4*size;
+
+    __asm__ volatile(
+        "vbroadcastsd %4, %%ymm5                \n\t"
+        "vbroadcastss %5, %%xmm6                \n\t"
+        "vbroadcastsd %6, %%ymm7                \n\t"
+        "vmovd        %7, %%xmm4                \n\t"
+        "vpshufd  $0, %%xmm4, %%xmm4            \n\t"
+        "1:                                     \n\t"
+        "vmulps     (%2,%0), %%xmm6, %%xmm0     \n\t"
+        "vcvtps2pd  %%xmm0, %%ymm0              \n\t" // qc
+        "vaddpd     %%ymm5, %%ymm0, %%ymm1      \n\t" // qc + 0.4054
+        "vminpd     %%ymm7, %%ymm0, %%ymm0      \n\t"
+        "vminpd     %%ymm7, %%ymm1, %%ymm1      \n\t"
+        "vcvttpd2dq %%ymm0, %%xmm0              \n\t"
+        "vcvttpd2dq %%ymm1, %%xmm1              \n\t"
+        "vmovdqu    (%1,%0), %%xmm2             \n\t"
+        "vpsrad     $31, %%xmm2, %%xmm2         \n\t" // sign of in
+        "vpand      %%xmm4, %%xmm2, %%xmm2      \n\t"
+        "vpunpckhdq %%xmm1, %%xmm0, %%xmm3      \n\t"
+        "vpunpckldq %%xmm1, %%xmm0, %%xmm0      \n\t"
+        "vpunpckhdq %%xmm2, %%xmm2, %%xmm1      \n\t"
+        "vpunpckldq %%xmm2, %%xmm2, %%xmm2      \n\t"
+        "vpxor      %%xmm2, %%xmm0, %%xmm0      \n\t"
+        "vpxor      %%xmm1, %%xmm3, %%xmm3      \n\t"
+        "vpsubd     %%xmm2, %%xmm0, %%xmm0      \n\t"
+        "vpsubd     %%xmm1, %%xmm3, %%xmm3      \n\t"
+        "vmovdqu    %%xmm0,   (%3,%0,2)         \n\t"
+        "vmovdqu    %%xmm3, 16(%3,%0,2)         \n\t"
+        "add        $16, %0                     \n\t"
+        " jl 1b                                 \n\t"
+        "vzeroupper                             \n\t"
+        :"+r"(i)
+        :"r"(in + size), "r"(scaled + size), "r"(out + size),
+         "m"(aac_round), "m"(Q34), "m"(maxv), "m"(sign)
+        :"memory"
+    );
+}
+#endif /* HAVE_AVX */
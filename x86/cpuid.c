@@ -34,7 +34,10 @@
          "xchg %%"REG_b", %%"REG_S\
          : "=a" (eax), "=S" (ebx),\
            "=c" (ecx), "=d" (edx)\
-         : "0" (index));
+         : "0" (index), "2"(0));
+
+#define xgetbv(index,eax,edx)\
+    __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c" (index))
 
 /* Function to test if multimedia instructions are supported...  */
 int mm_support(void)
@@ -90,10 +93,22 @@ int mm_support(void)
             rval |= FF_MM_SSE4;
         if (ecx & 0x00100000 )
             rval |= FF_MM_SSE42;
+        /* AVX also needs the OS to save the ymm registers */
+        if ((ecx & 0x18000000) == 0x18000000) {
+            xgetbv(0, eax, edx);
+            if ((eax & 0x6) == 0x6)
+                rval |= FF_MM_AVX;
+        }
 #endif
                   ;
     }
 
+    if(max_std_level >= 7 && (rval & FF_MM_AVX)){
+        cpuid(7, eax, ebx, ecx, edx);
+        if (ebx & 0x00000020)
+            rval |= FF_MM_AVX2;
+    }
+
     cpuid(0x80000000, max_ext_level, ebx, ecx, edx);
 
     if(max_ext_level >= 0x80000001){
@@ -109,7 +124,7 @@ int mm_support(void)
     }
 
 #if 0
-    av_log(NULL, AV_LOG_DEBUG, "%s%s%s%s%s%s%s%s%s%s\n",
+    av_log(NULL, AV_LOG_DEBUG, "%s%s%s%s%s%s%s%s%s%s%s%s\n",
         (rval&FF_MM_MMX) ? "MMX ":"",
         (rval&FF_MM_MMX2) ? "MMX2 ":"",
         (rval&FF_MM_SSE) ? "SSE ":"",
@@ -118,6 +133,8 @@ int mm_support(void)
         (rval&FF_MM_SSSE3) ? "SSSE3 ":"",
         (rval&FF_MM_SSE4) ? "SSE4.1 ":"",
         (rval&FF_MM_SSE42) ? "SSE4.2 ":"",
+        (rval&FF_MM_AVX) ? "AVX ":"",
+        (rval&FF_MM_AVX2) ? "AVX2 ":"",
         (rval&FF_MM_3DNOW) ? "3DNow ":"",
         (rval&FF_MM_3DNOWEXT) ? "3DNowExt ":"");
 #endif
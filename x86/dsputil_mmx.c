@@ -630,6 +630,56 @@ static void add_hfyu_median_prediction_cmov(uint8_t *dst, const uint8_t *top, co
 }
 #endif
 
+/* 4 pixels per iteration: prefix sum within the register in 2 steps,
+ * then add the last pixel of the previous iteration to all lanes. */
+static void add_hfyu_left_prediction_bgr32_sse2(uint8_t *dst, const uint8_t *src, int w, int *red, int *green, int *blue, int *alpha)
+{
+    x86_reg i = 0;
+    unsigned left = (*blue & 0xff) | (*green & 0xff) << 8 | (*red & 0xff) << 16 | (unsigned)(*alpha & 0xff) << 24;
+    uint8_t b, g, r, a;
+
+    if (w >= 4) {
+        __asm__ volatile(
+            "movd      %1, %%xmm7           \n\t"
+            "pshufd    $0, %%xmm7, %%xmm7   \n\t"
+            "1:                             \n\t"
+            "movdqu  (%3,%0), %%xmm0        \n\t"
+            "movdqa    %%xmm0, %%xmm1       \n\t"
+            "pslldq    $4, %%xmm1           \n\t"
+            "paddb     %%xmm1, %%xmm0       \n\t"
+            "movdqa    %%xmm0, %%xmm1       \n\t"
+            "pslldq    $8, %%xmm1           \n\t"
+            "paddb     %%xmm1, %%xmm0       \n\t"
+            "paddb     %%xmm7, %%xmm0       \n\t"
+            "movdqu    %%xmm0, (%2,%0)      \n\t"
+            "pshufd    $0xff, %%xmm0, %%xmm7\n\t"
+            "add       $16, %0              \n\t"
+            "cmp       %4, %0               \n\t"
+            " jb 1b                         \n\t"
+            "movd      %%xmm7, %1           \n\t"
+            :"+r"(i), "+r"(left)
+            :"r"(dst), "r"(src), "r"((x86_reg)(w & ~3) * 4)
+            :"memory"
+        );
+    }
+
+    b = left;
+    g = left >> 8;
+    r = left >> 16;
+    a = left >> 24;
+    for (; i < 4*w; i += 4) {
+        dst[i+0] = b += src[i+0];
+        dst[i+1] = g += src[i+1];
+        dst[i+2] = r += src[i+2];
+        dst[i+3] = a += src[i+3];
+    }
+
+    *blue  = b;
+    *green = g;
+    *red   = r;
+    *alpha = a;
+}
+
 #define H263_LOOP_FILTER \
         "pxor %%mm7, %%mm7              \n\t"\
         "movq  %0, %%mm0                \n\t"\
@@ -806,7 +856,7 @@ static void h263_h_loop_filter_mmx(uint8_t *src, int stride, int qscale){
 
 /* draw the edges of width 'w' of an image of size width, height
    this mmx version can only handle w==8 || w==16 */
-static void draw_edges_mmx(uint8_t *buf, int wrap, int width, int height, int w)
+static void draw_edges_mmx(uint8_t *buf, int wrap, int width, int height, int w, int sides)
 {
     uint8_t *ptr, *last_line;
     int i;
@@ -859,8 +909,9 @@ static void draw_edges_mmx(uint8_t *buf, int wrap, int width, int height, int w)
         );
     }
 
-    for(i=0;i<w;i+=4) {
-        /* top and bottom (and hopefully also the corners) */
+    /* top and bottom (and hopefully also the corners) */
+    if (sides&EDGE_TOP) {
+        for(i=0;i<w;i+=4) {
         ptr= buf - (i + 1) * wrap - w;
         __asm__ volatile(
                 "1:                             \n\t"
@@ -875,6 +926,11 @@ static void draw_edges_mmx(uint8_t *buf, int wrap, int width, int height, int w)
                 : "+r" (ptr)
                 : "r" ((x86_reg)buf - (x86_reg)ptr - w), "r" ((x86_reg)-wrap), "r" ((x86_reg)-wrap*3), "r" (ptr+width+2*w)
         );
+        }
+    }
+
+    if (sides&EDGE_BOTTOM) {
+        for(i=0;i<w;i+=4) {
         ptr= last_line + (i + 1) * wrap - w;
         __asm__ volatile(
                 "1:                             \n\t"
@@ -889,6 +945,7 @@ static void draw_edges_mmx(uint8_t *buf, int wrap, int width, int height, int w)
                 : "+r" (ptr)
                 : "r" ((x86_reg)last_line - (x86_reg)ptr - w), "r" ((x86_reg)wrap), "r" ((x86_reg)wrap*3), "r" (ptr+width+2*w)
         );
+        }
     }
 }
 
@@ -966,6 +1023,44 @@ PAETH(mmx2, ABS3_MMX2)
 PAETH(ssse3, ABS3_SSSE3)
 #endif
 
+#if CONFIG_PNG_DECODER
+void ff_add_png_avg_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+
+/* One pixel per iteration, the left pixel of the first one is 0. */
+static void add_png_avg_prediction_mmx2(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
+{
+    x86_reg i = 0;
+
+    if ((bpp != 3 && bpp != 4) || w < 4) {
+        ff_add_png_avg_prediction(dst, src, top, w, bpp);
+        return;
+    }
+    __asm__ volatile(
+        "pxor      %%mm0, %%mm0 \n"
+        "movq      %5,    %%mm7 \n"
+        "1: \n"
+        "movd    (%2,%0), %%mm1 \n"
+        "movd    (%3,%0), %%mm3 \n"
+        "movq      %%mm0, %%mm2 \n"
+        "pxor      %%mm1, %%mm2 \n"
+        "pavgb     %%mm1, %%mm0 \n"
+        "pand      %%mm7, %%mm2 \n"
+        "psubb     %%mm2, %%mm0 \n"
+        "paddb     %%mm3, %%mm0 \n"
+        "movd      %%mm0, (%1,%0) \n"
+        "add       %4, %0 \n"
+        "cmp       %6, %0 \n"
+        "jle 1b \n"
+        :"+r"(i)
+        :"r"(dst), "r"(top), "r"(src), "r"((x86_reg)bpp), "m"(ff_pb_1),
+         "g"((x86_reg)w-4)
+        :"memory"
+    );
+    for (; i < w; i++)
+        dst[i] = ((dst[i-bpp] + top[i]) >> 1) + src[i];
+}
+#endif
+
 #define QPEL_V_LOW(m3,m4,m5,m6, pw_20, pw_3, rnd, in0, in1, in2, in7, out, OP)\
         "paddw " #m4 ", " #m3 "           \n\t" /* x1 */\
         "movq "MANGLE(ff_pw_20)", %%mm4   \n\t" /* 20 */\
@@ -2777,6 +2872,9 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
                 ff_vc1dsp_init_mmx(c, avctx);
 
             c->add_png_paeth_prediction= add_png_paeth_prediction_mmx2;
+#if CONFIG_PNG_DECODER
+            c->add_png_avg_prediction= add_png_avg_prediction_mmx2;
+#endif
         } else if (mm_flags & FF_MM_3DNOW) {
             c->prefetch = prefetch_3dnow;
 
@@ -2863,6 +2961,8 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
             H264_QPEL_FUNCS(3, 2, sse2);
             H264_QPEL_FUNCS(3, 3, sse2);
 
+            c->add_hfyu_left_prediction_bgr32 = add_hfyu_left_prediction_bgr32_sse2;
+
             if (CONFIG_VP6_DECODER) {
                 c->vp6_filter_diag4 = ff_vp6_filter_diag4_sse2;
             }
@@ -2916,6 +3016,20 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
         }
 #endif
 
+#if HAVE_AVX2 && ARCH_X86_64
+        /* the intra (bS 4) deblocking filters keep their MMX2/SSE2 versions */
+        if (mm_flags & FF_MM_AVX2) {
+            c->h264_idct_add16      = ff_h264_idct_add16_avx2;
+            c->h264_idct_add16intra = ff_h264_idct_add16intra_avx2;
+            c->h264_idct_add8       = ff_h264_idct_add8_avx2;
+            c->h264_idct8_add4      = ff_h264_idct8_add4_avx2;
+            c->h264_v_loop_filter_luma = h264_v_loop_filter_luma_avx2;
+            c->h264_h_loop_filter_luma = h264_h_loop_filter_luma_avx2;
+            c->h264_v_loop_filter_chroma = h264_v_loop_filter_chroma_avx2;
+            c->h264_h_loop_filter_chroma = h264_h_loop_filter_chroma_avx2;
+        }
+#endif
+
 #if CONFIG_SNOW_DECODER
         if(mm_flags & FF_MM_SSE2 & 0){
             c->horizontal_compose97i = ff_snow_horizontal_compose97i_sse2;
@@ -938,6 +938,66 @@ static void sub_hfyu_median_prediction_mmx2(uint8_t *dst, const uint8_t *src1, c
     *left    = src2[w-1];
 }
 
+static void diff_bytes_sse2(uint8_t *dst, uint8_t *src1, uint8_t *src2, int w){
+    x86_reg i=0;
+    if(w >= 32){
+        __asm__ volatile(
+            "1:                             \n\t"
+            "movdqu  (%2, %0), %%xmm0       \n\t"
+            "movdqu  (%1, %0), %%xmm1       \n\t"
+            "psubb %%xmm0, %%xmm1           \n\t"
+            "movdqu %%xmm1, (%3, %0)        \n\t"
+            "movdqu 16(%2, %0), %%xmm0      \n\t"
+            "movdqu 16(%1, %0), %%xmm1      \n\t"
+            "psubb %%xmm0, %%xmm1           \n\t"
+            "movdqu %%xmm1, 16(%3, %0)      \n\t"
+            "add $32, %0                    \n\t"
+            "cmp %4, %0                     \n\t"
+            " jb 1b                         \n\t"
+            : "+r" (i)
+            : "r"(src1), "r"(src2), "r"(dst), "r"((x86_reg)w-31)
+        );
+    }
+    for(; i<w; i++)
+        dst[i+0] = src1[i+0]-src2[i+0];
+}
+
+static void sub_hfyu_median_prediction_sse2(uint8_t *dst, const uint8_t *src1, const uint8_t *src2, int w, int *left, int *left_top){
+    x86_reg i=0;
+    uint8_t l, lt;
+
+    __asm__ volatile(
+        "1:                             \n\t"
+        "movdqu  -1(%1, %0), %%xmm0     \n\t" // LT
+        "movdqu  (%1, %0), %%xmm1       \n\t" // T
+        "movdqu  -1(%2, %0), %%xmm2     \n\t" // L
+        "movdqu  (%2, %0), %%xmm3       \n\t" // X
+        "movdqa %%xmm2, %%xmm4          \n\t" // L
+        "psubb %%xmm0, %%xmm2           \n\t"
+        "paddb %%xmm1, %%xmm2           \n\t" // L + T - LT
+        "movdqa %%xmm4, %%xmm5          \n\t" // L
+        "pmaxub %%xmm1, %%xmm4          \n\t" // max(T, L)
+        "pminub %%xmm5, %%xmm1          \n\t" // min(T, L)
+        "pminub %%xmm2, %%xmm4          \n\t"
+        "pmaxub %%xmm1, %%xmm4          \n\t"
+        "psubb %%xmm4, %%xmm3           \n\t" // dst - pred
+        "movdqu %%xmm3, (%3, %0)        \n\t"
+        "add $16, %0                    \n\t"
+        "cmp %4, %0                     \n\t"
+        " jb 1b                         \n\t"
+        : "+r" (i)
+        : "r"(src1), "r"(src2), "r"(dst), "r"((x86_reg)w)
+    );
+
+    l= *left;
+    lt= *left_top;
+
+    dst[0]= src2[0] - mid_pred(l, src1[0], (l + src1[0] - lt)&0xFF);
+
+    *left_top= src1[w-1];
+    *left    = src2[w-1];
+}
+
 #define DIFF_PIXELS_1(m,a,t,p1,p2)\
     "mov"#m" "#p1", "#a"              \n\t"\
     "mov"#m" "#p2", "#t"              \n\t"\
@@ -1350,6 +1410,26 @@ static int ssd_int8_vs_int16_mmx(const int8_t *pix1, const int16_t *pix2, int si
 
 void ff_lpc_compute_autocorr_sse2(const int32_t *data, int len, int lag,
                                    double *autoc);
+void ff_lpc_compute_autocorr_avx(const int32_t *data, int len, int lag,
+                                  double *autoc);
+void ff_aac_quantize_bands_sse2(int (*out)[2], const float *in, const float *scaled,
+                                int size, float Q34, int is_signed, int maxval);
+void ff_aac_quantize_bands_avx(int (*out)[2], const float *in, const float *scaled,
+                               int size, float Q34, int is_signed, int maxval);
+void ff_aac_abs_pow34_sse2(float *out, const float *in, int size);
+void ff_flac_encode_residual_fixed_sse2(int32_t *res, const int32_t *smp, int n,
+                                        int order);
+void ff_flac_encode_residual_lpc_sse4(int32_t *res, const int32_t *smp, int n,
+                                      int order, const int32_t *coefs, int shift);
+void ff_flac_encode_residual_lpc_avx2(int32_t *res, const int32_t *smp, int n,
+                                      int order, const int32_t *coefs, int shift);
+void ff_flac_calc_sums_sse2(uint32_t *sums, const int32_t *res, int n,
+                            int pred_order, int porder);
+void ff_flac_calc_sums_avx2(uint32_t *sums, const int32_t *res, int n,
+                            int pred_order, int porder);
+void ff_sub_png_avg_prediction_sse2(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+void ff_sub_png_paeth_prediction_sse2(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+void ff_sub_png_paeth_prediction_ssse3(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
 
 
 void dsputilenc_init_mmx(DSPContext* c, AVCodecContext *avctx)
@@ -1413,10 +1493,48 @@ void dsputilenc_init_mmx(DSPContext* c, AVCodecContext *avctx)
             c->sum_abs_dctelem= sum_abs_dctelem_sse2;
             c->hadamard8_diff[0]= hadamard8_diff16_sse2;
             c->hadamard8_diff[1]= hadamard8_diff_sse2;
+            c->diff_bytes= diff_bytes_sse2;
+            c->sub_hfyu_median_prediction= sub_hfyu_median_prediction_sse2;
 #if CONFIG_LPC
             c->lpc_compute_autocorr = ff_lpc_compute_autocorr_sse2;
+#endif
+#if CONFIG_AAC_ENCODER
+            c->aac_quantize_bands = ff_aac_quantize_bands_sse2;
+            c->aac_abs_pow34      = ff_aac_abs_pow34_sse2;
+#endif
+#if CONFIG_FLAC_ENCODER
+            c->flac_encode_residual_fixed = ff_flac_encode_residual_fixed_sse2;
+            c->flac_calc_sums             = ff_flac_calc_sums_sse2;
+#endif
+#if CONFIG_PNG_ENCODER
+            c->sub_png_avg_prediction   = ff_sub_png_avg_prediction_sse2;
+            c->sub_png_paeth_prediction = ff_sub_png_paeth_prediction_sse2;
+#endif
+        }
+
+#if HAVE_SSSE3 && CONFIG_FLAC_ENCODER
+        if(mm_flags & FF_MM_SSE4){
+            c->flac_encode_residual_lpc = ff_flac_encode_residual_lpc_sse4;
+        }
+#endif
+
+#if HAVE_AVX
+        if(mm_flags & FF_MM_AVX){
+#if CONFIG_LPC
+            c->lpc_compute_autocorr = ff_lpc_compute_autocorr_avx;
+#endif
+#if CONFIG_AAC_ENCODER
+            c->aac_quantize_bands = ff_aac_quantize_bands_avx;
 #endif
         }
+#endif
+
+#if HAVE_AVX2 && CONFIG_FLAC_ENCODER
+        if(mm_flags & FF_MM_AVX2){
+            c->flac_encode_residual_lpc = ff_flac_encode_residual_lpc_avx2;
+            c->flac_calc_sums           = ff_flac_calc_sums_avx2;
+        }
+#endif
 
 #if HAVE_SSSE3
         if(mm_flags & FF_MM_SSSE3){
@@ -1427,6 +1545,9 @@ void dsputilenc_init_mmx(DSPContext* c, AVCodecContext *avctx)
             c->sum_abs_dctelem= sum_abs_dctelem_ssse3;
             c->hadamard8_diff[0]= hadamard8_diff16_ssse3;
             c->hadamard8_diff[1]= hadamard8_diff_ssse3;
+#if CONFIG_PNG_ENCODER
+            c->sub_png_paeth_prediction = ff_sub_png_paeth_prediction_ssse3;
+#endif
         }
 #endif
 
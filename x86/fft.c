@@ -21,8 +21,8 @@
 
 av_cold void ff_fft_init_mmx(FFTContext *s)
 {
+    int av_unused has_vectors = mm_support();
 #if HAVE_YASM
-    int has_vectors = mm_support();
     if (has_vectors & FF_MM_SSE && HAVE_SSE) {
         /* SSE for P3/P4/K8 */
         s->imdct_calc  = ff_imdct_calc_sse;
@@ -41,4 +41,16 @@ av_cold void ff_fft_init_mmx(FFTContext *s)
         s->fft_calc   = ff_fft_calc_3dn;
     }
 #endif
+#if HAVE_AVX
+    /* works on the C data layout, so the permutation is kept as is;
+     * the MDCT needs at least 16 points in the FFT */
+    if (has_vectors & FF_MM_AVX && s->nbits >= 3 && ff_fft_init_avx(s) >= 0) {
+        s->fft_calc = ff_fft_calc_avx;
+        if (s->nbits >= 4) {
+            s->imdct_calc = ff_imdct_calc_avx;
+            s->imdct_half = ff_imdct_half_avx;
+            s->mdct_calc  = ff_mdct_calc_avx;
+        }
+    }
+#endif
 }
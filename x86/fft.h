@@ -25,6 +25,9 @@ void ff_fft_permute_sse(FFTContext *s, FFTComplex *z);
 void ff_fft_calc_sse(FFTContext *s, FFTComplex *z);
 void ff_fft_calc_3dn(FFTContext *s, FFTComplex *z);
 void ff_fft_calc_3dn2(FFTContext *s, FFTComplex *z);
+void ff_fft_calc_avx(FFTContext *s, FFTComplex *z);
+
+int  ff_fft_init_avx(FFTContext *s);
 
 void ff_imdct_calc_3dn(FFTContext *s, FFTSample *output, const FFTSample *input);
 void ff_imdct_half_3dn(FFTContext *s, FFTSample *output, const FFTSample *input);
@@ -32,5 +35,8 @@ void ff_imdct_calc_3dn2(FFTContext *s, FFTSample *output, const FFTSample *input
 void ff_imdct_half_3dn2(FFTContext *s, FFTSample *output, const FFTSample *input);
 void ff_imdct_calc_sse(FFTContext *s, FFTSample *output, const FFTSample *input);
 void ff_imdct_half_sse(FFTContext *s, FFTSample *output, const FFTSample *input);
+void ff_imdct_calc_avx(FFTContext *s, FFTSample *output, const FFTSample *input);
+void ff_imdct_half_avx(FFTContext *s, FFTSample *output, const FFTSample *input);
+void ff_mdct_calc_avx(FFTContext *s, FFTSample *output, const FFTSample *input);
 
 #endif
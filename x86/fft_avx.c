@@ -0,0 +1,440 @@
+/*
+ * FFT/MDCT transform with AVX optimizations
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Unlike the SSE version, this works on arrays of FFTComplex like the C
+ * code, so it uses the same permutation and the C fft_permute. Each
+ * butterfly handles 4 complex values (8 floats) in a ymm register and
+ * does the same float operations as the C split-radix pass.
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/dsputil.h"
+#include "fft.h"
+
+#if HAVE_AVX
+
+DECLARE_ALIGNED(16, static const int, m1m1m1m1)[8] =
+    { 1 << 31, 1 << 31, 1 << 31, 1 << 31, 1 << 31, 1 << 31, 1 << 31, 1 << 31 };
+DECLARE_ALIGNED(16, static const int, p1p1p1m1)[4] =
+    { 0, 0, 0, 1 << 31 };
+
+/**
+ * Sets up the twiddle factors of the split-radix passes.
+ * For each size m >= 8 the table at twiddle_avx + m - 8 holds, per group
+ * of (up to) 4 butterflies, {wre, wre} pairs followed by {wim, -wim} pairs.
+ */
+av_cold int ff_fft_init_avx(FFTContext *s)
+{
+    int n = 1 << s->nbits;
+    int m, k;
+    FFTSample *tab;
+
+    if (n < 8)
+        return 0;
+    s->twiddle_avx = av_malloc((2*n - 8) * sizeof(FFTSample));
+    if (!s->twiddle_avx)
+        return -1;
+
+    for (m = 8, tab = s->twiddle_avx; m <= n; tab += m, m <<= 1) {
+        double freq = 2*M_PI/m;
+        int q = m >> 2;
+        int b = FFMIN(4, q);
+        for (k = 0; k < q; k++) {
+            FFTSample *t = tab + (k/b)*4*b + 2*(k%b);
+            t[0]     = t[1] = cos(k*freq);
+            /* the C code skips the multiplication for k = 0 */
+            t[2*b]   = k ? cos((q-k)*freq) : 0;
+            t[2*b+1] = -t[2*b];
+        }
+    }
+    return 0;
+}
+
+/* in: a0, a1, a2, a3 in m4, m5, m0, m1 and the twiddles in m6, m7
+ * out: a0, a1, a2, a3 in m6, m7, m4, m5 */
+#define PASS(x)\
+    "vpermilps $0xb1, %%"#x"mm0, %%"#x"mm2                \n\t"\
+    "vpermilps $0xb1, %%"#x"mm1, %%"#x"mm3                \n\t"\
+    "vmulps    %%"#x"mm6, %%"#x"mm0, %%"#x"mm0            \n\t"\
+    "vmulps    %%"#x"mm6, %%"#x"mm1, %%"#x"mm1            \n\t"\
+    "vmulps    %%"#x"mm7, %%"#x"mm2, %%"#x"mm2            \n\t"\
+    "vmulps    %%"#x"mm7, %%"#x"mm3, %%"#x"mm3            \n\t"\
+    "vaddps    %%"#x"mm2, %%"#x"mm0, %%"#x"mm0            \n\t" /* {t1,t2} */\
+    "vsubps    %%"#x"mm3, %%"#x"mm1, %%"#x"mm1            \n\t" /* {t5,t6} */\
+    "vaddps    %%"#x"mm1, %%"#x"mm0, %%"#x"mm2            \n\t"\
+    "vsubps    %%"#x"mm0, %%"#x"mm1, %%"#x"mm3            \n\t" /* {t3,-t4} */\
+    "vsubps    %%"#x"mm1, %%"#x"mm0, %%"#x"mm0            \n\t"\
+    "vpermilps $0xb1, %%"#x"mm3, %%"#x"mm3                \n\t"\
+    "vpermilps $0xb1, %%"#x"mm0, %%"#x"mm0                \n\t"\
+    "vaddps    %%"#x"mm2, %%"#x"mm4, %%"#x"mm6            \n\t"\
+    "vsubps    %%"#x"mm2, %%"#x"mm4, %%"#x"mm4            \n\t"\
+    "vaddsubps %%"#x"mm3, %%"#x"mm5, %%"#x"mm7            \n\t"\
+    "vaddsubps %%"#x"mm0, %%"#x"mm5, %%"#x"mm5            \n\t"
+
+/* in: {z0,z1} {z2,z3} in xmm0, xmm1
+ * out: {z0,z1} {z2,z3} in xmm4, xmm5 */
+#define FFT4\
+    "vshufps $0x44, %%xmm1, %%xmm0, %%xmm2    \n\t" /* {z0,z2} */\
+    "vshufps $0xee, %%xmm1, %%xmm0, %%xmm3    \n\t" /* {z1,z3} */\
+    "vaddps  %%xmm3, %%xmm2, %%xmm0           \n\t" /* {t1,t2,t6,t5} */\
+    "vsubps  %%xmm3, %%xmm2, %%xmm1           \n\t" /* {t3,t4,-t8,t7} */\
+    "vshufps $0x44, %%xmm1, %%xmm0, %%xmm2    \n\t" /* {t1,t2,t3,t4} */\
+    "vshufps $0xbe, %%xmm1, %%xmm0, %%xmm3    \n\t" /* {t6,t5,t7,-t8} */\
+    "vxorps  %[mask], %%xmm3, %%xmm3         \n\t"\
+    "vaddps  %%xmm3, %%xmm2, %%xmm4           \n\t"\
+    "vsubps  %%xmm3, %%xmm2, %%xmm5           \n\t"
+
+static void fft4_avx(FFTComplex *z)
+{
+    __asm__ volatile(
+        "vmovups   (%0), %%xmm0               \n\t"
+        "vmovups 16(%0), %%xmm1               \n\t"
+        FFT4
+        "vmovups %%xmm4,   (%0)               \n\t"
+        "vmovups %%xmm5, 16(%0)               \n\t"
+        ::"r"(z), [mask]"m"(*p1p1p1m1)
+        :"memory"
+    );
+}
+
+static void fft8_avx(FFTComplex *z, const FFTSample *tab)
+{
+    __asm__ volatile(
+        "vmovups   (%0), %%xmm0               \n\t"
+        "vmovups 16(%0), %%xmm1               \n\t"
+        FFT4
+        "vmovups 32(%0), %%xmm6               \n\t"
+        "vmovups 48(%0), %%xmm7               \n\t"
+        "vshufps $0x44, %%xmm7, %%xmm6, %%xmm2    \n\t" /* {z4,z6} */
+        "vshufps $0xee, %%xmm7, %%xmm6, %%xmm3    \n\t" /* {z5,z7} */
+        "vaddps  %%xmm3, %%xmm2, %%xmm6           \n\t"
+        "vsubps  %%xmm3, %%xmm2, %%xmm7           \n\t"
+        "vshufps $0x44, %%xmm7, %%xmm6, %%xmm0    \n\t" /* {z4+z5,z4-z5} */
+        "vshufps $0xee, %%xmm7, %%xmm6, %%xmm1    \n\t" /* {z6+z7,z6-z7} */
+        "vmovups   (%1), %%xmm6               \n\t"
+        "vmovups 16(%1), %%xmm7               \n\t"
+        PASS(x)
+        "vmovups %%xmm6,   (%0)               \n\t"
+        "vmovups %%xmm7, 16(%0)               \n\t"
+        "vmovups %%xmm4, 32(%0)               \n\t"
+        "vmovups %%xmm5, 48(%0)               \n\t"
+        ::"r"(z), "r"(tab), [mask]"m"(*p1p1p1m1)
+        :"memory"
+    );
+}
+
+/* z[0...16n-1], 4 butterflies per iteration */
+static void pass_avx(FFTComplex *z, const FFTSample *tab, x86_reg n)
+{
+    x86_reg o1 = 32*n;
+    __asm__ volatile(
+        "1:                                   \n\t"
+        "vmovups   (%0,%3,2), %%ymm0          \n\t"
+        "vmovups   (%0,%4),   %%ymm1          \n\t"
+        "vmovups   (%1),      %%ymm6          \n\t"
+        "vmovups 32(%1),      %%ymm7          \n\t"
+        "vmovups   (%0),      %%ymm4          \n\t"
+        "vmovups   (%0,%3),   %%ymm5          \n\t"
+        PASS(y)
+        "vmovups %%ymm6, (%0)                 \n\t"
+        "vmovups %%ymm7, (%0,%3)              \n\t"
+        "vmovups %%ymm4, (%0,%3,2)            \n\t"
+        "vmovups %%ymm5, (%0,%4)              \n\t"
+        "add     $32, %0                      \n\t"
+        "add     $64, %1                      \n\t"
+        "sub     $1,  %2                      \n\t"
+        " jg 1b                               \n\t"
+        :"+r"(z), "+r"(tab), "+r"(n)
+        :"r"(o1), "r"(3*o1)
+        :"memory"
+    );
+}
+
+static void fft_avx(FFTComplex *z, const FFTSample *tab, int nbits)
+{
+    int n = 1 << nbits;
+
+    if (nbits == 2) {
+        fft4_avx(z);
+    } else if (nbits == 3) {
+        fft8_avx(z, tab);
+    } else {
+        fft_avx(z,         tab, nbits-1);
+        fft_avx(z + n/2,   tab, nbits-2);
+        fft_avx(z + n*3/4, tab, nbits-2);
+        pass_avx(z, tab + n - 8, n >> 4);
+    }
+}
+
+void ff_fft_calc_avx(FFTContext *s, FFTComplex *z)
+{
+    fft_avx(z, s->twiddle_avx, s->nbits);
+    __asm__ volatile("vzeroupper");
+}
+
+/* a = p[0,2,...,14], b is clobbered */
+#define LOAD_EVEN(p, a, b)\
+    "vmovups             (%"#p"), %%xmm"#a"                 \n\t"\
+    "vmovups           16(%"#p"), %%xmm"#b"                 \n\t"\
+    "vinsertf128 $1,   32(%"#p"), %%ymm"#a", %%ymm"#a"      \n\t"\
+    "vinsertf128 $1,   48(%"#p"), %%ymm"#b", %%ymm"#b"      \n\t"\
+    "vshufps  $0x88, %%ymm"#b", %%ymm"#a", %%ymm"#a"        \n\t"
+
+/* a = p[15,13,...,1], b is clobbered */
+#define LOAD_ODD_REV(p, a, b)\
+    "vmovups           32(%"#p"), %%xmm"#a"                 \n\t"\
+    "vmovups           48(%"#p"), %%xmm"#b"                 \n\t"\
+    "vinsertf128 $1,     (%"#p"), %%ymm"#a", %%ymm"#a"      \n\t"\
+    "vinsertf128 $1,   16(%"#p"), %%ymm"#b", %%ymm"#b"      \n\t"\
+    "vshufps  $0xdd, %%ymm"#b", %%ymm"#a", %%ymm"#a"        \n\t"\
+    "vpermilps $0x1b, %%ymm"#a", %%ymm"#a"                  \n\t"
+
+/* re = p[0,2,...,14], im = p[1,3,...,15], a is clobbered */
+#define LOAD_CPLX(p, re, im, a)\
+    "vmovups             (%"#p"), %%xmm"#a"                 \n\t"\
+    "vmovups           16(%"#p"), %%xmm"#im"                \n\t"\
+    "vinsertf128 $1,   32(%"#p"), %%ymm"#a", %%ymm"#a"      \n\t"\
+    "vinsertf128 $1,   48(%"#p"), %%ymm"#im", %%ymm"#im"    \n\t"\
+    "vshufps  $0x88, %%ymm"#im", %%ymm"#a", %%ymm"#re"      \n\t"\
+    "vshufps  $0xdd, %%ymm"#im", %%ymm"#a", %%ymm"#im"      \n\t"
+
+/* p[0..15] = {re[0], im[0], re[1], im[1], ...}, re and im are clobbered */
+#define STORE_CPLX(p, re, im, a, b)\
+    "vunpcklps %%ymm"#im", %%ymm"#re", %%ymm"#a"            \n\t"\
+    "vunpckhps %%ymm"#im", %%ymm"#re", %%ymm"#b"            \n\t"\
+    "vperm2f128 $0x20, %%ymm"#b", %%ymm"#a", %%ymm"#re"     \n\t"\
+    "vperm2f128 $0x31, %%ymm"#b", %%ymm"#a", %%ymm"#im"     \n\t"\
+    "vmovups %%ymm"#re",   (%"#p")                          \n\t"\
+    "vmovups %%ymm"#im", 32(%"#p")                          \n\t"
+
+#define REVERSE(a)\
+    "vpermilps  $0x1b, %%ymm"#a", %%ymm"#a"                 \n\t"\
+    "vperm2f128 $0x01, %%ymm"#a", %%ymm"#a", %%ymm"#a"      \n\t"
+
+/**
+ * Post rotation + reordering, 8 values from each end per iteration.
+ * z[j] = {R(j), I(n4-1-j)}
+ * inverse: R = zi*sin - zr*cos, I = zi*cos + zr*sin
+ * forward: R = -(zr*cos + zi*sin), I = zi*cos - zr*sin
+ */
+#define POST_ROTATION(name, CMUL_R, CMUL_I)\
+static void name(FFTComplex *z, const FFTSample *tcos,\
+                 const FFTSample *tsin, int n4)\
+{\
+    int j0;\
+    for (j0 = 0; j0 < n4/2; j0 += 8) {\
+        int j1 = n4 - 8 - j0;\
+        __asm__ volatile(\
+            LOAD_CPLX(0, 0, 1, 4)\
+            "vmovups %2, %%ymm2                             \n\t"\
+            "vmovups %3, %%ymm3                             \n\t"\
+            CMUL_R(4) CMUL_I(5)\
+            LOAD_CPLX(1, 0, 1, 6)\
+            "vmovups %4, %%ymm2                             \n\t"\
+            "vmovups %5, %%ymm3                             \n\t"\
+            CMUL_R(6) CMUL_I(7)\
+            REVERSE(5)\
+            REVERSE(7)\
+            STORE_CPLX(0, 4, 7, 0, 1)\
+            STORE_CPLX(1, 6, 5, 0, 1)\
+            ::"r"(z+j0), "r"(z+j1),\
+              "m"(*(const FFTSample(*)[8])(tcos+j0)),\
+              "m"(*(const FFTSample(*)[8])(tsin+j0)),\
+              "m"(*(const FFTSample(*)[8])(tcos+j1)),\
+              "m"(*(const FFTSample(*)[8])(tsin+j1)),\
+              [mask]"m"(*m1m1m1m1)\
+            :"memory"\
+        );\
+    }\
+}
+
+/* re, im, cos, sin in ymm0, ymm1, ymm2, ymm3, the result goes to ymm(d),
+ * ymm0, ymm1 and ymm7 are clobbered */
+#define IMDCT_R(d)\
+    "vmulps %%ymm2, %%ymm0, %%ymm7                          \n\t"\
+    "vmulps %%ymm3, %%ymm1, %%ymm"#d"                       \n\t"\
+    "vsubps %%ymm7, %%ymm"#d", %%ymm"#d"                    \n\t"
+#define IMDCT_I(d)\
+    "vmulps %%ymm2, %%ymm1, %%ymm1                          \n\t"\
+    "vmulps %%ymm3, %%ymm0, %%ymm0                          \n\t"\
+    "vaddps %%ymm0, %%ymm1, %%ymm"#d"                       \n\t"
+#define MDCT_R(d)\
+    "vmulps %%ymm2, %%ymm0, %%ymm7                          \n\t"\
+    "vmulps %%ymm3, %%ymm1, %%ymm"#d"                       \n\t"\
+    "vaddps %%ymm"#d", %%ymm7, %%ymm"#d"                    \n\t"\
+    "vxorps %[mask], %%ymm"#d", %%ymm"#d"                   \n\t"
+#define MDCT_I(d)\
+    "vmulps %%ymm2, %%ymm1, %%ymm1                          \n\t"\
+    "vmulps %%ymm3, %%ymm0, %%ymm0                          \n\t"\
+    "vsubps %%ymm0, %%ymm1, %%ymm"#d"                       \n\t"
+
+POST_ROTATION(imdct_post_rotation_avx, IMDCT_R, IMDCT_I)
+POST_ROTATION(mdct_post_rotation_avx,  MDCT_R,  MDCT_I)
+
+void ff_imdct_half_avx(FFTContext *s, FFTSample *output, const FFTSample *input)
+{
+    int k, j;
+    int n  = 1 << s->mdct_bits;
+    int n2 = n >> 1;
+    int n4 = n >> 2;
+    const uint16_t *revtab = s->revtab;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    FFTComplex *z = (FFTComplex *)output;
+    DECLARE_ALIGNED_16(FFTComplex, tmp)[8];
+
+    /* pre rotation, {in2, in1} * {cos, sin} */
+    for (k = 0; k < n4; k += 8) {
+        __asm__ volatile(
+            LOAD_EVEN(0, 0, 4)                      // in1
+            LOAD_ODD_REV(1, 1, 5)                   // in2
+            "vmovups %3, %%ymm2                             \n\t"
+            "vmovups %4, %%ymm3                             \n\t"
+            "vmulps %%ymm2, %%ymm1, %%ymm4                  \n\t"
+            "vmulps %%ymm3, %%ymm0, %%ymm5                  \n\t"
+            "vmulps %%ymm3, %%ymm1, %%ymm1                  \n\t"
+            "vmulps %%ymm2, %%ymm0, %%ymm0                  \n\t"
+            "vsubps %%ymm5, %%ymm4, %%ymm4                  \n\t"
+            "vaddps %%ymm0, %%ymm1, %%ymm5                  \n\t"
+            STORE_CPLX(2, 4, 5, 0, 1)
+            ::"r"(input + 2*k), "r"(input + n2 - 16 - 2*k), "r"(tmp),
+              "m"(*(const FFTSample(*)[8])(tcos + k)),
+              "m"(*(const FFTSample(*)[8])(tsin + k))
+            :"memory"
+        );
+        for (j = 0; j < 8; j++)
+            z[revtab[k+j]] = tmp[j];
+    }
+
+    fft_avx(z, s->twiddle_avx, s->nbits);
+
+    imdct_post_rotation_avx(z, tcos, tsin, n4);
+    __asm__ volatile("vzeroupper");
+}
+
+void ff_imdct_calc_avx(FFTContext *s, FFTSample *output, const FFTSample *input)
+{
+    x86_reg j, k;
+    long n  = 1 << s->mdct_bits;
+    long n4 = n >> 2;
+
+    ff_imdct_half_avx(s, output+n4, input);
+
+    j = -n;
+    k = n-32;
+    __asm__ volatile(
+        "1:                                             \n\t"
+        "vmovups        (%2,%1), %%ymm0                 \n\t"
+        "vmovups        (%3,%0), %%ymm1                 \n\t"
+        REVERSE(0)
+        REVERSE(1)
+        "vxorps         %4, %%ymm0, %%ymm0              \n\t"
+        "vmovups        %%ymm1, (%3,%1)                 \n\t"
+        "vmovups        %%ymm0, (%2,%0)                 \n\t"
+        "sub            $32, %1                         \n\t"
+        "add            $32, %0                         \n\t"
+        " jl 1b                                         \n\t"
+        "vzeroupper                                     \n\t"
+        :"+r"(j), "+r"(k)
+        :"r"(output+n4), "r"(output+n4*3), "m"(*m1m1m1m1)
+        :"memory"
+    );
+}
+
+void ff_mdct_calc_avx(FFTContext *s, FFTSample *output, const FFTSample *input)
+{
+    int i, j;
+    int n  = 1 << s->mdct_bits;
+    int n2 = n >> 1;
+    int n4 = n >> 2;
+    int n8 = n >> 3;
+    int n3 = 3 * n4;
+    const uint16_t *revtab = s->revtab;
+    const FFTSample *tcos = s->tcos;
+    const FFTSample *tsin = s->tsin;
+    FFTComplex *x = (FFTComplex *)output;
+    DECLARE_ALIGNED_16(FFTComplex, tmp)[8];
+
+    /* pre rotation */
+    for (i = 0; i < n8; i += 8) {
+        /* u = input[2i+3n4] + input[n3-1-2i], v = input[n4-1-2i] - input[n4+2i]
+         * x = {u*cos - v*sin, -(u*sin + v*cos)} */
+        __asm__ volatile(
+            LOAD_EVEN(0, 0, 4)
+            LOAD_ODD_REV(1, 1, 5)
+            LOAD_EVEN(2, 2, 4)
+            LOAD_ODD_REV(3, 3, 5)
+            "vaddps %%ymm1, %%ymm0, %%ymm0                  \n\t"
+            "vsubps %%ymm2, %%ymm3, %%ymm1                  \n\t"
+            "vmovups %5, %%ymm2                             \n\t"
+            "vmovups %6, %%ymm3                             \n\t"
+            "vmulps %%ymm2, %%ymm0, %%ymm4                  \n\t"
+            "vmulps %%ymm3, %%ymm1, %%ymm5                  \n\t"
+            "vmulps %%ymm3, %%ymm0, %%ymm0                  \n\t"
+            "vmulps %%ymm2, %%ymm1, %%ymm1                  \n\t"
+            "vsubps %%ymm5, %%ymm4, %%ymm4                  \n\t"
+            "vaddps %%ymm1, %%ymm0, %%ymm5                  \n\t"
+            "vxorps %7, %%ymm5, %%ymm5                      \n\t"
+            STORE_CPLX(4, 4, 5, 0, 1)
+            ::"r"(input + 3*n4 + 2*i), "r"(input + n3 - 16 - 2*i),
+              "r"(input + n4 + 2*i),   "r"(input + n4 - 16 - 2*i), "r"(tmp),
+              "m"(*(const FFTSample(*)[8])(tcos + i)),
+              "m"(*(const FFTSample(*)[8])(tsin + i)), "m"(*m1m1m1m1)
+            :"memory"
+        );
+        for (j = 0; j < 8; j++)
+            x[revtab[i+j]] = tmp[j];
+
+        /* re = input[2i] - input[n2-1-2i], w = input[n2+2i] + input[n-1-2i]
+         * x = {w*sin - re*cos, re*sin + w*cos} */
+        __asm__ volatile(
+            LOAD_EVEN(0, 0, 4)
+            LOAD_ODD_REV(1, 1, 5)
+            LOAD_EVEN(2, 2, 4)
+            LOAD_ODD_REV(3, 3, 5)
+            "vsubps %%ymm1, %%ymm0, %%ymm0                  \n\t"
+            "vaddps %%ymm3, %%ymm2, %%ymm1                  \n\t"
+            "vmovups %5, %%ymm2                             \n\t"
+            "vmovups %6, %%ymm3                             \n\t"
+            "vmulps %%ymm3, %%ymm1, %%ymm4                  \n\t"
+            "vmulps %%ymm2, %%ymm0, %%ymm5                  \n\t"
+            "vmulps %%ymm3, %%ymm0, %%ymm0                  \n\t"
+            "vmulps %%ymm2, %%ymm1, %%ymm1                  \n\t"
+            "vsubps %%ymm5, %%ymm4, %%ymm4                  \n\t"
+            "vaddps %%ymm1, %%ymm0, %%ymm5                  \n\t"
+            STORE_CPLX(4, 4, 5, 0, 1)
+            ::"r"(input + 2*i),      "r"(input + n2 - 16 - 2*i),
+              "r"(input + n2 + 2*i), "r"(input + n - 16 - 2*i), "r"(tmp),
+              "m"(*(const FFTSample(*)[8])(tcos + n8 + i)),
+              "m"(*(const FFTSample(*)[8])(tsin + n8 + i))
+            :"memory"
+        );
+        for (j = 0; j < 8; j++)
+            x[revtab[n8+i+j]] = tmp[j];
+    }
+
+    fft_avx(x, s->twiddle_avx, s->nbits);
+
+    mdct_post_rotation_avx(x, tcos, tsin, n4);
+    __asm__ volatile("vzeroupper");
+}
+
+#endif /* HAVE_AVX */
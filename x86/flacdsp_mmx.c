@@ -0,0 +1,287 @@
+/*
+ * SIMD optimized FLAC encoder residual functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/dsputil.h"
+#include "libavcodec/lpc.h"
+#include "dsputil_mmx.h"
+
+/* The predictions are computed with wrapping 32-bit multiplies like in the
+ * C version, so the residual is identical. Samples the vector loops do not
+ * cover are done here. */
+static av_always_inline void lpc_residual_tail(int32_t *res, const int32_t *smp,
+                                               int i, int n, int order,
+                                               const int32_t *coefs, int shift)
+{
+    for(; i<n; i++) {
+        int j, p = 0;
+        for(j=0; j<order; j++)
+            p += coefs[j] * smp[i-j-1];
+        res[i] = smp[i] - (p >> shift);
+    }
+}
+
+#define LOAD(r, off) "movdqu "#off"(%1,%0), %%xmm"#r"   \n\t"
+#define SUB(a, b)    "psubd  %%xmm"#b", %%xmm"#a"       \n\t"
+#define FIXED_RESIDUAL(body)\
+    __asm__ volatile(\
+        "1:                             \n\t"\
+        body\
+        "movdqu  %%xmm0, (%2,%0)        \n\t"\
+        "add     $16, %0                \n\t"\
+        " jl 1b                         \n\t"\
+        :"+r"(k)\
+        :"r"(smp+order+len), "r"(res+order+len)\
+        :"memory"\
+    );
+
+void ff_flac_encode_residual_fixed_sse2(int32_t *res, const int32_t *smp, int n,
+                                        int order)
+{
+    int i;
+    int len = (n - order) & ~3;
+    x86_reg k = -4*len;
+
+    if(!order) {
+        memcpy(res, smp, n * sizeof(int32_t));
+        return;
+    }
+    for(i=0; i<order; i++)
+        res[i] = smp[i];
+
+    /* order k is the k-th difference of the signal */
+    if(len > 0) {
+        switch(order) {
+        case 1:
+            FIXED_RESIDUAL(LOAD(0, 0) LOAD(1, -4) SUB(0, 1))
+            break;
+        case 2:
+            FIXED_RESIDUAL(LOAD(0, 0) LOAD(1, -4) LOAD(2, -8)
+                           SUB(0, 1) SUB(1, 2)
+                           SUB(0, 1))
+            break;
+        case 3:
+            FIXED_RESIDUAL(LOAD(0, 0) LOAD(1, -4) LOAD(2, -8) LOAD(3, -12)
+                           SUB(0, 1) SUB(1, 2) SUB(2, 3)
+                           SUB(0, 1) SUB(1, 2)
+                           SUB(0, 1))
+            break;
+        default:
+            FIXED_RESIDUAL(LOAD(0, 0) LOAD(1, -4) LOAD(2, -8) LOAD(3, -12)
+                           LOAD(4, -16)
+                           SUB(0, 1) SUB(1, 2) SUB(2, 3) SUB(3, 4)
+                           SUB(0, 1) SUB(1, 2) SUB(2, 3)
+                           SUB(0, 1) SUB(1, 2)
+                           SUB(0, 1))
+            break;
+        }
+    }
+
+    for(i=order+FFMAX(len, 0); i<n; i++) {
+        switch(order) {
+        case 1: res[i] = smp[i] -   smp[i-1]; break;
+        case 2: res[i] = smp[i] - 2*smp[i-1] +   smp[i-2]; break;
+        case 3: res[i] = smp[i] - 3*smp[i-1] + 3*smp[i-2] -   smp[i-3]; break;
+        default:
+                res[i] = smp[i] - 4*smp[i-1] + 6*smp[i-2] - 4*smp[i-3] + smp[i-4];
+        }
+    }
+}
+#undef FIXED_RESIDUAL
+#undef SUB
+#undef LOAD
+
+void ff_flac_calc_sums_sse2(uint32_t *sums, const int32_t *res, int n,
+                            int pred_order, int porder)
+{
+    int i, j;
+    int parts = 1 << porder;
+    int end = n >> porder;
+
+    for(i=0, j=pred_order; i<parts; i++) {
+        uint32_t sum = 0;
+        int len = (end - j) & ~3;
+        if(len > 0) {
+            x86_reg k = -4*len;
+            __asm__ volatile(
+                "pxor     %%xmm0, %%xmm0        \n\t"
+                "1:                             \n\t"
+                "movdqu   (%2,%0), %%xmm1       \n\t"
+                "movdqa   %%xmm1, %%xmm2        \n\t"
+                "psrad    $31, %%xmm2           \n\t"
+                "paddd    %%xmm1, %%xmm1        \n\t"
+                "pxor     %%xmm2, %%xmm1        \n\t" // fold to unsigned
+                "paddd    %%xmm1, %%xmm0        \n\t"
+                "add      $16, %0               \n\t"
+                " jl 1b                         \n\t"
+                "pshufd   $0x4e, %%xmm0, %%xmm1 \n\t"
+                "paddd    %%xmm1, %%xmm0        \n\t"
+                "pshufd   $0xb1, %%xmm0, %%xmm1 \n\t"
+                "paddd    %%xmm1, %%xmm0        \n\t"
+                "movd     %%xmm0, %1            \n\t"
+                :"+&r"(k), "=r"(sum)
+                :"r"(res+j+len)
+                :"memory"
+            );
+            j += len;
+        }
+        for(; j<end; j++)
+            sum += (2*res[j]) ^ (res[j]>>31);
+        sums[i] = sum;
+        end += n >> porder;
+    }
+}
+
+#if HAVE_SSSE3
+/* 8 samples per iteration, pmulld is SSE4.1 */
+void ff_flac_encode_residual_lpc_sse4(int32_t *res, const int32_t *smp, int n,
+                                      int order, const int32_t *coefs, int shift)
+{
+    DECLARE_ALIGNED_16(int32_t, c4)[MAX_LPC_ORDER][4];
+    int i, j;
+    int end = order + ((n - order) & ~7);
+
+    for(i=0; i<order; i++)
+        res[i] = smp[i];
+    /* reversed so that the samples and coefs are both walked upwards */
+    for(j=0; j<order; j++)
+        c4[j][0] = c4[j][1] = c4[j][2] = c4[j][3] = coefs[order-1-j];
+
+    for(i=order; i<end; i+=8) {
+        x86_reg k = -4*order;
+        __asm__ volatile(
+            "movd     %4, %%xmm7            \n\t"
+            "pxor     %%xmm0, %%xmm0        \n\t"
+            "pxor     %%xmm1, %%xmm1        \n\t"
+            "1:                             \n\t"
+            "movdqa   (%2,%0,4), %%xmm4     \n\t"
+            "movdqu   (%1,%0), %%xmm2       \n\t"
+            "movdqu 16(%1,%0), %%xmm3       \n\t"
+            "pmulld   %%xmm4, %%xmm2        \n\t"
+            "pmulld   %%xmm4, %%xmm3        \n\t"
+            "paddd    %%xmm2, %%xmm0        \n\t"
+            "paddd    %%xmm3, %%xmm1        \n\t"
+            "add      $4, %0                \n\t"
+            " jl 1b                         \n\t"
+            "movdqu   (%1), %%xmm2          \n\t"
+            "movdqu 16(%1), %%xmm3          \n\t"
+            "psrad    %%xmm7, %%xmm0        \n\t"
+            "psrad    %%xmm7, %%xmm1        \n\t"
+            "psubd    %%xmm0, %%xmm2        \n\t"
+            "psubd    %%xmm1, %%xmm3        \n\t"
+            "movdqu   %%xmm2,   (%3)        \n\t"
+            "movdqu   %%xmm3, 16(%3)        \n\t"
+            :"+&r"(k)
+            :"r"(smp+i), "r"(c4+order), "r"(res+i), "m"(shift)
+            :"memory"
+        );
+    }
+    lpc_residual_tail(res, smp, i, n, order, coefs, shift);
+}
+#endif /* HAVE_SSSE3 */
+
+#if HAVE_AVX2
+/* 16 samples per iteration */
+void ff_flac_encode_residual_lpc_avx2(int32_t *res, const int32_t *smp, int n,
+                                      int order, const int32_t *coefs, int shift)
+{
+    DECLARE_ALIGNED_16(int32_t, rc)[MAX_LPC_ORDER];
+    int i, j;
+    int end = order + ((n - order) & ~15);
+
+    for(i=0; i<order; i++)
+        res[i] = smp[i];
+    for(j=0; j<order; j++)
+        rc[j] = coefs[order-1-j];
+
+    for(i=order; i<end; i+=16) {
+        x86_reg k = -4*order;
+        __asm__ volatile(
+            "vmovd      %4, %%xmm7                  \n\t"
+            "vpxor      %%ymm0, %%ymm0, %%ymm0      \n\t"
+            "vpxor      %%ymm1, %%ymm1, %%ymm1      \n\t"
+            "1:                                     \n\t"
+            "vpbroadcastd (%2,%0), %%ymm4           \n\t"
+            "vpmulld      (%1,%0), %%ymm4, %%ymm2   \n\t"
+            "vpmulld    32(%1,%0), %%ymm4, %%ymm3   \n\t"
+            "vpaddd     %%ymm2, %%ymm0, %%ymm0      \n\t"
+            "vpaddd     %%ymm3, %%ymm1, %%ymm1      \n\t"
+            "add        $4, %0                      \n\t"
+            " jl 1b                                 \n\t"
+            "vpsrad     %%xmm7, %%ymm0, %%ymm0      \n\t"
+            "vpsrad     %%xmm7, %%ymm1, %%ymm1      \n\t"
+            "vmovdqu      (%1), %%ymm2              \n\t"
+            "vmovdqu    32(%1), %%ymm3              \n\t"
+            "vpsubd     %%ymm0, %%ymm2, %%ymm2      \n\t"
+            "vpsubd     %%ymm1, %%ymm3, %%ymm3      \n\t"
+            "vmovdqu    %%ymm2,   (%3)              \n\t"
+            "vmovdqu    %%ymm3, 32(%3)              \n\t"
+            "vzeroupper                             \n\t"
+            :"+&r"(k)
+            :"r"(smp+i), "r"(rc+order), "r"(res+i), "m"(shift)
+            :"memory"
+        );
+    }
+    lpc_residual_tail(res, smp, i, n, order, coefs, shift);
+}
+
+void ff_flac_calc_sums_avx2(uint32_t *sums, const int32_t *res, int n,
+                            int pred_order, int porder)
+{
+    int i, j;
+    int parts = 1 << porder;
+    int end = n >> porder;
+
+    for(i=0, j=pred_order; i<parts; i++) {
+        uint32_t sum = 0;
+        int len = (end - j) & ~7;
+        if(len > 0) {
+            x86_reg k = -4*len;
+            __asm__ volatile(
+                "vpxor      %%ymm0, %%ymm0, %%ymm0      \n\t"
+                "1:                                     \n\t"
+                "vmovdqu    (%2,%0), %%ymm1             \n\t"
+                "vpsrad     $31, %%ymm1, %%ymm2         \n\t"
+                "vpaddd     %%ymm1, %%ymm1, %%ymm1      \n\t"
+                "vpxor      %%ymm2, %%ymm1, %%ymm1      \n\t" // fold to unsigned
+                "vpaddd     %%ymm1, %%ymm0, %%ymm0      \n\t"
+                "add        $32, %0                     \n\t"
+                " jl 1b                                 \n\t"
+                "vextracti128 $1, %%ymm0, %%xmm1        \n\t"
+                "vpaddd     %%xmm1, %%xmm0, %%xmm0      \n\t"
+                "vpshufd    $0x4e, %%xmm0, %%xmm1       \n\t"
+                "vpaddd     %%xmm1, %%xmm0, %%xmm0      \n\t"
+                "vpshufd    $0xb1, %%xmm0, %%xmm1       \n\t"
+                "vpaddd     %%xmm1, %%xmm0, %%xmm0      \n\t"
+                "vmovd      %%xmm0, %1                  \n\t"
+                "vzeroupper                             \n\t"
+                :"+&r"(k), "=r"(sum)
+                :"r"(res+j+len)
+                :"memory"
+            );
+            j += len;
+        }
+        for(; j<end; j++)
+            sum += (2*res[j]) ^ (res[j]>>31);
+        sums[i] = sum;
+        end += n >> porder;
+    }
+}
+#endif /* HAVE_AVX2 */
@@ -544,6 +544,253 @@ static void ff_h264_idct_add8_sse2(uint8_t **dest, const int *block_offset, DCTE
 }
 #endif
 
+#if HAVE_AVX2 && ARCH_X86_64
+/* Blocks without coefficients are all zero, and a DC-only block through the
+ * full transform gives the same result as the DC-add path, so whole 8x8
+ * quadrants (or pairs of 8x8 blocks) are transformed at once. */
+
+#define H264_IDCT4_1D_AVX2(a, b, c, d, t0, t1, t2, t3)\
+        "vpaddw     "#c", "#a", "#t0"   \n\t" /* z0 = a + c */\
+        "vpsubw     "#c", "#a", "#t1"   \n\t" /* z1 = a - c */\
+        "vpsraw        $1, "#b", "#t2"  \n\t"\
+        "vpsubw     "#d", "#t2", "#t2"  \n\t" /* z2 = (b>>1) - d */\
+        "vpsraw        $1, "#d", "#t3"  \n\t"\
+        "vpaddw     "#b", "#t3", "#t3"  \n\t" /* z3 = b + (d>>1) */\
+        "vpaddw    "#t3", "#t0", "#a"   \n\t"\
+        "vpsubw    "#t3", "#t0", "#d"   \n\t"\
+        "vpaddw    "#t2", "#t1", "#b"   \n\t"\
+        "vpsubw    "#t2", "#t1", "#c"   \n\t"
+
+// transposes the 4x4 blocks in each 64 bit half of a,b,c,d
+#define TRANSPOSE2x4x4W_AVX2(a, b, c, d, t0, t1, t2, t3)\
+        "vpunpcklwd  "#b", "#a", "#t0"  \n\t"\
+        "vpunpckhwd  "#b", "#a", "#t1"  \n\t"\
+        "vpunpcklwd  "#d", "#c", "#t2"  \n\t"\
+        "vpunpckhwd  "#d", "#c", "#t3"  \n\t"\
+        "vpunpckldq "#t2", "#t0", "#a"  \n\t"\
+        "vpunpckhdq "#t2", "#t0", "#c"  \n\t"\
+        "vpunpckldq "#t3", "#t1", "#b"  \n\t"\
+        "vpunpckhdq "#t3", "#t1", "#d"  \n\t"\
+        "vpunpcklqdq "#b", "#a", "#t0"  \n\t"\
+        "vpunpckhqdq "#b", "#a", "#t1"  \n\t"\
+        "vpunpcklqdq "#d", "#c", "#t2"  \n\t"\
+        "vpunpckhqdq "#d", "#c", "#t3"  \n\t"
+
+// adds the residual in p (16 words) to the 8 pixels at each of d1, d2
+#define STORE_DIFF_2x8P_AVX2(p, d1, d2, t, x)\
+        "vmovq       "#d1", "#x"        \n\t"\
+        "vmovhps     "#d2", "#x", "#x"  \n\t"\
+        "vpmovzxbw    "#x", "#t"        \n\t"\
+        "vpsraw        $6, "#p", "#p"   \n\t"\
+        "vpaddsw      "#t", "#p", "#p"  \n\t"\
+        "vpackuswb    "#p", "#p", "#p"  \n\t"\
+        "vpermq        $8, "#p", "#p"   \n\t"
+
+/**
+ * Adds the four 4x4 blocks of an 8x8 quadrant, each half of a ymm register
+ * holding an 8x4 row of two blocks.
+ */
+static void ff_h264_idct_add8x8_avx2(uint8_t *dst, int16_t *block, int stride)
+{
+    __asm__ volatile(
+        "vmovdqu      0x00(%1), %%ymm4  \n\t" // block 0
+        "vmovdqu      0x20(%1), %%ymm5  \n\t" // block 1
+        "vmovdqu      0x40(%1), %%ymm6  \n\t" // block 2
+        "vmovdqu      0x60(%1), %%ymm7  \n\t" // block 3
+        "vpunpcklqdq %%ymm5, %%ymm4, %%ymm0 \n\t" // rows 0,2 of blocks 0,1
+        "vpunpckhqdq %%ymm5, %%ymm4, %%ymm1 \n\t" // rows 1,3 of blocks 0,1
+        "vpunpcklqdq %%ymm7, %%ymm6, %%ymm2 \n\t"
+        "vpunpckhqdq %%ymm7, %%ymm6, %%ymm3 \n\t"
+        "vperm2i128 $0x20, %%ymm2, %%ymm0, %%ymm4 \n\t" // row 0
+        "vperm2i128 $0x31, %%ymm2, %%ymm0, %%ymm6 \n\t" // row 2
+        "vperm2i128 $0x20, %%ymm3, %%ymm1, %%ymm5 \n\t" // row 1
+        "vperm2i128 $0x31, %%ymm3, %%ymm1, %%ymm7 \n\t" // row 3
+        H264_IDCT4_1D_AVX2(%%ymm4, %%ymm5, %%ymm6, %%ymm7, %%ymm0, %%ymm1, %%ymm2, %%ymm3)
+        TRANSPOSE2x4x4W_AVX2(%%ymm4, %%ymm5, %%ymm6, %%ymm7, %%ymm0, %%ymm1, %%ymm2, %%ymm3)
+        "vpcmpeqw    %%ymm4, %%ymm4, %%ymm4 \n\t"
+        "vpsrlw          $15, %%ymm4, %%ymm4 \n\t"
+        "vpsllw           $5, %%ymm4, %%ymm4 \n\t" // pw_32
+        "vpaddw      %%ymm4, %%ymm0, %%ymm0 \n\t"
+        H264_IDCT4_1D_AVX2(%%ymm0, %%ymm1, %%ymm2, %%ymm3, %%ymm4, %%ymm5, %%ymm6, %%ymm7)
+        STORE_DIFF_2x8P_AVX2(%%ymm0, (%0),      (%4),      %%ymm4, %%xmm4)
+        "vmovq          %%xmm0, (%0)        \n\t"
+        "vmovhps        %%xmm0, (%4)        \n\t"
+        STORE_DIFF_2x8P_AVX2(%%ymm1, (%0,%2),   (%4,%2),   %%ymm4, %%xmm4)
+        "vmovq          %%xmm1, (%0,%2)     \n\t"
+        "vmovhps        %%xmm1, (%4,%2)     \n\t"
+        STORE_DIFF_2x8P_AVX2(%%ymm2, (%0,%2,2), (%4,%2,2), %%ymm4, %%xmm4)
+        "vmovq          %%xmm2, (%0,%2,2)   \n\t"
+        "vmovhps        %%xmm2, (%4,%2,2)   \n\t"
+        STORE_DIFF_2x8P_AVX2(%%ymm3, (%0,%3),   (%4,%3),   %%ymm4, %%xmm4)
+        "vmovq          %%xmm3, (%0,%3)     \n\t"
+        "vmovhps        %%xmm3, (%4,%3)     \n\t"
+        "vzeroupper                         \n\t"
+        :: "r"(dst), "r"(block), "r"((x86_reg)stride), "r"((x86_reg)3*stride),
+           "r"(dst + 4*stride)
+        : "memory"
+    );
+}
+
+// out: s0..s7 = 1-D H.264 8x8 IDCT of s0..s7, word-wise
+// clobbers: t0..t7
+#define H264_IDCT8_1D_AVX2(s0, s1, s2, s3, s4, s5, s6, s7, t0, t1, t2, t3, t4, t5, t6, t7)\
+        "vpaddw     "#s4", "#s0", "#t0" \n\t" /* a0 = s0 + s4 */\
+        "vpsubw     "#s4", "#s0", "#t1" \n\t" /* a2 = s0 - s4 */\
+        "vpsraw        $1, "#s2", "#t2" \n\t"\
+        "vpsubw     "#s6", "#t2", "#t2" \n\t" /* a4 = (s2>>1) - s6 */\
+        "vpsraw        $1, "#s6", "#t3" \n\t"\
+        "vpaddw     "#s2", "#t3", "#t3" \n\t" /* a6 = (s6>>1) + s2 */\
+        "vpaddw     "#t3", "#t0", "#t4" \n\t" /* b0 = a0 + a6 */\
+        "vpsubw     "#t3", "#t0", "#t0" \n\t" /* b6 = a0 - a6 */\
+        "vpaddw     "#t2", "#t1", "#t3" \n\t" /* b2 = a2 + a4 */\
+        "vpsubw     "#t2", "#t1", "#t1" \n\t" /* b4 = a2 - a4 */\
+        "vpsraw        $1, "#s7", "#t2" \n\t"\
+        "vpsubw     "#s3", "#s5", "#t5" \n\t"\
+        "vpsubw     "#s7", "#t5", "#s0" \n\t"\
+        "vpsubw     "#t2", "#s0", "#s0" \n\t" /* a1 = s5 - s3 - s7 - (s7>>1) */\
+        "vpsraw        $1, "#s3", "#t2" \n\t"\
+        "vpaddw     "#s7", "#s1", "#t6" \n\t"\
+        "vpsubw     "#s3", "#t6", "#s2" \n\t"\
+        "vpsubw     "#t2", "#s2", "#s2" \n\t" /* a3 = s1 + s7 - s3 - (s3>>1) */\
+        "vpsraw        $1, "#s5", "#t2" \n\t"\
+        "vpsubw     "#s1", "#s7", "#t7" \n\t"\
+        "vpaddw     "#s5", "#t7", "#s4" \n\t"\
+        "vpaddw     "#t2", "#s4", "#s4" \n\t" /* a5 = s7 - s1 + s5 + (s5>>1) */\
+        "vpsraw        $1, "#s1", "#t2" \n\t"\
+        "vpaddw     "#s5", "#s3", "#t5" \n\t"\
+        "vpaddw     "#s1", "#t5", "#s6" \n\t"\
+        "vpaddw     "#t2", "#s6", "#s6" \n\t" /* a7 = s3 + s5 + s1 + (s1>>1) */\
+        "vpsraw        $2, "#s6", "#t5" \n\t"\
+        "vpaddw     "#s0", "#t5", "#t5" \n\t" /* b1 = (a7>>2) + a1 */\
+        "vpsraw        $2, "#s4", "#t6" \n\t"\
+        "vpaddw     "#s2", "#t6", "#t6" \n\t" /* b3 = a3 + (a5>>2) */\
+        "vpsraw        $2, "#s2", "#t7" \n\t"\
+        "vpsubw     "#s4", "#t7", "#t7" \n\t" /* b5 = (a3>>2) - a5 */\
+        "vpsraw        $2, "#s0", "#t2" \n\t"\
+        "vpsubw     "#t2", "#s6", "#t2" \n\t" /* b7 = a7 - (a1>>2) */\
+        "vpaddw     "#t2", "#t4", "#s0" \n\t"\
+        "vpsubw     "#t2", "#t4", "#s7" \n\t"\
+        "vpaddw     "#t7", "#t3", "#s1" \n\t"\
+        "vpsubw     "#t7", "#t3", "#s6" \n\t"\
+        "vpaddw     "#t6", "#t1", "#s2" \n\t"\
+        "vpsubw     "#t6", "#t1", "#s5" \n\t"\
+        "vpaddw     "#t5", "#t0", "#s3" \n\t"\
+        "vpsubw     "#t5", "#t0", "#s4" \n\t"
+
+// transposes the 8x8 words in each 128 bit lane of s0..s7 into d0..d7
+#define TRANSPOSE2x8x8W_AVX2(s0, s1, s2, s3, s4, s5, s6, s7, d0, d1, d2, d3, d4, d5, d6, d7)\
+        "vpunpcklwd  "#s1", "#s0", "#d0" \n\t"\
+        "vpunpckhwd  "#s1", "#s0", "#d1" \n\t"\
+        "vpunpcklwd  "#s3", "#s2", "#d2" \n\t"\
+        "vpunpckhwd  "#s3", "#s2", "#d3" \n\t"\
+        "vpunpcklwd  "#s5", "#s4", "#d4" \n\t"\
+        "vpunpckhwd  "#s5", "#s4", "#d5" \n\t"\
+        "vpunpcklwd  "#s7", "#s6", "#d6" \n\t"\
+        "vpunpckhwd  "#s7", "#s6", "#d7" \n\t"\
+        "vpunpckldq  "#d2", "#d0", "#s0" \n\t"\
+        "vpunpckhdq  "#d2", "#d0", "#s1" \n\t"\
+        "vpunpckldq  "#d3", "#d1", "#s2" \n\t"\
+        "vpunpckhdq  "#d3", "#d1", "#s3" \n\t"\
+        "vpunpckldq  "#d6", "#d4", "#s4" \n\t"\
+        "vpunpckhdq  "#d6", "#d4", "#s5" \n\t"\
+        "vpunpckldq  "#d7", "#d5", "#s6" \n\t"\
+        "vpunpckhdq  "#d7", "#d5", "#s7" \n\t"\
+        "vpunpcklqdq "#s4", "#s0", "#d0" \n\t"\
+        "vpunpckhqdq "#s4", "#s0", "#d1" \n\t"\
+        "vpunpcklqdq "#s5", "#s1", "#d2" \n\t"\
+        "vpunpckhqdq "#s5", "#s1", "#d3" \n\t"\
+        "vpunpcklqdq "#s6", "#s2", "#d4" \n\t"\
+        "vpunpckhqdq "#s6", "#s2", "#d5" \n\t"\
+        "vpunpcklqdq "#s7", "#s3", "#d6" \n\t"\
+        "vpunpckhqdq "#s7", "#s3", "#d7" \n\t"
+
+// adds the residual in p (16 words) to the 16 pixels at d
+#define STORE_DIFF_16P_AVX2(p, d, t, x)\
+        "vpmovzxbw    "#d", "#t"        \n\t"\
+        "vpsraw        $6, "#p", "#p"   \n\t"\
+        "vpaddsw      "#t", "#p", "#p"  \n\t"\
+        "vpackuswb    "#p", "#p", "#p"  \n\t"\
+        "vpermq        $8, "#p", "#p"   \n\t"\
+        "vmovdqu      "#x", "#d"        \n\t"
+
+/**
+ * Adds two horizontally adjacent 8x8 blocks, one per 128 bit lane.
+ */
+static void ff_h264_idct8_add2_avx2(uint8_t *dst, int16_t *block, int16_t *block2, int stride)
+{
+    __asm__ volatile(
+        "vmovdqu      0x00(%1), %%xmm0  \n\t"
+        "vmovdqu      0x10(%1), %%xmm1  \n\t"
+        "vmovdqu      0x20(%1), %%xmm2  \n\t"
+        "vmovdqu      0x30(%1), %%xmm3  \n\t"
+        "vmovdqu      0x40(%1), %%xmm4  \n\t"
+        "vmovdqu      0x50(%1), %%xmm5  \n\t"
+        "vmovdqu      0x60(%1), %%xmm6  \n\t"
+        "vmovdqu      0x70(%1), %%xmm7  \n\t"
+        "vinserti128 $1, 0x00(%2), %%ymm0, %%ymm0 \n\t"
+        "vinserti128 $1, 0x10(%2), %%ymm1, %%ymm1 \n\t"
+        "vinserti128 $1, 0x20(%2), %%ymm2, %%ymm2 \n\t"
+        "vinserti128 $1, 0x30(%2), %%ymm3, %%ymm3 \n\t"
+        "vinserti128 $1, 0x40(%2), %%ymm4, %%ymm4 \n\t"
+        "vinserti128 $1, 0x50(%2), %%ymm5, %%ymm5 \n\t"
+        "vinserti128 $1, 0x60(%2), %%ymm6, %%ymm6 \n\t"
+        "vinserti128 $1, 0x70(%2), %%ymm7, %%ymm7 \n\t"
+        H264_IDCT8_1D_AVX2(%%ymm0, %%ymm1, %%ymm2, %%ymm3, %%ymm4, %%ymm5, %%ymm6, %%ymm7,
+                           %%ymm8, %%ymm9, %%ymm10, %%ymm11, %%ymm12, %%ymm13, %%ymm14, %%ymm15)
+        TRANSPOSE2x8x8W_AVX2(%%ymm0, %%ymm1, %%ymm2, %%ymm3, %%ymm4, %%ymm5, %%ymm6, %%ymm7,
+                             %%ymm8, %%ymm9, %%ymm10, %%ymm11, %%ymm12, %%ymm13, %%ymm14, %%ymm15)
+        "vpcmpeqw    %%ymm0, %%ymm0, %%ymm0 \n\t"
+        "vpsrlw          $15, %%ymm0, %%ymm0 \n\t"
+        "vpsllw           $5, %%ymm0, %%ymm0 \n\t" // pw_32
+        "vpaddw      %%ymm0, %%ymm8, %%ymm8 \n\t"
+        H264_IDCT8_1D_AVX2(%%ymm8, %%ymm9, %%ymm10, %%ymm11, %%ymm12, %%ymm13, %%ymm14, %%ymm15,
+                           %%ymm0, %%ymm1, %%ymm2, %%ymm3, %%ymm4, %%ymm5, %%ymm6, %%ymm7)
+        STORE_DIFF_16P_AVX2(%%ymm8,  (%0),      %%ymm0, %%xmm8)
+        STORE_DIFF_16P_AVX2(%%ymm9,  (%0,%3),   %%ymm0, %%xmm9)
+        STORE_DIFF_16P_AVX2(%%ymm10, (%0,%3,2), %%ymm0, %%xmm10)
+        STORE_DIFF_16P_AVX2(%%ymm11, (%0,%4),   %%ymm0, %%xmm11)
+        STORE_DIFF_16P_AVX2(%%ymm12, (%5),      %%ymm0, %%xmm12)
+        STORE_DIFF_16P_AVX2(%%ymm13, (%5,%3),   %%ymm0, %%xmm13)
+        STORE_DIFF_16P_AVX2(%%ymm14, (%5,%3,2), %%ymm0, %%xmm14)
+        STORE_DIFF_16P_AVX2(%%ymm15, (%5,%4),   %%ymm0, %%xmm15)
+        "vzeroupper                         \n\t"
+        :: "r"(dst), "r"(block), "r"(block2), "r"((x86_reg)stride), "r"((x86_reg)3*stride),
+           "r"(dst + 4*stride)
+        : "memory"
+    );
+}
+
+static void ff_h264_idct_add16_avx2(uint8_t *dst, const int *block_offset, DCTELEM *block, int stride, const uint8_t nnzc[6*8]){
+    int i;
+    for(i=0; i<16; i+=4)
+        if(nnzc[ scan8[i+0] ]|nnzc[ scan8[i+1] ]|nnzc[ scan8[i+2] ]|nnzc[ scan8[i+3] ])
+            ff_h264_idct_add8x8_avx2(dst + block_offset[i], block + i*16, stride);
+}
+
+static void ff_h264_idct_add16intra_avx2(uint8_t *dst, const int *block_offset, DCTELEM *block, int stride, const uint8_t nnzc[6*8]){
+    int i;
+    for(i=0; i<16; i+=4)
+        if(nnzc[ scan8[i+0] ]|nnzc[ scan8[i+1] ]|nnzc[ scan8[i+2] ]|nnzc[ scan8[i+3] ]
+           || (block[i*16]|block[i*16+16]|block[i*16+32]|block[i*16+48]))
+            ff_h264_idct_add8x8_avx2(dst + block_offset[i], block + i*16, stride);
+}
+
+static void ff_h264_idct_add8_avx2(uint8_t **dest, const int *block_offset, DCTELEM *block, int stride, const uint8_t nnzc[6*8]){
+    int i;
+    for(i=16; i<16+8; i+=4)
+        if(nnzc[ scan8[i+0] ]|nnzc[ scan8[i+1] ]|nnzc[ scan8[i+2] ]|nnzc[ scan8[i+3] ]
+           || (block[i*16]|block[i*16+16]|block[i*16+32]|block[i*16+48]))
+            ff_h264_idct_add8x8_avx2(dest[(i&4)>>2] + block_offset[i], block + i*16, stride);
+}
+
+static void ff_h264_idct8_add4_avx2(uint8_t *dst, const int *block_offset, DCTELEM *block, int stride, const uint8_t nnzc[6*8]){
+    int i;
+    for(i=0; i<16; i+=8)
+        if(nnzc[ scan8[i+0] ]|nnzc[ scan8[i+4] ])
+            ff_h264_idct8_add2_avx2(dst + block_offset[i], block + i*16, block + (i+4)*16, stride);
+}
+#endif /* HAVE_AVX2 && ARCH_X86_64 */
+
 /***********************************/
 /* deblocking */
 
@@ -792,6 +1039,196 @@ static void h264_h_loop_filter_chroma_intra_mmx2(uint8_t *pix, int stride, int a
     transpose4x4(pix-2+4*stride, trans+4, stride, 8);
 }
 
+#if HAVE_AVX2 && ARCH_X86_64
+// |x-y| < a for the words of x,y
+#define DIFF_LT_AVX2(x, y, a, o)\
+        "vpsubw       "#y", "#x", "#o"  \n\t"\
+        "vpabsw       "#o", "#o"        \n\t"\
+        "vpcmpgtw     "#o", "#a", "#o"  \n\t"
+
+// o = av_clip(x, -t, t), with z = 0
+#define CLIP_TC_AVX2(x, t, z, o)\
+        "vpminsw      "#t", "#x", "#o"  \n\t"\
+        "vpsubw       "#t", "#z", "#x"  \n\t"\
+        "vpmaxsw      "#x", "#o", "#o"  \n\t"
+
+// stores the 16 words of p as bytes at d
+#define STORE_16P_AVX2(p, d, x)\
+        "vpackuswb    "#p", "#p", "#p"  \n\t"\
+        "vpermq        $8, "#p", "#p"   \n\t"\
+        "vmovdqu      "#x", "#d"        \n\t"
+
+/**
+ * Filters a whole 16 pixel luma edge, the pixels widened to words so that
+ * each 128 bit lane holds an 8 pixel half of the edge.
+ */
+static void h264_loop_filter_luma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    __asm__ volatile(
+        "vpmovzxbw      (%0),    %%ymm8  \n\t" // p2
+        "vpmovzxbw      (%0,%2), %%ymm0  \n\t" // p1
+        "vpmovzxbw      (%0,%2,2), %%ymm1 \n\t" // p0
+        "vpmovzxbw      (%1),    %%ymm2  \n\t" // q0
+        "vpmovzxbw      (%1,%2), %%ymm3  \n\t" // q1
+        "vpmovzxbw      (%1,%2,2), %%ymm9 \n\t" // q2
+        "vpbroadcastw     %4,    %%ymm4  \n\t" // alpha
+        "vpbroadcastw     %5,    %%ymm5  \n\t" // beta
+        DIFF_LT_AVX2(%%ymm1, %%ymm2, %%ymm4, %%ymm7)  // |p0-q0| < alpha
+        DIFF_LT_AVX2(%%ymm0, %%ymm1, %%ymm5, %%ymm6)  // |p1-p0| < beta
+        "vpand         %%ymm6, %%ymm7, %%ymm7 \n\t"
+        DIFF_LT_AVX2(%%ymm3, %%ymm2, %%ymm5, %%ymm6)  // |q1-q0| < beta
+        "vpand         %%ymm6, %%ymm7, %%ymm7 \n\t"
+        "vmovd            %3,    %%xmm6  \n\t"
+        "vpunpcklbw    %%xmm6, %%xmm6, %%xmm6 \n\t"
+        "vpunpcklwd    %%xmm6, %%xmm6, %%xmm6 \n\t"
+        "vpmovsxbw     %%xmm6, %%ymm6    \n\t" // tc0 for each pixel
+        "vpcmpeqw      %%ymm15, %%ymm15, %%ymm15 \n\t"
+        "vpcmpgtw      %%ymm15, %%ymm6, %%ymm4 \n\t"
+        "vpand         %%ymm4, %%ymm7, %%ymm7 \n\t" // mask = filtered pixels
+        DIFF_LT_AVX2(%%ymm8, %%ymm1, %%ymm5, %%ymm10) // |p2-p0| < beta
+        DIFF_LT_AVX2(%%ymm9, %%ymm2, %%ymm5, %%ymm11) // |q2-q0| < beta
+        "vpand         %%ymm7, %%ymm10, %%ymm10 \n\t"
+        "vpand         %%ymm7, %%ymm11, %%ymm11 \n\t"
+        "vpxor         %%ymm14, %%ymm14, %%ymm14 \n\t"
+
+        /* p1, q1 */
+        "vpavgw        %%ymm2, %%ymm1, %%ymm12 \n\t" // (p0+q0+1)>>1
+        "vpaddw        %%ymm12, %%ymm8, %%ymm8 \n\t"
+        "vpsrlw            $1, %%ymm8, %%ymm8  \n\t"
+        "vpsubw        %%ymm0, %%ymm8, %%ymm8  \n\t"
+        CLIP_TC_AVX2(%%ymm8, %%ymm6, %%ymm14, %%ymm13)
+        "vpand         %%ymm10, %%ymm13, %%ymm13 \n\t"
+        "vpaddw        %%ymm13, %%ymm0, %%ymm13 \n\t" // p1'
+        "vpaddw        %%ymm12, %%ymm9, %%ymm9 \n\t"
+        "vpsrlw            $1, %%ymm9, %%ymm9  \n\t"
+        "vpsubw        %%ymm3, %%ymm9, %%ymm9  \n\t"
+        CLIP_TC_AVX2(%%ymm9, %%ymm6, %%ymm14, %%ymm12)
+        "vpand         %%ymm11, %%ymm12, %%ymm12 \n\t"
+        "vpaddw        %%ymm12, %%ymm3, %%ymm12 \n\t" // q1'
+
+        /* p0, q0 */
+        "vpsubw        %%ymm10, %%ymm6, %%ymm6 \n\t"
+        "vpsubw        %%ymm11, %%ymm6, %%ymm6 \n\t" // tc
+        "vpsubw        %%ymm1, %%ymm2, %%ymm4  \n\t"
+        "vpsllw            $2, %%ymm4, %%ymm4  \n\t"
+        "vpaddw        %%ymm0, %%ymm4, %%ymm4  \n\t"
+        "vpsubw        %%ymm3, %%ymm4, %%ymm4  \n\t"
+        "vpsrlw           $15, %%ymm15, %%ymm15 \n\t"
+        "vpsllw            $2, %%ymm15, %%ymm15 \n\t" // pw_4
+        "vpaddw        %%ymm15, %%ymm4, %%ymm4 \n\t"
+        "vpsraw            $3, %%ymm4, %%ymm4  \n\t"
+        CLIP_TC_AVX2(%%ymm4, %%ymm6, %%ymm14, %%ymm5)
+        "vpand         %%ymm7, %%ymm5, %%ymm5  \n\t" // delta
+        "vpaddw        %%ymm5, %%ymm1, %%ymm1  \n\t"
+        "vpsubw        %%ymm5, %%ymm2, %%ymm2  \n\t"
+
+        STORE_16P_AVX2(%%ymm13, (%0,%2),   %%xmm13)
+        STORE_16P_AVX2(%%ymm1,  (%0,%2,2), %%xmm1)
+        STORE_16P_AVX2(%%ymm2,  (%1),      %%xmm2)
+        STORE_16P_AVX2(%%ymm12, (%1,%2),   %%xmm12)
+        "vzeroupper                      \n\t"
+        :: "r"(pix-3*stride), "r"(pix), "r"((x86_reg)stride),
+           "m"(*(uint32_t*)tc0), "m"(alpha), "m"(beta)
+        : "memory"
+    );
+}
+
+static void h264_v_loop_filter_luma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    if((tc0[0] & tc0[1] & tc0[2] & tc0[3]) >= 0)
+        h264_loop_filter_luma_avx2(pix, stride, alpha, beta, tc0);
+}
+
+static void h264_h_loop_filter_luma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    DECLARE_ALIGNED_16(uint8_t, trans)[8*16];
+    int i;
+    if((tc0[0] & tc0[1] & tc0[2] & tc0[3]) < 0)
+        return;
+    for(i=0; i<4; i++) {
+        transpose4x4(trans      +4*i, pix-4+4*i*stride, 16, stride);
+        transpose4x4(trans+4*16 +4*i, pix  +4*i*stride, 16, stride);
+    }
+    h264_loop_filter_luma_avx2(trans+4*16, 16, alpha, beta, tc0);
+    for(i=0; i<4; i++)
+        transpose4x4(pix-2+4*i*stride, trans+2*16+4*i, stride, 16);
+}
+
+/**
+ * Filters an 8 pixel chroma edge with bS < 4. The pixels are widened to
+ * words with the p side of the edge in the low and the q side in the high
+ * 128 bit lane, so that both sides are tested and updated together.
+ */
+static void h264_loop_filter_chroma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    __asm__ volatile(
+        "vmovq          (%0),    %%xmm0  \n\t"
+        "vmovhps        (%1,%2), %%xmm0, %%xmm0 \n\t"
+        "vpmovzxbw     %%xmm0,  %%ymm0   \n\t" // p1 | q1
+        "vmovq          (%0,%2), %%xmm1  \n\t"
+        "vmovhps        (%1),    %%xmm1, %%xmm1 \n\t"
+        "vpmovzxbw     %%xmm1,  %%ymm1   \n\t" // p0 | q0
+        "vpermq         $0x4e, %%ymm0, %%ymm3 \n\t" // q1 | p1
+        "vpermq         $0x4e, %%ymm1, %%ymm2 \n\t" // q0 | p0
+        "vpbroadcastw     %4,    %%ymm4  \n\t" // alpha
+        "vpbroadcastw     %5,    %%ymm5  \n\t" // beta
+        DIFF_LT_AVX2(%%ymm1, %%ymm2, %%ymm4, %%ymm7)  // |p0-q0| < alpha
+        DIFF_LT_AVX2(%%ymm0, %%ymm1, %%ymm5, %%ymm6)  // |p1-p0| < beta | |q1-q0| < beta
+        "vpand         %%ymm6, %%ymm7, %%ymm7 \n\t"
+        "vpermq         $0x4e, %%ymm6, %%ymm6 \n\t"
+        "vpand         %%ymm6, %%ymm7, %%ymm7 \n\t"
+        "vmovd            %3,    %%xmm6  \n\t"
+        "vpunpcklbw    %%xmm6, %%xmm6, %%xmm6 \n\t"
+        "vpunpcklqdq   %%xmm6, %%xmm6, %%xmm6 \n\t"
+        "vpmovsxbw     %%xmm6, %%ymm6    \n\t" // tc0 for each pixel of both lanes
+        "vpxor         %%ymm14, %%ymm14, %%ymm14 \n\t"
+        "vpcmpgtw      %%ymm14, %%ymm6, %%ymm4 \n\t"
+        "vpand         %%ymm4, %%ymm7, %%ymm7 \n\t" // mask = filtered pixels
+
+        /* delta = ((q0-p0)*4 + p1-q1 + 4) >> 3, computed in the low lane */
+        "vpsubw        %%ymm1, %%ymm2, %%ymm4  \n\t"
+        "vpsllw            $2, %%ymm4, %%ymm4  \n\t"
+        "vpaddw        %%ymm0, %%ymm4, %%ymm4  \n\t"
+        "vpsubw        %%ymm3, %%ymm4, %%ymm4  \n\t"
+        "vpcmpeqw      %%ymm15, %%ymm15, %%ymm15 \n\t"
+        "vpsrlw           $15, %%ymm15, %%ymm15 \n\t"
+        "vpsllw            $2, %%ymm15, %%ymm15 \n\t" // pw_4
+        "vpaddw        %%ymm15, %%ymm4, %%ymm4 \n\t"
+        "vpsraw            $3, %%ymm4, %%ymm4  \n\t"
+        CLIP_TC_AVX2(%%ymm4, %%ymm6, %%ymm14, %%ymm5)
+        "vpermq         $0x44, %%ymm5, %%ymm5 \n\t"
+        "vpsubw        %%ymm5, %%ymm14, %%ymm4 \n\t"
+        "vpblendd       $0xf0, %%ymm4, %%ymm5, %%ymm5 \n\t" // delta | -delta
+        "vpand         %%ymm7, %%ymm5, %%ymm5  \n\t"
+        "vpaddw        %%ymm5, %%ymm1, %%ymm1  \n\t"
+
+        "vpackuswb     %%ymm1, %%ymm1, %%ymm1  \n\t"
+        "vpermq            $8, %%ymm1, %%ymm1  \n\t"
+        "vmovq         %%xmm1, (%0,%2)   \n\t"
+        "vmovhps       %%xmm1, (%1)      \n\t"
+        "vzeroupper                      \n\t"
+        :: "r"(pix-2*stride), "r"(pix), "r"((x86_reg)stride),
+           "m"(*(uint32_t*)tc0), "m"(alpha), "m"(beta)
+        : "memory"
+    );
+}
+
+static void h264_v_loop_filter_chroma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    h264_loop_filter_chroma_avx2(pix, stride, alpha, beta, tc0);
+}
+
+static void h264_h_loop_filter_chroma_avx2(uint8_t *pix, int stride, int alpha, int beta, int8_t *tc0)
+{
+    DECLARE_ALIGNED_8(uint8_t, trans)[8*4];
+    transpose4x4(trans, pix-2, 8, stride);
+    transpose4x4(trans+4, pix-2+4*stride, 8, stride);
+    h264_loop_filter_chroma_avx2(trans+2*8, 8, alpha, beta, tc0);
+    transpose4x4(pix-2, trans, stride, 8);
+    transpose4x4(pix-2+4*stride, trans+4, stride, 8);
+}
+#endif /* HAVE_AVX2 && ARCH_X86_64 */
+
 static void h264_loop_filter_strength_mmx2( int16_t bS[2][4][4], uint8_t nnz[40], int8_t ref[2][40], int16_t mv[2][40][2],
                                             int bidir, int edges, int step, int mask_mv0, int mask_mv1, int field ) {
     int dir;
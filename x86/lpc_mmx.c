@@ -138,3 +138,60 @@ void ff_lpc_compute_autocorr_sse2(const int32_t *data, int len, int lag,
         }
     }
 }
+
+#if HAVE_AVX
+/* 4 lags per pass, 4 samples per iteration */
+void ff_lpc_compute_autocorr_avx(const int32_t *data, int len, int lag,
+                                  double *autoc)
+{
+    double tmp[len + lag + 8];
+    double *data1 = tmp + lag + 3;
+    DECLARE_ALIGNED_16(double, sum)[4];
+    int len4 = (len + 3) & ~3;
+    int j;
+
+    if((x86_reg)data1 & 15)
+        data1++;
+
+    apply_welch_window_sse2(data, len, data1);
+
+    for(j=0; j<lag+3; j++)
+        data1[j-lag-3]= 0.0;
+    for(j=len; j<len4; j++)
+        data1[j]= 0.0;
+
+    for(j=0; j<=lag; j+=4){
+        x86_reg i = -len4*sizeof(double);
+        __asm__ volatile(
+            "vmovsd  "MANGLE(ff_pd_1)", %%xmm0      \n\t"
+            "vmovsd  "MANGLE(ff_pd_1)", %%xmm1      \n\t"
+            "vmovsd  "MANGLE(ff_pd_1)", %%xmm2      \n\t"
+            "vmovsd  "MANGLE(ff_pd_1)", %%xmm3      \n\t"
+            "1:                                     \n\t"
+            "vmovupd    (%2,%0), %%ymm4             \n\t"
+            "vmulpd     (%3,%0), %%ymm4, %%ymm5     \n\t"
+            "vmulpd   -8(%3,%0), %%ymm4, %%ymm6     \n\t"
+            "vaddpd     %%ymm5, %%ymm0, %%ymm0      \n\t"
+            "vaddpd     %%ymm6, %%ymm1, %%ymm1      \n\t"
+            "vmulpd  -16(%3,%0), %%ymm4, %%ymm5     \n\t"
+            "vmulpd  -24(%3,%0), %%ymm4, %%ymm6     \n\t"
+            "vaddpd     %%ymm5, %%ymm2, %%ymm2      \n\t"
+            "vaddpd     %%ymm6, %%ymm3, %%ymm3      \n\t"
+            "add        $32,    %0                  \n\t"
+            "jl 1b                                  \n\t"
+            "vhaddpd    %%ymm1, %%ymm0, %%ymm0      \n\t"
+            "vhaddpd    %%ymm3, %%ymm2, %%ymm2      \n\t"
+            "vperm2f128 $0x20, %%ymm2, %%ymm0, %%ymm1 \n\t"
+            "vperm2f128 $0x31, %%ymm2, %%ymm0, %%ymm0 \n\t"
+            "vaddpd     %%ymm1, %%ymm0, %%ymm0      \n\t"
+            "vmovapd    %%xmm0,   (%1)              \n\t"
+            "vextractf128 $1, %%ymm0, 16(%1)        \n\t"
+            "vzeroupper                             \n\t"
+            :"+&r"(i)
+            :"r"(sum), "r"(data1+len4), "r"(data1+len4-j)
+            :"memory"
+        );
+        memcpy(autoc+j, sum, FFMIN(4, lag+1-j) * sizeof(double));
+    }
+}
+#endif /* HAVE_AVX */
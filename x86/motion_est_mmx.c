@@ -119,6 +119,149 @@ static int sad16_sse2(void *v, uint8_t *blk2, uint8_t *blk1, int stride, int h)
     return ret;
 }
 
+#if ARCH_X86_64
+/* The source rows are loaded once for the 4 candidates, xmm4-7 hold the sums. */
+#define SAD_X4_STORE_SSE2(acc, dst)\
+        "movhlps "#acc", %%xmm0         \n\t"\
+        "paddw %%xmm0, "#acc"           \n\t"\
+        "movd "#acc", "#dst"            \n\t"
+
+static void sad16_x4_sse2(int scores[4], uint8_t *blk2, uint8_t * const blk1[4], int stride, int h)
+{
+    uint8_t *ref0= blk1[0], *ref1= blk1[1], *ref2= blk1[2], *ref3= blk1[3];
+    __asm__ volatile(
+        "pxor %%xmm4, %%xmm4            \n\t"
+        "pxor %%xmm5, %%xmm5            \n\t"
+        "pxor %%xmm6, %%xmm6            \n\t"
+        "pxor %%xmm7, %%xmm7            \n\t"
+        ASMALIGN(4)
+        "1:                             \n\t"
+        "movdqa (%1), %%xmm0            \n\t"
+        "movdqu (%2), %%xmm1            \n\t"
+        "movdqu (%3), %%xmm2            \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "paddw %%xmm1, %%xmm4           \n\t"
+        "paddw %%xmm2, %%xmm5           \n\t"
+        "movdqu (%4), %%xmm1            \n\t"
+        "movdqu (%5), %%xmm2            \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "paddw %%xmm1, %%xmm6           \n\t"
+        "paddw %%xmm2, %%xmm7           \n\t"
+        "add %7, %1                     \n\t"
+        "add %7, %2                     \n\t"
+        "add %7, %3                     \n\t"
+        "add %7, %4                     \n\t"
+        "add %7, %5                     \n\t"
+        "dec %0                         \n\t"
+        " jg 1b                         \n\t"
+        SAD_X4_STORE_SSE2(%%xmm4, 0(%6))
+        SAD_X4_STORE_SSE2(%%xmm5, 4(%6))
+        SAD_X4_STORE_SSE2(%%xmm6, 8(%6))
+        SAD_X4_STORE_SSE2(%%xmm7, 12(%6))
+        : "+r" (h), "+r" (blk2), "+r" (ref0), "+r" (ref1), "+r" (ref2), "+r" (ref3)
+        : "r" (scores), "r" ((x86_reg)stride)
+        : "memory"
+    );
+}
+
+static void sad8_x4_sse2(int scores[4], uint8_t *blk2, uint8_t * const blk1[4], int stride, int h)
+{
+    uint8_t *ref0= blk1[0], *ref1= blk1[1], *ref2= blk1[2], *ref3= blk1[3];
+    __asm__ volatile(
+        "pxor %%xmm4, %%xmm4            \n\t"
+        "pxor %%xmm5, %%xmm5            \n\t"
+        "pxor %%xmm6, %%xmm6            \n\t"
+        "pxor %%xmm7, %%xmm7            \n\t"
+        ASMALIGN(4)
+        "1:                             \n\t"
+        "movq (%1), %%xmm0              \n\t"
+        "movhps (%1, %7), %%xmm0        \n\t"
+        "movq (%2), %%xmm1              \n\t"
+        "movhps (%2, %7), %%xmm1        \n\t"
+        "movq (%3), %%xmm2              \n\t"
+        "movhps (%3, %7), %%xmm2        \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "paddw %%xmm1, %%xmm4           \n\t"
+        "paddw %%xmm2, %%xmm5           \n\t"
+        "movq (%4), %%xmm1              \n\t"
+        "movhps (%4, %7), %%xmm1        \n\t"
+        "movq (%5), %%xmm2              \n\t"
+        "movhps (%5, %7), %%xmm2        \n\t"
+        "psadbw %%xmm0, %%xmm1          \n\t"
+        "psadbw %%xmm0, %%xmm2          \n\t"
+        "paddw %%xmm1, %%xmm6           \n\t"
+        "paddw %%xmm2, %%xmm7           \n\t"
+        "lea (%1,%7,2), %1              \n\t"
+        "lea (%2,%7,2), %2              \n\t"
+        "lea (%3,%7,2), %3              \n\t"
+        "lea (%4,%7,2), %4              \n\t"
+        "lea (%5,%7,2), %5              \n\t"
+        "sub $2, %0                     \n\t"
+        " jg 1b                         \n\t"
+        SAD_X4_STORE_SSE2(%%xmm4, 0(%6))
+        SAD_X4_STORE_SSE2(%%xmm5, 4(%6))
+        SAD_X4_STORE_SSE2(%%xmm6, 8(%6))
+        SAD_X4_STORE_SSE2(%%xmm7, 12(%6))
+        : "+r" (h), "+r" (blk2), "+r" (ref0), "+r" (ref1), "+r" (ref2), "+r" (ref3)
+        : "r" (scores), "r" ((x86_reg)stride)
+        : "memory"
+    );
+}
+
+#if HAVE_AVX2
+/* Two rows per iteration, one in each 128-bit lane. */
+#define SAD_X4_STORE_AVX2(acc, xacc, dst)\
+        "vextracti128 $1, "#acc", %%xmm0    \n\t"\
+        "vpaddw %%xmm0, "#xacc", "#xacc"    \n\t"\
+        "vpshufd $0xE, "#xacc", %%xmm0      \n\t"\
+        "vpaddw %%xmm0, "#xacc", "#xacc"    \n\t"\
+        "vmovd "#xacc", "#dst"              \n\t"
+
+#define SAD_X4_ROW2_AVX2(ref, acc)\
+        "vmovdqu ("#ref"), %%xmm1           \n\t"\
+        "vinserti128 $1, ("#ref", %7), %%ymm1, %%ymm1 \n\t"\
+        "vpsadbw %%ymm0, %%ymm1, %%ymm1     \n\t"\
+        "vpaddw %%ymm1, "#acc", "#acc"      \n\t"
+
+static void sad16_x4_avx2(int scores[4], uint8_t *blk2, uint8_t * const blk1[4], int stride, int h)
+{
+    uint8_t *ref0= blk1[0], *ref1= blk1[1], *ref2= blk1[2], *ref3= blk1[3];
+    __asm__ volatile(
+        "vpxor %%ymm4, %%ymm4, %%ymm4       \n\t"
+        "vpxor %%ymm5, %%ymm5, %%ymm5       \n\t"
+        "vpxor %%ymm6, %%ymm6, %%ymm6       \n\t"
+        "vpxor %%ymm7, %%ymm7, %%ymm7       \n\t"
+        ASMALIGN(4)
+        "1:                                 \n\t"
+        "vmovdqa (%1), %%xmm0               \n\t"
+        "vinserti128 $1, (%1, %7), %%ymm0, %%ymm0 \n\t"
+        SAD_X4_ROW2_AVX2(%2, %%ymm4)
+        SAD_X4_ROW2_AVX2(%3, %%ymm5)
+        SAD_X4_ROW2_AVX2(%4, %%ymm6)
+        SAD_X4_ROW2_AVX2(%5, %%ymm7)
+        "lea (%1,%7,2), %1                  \n\t"
+        "lea (%2,%7,2), %2                  \n\t"
+        "lea (%3,%7,2), %3                  \n\t"
+        "lea (%4,%7,2), %4                  \n\t"
+        "lea (%5,%7,2), %5                  \n\t"
+        "sub $2, %0                         \n\t"
+        " jg 1b                             \n\t"
+        SAD_X4_STORE_AVX2(%%ymm4, %%xmm4, 0(%6))
+        SAD_X4_STORE_AVX2(%%ymm5, %%xmm5, 4(%6))
+        SAD_X4_STORE_AVX2(%%ymm6, %%xmm6, 8(%6))
+        SAD_X4_STORE_AVX2(%%ymm7, %%xmm7, 12(%6))
+        "vzeroupper                         \n\t"
+        : "+r" (h), "+r" (blk2), "+r" (ref0), "+r" (ref1), "+r" (ref2), "+r" (ref3)
+        : "r" (scores), "r" ((x86_reg)stride)
+        : "memory"
+    );
+}
+#endif /* HAVE_AVX2 */
+#endif /* ARCH_X86_64 */
+
 static inline void sad8_x2a_mmx2(uint8_t *blk1, uint8_t *blk2, int stride, int h)
 {
     __asm__ volatile(
@@ -458,5 +601,13 @@ void dsputil_init_pix_mmx(DSPContext* c, AVCodecContext *avctx)
     }
     if ((mm_flags & FF_MM_SSE2) && !(mm_flags & FF_MM_3DNOW) && avctx->codec_id != CODEC_ID_SNOW) {
         c->sad[0]= sad16_sse2;
+#if ARCH_X86_64
+        c->sad_x4[0]= sad16_x4_sse2;
+        c->sad_x4[1]= sad8_x4_sse2;
+#if HAVE_AVX2
+        if (mm_flags & FF_MM_AVX2)
+            c->sad_x4[0]= sad16_x4_avx2;
+#endif
+#endif
     }
 }
@@ -0,0 +1,125 @@
+/*
+ * SIMD optimized PNG encoder filters
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/dsputil.h"
+#include "dsputil_mmx.h"
+
+/* Unlike in the decoder, the prediction only depends on the source rows,
+ * so all pixels of a row are filtered in parallel. */
+
+void ff_sub_png_avg_prediction_sse2(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
+{
+    const uint8_t *end = src + w;
+
+    __asm__ volatile(
+        "pxor      %%xmm6, %%xmm6       \n\t"
+        "pcmpeqb   %%xmm7, %%xmm7       \n\t"
+        "psubb     %%xmm7, %%xmm6       \n\t" // pb_1
+        "1:                             \n\t"
+        "movdqu  (%0,%4), %%xmm0        \n\t" // left
+        "movdqu    (%1), %%xmm1         \n\t" // top
+        "movdqu    (%0), %%xmm3         \n\t"
+        "movdqa    %%xmm0, %%xmm2       \n\t"
+        "pxor      %%xmm1, %%xmm2       \n\t"
+        "pavgb     %%xmm1, %%xmm0       \n\t"
+        "pand      %%xmm6, %%xmm2       \n\t"
+        "psubb     %%xmm2, %%xmm0       \n\t" // (left + top) >> 1
+        "psubb     %%xmm0, %%xmm3       \n\t"
+        "movdqu    %%xmm3, (%2)         \n\t"
+        "add       $16, %0              \n\t"
+        "add       $16, %1              \n\t"
+        "add       $16, %2              \n\t"
+        "cmp       %3, %0               \n\t"
+        " jb 1b                         \n\t"
+        :"+r"(src), "+r"(top), "+r"(dst)
+        :"g"(end), "r"((x86_reg)-bpp)
+        :"memory"
+    );
+}
+
+/* 8 pixels per iteration as words:
+ * xmm0 = a (left), xmm1 = b (top), xmm2 = c (top left) */
+#define SUB_PAETH(cpu, abs3)\
+void ff_sub_png_paeth_prediction_##cpu(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)\
+{\
+    const uint8_t *end = src + w;\
+\
+    __asm__ volatile(\
+        "pxor      %%xmm7, %%xmm7       \n\t"\
+        "1:                             \n\t"\
+        "movq    (%0,%4), %%xmm0        \n\t"\
+        "movq      (%1), %%xmm1         \n\t"\
+        "movq    (%1,%4), %%xmm2        \n\t"\
+        "punpcklbw %%xmm7, %%xmm0       \n\t"\
+        "punpcklbw %%xmm7, %%xmm1       \n\t"\
+        "punpcklbw %%xmm7, %%xmm2       \n\t"\
+        "movdqa    %%xmm1, %%xmm3       \n\t"\
+        "movdqa    %%xmm0, %%xmm4       \n\t"\
+        "psubw     %%xmm2, %%xmm3       \n\t" /* p  = b - c */\
+        "psubw     %%xmm2, %%xmm4       \n\t" /* pc = a - c */\
+        "movdqa    %%xmm3, %%xmm5       \n\t"\
+        "paddw     %%xmm4, %%xmm5       \n\t"\
+        abs3 /* pa, pb, pc */\
+        "movdqa    %%xmm4, %%xmm6       \n\t"\
+        "pminsw    %%xmm5, %%xmm6       \n\t"\
+        "pcmpgtw   %%xmm6, %%xmm3       \n\t" /* pa > pb || pa > pc */\
+        "pcmpgtw   %%xmm5, %%xmm4       \n\t" /* pb > pc */\
+        "pand      %%xmm4, %%xmm2       \n\t"\
+        "pandn     %%xmm1, %%xmm4       \n\t"\
+        "por       %%xmm4, %%xmm2       \n\t" /* pb > pc ? c : b */\
+        "pand      %%xmm3, %%xmm2       \n\t"\
+        "pandn     %%xmm0, %%xmm3       \n\t"\
+        "por       %%xmm3, %%xmm2       \n\t"\
+        "movq      (%0), %%xmm0         \n\t"\
+        "packuswb  %%xmm2, %%xmm2       \n\t"\
+        "psubb     %%xmm2, %%xmm0       \n\t"\
+        "movq      %%xmm0, (%2)         \n\t"\
+        "add       $8, %0               \n\t"\
+        "add       $8, %1               \n\t"\
+        "add       $8, %2               \n\t"\
+        "cmp       %3, %0               \n\t"\
+        " jb 1b                         \n\t"\
+        :"+r"(src), "+r"(top), "+r"(dst)\
+        :"g"(end), "r"((x86_reg)-bpp)\
+        :"memory"\
+    );\
+}
+
+#define ABS3_SSE2\
+        "pxor      %%xmm6, %%xmm6       \n\t"\
+        "psubw     %%xmm3, %%xmm6       \n\t"\
+        "pmaxsw    %%xmm6, %%xmm3       \n\t"\
+        "pxor      %%xmm6, %%xmm6       \n\t"\
+        "psubw     %%xmm4, %%xmm6       \n\t"\
+        "pmaxsw    %%xmm6, %%xmm4       \n\t"\
+        "pxor      %%xmm6, %%xmm6       \n\t"\
+        "psubw     %%xmm5, %%xmm6       \n\t"\
+        "pmaxsw    %%xmm6, %%xmm5       \n\t"
+
+#define ABS3_SSSE3\
+        "pabsw     %%xmm3, %%xmm3       \n\t"\
+        "pabsw     %%xmm4, %%xmm4       \n\t"\
+        "pabsw     %%xmm5, %%xmm5       \n\t"
+
+SUB_PAETH(sse2, ABS3_SSE2)
+#if HAVE_SSSE3
+SUB_PAETH(ssse3, ABS3_SSSE3)
+#endif